@@ -36,6 +36,15 @@ struct memblock
     uint32 size;
 };
 
+// Custom memory management, see LVPAFile::SetAllocator().
+// freeF() gets the same size that was passed to allocF(). Both may be called from several threads at once.
+struct LVPAAllocator
+{
+    void *(*allocF)(void *opaque, size_t size); // must not return NULL
+    void (*freeF)(void *opaque, void *ptr, size_t size);
+    void *opaque;
+};
+
 
 LVPA_NAMESPACE_END
 
@@ -11,12 +11,20 @@
 //#define LVPA_SUPPORT_LZO
 //#define LVPA_SUPPORT_LZF
 //#define LVPA_SUPPORT_LZHAM
+//#define LVPA_SUPPORT_ZSTD
+//#define LVPA_SUPPORT_LZ4
+
+// use the reference LZ4 library (lz4.h and lz4hc.h from the include path) instead of the included one
+//#define LVPA_SYSTEM_LZ4
+
+// report the stages of loading and saving to a callback, see LVPAFile::SetTraceCallback()
+//#define LVPA_SUPPORT_TRACING
 
 
 // ------ End of config ------
 
 #if !(defined(LVPA_SUPPORT_ZLIB) || defined(LVPA_SUPPORT_LZMA) || defined(LVPA_SUPPORT_LZO) \
-    || defined(LVPA_SUPPORT_LZF) || defined(LVPA_SUPPORT_LZHAM))
+    || defined(LVPA_SUPPORT_LZF) || defined(LVPA_SUPPORT_LZHAM) || defined(LVPA_SUPPORT_ZSTD) || defined(LVPA_SUPPORT_LZ4))
 #error No compression support enabled; if this is the intent, comment out this warning and go ahead
 #endif
 
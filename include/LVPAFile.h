@@ -12,6 +12,9 @@ LVPA_NAMESPACE_START
 // default compression level used if nothing else is specified [0..9]
 #define LVPA_DEFAULT_LEVEL LVPACOMP_NORMAL
 
+// default for UseDictionary(): only files up to this size are used for training, and packed with the dictionary
+#define LVPA_DICT_MAX_FILE_SIZE (64 * 1024)
+
 
 // --- Changing any of the settings below will make this library version incompatible with others.
 // --- If this is intended, go ahead. If not, stay away from these defines!
@@ -19,21 +22,29 @@ LVPA_NAMESPACE_START
 // each buffer allocated for files gets this amount of extra padding bytes (for pure text files that need to end with \0, for example)
 #define LVPA_EXTRA_BUFSIZE 4
 
-// multiple ciphers would be a bit overkill right now, so we use only this
+// the default cipher, see LVPAEncr for the others
 #define LVPACipher HPRC4LikeCipher
 #define LVPAHash SHA256Hash
 #define LVPAHash_Size 32
 
 // these are part of the header of each file
 #define LVPA_MAGIC "LVPA"
-#define LVPA_VERSION 0
+// 1: shared dictionaries (LVPAFLAG_DICT, LVPAFLAG_DICTREF), 2: filters (LVPAFLAG_FILTERED), 3: other ciphers (LVPAENCR_CHACHA20),
+// 4: other checksums (LVPAHDR_XXH64), 5: restart points in solid blocks (LVPAHDR_RESTARTS).
+// archives are written with the lowest version that can read them, so those without any of these features are still 0.
+#define LVPA_VERSION 5
 #define LVPA_HDR_CIPHER_WARMUP 1337
+// set in the stored cipherWarmup if the file does not use the default cipher. The cipher id and the nonce follow.
+#define LVPA_CIPHER_EXTENDED 0x8000
+#define LVPA_CIPHER_NONCE_SIZE 12
 
 enum LVPAMasterFlags
 {
     LVPAHDR_NONE        = 0x00,
     LVPAHDR_PACKED      = 0x01,
     LVPAHDR_ENCRYPTED   = 0x02,
+    LVPAHDR_XXH64       = 0x04, // the headers are checked with LVPACHECK_XXH64, and each file header stores its checksum type
+    LVPAHDR_RESTARTS    = 0x08, // each packed solid block header stores its restart points (see LVPARestartPoint)
 };
 
 enum LVPAFileFlags
@@ -47,6 +58,9 @@ enum LVPAFileFlags
                                 // Note: the actual "salt" is HASH(master key), be sure to have one set should you use this,
                                 // otherwise it is possible to extract the file without knowing its name by simply using its hash !!
                                 // If ENCRYPTED and SCRAMBLED are combined, the key to encrypt the file will be HASH(master key .. HASH(filename))
+    LVPAFLAG_DICT       = 0x20, // file is not an actual file, but a shared compression dictionary
+    LVPAFLAG_DICTREF    = 0x40, // file was packed using the dictionary stored in header blockId (never combined with SOLID)
+    LVPAFLAG_FILTERED   = 0x80, // data went through a filter before packing (always combined with PACKED, see LVPAFilters)
 };
 
 enum LVPAAlgos
@@ -57,20 +71,60 @@ enum LVPAAlgos
     LVPAPACK_DEFLATE,
     LVPAPACK_LZF,
     LVPAPACK_LZHAM,
+    LVPAPACK_LZMAMT, // LZMA, split into independent chunks that are processed in parallel
+    LVPAPACK_ZSTD,
+    LVPAPACK_LZ4, // LZ4 on low levels, LZ4HC on higher ones
 
     LVPAPACK_MAX_SUPPORTED, // must be after last algo
 
     LVPAPACK_INHERIT = 0xFF // select the one used by parent
 };
 
+// Reversible transforms that are applied before compression, to make some kinds of data compress better.
+// They are only kept for a file or solid block if it was actually packed.
+enum LVPAFilters
+{
+    LVPAFILTER_NONE,
+    LVPAFILTER_X86,     // x86/x64 machine code (executables, DLLs): relative CALL/JMP targets are made absolute
+    LVPAFILTER_DELTA,   // each byte minus the one [param] bytes before it; param 1..255.
+                        // For samples, pixels, tables of numbers with a record size of [param] bytes.
+    LVPAFILTER_SHUFFLE, // splits elements of [param] bytes into one stream per byte position; param 2..255.
+                        // For arrays of floats or integers (meshes, sensor data), where the high bytes vary slowly.
+
+    LVPAFILTER_MAX_SUPPORTED // must be after last filter
+};
+
 enum LVPAEncr
 {
     LVPAENCR_NONE,
-    LVPAENCR_ENABLED, // currently, the code supports only on, off, and inherit
+    LVPAENCR_ENABLED, // the default cipher (LVPACipher)
+    LVPAENCR_CHACHA20, // ChaCha20, a counter mode cipher: decryption can start anywhere, and large files are decrypted in parallel
+
+    LVPAENCR_MAX_SUPPORTED, // must be after last cipher
 
     LVPAENCR_INHERIT = 0xFF // select the one used by parent
 };
 
+// Checksum used for the data of a file (crcPacked, crcReal)
+enum LVPAChecksums
+{
+    LVPACHECK_CRC32, // the default, readable by all versions
+    LVPACHECK_XXH64, // xxHash64, several times faster, and 64 bits per checksum (the header checksums keep the lower 32 bits)
+
+    LVPACHECK_MAX_SUPPORTED // must be after last checksum
+};
+
+// How Get() checks the unpacked data of a file, see LVPAFile::SetVerifyMode().
+// Packed data, and files that are only stored, are always checked while they are read, in every mode.
+enum LVPAVerifyModes
+{
+    LVPAVERIFY_SYNC,        // checked before Get() returns (the default)
+    LVPAVERIFY_BACKGROUND,  // Get() returns the data right away, and the check is done in a background thread
+    LVPAVERIFY_TRUSTED,     // not checked at all, for archives that are known to be fine (see GetFingerprint())
+
+    LVPAVERIFY_MAX_SUPPORTED // must be after last mode
+};
+
 enum LVPAComprLevels
 {
     LVPACOMP_NONE = 0, // just store
@@ -101,39 +155,59 @@ struct LVPAMasterHeader
     // level is not explicitly stored
 };
 
+// Start of an independently packed segment inside a solid block, see LVPAFile::SetRestartInterval().
+// Segments that did not get smaller are stored as they are (packed size == unpacked size), and are never filtered.
+struct LVPARestartPoint
+{
+    uint32 unpackedOffs; // offset in the unpacked block, always where a file starts
+    uint32 packedOffs; // offset in the packed data
+};
+
 struct LVPAFileHeader
 {
     LVPAFileHeader()
-        : packedSize(0), realSize(0), crcPacked(0), crcReal(0), blockId(0), cipherWarmup(0),
-          flags(LVPAFLAG_NONE), algo(LVPAPACK_NONE), level(LVPACOMP_NONE),
+        : packedSize(0), realSize(0), crcPacked(0), crcReal(0), blockId(0), cipherWarmup(0), cipher(LVPAENCR_ENABLED),
+          flags(LVPAFLAG_NONE), algo(LVPAPACK_NONE), level(LVPACOMP_NONE), filter(LVPAFILTER_NONE), filterParam(0), checksum(LVPACHECK_CRC32),
           id(-1), offset(-1), encryption(LVPAENCR_NONE), good(true), checkedCRC(false), checkedCRCPacked(false),
-          otherMem(false), sparePtr(NULL)
+          cipherKeyFlags(0), otherMem(false), sparePtr(NULL), pins(0), pinGen(0), cachePrev(-1), cacheNext(-1), cached(false), resident(false), blockLink(-1), inBlockList(false)
     {
         memset(&hash[0], 0, LVPAHash_Size);
+        memset(&cipherNonce[0], 0, LVPA_CIPHER_NONCE_SIZE);
     }
 
     // these are stored in the file
     std::string filename; // empty/unused if LVPAFLAG_SCRAMBLED is set
     uint32 packedSize; // size in bytes in current file (usually packed)
     uint32 realSize; // unpacked size of the file, for array allocation
-    uint32 crcPacked; // checksum for the packed data block
-    uint32 crcReal; // checksum for the unpacked data block
-    uint32 blockId; // solid block ID, this is the header index of the file that serves as solid block
+    uint64 crcPacked; // checksum for the packed data block, see LVPAChecksums. stored with 32 bits for CRC32.
+    uint64 crcReal; // checksum for the unpacked data block
+    uint32 blockId; // solid block ID, this is the header index of the file that serves as solid block (or as dictionary, if LVPAFLAG_DICTREF is set)
     uint16 cipherWarmup; // if LVPAFLAG_ENCRYPTED is set, this many bytes were drawn from the cipher before starting the actual encryption
+    uint8 cipher; // LVPAEncr value of the cipher used if LVPAFLAG_ENCRYPTED or LVPAFLAG_SCRAMBLED is set. stored only if not LVPAENCR_ENABLED.
+    uint8 cipherNonce[LVPA_CIPHER_NONCE_SIZE]; // for LVPAENCR_CHACHA20, new for every time the file is encrypted
     uint8 flags; // see LVPAFileFlags
     uint8 algo; // algorithm used to compress this file
     uint8 level; // compression level used. default: LVPACOMP_INHERIT
+    uint8 filter; // see LVPAFilters. stored only if LVPAFLAG_FILTERED is set, but kept in memory to be used again when saving
+    uint8 filterParam; // depends on the filter
+    uint8 checksum; // LVPAChecksums type of crcPacked and crcReal. stored only if the archive has LVPAHDR_XXH64 set
     uint8 hash[LVPAHash_Size]; // used only if LVPAFLAG_SCRAMBLED is set
+    std::vector<LVPARestartPoint> restarts; // packed solid blocks only, ascending; the first segment (at 0) is implied
 
     // calculated during load, or only required for saving. not stored in the file.
     uint32 id;
     uint32 offset; // offset where the data block starts, either absolute address in the file, or offset in solid block
     memblock data;
-    uint8 encryption;
+    uint8 encryption; // LVPAEncr value requested for saving
     bool good;
     bool checkedCRC;
     bool checkedCRCPacked;
 
+    // for scrambled files: the cipher key derived from the file name (and master key, if encrypted), to skip hashing it again.
+    // valid if cipherKeyFlags is equal to the (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED) part of flags, 0 if not yet known.
+    uint8 cipherKey[LVPAHash_Size];
+    uint8 cipherKeyFlags;
+
     // when a file from a solid block is requested, it gets a pointer to inside solid block's memory.
     // if the file is dropped later, its data.ptr is set to NULL to indicate it must be loaded again.
     // the spare ptr below will store this ptr to (1) quickly regain access to still existing memory,
@@ -147,6 +221,18 @@ struct LVPAFileHeader
     // if sparePtr is NULL and otherMem is true, memory came from outside and must not be touched.
     bool otherMem;
 
+    // cache bookkeeping, see LVPAFile::SetCacheBudget()
+    uint32 pins; // successful Get() calls not yet matched by Release(). for solid blocks, this includes those of the files inside.
+    uint32 pinGen; // changes whenever Free() takes the pins away, so that LVPAHandles from before leave the new pins alone
+    uint32 cachePrev, cacheNext; // neighbours in the LRU list (-1 at either end), only valid if cached is true
+    bool cached; // data were loaded while the cache was enabled, and count towards its budget
+    bool resident; // data were loaded by the LVPAFile, and count towards LVPAStats
+
+    // the files that were given a pointer into a solid block's memory form a list, so that they can be reset when the block is freed.
+    // for a solid block, this is the first file in its list, for a solid file the next one (-1 at the end).
+    uint32 blockLink;
+    bool inBlockList;
+
 };
 
 struct LVPAFileReader
@@ -167,7 +253,112 @@ struct LVPAFileReader
 
 typedef std::map<std::string, uint32> LVPAIndexMap; // maps a file name to its internal file number (which is the index of _headers vector)
 
+class LVPAFile;
+
+// Refcounted reference to a file's data, see LVPAFile::GetHandle(). Every copy pins the file (like Get() does),
+// and gives the pin back when it goes away. Without a cache budget, the last handle into a solid block frees the block.
+// Free() takes the pins of all handles to the file (or its solid block) along; those handles are stale afterwards and must not
+// be dereferenced, but can still be copied and reset safely. All handles must be gone before their LVPAFile is cleared or deleted.
+class LVPAHandle
+{
+public:
+    LVPAHandle() : _lvpa(NULL), _id(-1), _gen(0) {}
+    LVPAHandle(const LVPAHandle& h);
+    ~LVPAHandle() { Reset(); }
+    LVPAHandle& operator=(const LVPAHandle& h);
+
+    void Reset(void); // gives the pin back, the handle is empty afterwards
+    inline bool Valid(void) const { return _mb.ptr != NULL; }
+    inline const memblock& Data(void) const { return _mb; }
+    inline uint8 *Ptr(void) const { return _mb.ptr; }
+    inline uint32 Size(void) const { return _mb.size; }
+    inline uint32 Id(void) const { return _id; }
+
+private:
+    friend class LVPAFile;
+    LVPAHandle(LVPAFile *lvpa, uint32 id, uint32 gen, memblock mb) : _lvpa(lvpa), _id(id), _gen(gen), _mb(mb) {}
+    bool _Pinned(void) const; // false if empty, or if Free() took the pin away
+
+    LVPAFile *_lvpa; // NULL if empty
+    uint32 _id;
+    uint32 _gen; // pinGen of the file when it was pinned
+    memblock _mb;
+};
+
+// called from the verify thread if a file that was checked in the background turned out to be bad.
+// It must not call into the LVPAFile; the header is marked as bad on the next call of Get() or WaitVerify().
+typedef void (*LVPAVerifyCallback)(LVPAFile *lvpa, uint32 id, const char *fn, void *user);
+// called by VerifyAll() after each file or solid block, from any of its threads (but never from two at once)
+typedef void (*LVPAProgressCallback)(uint32 done, uint32 total, void *user);
+
+// Memory and I/O counters of an LVPAFile, see LVPAFile::GetStats().
+// Work done by the background verify thread and by VerifyAll() is included.
+struct LVPAStats
+{
+    LVPAStats() { memset(this, 0, sizeof(*this)); }
+
+    // unpacked data loaded from the archive and held in memory. Memory passed to Add() is not counted,
+    // and files inside a solid block are part of the block.
+    uint64 residentBytes;
+    uint64 residentFileBytes; // in files that are not solid (incl. dictionaries)
+    uint64 residentBlockBytes; // in solid blocks, even if only partially unpacked so far
+    uint64 residentFiles, residentBlocks;
+    uint64 peakResidentBytes; // highest residentBytes so far
+
+    uint64 bytesRead; // file data read from the archive, incl. raw copies when saving
+    uint64 bytesDecrypted;
+    uint64 bytesDecompressed;
+    uint64 crcNanos; // time spent calculating checksums while loading, summed over all threads
+    uint64 decodeNanos; // time spent decompressing and unfiltering, summed over all threads
+
+    uint64 cacheHits; // Get() calls that found the data in memory already
+    uint64 cacheMisses; // Get() calls that had to load
+};
+
+// Stages of loading and saving that are reported to a LVPATraceCallback, see LVPAFile::SetTraceCallback().
+enum LVPATraceStages
+{
+    // loading; each one runs inside the one before
+    LVPATRACE_PREPARE,  // all that Get() needs to make a file available
+    LVPATRACE_UNPACK,   // load, check and decompress a file or solid block (also when a solid block is unpacked further)
+    LVPATRACE_DECRYPT,  // read, decrypt and checksum the stored data
+    LVPATRACE_LOAD,     // read the stored data as they are (raw copies while saving)
+    LVPATRACE_CHECK,    // checksum of the unpacked data, unless done in the background or while unpacking
+    // saving; once for each file or solid block
+    LVPATRACE_COMPRESS, // filter and compress
+    LVPATRACE_ENCRYPT,  // encrypt and checksum
+    LVPATRACE_WRITE,    // write to the new archive
+
+    LVPATRACE_MAX // must be after last stage
+};
+
+struct LVPATraceEvent
+{
+    uint64 time; // nanoseconds, from a monotonic clock
+    const char *filename; // valid only during the call. empty for scrambled files whose name is unknown.
+    uint32 id; // header index of the file, solid block or dictionary
+    uint64 bytesIn; // size of the data going into the stage
+    uint64 bytesOut; // at the end: size of the data that came out, 0 if the stage failed
+    uint8 stage; // see LVPATraceStages
+    bool begin; // false at the end of the stage
+    // when saving, these are final only at the end of a stage
+    uint8 algo; // LVPAAlgos value of the codec, LVPAPACK_NONE if not packed
+    uint8 cipher; // LVPAEncr value of the cipher, LVPAENCR_NONE if not encrypted or scrambled
+};
+
+// called at the beginning and end of each stage, from the thread that called Get() or SaveAs().
+// It must not call into the LVPAFile.
+typedef void (*LVPATraceCallback)(LVPAFile *lvpa, const LVPATraceEvent& ev, void *user);
+
 class MTRand;
+class LVPACipher;
+class ISymmetricCipher;
+class ChaCha20Cipher;
+class ICompressor;
+class ByteBuffer;
+struct LVPAVerifyState;
+struct LVPAPartialBlock;
+struct LVPAVerifyAllJob;
 
 class LVPAFile
 {
@@ -184,15 +375,30 @@ public:
     virtual memblock Remove(const char *fn); // removes a file from the container and returns its memblock
     memblock Get(const char *fn, bool checkCRC = true);
     memblock Get(uint32 index, bool checkCRC = true);
+    // Like Get(), but the pin is given back automatically when the last copy of the handle is gone. An empty handle if it failed.
+    LVPAHandle GetHandle(const char *fn, bool checkCRC = true);
+    LVPAHandle GetHandle(uint32 index, bool checkCRC = true);
     uint32 GetId(const char *fn);
     void Clear(bool del = true); // free all
     virtual bool Delete(const char *fn); // removes a file from the container and frees up memory. returns false if the file was not found.
 
     // Frees the memory associated with a file, leaving it in the container. if requested again, it will be loaded from disk.
-    // Returns true if the memory was freed, false if it was not possible.
+    // All of the file's pins are given back (see Release()). Returns true if the memory was freed, false if it was not possible.
     bool Free(const char *fn);
     bool Free(uint32 id);
-    uint32 FreeUnused(void); // frees unused solid blocks
+    uint32 FreeUnused(void); // frees solid blocks that are not pinned
+
+    // Let the LVPAFile decide what stays in memory: decompressed files and solid blocks are kept up to a total of budget bytes,
+    // beyond that the least recently used ones are freed, and loaded again from disk when needed.
+    // Every successful Get() pins the file (and its solid block) until it is given back with Release(), pinned data are never freed.
+    // Only data loaded from disk while a budget is set are counted, files passed to Add() stay as they are.
+    // 0 disables the cache (the default). Then solid blocks are freed as soon as the last LVPAHandle into them is gone;
+    // everything else stays loaded until it is freed by hand (unpinned solid blocks e.g. with FreeUnused()).
+    void SetCacheBudget(uint64 budget);
+    uint64 GetCacheBudget(void) const { return _cacheBudget; }
+    uint64 GetCacheUsed(void) const { return _cacheUsed; } // bytes held by the cache, pinned or not
+    void Release(const char *fn);
+    void Release(uint32 id); // call once for each successful Get(); with a cache budget, the memory may be freed right away
 
     // drops our reference to the file, so it will be loaded again from disk if required. The original memory will not be touched,
     // so that it can be processed elsewhere.
@@ -201,7 +407,13 @@ public:
     bool Drop(const char *fn);
     bool Drop(uint32 id);
 
-    uint32 SetSolidBlock(const char *name, uint8 compression = LVPACOMP_INHERIT, uint8 algo = LVPAPACK_INHERIT); // return file id of block
+    uint32 SetSolidBlock(const char *name, uint8 compression = LVPACOMP_INHERIT, uint8 algo = LVPAPACK_INHERIT,
+        uint8 filter = LVPAFILTER_NONE, uint8 filterParam = 0); // return file id of block
+
+    // Filter a file's data before packing it (see LVPAFilters). Add() resets this, so call it afterwards.
+    // Files in a solid block can't have their own filter, set one for the whole block instead.
+    // Returns false if the file does not exist, is in a solid block, or the filter/param combination is invalid.
+    bool SetFilter(const char *fn, uint8 filter, uint8 param = 0);
 
     inline uint32 Count(void) const { return _indexes.size(); }
     inline uint32 HeaderCount(void) const { return _headers.size(); }
@@ -209,6 +421,9 @@ public:
 
     bool AllGood(void) const;
     const LVPAFileHeader& GetFileInfo(uint32 i) const;
+    // Solid blocks are only unpacked as far as the files requested so far need it (if the algorithm supports that,
+    // or if the block has restart points), this tells how many bytes of it are unpacked. 0 if the file is not loaded.
+    uint32 GetUnpackedSize(uint32 id) const;
 
     // encryption related
     void SetMasterKey(const void *key, uint32 size);
@@ -219,6 +434,72 @@ public:
 
     void RandomSeed(uint32); // for encryption
 
+    // Max. number of threads a compressor may use for a single file or solid block (if the algorithm supports it).
+    // 0 means one per CPU, which is the default.
+    void SetThreads(uint32 threads) { _threads = threads; }
+    uint32 GetThreads(void) const { return _threads; }
+
+    // Memory for file data and solid blocks, and for the buffers used for loading, packing and unpacking, comes from alloc.
+    // NULL selects new[]/delete[] (the default). alloc is copied, but its opaque pointer must stay valid.
+    // If more than one thread is used (see SetThreads()), the functions are called from several threads at once.
+    // The memory passed to Add() is freed by the LVPAFile later on, so with an allocator set it must come from AllocBuffer(),
+    // and memory returned by Remove() must be freed with FreeBuffer().
+    // Can only be changed while no data are loaded; returns false otherwise.
+    bool SetAllocator(const LVPAAllocator *alloc);
+    uint8 *AllocBuffer(uint32 size); // room for size + LVPA_EXTRA_BUFSIZE bytes
+    void FreeBuffer(memblock mb); // mb.size must be the size given to AllocBuffer()
+
+    // Without an allocator, large internal buffers (like solid blocks while saving) come straight from the OS where possible,
+    // so that they can grow without copying. This backs them with transparent huge pages (Linux only), which helps with
+    // very large archives, but may take more memory. Off by default, applies to all LVPAFiles.
+    static void UseHugePages(bool use);
+
+    // Train a shared dictionary of up to dictSize bytes from the small files when saving, and pack every file
+    // up to maxFileSize bytes with it (if its algorithm supports dictionaries). Helps a lot with many small, similar files
+    // that each compress poorly on their own. If the archive already has a dictionary, it is kept and used instead.
+    // dictSize 0 disables training (the default).
+    void UseDictionary(uint32 dictSize, uint32 maxFileSize = LVPA_DICT_MAX_FILE_SIZE) { _dictSize = dictSize; _dictMaxFileSize = maxFileSize; }
+
+    // Pack solid blocks in independent segments of at least this many bytes when saving, each starting with a file.
+    // A file far inside a block then only needs its own segment unpacked, which costs a little compression.
+    // 0 packs each block as a whole (the default). Blocks that are not loaded are copied as they are, and keep their segments.
+    void SetRestartInterval(uint32 bytes) { _restartInterval = bytes; }
+    uint32 GetRestartInterval(void) const { return _restartInterval; }
+
+    // Checksum type for files written when saving (see LVPAChecksums). Files that were not loaded are copied as they are,
+    // and keep theirs. LoadFrom() sets LVPACHECK_XXH64 if the loaded archive uses it.
+    // Returns false if the type is unknown.
+    bool SetChecksum(uint8 type);
+    uint8 GetChecksum(void) const { return _checksum; }
+
+    // Select how Get(..., true) checks the unpacked data, see LVPAVerifyModes. The callback is only used in background mode.
+    // Data returned by Get() must not be changed until it was checked, call WaitVerify() first if necessary.
+    // Returns false if the mode is unknown.
+    bool SetVerifyMode(uint8 mode, LVPAVerifyCallback cb = NULL, void *user = NULL);
+    uint8 GetVerifyMode(void) const { return _verifyMode; }
+    void WaitVerify(void); // waits until all background checks are done, and marks the bad files
+    // true if every file was checked and found good; waits for the background checks.
+    // To skip the checks on later runs, remember GetFingerprint() and switch to LVPAVERIFY_TRUSTED if it is still the same.
+    bool AllVerified(void);
+    // hash over all headers (incl. each file's checksum), calculated by LoadFrom(). Changes whenever the archive is saved differently.
+    uint64 GetFingerprint(void) const { return _fingerprint; }
+
+    // Reads and checks every file on disk, spread over GetThreads() threads. Solid blocks are unpacked once for all of their files.
+    // With packedOnly, only the stored data are checked (decrypted if necessary, but never unpacked), which is mostly limited
+    // by the disk speed. Scrambled files can only be checked if their name is known.
+    // Bad files are marked like Get() does. Returns false if any file is bad.
+    bool VerifyAll(bool packedOnly = false, LVPAProgressCallback cb = NULL, void *user = NULL);
+
+    // Snapshot of the counters. Cheap, and can be called from any thread while the LVPAFile is in use.
+    LVPAStats GetStats(void) const;
+    // Sets all counters to 0, except the resident ones, which describe what is loaded now. The peak starts over from there.
+    void ResetStats(void);
+
+    // Report the stages of loading and saving each file to cb (NULL to stop), see LVPATraceStages.
+    // Returns false if the library was built without LVPA_SUPPORT_TRACING; the calls cost nothing then.
+    bool SetTraceCallback(LVPATraceCallback cb, void *user = NULL);
+    static const char *GetTraceStageName(uint8 stage); // short lowercase name, like "unpack"
+
 
 private:
     std::string _ownName;
@@ -227,30 +508,76 @@ private:
     LVPAFileReader reader;
     MTRand *_mtrand;
     uint32 _realSize, _packedSize; // for stats
+    uint32 _threads;
+    uint32 _dictSize, _dictMaxFileSize; // see UseDictionary()
+    uint32 _restartInterval; // see SetRestartInterval()
+    uint8 _checksum; // see SetChecksum()
+    LVPAAllocator _allocStore;
+    const LVPAAllocator *_allocator; // &_allocStore, or NULL if not set
+    uint8 _verifyMode; // see SetVerifyMode()
+    LVPAVerifyState *_verify; // background verification, NULL until needed
+    uint64 _fingerprint;
+    uint64 _cacheBudget, _cacheUsed; // see SetCacheBudget()
+    uint32 _cacheHead, _cacheTail; // most and least recently used file, -1 if the list is empty
+    std::map<uint32, LVPAPartialBlock*> _partial; // solid blocks that are not yet unpacked completely
+    LVPAStats _stats; // see GetStats(); only changed via the atomic functions, as other threads update it too
+    LVPATraceCallback _traceCb; // see SetTraceCallback()
+    void *_traceUser;
 
     std::vector<uint8> _masterKey; // used as global encryption key for each file
     uint8 _masterSalt[LVPAHash_Size]; // derived from master key, used for filename salting
+    LVPACipher *_masterCipher; // initialized with the master key, copied for each file instead of initializing again. NULL until needed.
+    ChaCha20Cipher *_masterChaCha; // the same for LVPAENCR_CHACHA20
 
     // loading functions, call chain/data flow is in this order:
-    // [HDD] -> _LoadFile() -> _DecryptFile() -> _UnpackFile() -> _PrepareFile() -> Get() -> [memblock]
-    bool _LoadFile(memblock& target, LVPAFileHeader& h); // load from disk
-    bool _DecryptFile(memblock &target, LVPAFileHeader& h); // _LoadFile() and decrypt
-    memblock _UnpackFile(LVPAFileHeader& h); // _DecryptFile(), and unpack
-    memblock _PrepareFile(LVPAFileHeader& h, bool checkCRC = true); // _UnpackFile(), and check CRC
+    // [HDD] -> _DecryptFile() -> _UnpackFile() -> _PrepareFile() -> Get() -> [memblock]
+    bool _LoadFile(memblock& target, LVPAFileHeader& h); // load from disk (as is, for raw-copying)
+    bool _DecryptFile(memblock &target, LVPAFileHeader& h, uint64 *crc = NULL); // load from disk, decrypt, and checksum
+    // of solid blocks, only the range [from, upTo) is unpacked if possible, the rest follows in _ContinueUnpack() when needed
+    memblock _UnpackFile(LVPAFileHeader& h, bool checkCRC = true, uint32 from = 0, uint32 upTo = -1); // _DecryptFile(), check CRC, and unpack
+    memblock _PrepareFile(LVPAFileHeader& h, bool checkCRC = true, uint32 from = 0, uint32 upTo = -1); // _UnpackFile(), and check CRC
+    bool _ContinueUnpack(LVPAFileHeader& h, uint32 from, uint32 upTo); // false if unpacking failed
+    void _DropPartial(LVPAFileHeader& h); // forgets the rest of a partially unpacked solid block
+    bool _CheckCRC(LVPAFileHeader& h, uint64 crc, bool packed); // marks the file as checked or bad
+    bool _QueueVerify(LVPAFileHeader& h); // hands the unpacked check over to the verify thread; false if that is not possible
+    void _ApplyVerifyResults(void); // marks files that failed the check in the background
+    static void _VerifyThread(void *p);
+    static void _VerifyEntry(uint32 idx, void *p); // VerifyAll() helper, checks one file or solid block
+
+    ICompressor *_AllocCompressor(uint8 algo); // applies per-archive compressor settings
+
+    void _Pin(LVPAFileHeader& h);
+    // trims the cache if a budget is set. without one, freeBlock frees the solid block once nothing pins it anymore
+    void _Unpin(LVPAFileHeader& h, uint32 count, bool freeBlock = false);
+    void _DetachSolidFiles(LVPAFileHeader& block); // resets the files pointing into the block's memory, before it is freed
+
+    // LRU list helpers, see SetCacheBudget()
+    void _CacheLink(LVPAFileHeader& h); // starts tracking h as the most recently used entry
+    void _CacheUnlink(LVPAFileHeader& h); // stops tracking h, if it was
+    void _CacheTrim(void); // frees unpinned entries until the budget is met
+    void _CacheEvict(LVPAFileHeader& h);
+    void _TrackResident(LVPAFileHeader& h); // counts freshly loaded data in the stats
+    void _UntrackResident(LVPAFileHeader& h); // before the data are freed or handed over, if they were counted
 
     bool _OpenFile(void);
     void _CloseFile(void);
     void _CreateIndexes(void); // load helper
     void _CalcOffsets(uint32 startOffset); // load helper
     void _MakeSolid(LVPAFileHeader& h, const char *solidBlockName); // put file into solid block
+    uint32 _PrepareDictionary(std::vector<LVPAFileHeader>& hdrs, std::vector<bool>& useDict, ByteBuffer& storage); // save helper
     void _CalcSaltedFilenameHash(uint8 *dst, const std::string& fn);
     // encrypt or decrypt block of data; it is assumed that hdr.filename already holds the correct file name in case the file is scrambled
     // writeMode should be true when the block is supposed to be encrypted/scrambled, false otherwise
-    bool _CryptBlock(uint8 *buf, LVPAFileHeader& hdr, bool writeMode);
+    // if crc is not NULL, the checksum of the unencrypted data is calculated along the way, and stored there
+    bool _CryptBlock(uint8 *buf, LVPAFileHeader& hdr, bool writeMode, uint64 *crc = NULL);
+    ISymmetricCipher *_InitCipher(LVPAFileHeader& hdr, bool writeMode); // _CryptBlock() helper; returns a new cipher, or NULL if not possible
+    void _PrepareCipherKeys(const std::vector<LVPAFileHeader*>& hdrs); // save helper; derives the keys of many scrambled files at once
     // these return true and set *id to the internal file number (= _headers[] array position) if found
     bool _FindHeaderByName(const char *fn, uint32 *id);
     bool _FindHeaderByHash(uint8 *hash, uint32 *id);
 
+    friend class LVPAHandle;
+
 };
 
 class LVPAFileReadOnly : public LVPAFile
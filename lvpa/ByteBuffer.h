@@ -3,6 +3,7 @@
 
 #include "LVPACommon.h"
 #include "ByteConverter.h"
+#include "LVPAMemory.h"
 
 #include <string.h> // for memcpy
 #include <assert.h>
@@ -60,7 +61,10 @@ protected:
         _size; // used buffer size
     delete_func _delfunc;
     allocator_func _allocfunc;
+    const LVPAAllocator *_allocator; // used for new allocations if set (instead of _allocfunc)
+    const LVPAAllocator *_bufAllocator; // the one _buf came from, if any
     bool _mybuf; // if true, destructor deletes buffer
+    bool _large; // _buf came from LargeAlloc(), see _allocate()
     bool _growable; // default true, if false, buffer will not re-allocate more space
 
 public:
@@ -68,25 +72,25 @@ public:
 
     ByteBuffer()
         : _rpos(0), _wpos(0), _buf(NULL), _size(0), _growable(true), _res(0), _mybuf(false), _delfunc(NULL),
-        _allocfunc(NULL)
+        _allocfunc(NULL), _allocator(NULL), _bufAllocator(NULL), _large(false)
     {
     }
     ByteBuffer(uint32 res)
         : _rpos(0), _wpos(0), _buf(NULL), _size(0), _growable(true), _res(0), _mybuf(false), _delfunc(NULL),
-        _allocfunc(NULL)
+        _allocfunc(NULL), _allocator(NULL), _bufAllocator(NULL), _large(false)
     {
         _allocate(res);
     }
     ByteBuffer(ByteBuffer &buf, Mode mode = COPY, uint32 extra = 0)
         : _rpos(0), _wpos(0), _buf(NULL), _size(0), _growable(true), _res(0), _mybuf(false), _delfunc(NULL),
-        _allocfunc(NULL)
+        _allocfunc(NULL), _allocator(NULL), _bufAllocator(NULL), _large(false)
     {
         init(buf, mode, extra);
     }
     // del param only used with TAKE_OVER, extra only used with COPY
     ByteBuffer(void *buf, uint32 size, Mode mode = COPY, delete_func del = NULL, uint32 extra = 0)
         : _rpos(0), _wpos(0), _size(size), _buf(NULL), _growable(true), _delfunc(del),
-        _mybuf(false), _allocfunc(NULL) // for mode == REUSE
+        _mybuf(false), _allocfunc(NULL), _allocator(NULL), _bufAllocator(NULL), _large(false) // for mode == REUSE
     {
         init(buf, size, mode, del, extra);
     }
@@ -104,6 +108,8 @@ public:
         case TAKE_OVER:
             _mybuf = true; // fallthrough
         case REUSE:
+            _bufAllocator = NULL;
+            _large = false;
             _buf = (uint8*)buf;
             _res = size;
             _size = size;
@@ -113,6 +119,7 @@ public:
     void init(ByteBuffer& bb, Mode mode = COPY, uint32 extra = 0)
     {
         _allocfunc = bb._allocfunc;
+        _allocator = bb._allocator;
 
         switch(mode)
         {
@@ -125,6 +132,8 @@ public:
         case REUSE:
             _mybuf = bb._mybuf;
             _delfunc = bb._delfunc;
+            _bufAllocator = bb._bufAllocator;
+            _large = bb._large;
             _buf = bb._buf;
             _res = bb._res;
             _size = bb._size;
@@ -296,7 +305,7 @@ public:
     template <typename T> void append(T value)
     {
         ToLittleEndian<T>(value);
-        _enlargeIfReq(_wpos + sizeof(T));
+        _enlargeIfReq(uint64(_wpos) + sizeof(T));
         *((T*)(_buf + _wpos)) = value;
         _wpos += sizeof(T);
         if(_size < _wpos)
@@ -306,7 +315,7 @@ public:
     void append(const void *src, uint32 bytes)
     {
         if (!bytes) return;
-        _enlargeIfReq(_wpos + bytes);
+        _enlargeIfReq(uint64(_wpos) + bytes);
         memcpy(_buf + _wpos, src, bytes);
         _wpos += bytes;
         if(_size < _wpos)
@@ -335,6 +344,27 @@ public:
     inline bool growable(void) { return _growable; }
     inline void growable(bool b) { _growable = b; }
 
+    // memory is taken from a, from the next allocation on (NULL: new[]). a must stay valid while this buffer uses it.
+    inline const LVPAAllocator *allocator(void) const { return _allocator; }
+    inline void allocator(const LVPAAllocator *a) { _allocator = a; }
+
+    // exchange contents and ownership with another buffer, without copying any data
+    void swap(ByteBuffer& bb)
+    {
+        std::swap(_buf, bb._buf);
+        std::swap(_rpos, bb._rpos);
+        std::swap(_wpos, bb._wpos);
+        std::swap(_res, bb._res);
+        std::swap(_size, bb._size);
+        std::swap(_delfunc, bb._delfunc);
+        std::swap(_allocfunc, bb._allocfunc);
+        std::swap(_allocator, bb._allocator);
+        std::swap(_bufAllocator, bb._bufAllocator);
+        std::swap(_large, bb._large);
+        std::swap(_mybuf, bb._mybuf);
+        std::swap(_growable, bb._growable);
+    }
+
     // dangerous functions
 
     void _setPtr(void *p)
@@ -368,7 +398,14 @@ protected:
     {
         if(_mybuf)
         {
-            if(_delfunc)
+            if(_bufAllocator)
+            {
+                if(_buf)
+                    _bufAllocator->freeF(_bufAllocator->opaque, _buf, _res);
+            }
+            else if(_large)
+                LargeFree(_buf, _res);
+            else if(_delfunc)
                 _delfunc(_buf);
             else
                 delete [] _buf;
@@ -378,13 +415,33 @@ protected:
     }
 
     // allocate larger buffer and copy contents. if we own the current buffer, delete old, otherwise, leave it as it is.
+    // large buffers of our own are resized in place instead, see LargeRealloc().
     void _allocate(uint32 s)
     {
         if(!_growable && _buf) // only throw if we already have a buf
             BYTEBUFFER_EXCEPT(this, "_alloc+locked", s);
 
+        const bool large = !_allocator && !_allocfunc && s >= LVPA_LARGE_BUFFER_MIN;
+        if(large && _large && _mybuf)
+        {
+            if(uint8 *p = LargeRealloc(_buf, _res, s))
+            {
+                _buf = p;
+                _res = s;
+                return;
+            }
+        }
+
         // dangerous: It's up to the user to be sure that _allocfunc and _delfunc are matching
-        uint8 *newbuf = (uint8*)(_allocfunc ? _allocfunc(s) : new char[s]);
+        uint8 *newbuf = large ? LargeAlloc(s) : NULL;
+        const bool newLarge = newbuf != NULL;
+        if(!newbuf)
+        {
+            if(_allocator)
+                newbuf = (uint8*)_allocator->allocF(_allocator->opaque, s);
+            else
+                newbuf = (uint8*)(_allocfunc ? _allocfunc(s) : new char[s]);
+        }
         if(_buf)
         {
             memcpy(newbuf, _buf, _size);
@@ -393,19 +450,24 @@ protected:
         _buf = newbuf;
         _res = s;
         _mybuf = true;
+        _bufAllocator = _allocator;
+        _large = newLarge;
 
         if (!_allocfunc)
             _delfunc = NULL;
     }
 
-    void _enlargeIfReq(uint32 minSize)
+    // minSize is 64 bits wide, so that a position plus a size can't overflow unnoticed
+    void _enlargeIfReq(uint64 minSize)
     {
         if(_res < minSize)
         {
-            uint32 a = _res * 2;
+            if(minSize > 0xFFFFFFFF)
+                BYTEBUFFER_EXCEPT(this, "_enlarge+overflow", uint32(minSize - _res));
+            uint64 a = uint64(_res) * 2;
             if(a < minSize) // fallback if doubling the space was not enough
                 a += minSize;
-            _allocate(a);
+            _allocate(a > 0xFFFFFFFF ? 0xFFFFFFFF : uint32(a));
         }
     }
 
@@ -0,0 +1,61 @@
+#include "LVPAInternal.h"
+#include "CPUFeatures.h"
+
+#ifdef LVPA_X86_SIMD
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+
+LVPA_NAMESPACE_START
+
+#ifdef LVPA_X86_SIMD
+static void cpuid(uint32 leaf, uint32 *regs, uint32 subleaf = 0) // eax, ebx, ecx, edx
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, int(leaf), int(subleaf));
+    for(uint32 i = 0; i < 4; ++i)
+        regs[i] = uint32(r[i]);
+#else
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+    regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+}
+#endif
+
+static CPUFeatures detect(void)
+{
+    CPUFeatures f;
+    memset(&f, 0, sizeof(f));
+#ifdef LVPA_X86_SIMD
+    uint32 r[4];
+    cpuid(0, r);
+    const uint32 maxLeaf = r[0];
+    if(maxLeaf >= 1)
+    {
+        cpuid(1, r);
+        f.sse2   = !!(r[3] & (1 << 26));
+        f.ssse3  = !!(r[2] & (1 << 9));
+        f.sse41  = !!(r[2] & (1 << 19));
+        f.pclmul = !!(r[2] & (1 << 1));
+    }
+    if(maxLeaf >= 7)
+    {
+        cpuid(7, r, 0);
+        f.sha    = !!(r[1] & (1 << 29));
+    }
+#endif
+    return f;
+}
+
+const CPUFeatures& GetCPUFeatures(void)
+{
+    static const CPUFeatures f = detect(); // if two threads get here at once, both write the same values
+    return f;
+}
+
+LVPA_NAMESPACE_END
@@ -0,0 +1,37 @@
+#ifndef _CPUFEATURES_H
+#define _CPUFEATURES_H
+
+#include "LVPACommon.h"
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64) || defined(_M_AMD64)
+#  define LVPA_ARCH_X86 1
+#endif
+
+// x86 SIMD code is compiled for a specific instruction set per function, and used only if the CPU supports it.
+// MSVC allows the intrinsics anywhere, GCC and clang need the target attribute.
+#if defined(LVPA_ARCH_X86) && (defined(_MSC_VER) || defined(__GNUC__))
+#  define LVPA_X86_SIMD 1
+#  ifdef _MSC_VER
+#    define LVPA_TARGET(x)
+#  else
+#    define LVPA_TARGET(x) __attribute__((target(x)))
+#  endif
+#endif
+
+LVPA_NAMESPACE_START
+
+// Instruction set extensions that the CPU supports (detected once, via CPUID). All false on non-x86 platforms.
+struct CPUFeatures
+{
+    bool sse2;
+    bool ssse3;
+    bool sse41;
+    bool pclmul;
+    bool sha; // SHA-1/SHA-256 extensions (SHA-NI)
+};
+
+const CPUFeatures& GetCPUFeatures(void);
+
+LVPA_NAMESPACE_END
+
+#endif
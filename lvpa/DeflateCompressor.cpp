@@ -13,10 +13,20 @@
 
 LVPA_NAMESPACE_START
 
+struct DeflateStreamState
+{
+    z_stream stream;
+};
+
 DeflateCompressor::DeflateCompressor()
 :   _windowBits(-MAX_WBITS), // negative, because we want a raw deflate stream, and not zlib-wrapped
-    _forceCompress(false)
+    _inflate(NULL)
+{
+}
+
+DeflateCompressor::~DeflateCompressor()
 {
+    DeflateCompressor::EndDecompress();
 }
 
 ZlibCompressor::ZlibCompressor()
@@ -34,7 +44,7 @@ GzipCompressor::GzipCompressor()
 
 // TODO: do compression block-wise, and call progress callback periodically
 void DeflateCompressor::compress(void* dst, uint32 *dst_size, const void* src, uint32 src_size,
-                                 uint8 level, int wbits, ProgressCallback pcb)
+                                 uint8 level, int wbits, ProgressCallback pcb, const uint8 *dict, uint32 dictSize)
 {
     z_stream c_stream;
 
@@ -49,6 +59,15 @@ void DeflateCompressor::compress(void* dst, uint32 *dst_size, const void* src, u
         return;
     }
 
+    // raw and zlib streams only; zlib uses at most the last 32 KB of the dictionary
+    if (dict && Z_OK != deflateSetDictionary(&c_stream, (const Bytef*)dict, dictSize))
+    {
+        logerror("ZLIB: Can't compress (zlib: deflateSetDictionary)");
+        deflateEnd(&c_stream);
+        *dst_size = 0;
+        return;
+    }
+
     c_stream.next_out = (Bytef*)dst;
     c_stream.avail_out = *dst_size;
     c_stream.next_in = (Bytef*)src;
@@ -85,7 +104,8 @@ void DeflateCompressor::compress(void* dst, uint32 *dst_size, const void* src, u
     *dst_size = c_stream.total_out;
 }
 
-void DeflateCompressor::decompress(void *dst, uint32 *origsize, const void *src, uint32 size, int wbits)
+void DeflateCompressor::decompress(void *dst, uint32 *origsize, const void *src, uint32 size, int wbits,
+                                   const uint8 *dict, uint32 dictSize)
 {
     z_stream stream;
     int err;
@@ -106,7 +126,20 @@ void DeflateCompressor::decompress(void *dst, uint32 *origsize, const void *src,
         return;
     }
 
-    err = inflate(&stream, Z_FINISH);
+    // a raw stream needs the dictionary up front, a zlib stream asks for it
+    if (dict && wbits < 0)
+        err = inflateSetDictionary(&stream, (const Bytef*)dict, dictSize);
+
+    if (err == Z_OK)
+        err = inflate(&stream, Z_FINISH);
+
+    if (err == Z_NEED_DICT && dict)
+    {
+        err = inflateSetDictionary(&stream, (const Bytef*)dict, dictSize);
+        if (err == Z_OK)
+            err = inflate(&stream, Z_FINISH);
+    }
+
     if (err != Z_STREAM_END)
     {
         inflateEnd(&stream);
@@ -121,60 +154,96 @@ void DeflateCompressor::decompress(void *dst, uint32 *origsize, const void *src,
 }
 
 
-void DeflateCompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
+bool DeflateCompressor::SupportsDictionary(void) const
 {
-    if(!_forceCompress && (!level || _iscompressed || (!size())))
-        return;
+    return _windowBits <= MAX_WBITS; // not with a gzip header
+}
 
-    char *buf;
-    
+uint32 DeflateCompressor::CompressBound(uint32 srcLen) const
+{
+    return compressBound(srcLen) + 30; // for optional gzip header
+}
 
-    uint32 oldsize = size();
-    uint32 newsize = compressBound(oldsize) + 30; // for optional gzip header
+uint32 DeflateCompressor::CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb /* = NULL */)
+{
+    if(!_forceCompress && !level)
+        return 0;
 
-    buf = new char[newsize];
+    uint32 newsize = dstCap;
+    compress((void*)dst, &newsize, (const void*)src, srcLen, level, _windowBits, pcb, _dict, _dictSize);
+    return newsize;
+}
 
-    compress((void*)buf, &newsize, (void*)contents(), oldsize, level, _windowBits, pcb);
-    if(!newsize || (!_forceCompress && newsize > oldsize)) // only allow more data if compression is forced (which is the case for gzip)
+bool DeflateCompressor::DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    uint32 origsize = dstLen;
+    decompress((void*)dst, &origsize, (const void*)src, srcLen, _windowBits, _dict, _dictSize);
+    if(origsize != dstLen)
     {
-        delete [] buf;
-        return;
+        logerror("DeflateCompressor: Inflate error! cursize=%u origsize=%u realsize=%u", srcLen, origsize, dstLen);
+        return false;
     }
+    return true;
+}
 
-    resize(newsize);
-    rpos(0);
-    wpos(0);
-    append(buf,newsize);
-    delete [] buf;
-
-    _iscompressed = true;
+bool DeflateCompressor::BeginDecompress(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    EndDecompress();
+    DeflateStreamState *st = new DeflateStreamState;
+    z_stream& stream = st->stream;
+    memset(&stream, 0, sizeof(stream)); // Z_NULL allocators
+    stream.next_in = (Bytef*)src;
+    stream.avail_in = (uInt)srcLen;
 
-    _real_size = oldsize;
+    int err = inflateInit2(&stream, _windowBits);
+    if (err == Z_OK && _dict && _windowBits < 0) // see decompress()
+    {
+        err = inflateSetDictionary(&stream, (const Bytef*)_dict, _dictSize);
+        if (err != Z_OK)
+            inflateEnd(&stream);
+    }
+    if (err != Z_OK)
+    {
+        delete st;
+        return false;
+    }
+    _inflate = st;
+    return ICompressor::BeginDecompress(dst, dstLen, src, srcLen);
 }
 
-void DeflateCompressor::Decompress(void)
+bool DeflateCompressor::DecompressUntil(uint32 upTo)
 {
-    if( (!_iscompressed) || (!_real_size) || (!size()))
-        return;
-
-    uint32 rs = (uint32)_real_size;
-    uint32 origsize = rs;
-    uint8 *target = new uint8[rs];
-    wpos(0);
-    rpos(0);
-    decompress((void*)target, &origsize, (const void*)contents(), size(), _windowBits);
-    if(origsize != rs)
+    if(!_inflate)
+        return false;
+    if(upTo > _streamDstLen)
+        upTo = _streamDstLen;
+    if(_streamDone >= upTo)
+        return true;
+
+    z_stream& stream = _inflate->stream;
+    stream.next_out = (Bytef*)_streamDst + _streamDone;
+    stream.avail_out = upTo - _streamDone;
+
+    int err = inflate(&stream, Z_SYNC_FLUSH);
+    if (err == Z_NEED_DICT && _dict)
     {
-        logerror("DeflateCompressor: Inflate error! result=%d cursize=%u origsize=%u realsize=%u",size(),origsize,rs);
-        delete [] target;
-        return;
+        err = inflateSetDictionary(&stream, (const Bytef*)_dict, _dictSize);
+        if (err == Z_OK)
+            err = inflate(&stream, Z_SYNC_FLUSH);
     }
-    clear();
-    append(target, origsize);
-    delete [] target;
-    _real_size = 0;
-    _iscompressed = false;
+    _streamDone = uint32(stream.next_out - (Bytef*)_streamDst);
+    return (err == Z_OK || err == Z_STREAM_END) && _streamDone >= upTo;
+}
 
+void DeflateCompressor::EndDecompress(void)
+{
+    if(_inflate)
+    {
+        inflateEnd(&_inflate->stream);
+        delete _inflate;
+        _inflate = NULL;
+    }
+    ICompressor::EndDecompress();
 }
 
 void GzipCompressor::Decompress(void)
@@ -7,23 +7,31 @@
 
 LVPA_NAMESPACE_START
 
+struct DeflateStreamState;
+
 // implements a raw deflate stream, not zlib wrapped, and not checksummed.
 class DeflateCompressor : public ICompressor
 {
 public:
     DeflateCompressor();
-    virtual ~DeflateCompressor() {}
-    virtual void Compress(uint8 level = 1, ProgressCallback pcb = NULL);
-    virtual void Decompress(void);
+    virtual ~DeflateCompressor();
+    virtual uint32 CompressBound(uint32 srcLen) const;
+    virtual uint32 CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb = NULL);
+    virtual bool DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+    virtual bool BeginDecompress(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+    virtual bool DecompressUntil(uint32 upTo);
+    virtual void EndDecompress(void);
+    virtual bool SupportsDictionary(void) const;
 
 protected:
     int _windowBits; // read zlib docs to know what this means
-    bool _forceCompress;
+    DeflateStreamState *_inflate; // while unpacking incrementally
 
 private:
-    static void decompress(void *dst, uint32 *origsize, const void *src, uint32 size, int wbits);
+    static void decompress(void *dst, uint32 *origsize, const void *src, uint32 size, int wbits,
+        const uint8 *dict, uint32 dictSize);
     static void compress(void* dst, uint32 *dst_size, const void* src, uint32 src_size,
-        uint8 level, int wbits, ProgressCallback pcb);
+        uint8 level, int wbits, ProgressCallback pcb, const uint8 *dict, uint32 dictSize);
 };
 
 // implements deflate stream, zlib wrapped
@@ -0,0 +1,100 @@
+#include "LVPAInternal.h"
+#include "ICompressor.h"
+
+LVPA_NAMESPACE_START
+
+
+void ICompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
+{
+    if(_iscompressed || (!size() && !_forceCompress))
+        return;
+
+    uint32 oldsize = size();
+    uint32 bound = CompressBound(oldsize);
+    if(!bound)
+        return;
+
+    ByteBuffer out;
+    out.allocator(allocator());
+    out.reserve(bound);
+    uint32 newsize = CompressTo(out.contents(), bound, contents(), oldsize, level, pcb);
+    if(!newsize || (!_forceCompress && newsize >= oldsize)) // only allow more data if compression is forced (which is the case for gzip)
+        return;
+
+    out.resize(newsize);
+    swap(out); // the old buffer is deleted along with out
+
+    _iscompressed = true;
+    _real_size = oldsize;
+}
+
+void ICompressor::Decompress(void)
+{
+    if( (!_iscompressed) || (!_real_size) || (!size()))
+        return;
+
+    ByteBuffer out;
+    out.allocator(allocator());
+    out.reserve(_real_size);
+    if(!DecompressTo(out.contents(), _real_size, contents(), size()))
+        return;
+
+    out.resize(_real_size);
+    swap(out);
+
+    _real_size = 0;
+    _iscompressed = false;
+}
+
+void ICompressor::CompressFrom(const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb /* = NULL */)
+{
+    DEBUG(ASSERT(!_iscompressed && !size()));
+
+    if(srcLen || _forceCompress)
+    {
+        if(uint32 bound = CompressBound(srcLen))
+        {
+            reserve(bound);
+            uint32 newsize = CompressTo(contents(), bound, src, srcLen, level, pcb);
+            if(newsize && (_forceCompress || newsize < srcLen))
+            {
+                resize(newsize);
+                _iscompressed = true;
+                _real_size = srcLen;
+                return;
+            }
+        }
+    }
+
+    // incompressible, keep a plain copy (the memory reserved above is reused)
+    append(src, srcLen);
+}
+
+bool ICompressor::BeginDecompress(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    _streamDst = dst;
+    _streamDstLen = dstLen;
+    _streamSrc = src;
+    _streamSrcLen = srcLen;
+    _streamDone = 0;
+    return true;
+}
+
+bool ICompressor::DecompressUntil(uint32 upTo)
+{
+    if(_streamDone >= upTo || _streamDone == _streamDstLen)
+        return true;
+    if(!DecompressTo(_streamDst, _streamDstLen, _streamSrc, _streamSrcLen))
+        return false;
+    _streamDone = _streamDstLen;
+    return true;
+}
+
+void ICompressor::EndDecompress(void)
+{
+    _streamDst = NULL;
+    _streamSrc = NULL;
+    _streamDstLen = _streamSrcLen = _streamDone = 0;
+}
+
+LVPA_NAMESPACE_END
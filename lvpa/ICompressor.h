@@ -1,4 +1,3 @@
-
 #ifndef LVPA_ICOMPRESSOR_H
 #define LVPA_ICOMPRESSOR_H
 
@@ -12,16 +11,49 @@ class ICompressor : public ByteBuffer
 public:
     typedef int (*ProgressCallback)(void *, uint64 , uint64);
 
-    ICompressor(): _iscompressed(false), _real_size(0) {}
+    ICompressor(): _iscompressed(false), _forceCompress(false), _real_size(0), _threads(0), _dict(NULL), _dictSize(0),
+        _streamDst(NULL), _streamDstLen(0), _streamSrc(NULL), _streamSrcLen(0), _streamDone(0) {}
     virtual ~ICompressor() {}
-    virtual void Compress(uint8 level = 1, ProgressCallback pcb = NULL) {}
-    virtual void Decompress(void) {}
+
+    // In-place interface: compresses/decompresses the buffer contents.
+    // Both are implemented on top of the span interface below, and swap in the result buffer instead of copying it back.
+    virtual void Compress(uint8 level = 1, ProgressCallback pcb = NULL);
+    virtual void Decompress(void);
+
+    // Like Compress(), but reads the data from external memory, so they do not have to be copied into this buffer first.
+    // If the data can not be compressed, they are appended uncompressed (just like Compress() would leave them).
+    void CompressFrom(const uint8 *src, uint32 srcLen, uint8 level = 1, ProgressCallback pcb = NULL);
+
+    // Span interface, to be implemented by each algorithm. The buffer contents are not touched.
+    // Max. number of bytes CompressTo() may write for an input of srcLen bytes.
+    virtual uint32 CompressBound(uint32 srcLen) const { return 0; }
+    // Returns the number of bytes written to dst, or 0 if compression failed or dstCap was too small.
+    virtual uint32 CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb = NULL) { return 0; }
+    // dstLen must be the exact unpacked size. Returns true if exactly dstLen bytes were written.
+    virtual bool DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen) { return false; }
+
+    // Incremental interface, for when only the beginning of the data is needed right away.
+    // BeginDecompress() prepares unpacking src into dst (dstLen is the exact unpacked size), both must stay valid until EndDecompress().
+    // DecompressUntil() continues until at least upTo bytes (or all) are unpacked, and returns false on error.
+    // The default implementation unpacks everything at once via DecompressTo().
+    virtual bool BeginDecompress(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+    virtual bool DecompressUntil(uint32 upTo);
+    virtual void EndDecompress(void);
+    uint32 DecompressedSize(void) const { return _streamDone; } // bytes at the start of dst that are final
 
 
     bool Compressed(void) const { return _iscompressed; }
     void Compressed(bool b) { _iscompressed = b; }
     uint32 RealSize(void) const { return _iscompressed ? _real_size : size(); }
     void RealSize(uint32 realsize) { _real_size = realsize; }
+    uint32 Threads(void) const { return _threads; }
+    void Threads(uint32 t) { _threads = t; } // max. worker threads, 0 = one per CPU; ignored by single-threaded algorithms
+
+    // Preset dictionary, used for compression and decompression if SupportsDictionary() is true.
+    // The memory is not copied and must stay valid while the compressor is used. Data compressed
+    // with a dictionary can only be decompressed with the same dictionary.
+    void SetDictionary(const uint8 *dict, uint32 size) { _dict = dict; _dictSize = size; }
+    virtual bool SupportsDictionary(void) const { return false; }
     void clear(void) // not required to be strictly virtual; be careful not to mess up static types!
     {
         ByteBuffer::clear();
@@ -31,7 +63,18 @@ public:
 
 protected:
     bool _iscompressed;
+    bool _forceCompress; // keep the compressed data even if they are larger than the input
     uint32 _real_size;
+    uint32 _threads;
+    const uint8 *_dict;
+    uint32 _dictSize;
+
+    // see BeginDecompress()
+    uint8 *_streamDst;
+    uint32 _streamDstLen;
+    const uint8 *_streamSrc;
+    uint32 _streamSrcLen;
+    uint32 _streamDone;
 };
 
 LVPA_NAMESPACE_END
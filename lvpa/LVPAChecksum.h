@@ -0,0 +1,51 @@
+#ifndef LVPACHECKSUM_H
+#define LVPACHECKSUM_H
+
+#include "LVPAFile.h"
+#include "MyCrc32.h"
+#include "XXHash64.h"
+
+LVPA_NAMESPACE_START
+
+// Checksum of one of the LVPAChecksums types, for data of files, and headers.
+// CRC32 results are extended to 64 bits, so that all types can be handled alike.
+class LVPAChecksum
+{
+public:
+    LVPAChecksum(uint8 type) : _type(type) {}
+
+    void Update(const void *buf, uint32 size)
+    {
+        if(_type == LVPACHECK_XXH64)
+            _xxh.Update(buf, size);
+        else
+            _crc.Update(buf, size);
+    }
+
+    uint64 Finalize(void)
+    {
+        if(_type == LVPACHECK_XXH64)
+        {
+            _xxh.Finalize();
+            return _xxh.Result();
+        }
+        _crc.Finalize();
+        return _crc.Result();
+    }
+
+    inline static uint64 Calc(uint8 type, const void *buf, uint32 size)
+    {
+        if(type == LVPACHECK_XXH64)
+            return XXHash64::Calc(buf, size);
+        return CRC32::Calc(buf, size);
+    }
+
+private:
+    uint8 _type;
+    CRC32 _crc;
+    XXHash64 _xxh;
+};
+
+LVPA_NAMESPACE_END
+
+#endif
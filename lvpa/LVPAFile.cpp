@@ -3,18 +3,24 @@
 #include "LVPATools.h"
 
 #include <memory>
-#include <set>
+#include <algorithm>
+#include <deque>
 
 #include "MersenneTwister.h"
-#include "MyCrc32.h"
+#include "LVPAChecksum.h"
+#include "XXHash64.h"
 #include "LVPAStreamCipher.h"
 #include "SHA256Hash.h"
 #include "ProgressBar.h"
+#include "LVPAFilters.h"
+#include "LVPAThreading.h"
+#include "LVPAMemory.h"
 
 #include "ICompressor.h"
 
 #ifdef LVPA_SUPPORT_LZMA
 #  include "LZMACompressor.h"
+#  include "LZMAMTCompressor.h"
 #endif
 #ifdef LVPA_SUPPORT_LZO
 #  include "LZOCompressor.h"
@@ -28,6 +34,12 @@
 #ifdef LVPA_SUPPORT_LZHAM
 #  include "LZHAMCompressor.h"
 #endif
+#ifdef LVPA_SUPPORT_ZSTD
+#  include "ZstdCompressor.h"
+#endif
+#ifdef LVPA_SUPPORT_LZ4
+#  include "LZ4Compressor.h"
+#endif
 
 LVPA_NAMESPACE_START
 
@@ -38,6 +50,13 @@ static ProgressBar *gProgress = NULL;
 static const char* gMagic = LVPA_MAGIC;
 static const uint32 gVersion = LVPA_VERSION;
 
+// a dictionary is only trained if at least this many files can use it
+#define LVPA_DICT_MIN_FILES 8
+
+// files are read, decrypted and checksummed in pieces of this size, so that each piece stays in the L1/L2 cache.
+// must be a multiple of 4, the cipher works on uint32 blocks.
+#define LVPA_CRYPT_TILE_SIZE (32 * 1024)
+
 
 static bool default_open(const char *fn, void *opaque)
 {
@@ -101,6 +120,10 @@ static ICompressor *allocCompressor(uint8 algo)
         case LVPAPACK_LZF:
             return new LZFCompressor;
 #endif
+#ifdef LVPA_SUPPORT_LZ4
+        case LVPAPACK_LZ4:
+            return new LZ4Compressor;
+#endif
 #ifdef LVPA_SUPPORT_LZO
         case LVPAPACK_LZO1X:
             return new LZOCompressor;
@@ -109,9 +132,15 @@ static ICompressor *allocCompressor(uint8 algo)
         case LVPAPACK_DEFLATE:
             return new DeflateCompressor;
 #endif
+#ifdef LVPA_SUPPORT_ZSTD
+        case LVPAPACK_ZSTD:
+            return new ZstdCompressor;
+#endif
 #ifdef LVPA_SUPPORT_LZMA
         case LVPAPACK_LZMA:
             return new LZMACompressor;
+        case LVPAPACK_LZMAMT:
+            return new LZMAMTCompressor;
 #endif
 #ifdef LVPA_SUPPORT_LZHAM
         case LVPAPACK_LZHAM:
@@ -156,11 +185,26 @@ ByteBuffer &operator << (ByteBuffer& bb, LVPAMasterHeader& hdr)
     return bb;
 }
 
-ByteBuffer &operator >> (ByteBuffer& bb, LVPAFileHeader& h)
+// checksumTypes: the archive has LVPAHDR_XXH64 set, each header stores the type of its checksums then.
+// Otherwise they are CRC32, stored in 32 bits, as always.
+// restartPoints: the archive has LVPAHDR_RESTARTS set, packed solid blocks store their restart points then.
+static void readFileHeader(ByteBuffer& bb, LVPAFileHeader& h, bool checksumTypes, bool restartPoints)
 {
+    uint32 crc32;
+
     bb >> h.flags;
+    h.checksum = LVPACHECK_CRC32;
+    if(checksumTypes)
+        bb >> h.checksum;
+    const bool wide = h.checksum != LVPACHECK_CRC32;
     bb >> h.realSize;
-    bb >> h.crcReal;
+    if(wide)
+        bb >> h.crcReal;
+    else
+    {
+        bb >> crc32;
+        h.crcReal = crc32;
+    }
 
     if(h.flags & LVPAFLAG_SCRAMBLED)
         bb.read(h.hash, LVPAHash_Size);
@@ -170,7 +214,13 @@ ByteBuffer &operator >> (ByteBuffer& bb, LVPAFileHeader& h)
     if(h.flags & LVPAFLAG_PACKED)
     {
         bb >> h.packedSize;
-        bb >> h.crcPacked;
+        if(wide)
+            bb >> h.crcPacked;
+        else
+        {
+            bb >> crc32;
+            h.crcPacked = crc32;
+        }
         bb >> h.algo;
         bb >> h.level;
     }
@@ -182,7 +232,18 @@ ByteBuffer &operator >> (ByteBuffer& bb, LVPAFileHeader& h)
         h.level = LVPACOMP_NONE;
     }
 
-    if(h.flags & LVPAFLAG_SOLID)
+    if(h.flags & LVPAFLAG_FILTERED)
+    {
+        bb >> h.filter;
+        bb >> h.filterParam;
+    }
+    else
+    {
+        h.filter = LVPAFILTER_NONE;
+        h.filterParam = 0;
+    }
+
+    if(h.flags & (LVPAFLAG_SOLID | LVPAFLAG_DICTREF))
     {
         bb >> h.blockId;
     }
@@ -191,23 +252,56 @@ ByteBuffer &operator >> (ByteBuffer& bb, LVPAFileHeader& h)
         h.blockId = 0;
     }
 
+    h.cipher = LVPAENCR_ENABLED;
     if(h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED))
     {
         bb >> h.cipherWarmup;
+        if(h.cipherWarmup & LVPA_CIPHER_EXTENDED)
+        {
+            h.cipherWarmup &= ~LVPA_CIPHER_EXTENDED;
+            bb >> h.cipher;
+            bb.read(h.cipherNonce, LVPA_CIPHER_NONCE_SIZE);
+        }
     }
     else
     {
         h.cipherWarmup = 0;
     }
 
-    return bb;
+    h.restarts.clear();
+    if(restartPoints && (h.flags & LVPAFLAG_SOLIDBLOCK) && (h.flags & LVPAFLAG_PACKED))
+    {
+        uint32 count;
+        bb >> count;
+        if(count > (bb.size() - bb.rpos()) / (2 * sizeof(uint32)))
+        {
+            // can't be, leave one that the check after loading rejects
+            h.restarts.assign(1, LVPARestartPoint());
+            h.restarts[0].unpackedOffs = h.restarts[0].packedOffs = 0;
+            return;
+        }
+        h.restarts.resize(count);
+        for(uint32 i = 0; i < count; ++i)
+        {
+            bb >> h.restarts[i].unpackedOffs;
+            bb >> h.restarts[i].packedOffs;
+        }
+    }
 }
 
-ByteBuffer &operator << (ByteBuffer& bb, LVPAFileHeader& h)
+static void writeFileHeader(ByteBuffer& bb, const LVPAFileHeader& h, bool checksumTypes, bool restartPoints)
 {
+    DEBUG(ASSERT(checksumTypes || h.checksum == LVPACHECK_CRC32));
+    const bool wide = h.checksum != LVPACHECK_CRC32;
+
     bb << h.flags;
+    if(checksumTypes)
+        bb << h.checksum;
     bb << h.realSize;
-    bb << h.crcReal;
+    if(wide)
+        bb << h.crcReal;
+    else
+        bb << uint32(h.crcReal);
 
     if(h.flags & LVPAFLAG_SCRAMBLED)
         bb.append(h.hash, LVPAHash_Size);
@@ -217,25 +311,282 @@ ByteBuffer &operator << (ByteBuffer& bb, LVPAFileHeader& h)
     if(h.flags & LVPAFLAG_PACKED)
     {
         bb << h.packedSize;
-        bb << h.crcPacked;
+        if(wide)
+            bb << h.crcPacked;
+        else
+            bb << uint32(h.crcPacked);
         bb << h.algo;
         bb << h.level;
     }
 
-    if(h.flags & LVPAFLAG_SOLID)
+    if(h.flags & LVPAFLAG_FILTERED)
+    {
+        bb << h.filter;
+        bb << h.filterParam;
+    }
+
+    if(h.flags & (LVPAFLAG_SOLID | LVPAFLAG_DICTREF))
     {
         bb << h.blockId;
     }
 
     if(h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED))
-        bb << h.cipherWarmup;
+    {
+        if(h.cipher == LVPAENCR_ENABLED)
+            bb << h.cipherWarmup;
+        else
+        {
+            bb << uint16(h.cipherWarmup | LVPA_CIPHER_EXTENDED);
+            bb << h.cipher;
+            bb.append(h.cipherNonce, LVPA_CIPHER_NONCE_SIZE);
+        }
+    }
 
-    return bb;
+    DEBUG(ASSERT(restartPoints || h.restarts.empty()));
+    if(restartPoints && (h.flags & LVPAFLAG_SOLIDBLOCK) && (h.flags & LVPAFLAG_PACKED))
+    {
+        bb << uint32(h.restarts.size());
+        for(uint32 i = 0; i < h.restarts.size(); ++i)
+        {
+            bb << h.restarts[i].unpackedOffs;
+            bb << h.restarts[i].packedOffs;
+        }
+    }
+}
+
+// true if the restart points of a solid block split it into proper segments
+static bool checkRestartPoints(const LVPAFileHeader& h)
+{
+    uint32 u = 0, p = 0;
+    for(uint32 i = 0; i < h.restarts.size(); ++i)
+    {
+        const LVPARestartPoint& rp = h.restarts[i];
+        if(rp.unpackedOffs <= u || rp.packedOffs <= p || rp.unpackedOffs >= h.realSize || rp.packedOffs >= h.packedSize)
+            return false;
+        u = rp.unpackedOffs;
+        p = rp.packedOffs;
+    }
+    return true;
+}
+
+// a solid block that is not yet unpacked completely, see LVPAFile::_ContinueUnpack()
+struct LVPAPartialBlock
+{
+    LVPAPartialBlock(ICompressor *c, uint8 *d) : comp(c), dst(d), unpacked(0) {}
+    ~LVPAPartialBlock() { delete comp; }
+
+    ICompressor *comp; // holds the packed data, and the decompressor state if the block has no restart points
+    uint8 *dst; // the block's memory
+    std::vector<bool> segDone; // with restart points: for each segment, whether it is unpacked already
+    uint32 unpacked; // bytes
+};
+
+static bool restartAfter(uint32 offs, const LVPARestartPoint& rp)
+{
+    return offs < rp.unpackedOffs;
+}
+
+// index of the segment that holds the unpacked offset offs
+static uint32 findSegment(const LVPAFileHeader& h, uint32 offs)
+{
+    return uint32(std::upper_bound(h.restarts.begin(), h.restarts.end(), offs, restartAfter) - h.restarts.begin());
+}
+
+// unpacks segment s of a solid block with restart points from the packed data in src into the block's memory at dst
+static bool unpackSegment(ICompressor *comp, const LVPAFileHeader& h, uint32 s, uint8 *dst, const uint8 *src)
+{
+    const bool last = s == h.restarts.size();
+    const uint32 u = s ? h.restarts[s - 1].unpackedOffs : 0;
+    const uint32 p = s ? h.restarts[s - 1].packedOffs : 0;
+    const uint32 len = (last ? h.realSize : h.restarts[s].unpackedOffs) - u;
+    const uint32 packedLen = (last ? h.packedSize : h.restarts[s].packedOffs) - p;
+
+    if(packedLen == len) // stored as is
+    {
+        memcpy(dst + u, src + p, len);
+        return true;
+    }
+    if(!comp->DecompressTo(dst + u, len, src + p, packedLen))
+        return false;
+    if(h.flags & LVPAFLAG_FILTERED)
+        FilterDecode(h.filter, h.filterParam, dst + u, len); // was checked on load
+    return true;
+}
+
+// unpacks (and unfilters) all of a packed file or solid block
+static bool unpackAll(ICompressor *comp, const LVPAFileHeader& h, uint8 *dst, const uint8 *src)
+{
+    if(!h.restarts.empty())
+    {
+        for(uint32 s = 0; s <= h.restarts.size(); ++s)
+            if(!unpackSegment(comp, h, s, dst, src))
+                return false;
+        return true;
+    }
+    if(!comp->DecompressTo(dst, h.realSize, src, h.packedSize))
+        return false;
+    if(h.flags & LVPAFLAG_FILTERED)
+        FilterDecode(h.filter, h.filterParam, dst, h.realSize); // was checked on load
+    return true;
+}
+
+// LVPAChecksum::Calc(), with the time counted in st
+static uint64 timedChecksum(LVPAStats& st, uint8 type, const uint8 *ptr, uint32 size)
+{
+    const uint64 t = GetTimeNanos();
+    const uint64 crc = LVPAChecksum::Calc(type, ptr, size);
+    AtomicAdd(&st.crcNanos, GetTimeNanos() - t);
+    return crc;
+}
+
+// Packs a solid block as independent segments starting at the given offsets, each filtered on its own (see LVPARestartPoint).
+// Stores the restart points and sets LVPAFLAG_FILTERED in h if the block got smaller, otherwise the block is left alone.
+static void compressSegments(ICompressor *block, LVPAFileHeader& h, const std::vector<uint32>& starts, const LVPAAllocator *alloc)
+{
+    const uint32 total = block->size();
+    ByteBuffer out, filtered;
+    out.allocator(alloc);
+    filtered.allocator(alloc);
+    std::vector<LVPARestartPoint> restarts(starts.size());
+    bool anyFiltered = false;
+
+    for(uint32 s = 0; s <= starts.size(); ++s)
+    {
+        const uint32 u = s ? starts[s - 1] : 0;
+        const uint32 len = (s < starts.size() ? starts[s] : total) - u;
+        const uint8 *src = block->contents() + u;
+        const uint32 pos = out.size();
+        if(s)
+        {
+            restarts[s - 1].unpackedOffs = u;
+            restarts[s - 1].packedOffs = pos;
+        }
+
+        const uint8 *in = src;
+        if(h.filter != LVPAFILTER_NONE)
+        {
+            filtered.resize(len);
+            FilterEncode(h.filter, h.filterParam, filtered.contents(), src, len);
+            in = filtered.contents();
+        }
+
+        uint32 packed = 0;
+        if(uint32 bound = block->CompressBound(len))
+        {
+            out.resize(pos + bound);
+            packed = block->CompressTo(out.contents() + pos, bound, in, len, h.level, drawCompressProgressBar);
+        }
+        if(packed && packed < len)
+        {
+            out.resize(pos + packed);
+            anyFiltered = anyFiltered || in != src;
+        }
+        else // stored as is, see unpackSegment()
+        {
+            out.resize(pos);
+            out.append(src, len);
+        }
+
+        if(out.size() >= total)
+            return;
+    }
+
+    block->swap(out);
+    block->Compressed(true);
+    block->RealSize(total);
+    h.restarts.swap(restarts);
+    if(anyFiltered)
+        h.flags |= LVPAFLAG_FILTERED;
 }
 
+// unpacked data of a file, to be checked by the verify thread
+struct LVPAVerifyJob
+{
+    uint32 id;
+    const uint8 *ptr;
+    uint32 size;
+    uint64 expected;
+    uint64 result;
+    uint8 checksum;
+    std::string filename;
+};
+
+struct LVPAVerifyState
+{
+    LVPAVerifyState() : running(false), cb(NULL), user(NULL), owner(NULL) {}
+
+    Mutex mtx;
+    Thread thread;
+    std::deque<LVPAVerifyJob> todo; // protected by mtx
+    std::vector<LVPAVerifyJob> done; // protected by mtx
+    bool running; // protected by mtx; the thread exits as soon as todo is empty
+    LVPAVerifyCallback cb;
+    void *user;
+    LVPAFile *owner;
+};
+
+
+#ifdef LVPA_SUPPORT_TRACING
+
+// Reports the beginning of a stage right away, and its end when going out of scope. Does nothing if cb is NULL.
+class LVPATraceScope
+{
+public:
+    LVPATraceScope(LVPAFile *lvpa, LVPATraceCallback cb, void *user, uint8 stage, const LVPAFileHeader& h, uint64 bytesIn)
+        : _lvpa(lvpa), _cb(cb), _user(user), _h(h)
+    {
+        if(!cb)
+            return;
+        _ev.id = h.id;
+        _ev.bytesIn = bytesIn;
+        _ev.bytesOut = 0;
+        _ev.stage = stage;
+        _Fire(true);
+    }
+    ~LVPATraceScope()
+    {
+        if(_cb)
+            _Fire(false);
+    }
+    inline void Out(uint64 bytes) { _ev.bytesOut = bytes; }
+
+private:
+    LVPATraceScope& operator=(const LVPATraceScope&);
+    void _Fire(bool begin)
+    {
+        // the flags may have changed meanwhile, when saving
+        _ev.time = GetTimeNanos();
+        _ev.filename = _h.filename.c_str();
+        _ev.begin = begin;
+        _ev.algo = (_h.flags & LVPAFLAG_PACKED) || _ev.stage == LVPATRACE_COMPRESS ? _h.algo : uint8(LVPAPACK_NONE);
+        _ev.cipher = (_h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED)) ? _h.cipher : uint8(LVPAENCR_NONE);
+        _cb(_lvpa, _ev, _user);
+    }
+
+    LVPAFile *_lvpa;
+    LVPATraceCallback _cb;
+    void *_user;
+    const LVPAFileHeader& _h;
+    LVPATraceEvent _ev;
+};
+
+// LVPA_TRACE_SCOPE_IF() reports the stage only if cond is true
+#  define LVPA_TRACE_SCOPE(var, stage, h, bytesIn) LVPATraceScope var(this, _traceCb, _traceUser, stage, h, bytesIn)
+#  define LVPA_TRACE_SCOPE_IF(var, cond, stage, h, bytesIn) LVPATraceScope var(this, (cond) ? _traceCb : NULL, _traceUser, stage, h, bytesIn)
+#  define LVPA_TRACE_OUT(var, bytes) var.Out(bytes)
+
+#else
+
+#  define LVPA_TRACE_SCOPE(var, stage, h, bytesIn)
+#  define LVPA_TRACE_SCOPE_IF(var, cond, stage, h, bytesIn)
+#  define LVPA_TRACE_OUT(var, bytes) ((void)0)
+
+#endif
 
 LVPAFile::LVPAFile()
-: _realSize(0), _packedSize(0)
+: _realSize(0), _packedSize(0), _threads(0), _dictSize(0), _dictMaxFileSize(LVPA_DICT_MAX_FILE_SIZE), _restartInterval(0),
+  _checksum(LVPACHECK_CRC32), _allocator(NULL), _verifyMode(LVPAVERIFY_SYNC), _verify(NULL), _fingerprint(0),
+  _cacheBudget(0), _cacheUsed(0), _cacheHead(-1), _cacheTail(-1), _traceCb(NULL), _traceUser(NULL), _masterCipher(NULL), _masterChaCha(NULL)
 {
     _mtrand = new MTRand;
     initDefaultFileReader(&reader);
@@ -244,14 +595,19 @@ LVPAFile::LVPAFile()
 LVPAFile::~LVPAFile()
 {
     delete _mtrand;
+    delete _masterCipher;
+    delete _masterChaCha;
     Clear();
+    delete _verify;
     _CloseFile();
 }
 
 void LVPAFile::Clear(bool del /* = true */)
 {
+    WaitVerify(); // the data are about to be deleted
     for(uint32 i = 0; i < _headers.size(); ++i)
     {
+        _UntrackResident(_headers[i]); // the headers are gone afterwards, whether the data are or not
         // never try to delete files that are part of a bigger allocated block
         if(_headers[i].data.ptr && !_headers[i].otherMem)
         {
@@ -259,14 +615,19 @@ void LVPAFile::Clear(bool del /* = true */)
             // from file, and it can never be constant
             if(del || (_headers[i].flags & LVPAFLAG_SOLIDBLOCK))
             {
-                delete [] _headers[i].data.ptr;
+                FreeBuffer(_headers[i].data);
                 _headers[i].data.ptr = NULL;
                 _headers[i].data.size = 0;
             }
         }
     }
+    for(std::map<uint32, LVPAPartialBlock*>::iterator it = _partial.begin(); it != _partial.end(); ++it)
+        delete it->second;
+    _partial.clear();
     _headers.clear();
     _indexes.clear();
+    _cacheUsed = 0;
+    _cacheHead = _cacheTail = -1;
 }
 
 bool LVPAFile::_OpenFile(void)
@@ -320,8 +681,16 @@ void LVPAFile::_MakeSolid(LVPAFileHeader& h, const char *solidBlockName)
     _headers[h.blockId].flags |= (h.flags & LVPAFLAG_ENCRYPTED);
 }
 
-uint32 LVPAFile::SetSolidBlock(const char *name, uint8 compression /* = LVPACOMP_INHERIT */, uint8 algo /* = LVPAPACK_INHERIT */)
+uint32 LVPAFile::SetSolidBlock(const char *name, uint8 compression /* = LVPACOMP_INHERIT */, uint8 algo /* = LVPAPACK_INHERIT */,
+                               uint8 filter /* = LVPAFILTER_NONE */, uint8 filterParam /* = 0 */)
 {
+    if(!IsValidFilter(filter, filterParam))
+    {
+        logerror("SetSolidBlock: invalid filter %u (param %u) for block '%s', not using it", uint32(filter), uint32(filterParam), name);
+        filter = LVPAFILTER_NONE;
+        filterParam = 0;
+    }
+
     std::string n(name);
     n += '*';
     uint32 id;
@@ -329,6 +698,8 @@ uint32 LVPAFile::SetSolidBlock(const char *name, uint8 compression /* = LVPACOMP
     {
         _headers[id].algo = algo;
         _headers[id].level = compression;
+        _headers[id].filter = filter;
+        _headers[id].filterParam = filterParam;
     }
     else // add new solid block
     {
@@ -337,6 +708,8 @@ uint32 LVPAFile::SetSolidBlock(const char *name, uint8 compression /* = LVPACOMP
         hdr.filename = n;
         hdr.algo = algo;
         hdr.level = compression;
+        hdr.filter = filter;
+        hdr.filterParam = filterParam;
         id = hdr.id = _headers.size();
         _headers.push_back(hdr);
         _indexes[n] = id; // save the index of the hdr we just added
@@ -348,14 +721,17 @@ void LVPAFile::Add(const char *fn, memblock mb, const char *solidBlockName /* =
                    uint8 algo /* = LVPAPACK_INHERIT */, uint8 level /* = LVPACOMP_INHERIT */,
                    uint8 encrypt /* = LVPAENCR_INHERIT */, bool scramble /* = false */)
 {
+    WaitVerify();
     uint32 id = -1;
     if(_FindHeaderByName(fn, &id))
     {
         // already exists, overwrite old with new info
         LVPAFileHeader& hdrRef = _headers[id];
+        _CacheUnlink(hdrRef);
+        _UntrackResident(hdrRef);
         if(hdrRef.data.ptr && hdrRef.data.ptr != mb.ptr)
         {
-            delete [] hdrRef.data.ptr;
+            FreeBuffer(hdrRef.data);
             hdrRef.otherMem = false;
             // will be overwritten anyways, not necessary here to set to null values
         }
@@ -379,20 +755,44 @@ void LVPAFile::Add(const char *fn, memblock mb, const char *solidBlockName /* =
     LVPAFileHeader& h = _headers[id];
 
     h.filename = fn;
+    h.cipherKeyFlags = 0;
     h.data = mb;
     h.flags = scramble ? LVPAFLAG_SCRAMBLED : LVPAFLAG_NONE;
     h.encryption = encrypt;
     h.algo = algo;
     h.level = level;
+    h.filter = LVPAFILTER_NONE;
+    h.filterParam = 0;
     _MakeSolid(h, solidBlockName); // this will also fix up flags a bit if necessary
 }
 
+bool LVPAFile::SetFilter(const char *fn, uint8 filter, uint8 param /* = 0 */)
+{
+    uint32 id;
+    if(!_FindHeaderByName(fn, &id) || !IsValidFilter(filter, param))
+        return false;
+
+    LVPAFileHeader& h = _headers[id];
+    if(h.flags & (LVPAFLAG_SOLID | LVPAFLAG_DICT))
+        return false;
+
+    h.filter = filter;
+    h.filterParam = param;
+    return true;
+}
+
 memblock LVPAFile::Remove(const char  *fn)
 {
+    WaitVerify(); // the caller gets the memory, and may do whatever with it
     uint32 id;
     memblock mb;
     if(_FindHeaderByName(fn, &id))
+    {
+        _CacheUnlink(_headers[id]); // the caller owns it now
+        _UntrackResident(_headers[id]);
+        _ContinueUnpack(_headers[id], 0, -1);
         mb = _headers[id].data; // copy ptr
+    }
 
     _headers[id].data = memblock(); // overwrite with empty
     _indexes.erase(fn); // remove entry
@@ -402,16 +802,20 @@ memblock LVPAFile::Remove(const char  *fn)
 
 bool LVPAFile::Delete(const char *fn)
 {
+    WaitVerify();
     uint32 id;
     if(_FindHeaderByName(fn, &id))
     {
+        _CacheUnlink(_headers[id]);
+        _UntrackResident(_headers[id]);
+        _DropPartial(_headers[id]);
         memblock mb = _headers[id].data;
         _headers[id].data = memblock(); // overwrite with empty
         _indexes.erase(fn); // remove entry
 
         if(mb.ptr && !_headers[id].otherMem)
         {
-            delete [] mb.ptr;
+            FreeBuffer(mb);
             return true;
         }
     }
@@ -423,151 +827,437 @@ memblock LVPAFile::Get(const char *fn, bool checkCRC /* = true */)
     uint32 id;
     memblock mb;
     if(_FindHeaderByName(fn, &id))
-        mb = _PrepareFile(_headers[id], checkCRC);
+        mb = Get(id, checkCRC);
     return mb;
 }
 
 memblock LVPAFile::Get(uint32 index, bool checkCRC /* = true */)
 {
-    return _PrepareFile(_headers[index], checkCRC);
+    if(_verify)
+        _ApplyVerifyResults();
+    LVPAFileHeader& h = _headers[index];
+    const bool inMemory = h.data.ptr || ((h.flags & LVPAFLAG_SOLID) && h.blockId < _headers.size() && _headers[h.blockId].data.ptr);
+    AtomicAdd(inMemory ? &_stats.cacheHits : &_stats.cacheMisses, 1);
+    memblock mb = _PrepareFile(h, checkCRC && _verifyMode != LVPAVERIFY_TRUSTED);
+    if(mb.ptr)
+    {
+        _Pin(h);
+        // the memory of files in a solid block belongs to the block
+        LVPAFileHeader *owner = (h.flags & LVPAFLAG_SOLID) ? &_headers[h.blockId] : &h;
+        if(owner->cached && _cacheHead != owner->id)
+        {
+            _CacheUnlink(*owner);
+            _CacheLink(*owner);
+        }
+        if(_cacheBudget && _cacheUsed > _cacheBudget)
+            _CacheTrim();
+    }
+    return mb;
 }
 
-bool LVPAFile::Free(const char *fn)
+void LVPAFile::Release(const char *fn)
 {
     uint32 id;
     if(_FindHeaderByName(fn, &id))
-        return Free(id);
-    return true; // file never existed, no problem
+        Release(id);
 }
 
-bool LVPAFile::Free(uint32 id)
+void LVPAFile::Release(uint32 id)
 {
-    LVPAFileHeader& hdrRef = _headers[id];
-    bool freed = false;
-    if(hdrRef.data.ptr && !hdrRef.otherMem)
+    LVPAFileHeader& h = _headers[id];
+    if(!h.pins)
     {
-        delete [] hdrRef.data.ptr;
-        freed = true;
+        DEBUG(logerror("Release(): '%s' is not in use", h.filename.c_str()));
+        return;
     }
+    _Unpin(h, 1);
+}
 
-    if(freed || !(hdrRef.flags & LVPAFLAG_SOLIDBLOCK))
-    {
-        hdrRef.data.ptr = NULL; // can be retrieved easily if needed later
-        hdrRef.data.size = 0;
-    }
+LVPAHandle LVPAFile::GetHandle(const char *fn, bool checkCRC /* = true */)
+{
+    uint32 id;
+    if(_FindHeaderByName(fn, &id))
+        return GetHandle(id, checkCRC);
+    return LVPAHandle();
+}
 
-    hdrRef.sparePtr = NULL; // now its definitely not used anymore.
-    return freed;
+LVPAHandle LVPAFile::GetHandle(uint32 index, bool checkCRC /* = true */)
+{
+    memblock mb = Get(index, checkCRC);
+    if(!mb.ptr)
+        return LVPAHandle();
+    return LVPAHandle(this, index, _headers[index].pinGen, mb); // takes over the pin from Get()
 }
 
-uint32 LVPAFile::FreeUnused(void)
+void LVPAFile::_Pin(LVPAFileHeader& h)
 {
-    uint32 freed = 0;
-    std::set<uint8*> ptrsInUse;
-    // first, collect all pointers from files inside a solid block
-    for(uint32 i = 0; i < HeaderCount(); ++i)
+    ++h.pins;
+    if(h.flags & LVPAFLAG_SOLID)
+        ++_headers[h.blockId].pins;
+}
+
+void LVPAFile::_Unpin(LVPAFileHeader& h, uint32 count, bool freeBlock)
+{
+    DEBUG(ASSERT(count <= h.pins));
+    h.pins -= count;
+    LVPAFileHeader *block = NULL;
+    if(h.flags & LVPAFLAG_SOLIDBLOCK)
+        block = &h;
+    else if((h.flags & LVPAFLAG_SOLID) && h.blockId < _headers.size())
     {
-        LVPAFileHeader& h = _headers[i];
-        if(h.flags & LVPAFLAG_SOLID)
-        {
-            // inserting NULL is not a problem
-            ptrsInUse.insert(_headers[i].data.ptr);
-            ptrsInUse.insert(_headers[i].sparePtr);
-        }
+        block = &_headers[h.blockId];
+        block->pins -= std::min(count, block->pins);
     }
-    std::set<uint8*>::iterator it;
-    for(uint32 i = 0; i < HeaderCount(); ++i)
+
+    if(_cacheBudget)
     {
-        LVPAFileHeader& h = _headers[i];
-        if(h.flags & LVPAFLAG_SOLIDBLOCK && h.data.ptr) // because we check h.data.ptr here, *it below can be NULL without causing trouble
+        if(_cacheUsed > _cacheBudget)
+            _CacheTrim();
+    }
+    else if(freeBlock && block && !block->pins && block->data.ptr && !block->otherMem)
+        Free(block->id); // nobody uses it anymore
+}
+
+void LVPAFile::_DetachSolidFiles(LVPAFileHeader& block)
+{
+    const uint8 *start = block.data.ptr;
+    const uint8 *end = start + block.data.size;
+    for(uint32 id = block.blockLink; id != uint32(-1); )
+    {
+        LVPAFileHeader& f = _headers[id];
+        id = f.blockLink;
+        // Add() may have given the file other memory meanwhile
+        if(f.otherMem && f.data.ptr >= start && f.data.ptr <= end)
+            f.data = memblock();
+        if(!f.data.ptr && f.pins)
         {
-            bool used = false;
-            for(it = ptrsInUse.begin(); it != ptrsInUse.end(); ++it)
-            {
-                uint8 *ptr = *it;
-                if(ptr >= h.data.ptr && ptr < h.data.ptr + h.data.size) // pointer inside solid block memory?
-                {
-                    used = true;
-                    break;
-                }
-            }
-            if(!used)
-                freed += Free(h.id);
+            f.pins = 0; // the block is gone, so are the pins on it
+            ++f.pinGen;
         }
+        if(f.sparePtr >= start && f.sparePtr <= end)
+            f.sparePtr = NULL;
+        f.blockLink = -1;
+        f.inBlockList = false;
     }
-    return freed;
+    block.blockLink = -1;
 }
 
-
-bool LVPAFile::Drop(const char *fn)
+LVPAHandle::LVPAHandle(const LVPAHandle& h)
+: _lvpa(h._lvpa), _id(h._id), _gen(h._gen), _mb(h._mb)
 {
-    uint32 id;
-    if(_FindHeaderByName(fn, &id))
-        return Drop(id);
-    return true; // the file isn't there, no problem.
+    if(_Pinned())
+        _lvpa->_Pin(_lvpa->_headers[_id]);
 }
 
-bool LVPAFile::Drop(uint32 id)
+LVPAHandle& LVPAHandle::operator=(const LVPAHandle& h)
 {
-    LVPAFileHeader& hdrRef = _headers[id];
-    if(hdrRef.data.ptr)
-        hdrRef.sparePtr = hdrRef.data.ptr;
-
-    hdrRef.data.ptr = NULL;
-    hdrRef.data.size = 0;
-
-    return !hdrRef.otherMem;
+    if(h._Pinned())
+        h._lvpa->_Pin(h._lvpa->_headers[h._id]); // first, in case both refer to the same file
+    Reset();
+    _lvpa = h._lvpa;
+    _id = h._id;
+    _gen = h._gen;
+    _mb = h._mb;
+    return *this;
 }
 
-bool LVPAFile::LoadFrom(const char *fn, LVPAFileReader *rd /* = NULL */)
+bool LVPAHandle::_Pinned(void) const
 {
-    _ownName = fn;
-
-    if(rd)
-        reader = *rd;
-    else
-        initDefaultFileReader(&reader);
-
-    if(!_OpenFile())
-        return false;
-
-    Clear();
+    return _lvpa && _lvpa->_headers[_id].pinGen == _gen;
+}
 
-    uint32 bytes;
-    char magic[4];
+void LVPAHandle::Reset(void)
+{
+    if(_Pinned()) // otherwise Free() took the pin, and the current ones belong to someone else
+        _lvpa->_Unpin(_lvpa->_headers[_id], 1, true); // the last handle into a solid block takes it along
+    _lvpa = NULL;
+    _id = -1;
+    _gen = 0;
+    _mb = memblock();
+}
 
-    bytes = reader.read(magic, 4);
-    if(bytes != 4 || memcmp(magic, gMagic, 4))
+void LVPAFile::SetCacheBudget(uint64 budget)
+{
+    _cacheBudget = budget;
+    if(budget)
     {
-        _CloseFile();
-        return false;
+        _CacheTrim();
+        return;
     }
+    // disabled: whatever is loaded stays, but is no longer tracked
+    while(_cacheHead != uint32(-1))
+        _CacheUnlink(_headers[_cacheHead]);
+}
 
-    ByteBuffer masterBuf;
-    LVPAMasterHeader masterHdr;
-
-    masterBuf.resize(sizeof(LVPAMasterHeader));
-    bytes = reader.read((void*)masterBuf.contents(), sizeof(LVPAMasterHeader));
-    masterBuf >> masterHdr; // not reading it directly via fread() is intentional
+void LVPAFile::_CacheLink(LVPAFileHeader& h)
+{
+    DEBUG(ASSERT(!h.cached));
+    h.cachePrev = -1;
+    h.cacheNext = _cacheHead;
+    (_cacheHead != uint32(-1) ? _headers[_cacheHead].cachePrev : _cacheTail) = h.id;
+    _cacheHead = h.id;
+    h.cached = true;
+    _cacheUsed += h.data.size;
+}
 
-    DEBUG(logdebug("master: version: %u", masterHdr.version));
-    DEBUG(logdebug("master: flags: %u", masterHdr.flags));
+void LVPAFile::_CacheUnlink(LVPAFileHeader& h)
+{
+    if(!h.cached)
+        return;
+    (h.cachePrev != uint32(-1) ? _headers[h.cachePrev].cacheNext : _cacheHead) = h.cacheNext;
+    (h.cacheNext != uint32(-1) ? _headers[h.cacheNext].cachePrev : _cacheTail) = h.cachePrev;
+    h.cached = false;
+    _cacheUsed -= h.data.size;
+}
 
-    if(masterHdr.version != gVersion)
+void LVPAFile::_CacheTrim(void)
+{
+    bool waited = false;
+    uint32 id = _cacheTail;
+    while(_cacheUsed > _cacheBudget && id != uint32(-1))
     {
-        logerror("Unsupported LVPA file version: %u", masterHdr.version);
-        _CloseFile();
-        return false;
+        LVPAFileHeader& h = _headers[id];
+        id = h.cachePrev;
+        if(h.pins)
+            continue;
+        if(!waited)
+        {
+            WaitVerify(); // the verify thread may still be reading it
+            waited = true;
+        }
+        _CacheEvict(h);
     }
+}
 
-    if(masterHdr.flags & LVPAHDR_ENCRYPTED && !_masterKey.size())
+void LVPAFile::_CacheEvict(LVPAFileHeader& h)
+{
+    DEBUG(logdebug("Cache: freeing '%s' (%u bytes)", h.filename.c_str(), h.data.size));
+    _CacheUnlink(h);
+    _UntrackResident(h);
+    if(h.flags & LVPAFLAG_SOLIDBLOCK)
     {
-        logerror("Headers are encrypted, but no key set, can't read!");
-        _CloseFile();
-        return false;
+        _DropPartial(h);
+        _DetachSolidFiles(h); // they will be set up again when the block is loaded next time
     }
+    FreeBuffer(h.data);
+    h.data = memblock();
+    h.sparePtr = NULL;
+}
 
-    // decrypt if required
+void LVPAFile::_TrackResident(LVPAFileHeader& h)
+{
+    DEBUG(ASSERT(!h.resident && !h.otherMem));
+    const bool block = (h.flags & LVPAFLAG_SOLIDBLOCK) != 0;
+    h.resident = true;
+    AtomicAdd(block ? &_stats.residentBlockBytes : &_stats.residentFileBytes, h.data.size);
+    AtomicAdd(block ? &_stats.residentBlocks : &_stats.residentFiles, 1);
+    AtomicMax(&_stats.peakResidentBytes, AtomicAdd(&_stats.residentBytes, h.data.size));
+}
+
+void LVPAFile::_UntrackResident(LVPAFileHeader& h)
+{
+    if(!h.resident)
+        return;
+    const bool block = (h.flags & LVPAFLAG_SOLIDBLOCK) != 0;
+    h.resident = false;
+    AtomicSub(block ? &_stats.residentBlockBytes : &_stats.residentFileBytes, h.data.size);
+    AtomicSub(block ? &_stats.residentBlocks : &_stats.residentFiles, 1);
+    AtomicSub(&_stats.residentBytes, h.data.size);
+}
+
+LVPAStats LVPAFile::GetStats(void) const
+{
+    LVPAStats st;
+    st.residentBytes = AtomicGet(&_stats.residentBytes);
+    st.residentFileBytes = AtomicGet(&_stats.residentFileBytes);
+    st.residentBlockBytes = AtomicGet(&_stats.residentBlockBytes);
+    st.residentFiles = AtomicGet(&_stats.residentFiles);
+    st.residentBlocks = AtomicGet(&_stats.residentBlocks);
+    st.peakResidentBytes = AtomicGet(&_stats.peakResidentBytes);
+    st.bytesRead = AtomicGet(&_stats.bytesRead);
+    st.bytesDecrypted = AtomicGet(&_stats.bytesDecrypted);
+    st.bytesDecompressed = AtomicGet(&_stats.bytesDecompressed);
+    st.crcNanos = AtomicGet(&_stats.crcNanos);
+    st.decodeNanos = AtomicGet(&_stats.decodeNanos);
+    st.cacheHits = AtomicGet(&_stats.cacheHits);
+    st.cacheMisses = AtomicGet(&_stats.cacheMisses);
+    return st;
+}
+
+void LVPAFile::ResetStats(void)
+{
+    AtomicSet(&_stats.peakResidentBytes, AtomicGet(&_stats.residentBytes));
+    AtomicSet(&_stats.bytesRead, 0);
+    AtomicSet(&_stats.bytesDecrypted, 0);
+    AtomicSet(&_stats.bytesDecompressed, 0);
+    AtomicSet(&_stats.crcNanos, 0);
+    AtomicSet(&_stats.decodeNanos, 0);
+    AtomicSet(&_stats.cacheHits, 0);
+    AtomicSet(&_stats.cacheMisses, 0);
+}
+
+bool LVPAFile::SetTraceCallback(LVPATraceCallback cb, void *user /* = NULL */)
+{
+#ifdef LVPA_SUPPORT_TRACING
+    _traceCb = cb;
+    _traceUser = user;
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char *LVPAFile::GetTraceStageName(uint8 stage)
+{
+    switch(stage)
+    {
+        case LVPATRACE_PREPARE:  return "prepare";
+        case LVPATRACE_UNPACK:   return "unpack";
+        case LVPATRACE_DECRYPT:  return "decrypt";
+        case LVPATRACE_LOAD:     return "load";
+        case LVPATRACE_CHECK:    return "check";
+        case LVPATRACE_COMPRESS: return "compress";
+        case LVPATRACE_ENCRYPT:  return "encrypt";
+        case LVPATRACE_WRITE:    return "write";
+        default:                 return "unknown";
+    }
+}
+
+bool LVPAFile::Free(const char *fn)
+{
+    uint32 id;
+    if(_FindHeaderByName(fn, &id))
+        return Free(id);
+    return true; // file never existed, no problem
+}
+
+bool LVPAFile::Free(uint32 id)
+{
+    WaitVerify();
+    LVPAFileHeader& hdrRef = _headers[id];
+    _CacheUnlink(hdrRef);
+    _UntrackResident(hdrRef);
+    if(hdrRef.pins)
+    {
+        if(hdrRef.flags & LVPAFLAG_SOLIDBLOCK)
+            hdrRef.pins = 0; // it is gone now, whoever still used it. the files inside lose their pins below
+        else
+            _Unpin(hdrRef, hdrRef.pins); // the solid block stays, other files may need it soon
+        ++hdrRef.pinGen; // handles pinned before are stale now
+    }
+
+    bool freed = false;
+    if(hdrRef.data.ptr && !hdrRef.otherMem)
+    {
+        if(hdrRef.flags & LVPAFLAG_SOLIDBLOCK)
+        {
+            _DropPartial(hdrRef);
+            _DetachSolidFiles(hdrRef);
+        }
+        FreeBuffer(hdrRef.data);
+        freed = true;
+    }
+
+    if(freed || !(hdrRef.flags & LVPAFLAG_SOLIDBLOCK))
+    {
+        hdrRef.data.ptr = NULL; // can be retrieved easily if needed later
+        hdrRef.data.size = 0;
+    }
+
+    hdrRef.sparePtr = NULL; // now its definitely not used anymore.
+    return freed;
+}
+
+uint32 LVPAFile::FreeUnused(void)
+{
+    // every file that was handed out and not given back pins its solid block, see _Pin().
+    // files that were dropped keep their pins, so their memory stays valid.
+    uint32 freed = 0;
+    for(uint32 i = 0; i < HeaderCount(); ++i)
+    {
+        LVPAFileHeader& h = _headers[i];
+        if((h.flags & LVPAFLAG_SOLIDBLOCK) && h.data.ptr && !h.pins)
+            freed += Free(h.id);
+    }
+    return freed;
+}
+
+
+bool LVPAFile::Drop(const char *fn)
+{
+    uint32 id;
+    if(_FindHeaderByName(fn, &id))
+        return Drop(id);
+    return true; // the file isn't there, no problem.
+}
+
+bool LVPAFile::Drop(uint32 id)
+{
+    WaitVerify(); // the memory may be changed freely afterwards
+    LVPAFileHeader& hdrRef = _headers[id];
+    _CacheUnlink(hdrRef);
+    _UntrackResident(hdrRef);
+    _ContinueUnpack(hdrRef, 0, -1); // whoever takes it expects all of it
+    if(hdrRef.data.ptr)
+        hdrRef.sparePtr = hdrRef.data.ptr;
+
+    hdrRef.data.ptr = NULL;
+    hdrRef.data.size = 0;
+
+    return !hdrRef.otherMem;
+}
+
+bool LVPAFile::LoadFrom(const char *fn, LVPAFileReader *rd /* = NULL */)
+{
+    _ownName = fn;
+
+    if(rd)
+        reader = *rd;
+    else
+        initDefaultFileReader(&reader);
+
+    if(!_OpenFile())
+        return false;
+
+    Clear();
+
+    uint32 bytes;
+    char magic[4];
+
+    bytes = reader.read(magic, 4);
+    if(bytes != 4 || memcmp(magic, gMagic, 4))
+    {
+        _CloseFile();
+        return false;
+    }
+
+    ByteBuffer masterBuf;
+    LVPAMasterHeader masterHdr;
+
+    masterBuf.resize(sizeof(LVPAMasterHeader));
+    bytes = reader.read((void*)masterBuf.contents(), sizeof(LVPAMasterHeader));
+    masterBuf >> masterHdr; // not reading it directly via fread() is intentional
+
+    DEBUG(logdebug("master: version: %u", masterHdr.version));
+    DEBUG(logdebug("master: flags: %u", masterHdr.flags));
+
+    if(masterHdr.version > gVersion)
+    {
+        logerror("Unsupported LVPA file version: %u", masterHdr.version);
+        _CloseFile();
+        return false;
+    }
+
+    _checksum = (masterHdr.flags & LVPAHDR_XXH64) ? LVPACHECK_XXH64 : LVPACHECK_CRC32;
+
+    if(masterHdr.flags & LVPAHDR_ENCRYPTED && !_masterKey.size())
+    {
+        logerror("Headers are encrypted, but no key set, can't read!");
+        _CloseFile();
+        return false;
+    }
+
+    // decrypt if required
     LVPACipher hdrCiph;
     if(masterHdr.flags & LVPAHDR_ENCRYPTED)
     {
@@ -608,7 +1298,7 @@ bool LVPAFile::LoadFrom(const char *fn, LVPAFileReader *rd /* = NULL */)
     // seek to the file header's offset if we are not yet there
     reader.seek(masterHdr.hdrOffset);
 
-    std::auto_ptr<ICompressor> hdrBuf(allocCompressor(masterHdr.algo));
+    std::auto_ptr<ICompressor> hdrBuf(_AllocCompressor(masterHdr.algo));
 
     if(!hdrBuf.get())
     {
@@ -638,7 +1328,7 @@ bool LVPAFile::LoadFrom(const char *fn, LVPAFileReader *rd /* = NULL */)
     if(masterHdr.flags & LVPAHDR_PACKED)
     {
         // check CRC of packed header data
-        if(CRC32::Calc((uint8*)hdrBuf->contents(), hdrBuf->size()) != masterHdr.hdrCrcPacked)
+        if(uint32(LVPAChecksum::Calc(_checksum, hdrBuf->contents(), hdrBuf->size())) != masterHdr.hdrCrcPacked)
         {
             logerror("CRC mismatch, packed header is damaged");
             _CloseFile();
@@ -651,13 +1341,16 @@ bool LVPAFile::LoadFrom(const char *fn, LVPAFileReader *rd /* = NULL */)
     }
 
     // check CRC of unpacked header data
-    if(CRC32::Calc((uint8*)hdrBuf->contents(), hdrBuf->size()) != masterHdr.hdrCrcReal)
+    if(uint32(LVPAChecksum::Calc(_checksum, hdrBuf->contents(), hdrBuf->size())) != masterHdr.hdrCrcReal)
     {
         logerror("CRC mismatch, unpacked header is damaged");
         _CloseFile();
         return false;
     }
 
+    // the headers hold every file's size, position and checksum, so any change to the archive shows up here
+    _fingerprint = XXHash64::Calc(hdrBuf->contents(), hdrBuf->size(), masterHdr.dataOffs);
+
     _realSize = _packedSize = 0;
 
     // read the headers
@@ -667,20 +1360,25 @@ bool LVPAFile::LoadFrom(const char *fn, LVPAFileReader *rd /* = NULL */)
     for(uint32 i = 0; i < masterHdr.hdrEntries; ++i)
     {
         LVPAFileHeader &h = _headers[i];
-        *hdrBuf >> h;
+        readFileHeader(*hdrBuf, h, _checksum != LVPACHECK_CRC32, (masterHdr.flags & LVPAHDR_RESTARTS) != 0);
         h.good = true;
 
-        DEBUG(logdebug("'%s' bytes: %u; blockId: %u; [%s%s%s%s%s]",
+        DEBUG(logdebug("'%s' bytes: %u; blockId: %u; [%s%s%s%s%s%s%s%s]",
             h.filename.c_str(), h.packedSize, h.blockId,
             (h.flags & LVPAFLAG_PACKED) ? "PACKED " : "",
             (h.flags & LVPAFLAG_SOLID) ? "SOLID " : "",
             (h.flags & LVPAFLAG_SOLIDBLOCK) ? "SBLOCK " : "",
             (h.flags & LVPAFLAG_ENCRYPTED) ? "ENCR " : "",
-            (h.flags & LVPAFLAG_SCRAMBLED) ? "SCRAM " : ""
+            (h.flags & LVPAFLAG_SCRAMBLED) ? "SCRAM " : "",
+            (h.flags & LVPAFLAG_DICT) ? "DICT " : "",
+            (h.flags & LVPAFLAG_DICTREF) ? "DICTREF " : "",
+            (h.flags & LVPAFLAG_FILTERED) ? "FILTERED " : ""
             ));
 
-        // sanity check - can't be in a solid block and a solid block itself
-        if((h.flags & LVPAFLAG_SOLID) &&( h.flags & LVPAFLAG_SOLIDBLOCK))
+        // sanity check - can't be in a solid block and a solid block itself,
+        // and a dictionary is neither in a solid block nor packed with another dictionary
+        if( ((h.flags & LVPAFLAG_SOLID) && (h.flags & (LVPAFLAG_SOLIDBLOCK | LVPAFLAG_DICT | LVPAFLAG_DICTREF)))
+         || ((h.flags & LVPAFLAG_DICT) && (h.flags & (LVPAFLAG_SOLIDBLOCK | LVPAFLAG_DICTREF))) )
         {
             h.good = false;
             logerror("File '%s' has wrong/incompatible flags, whoops!", h.filename.c_str());
@@ -688,11 +1386,49 @@ bool LVPAFile::LoadFrom(const char *fn, LVPAFileReader *rd /* = NULL */)
             return false;
         }
 
+        // filters are only stored for packed data, and must be known to undo them
+        if( (h.flags & LVPAFLAG_FILTERED) && (!(h.flags & LVPAFLAG_PACKED) || (h.flags & LVPAFLAG_SOLID)
+            || h.filter == LVPAFILTER_NONE || !IsValidFilter(h.filter, h.filterParam)) )
+        {
+            h.good = false;
+            logerror("File '%s' uses unknown filter %u (param %u)", h.filename.c_str(), uint32(h.filter), uint32(h.filterParam));
+            _CloseFile();
+            return false;
+        }
+
+        if( (h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED))
+            && (h.cipher == LVPAENCR_NONE || h.cipher >= LVPAENCR_MAX_SUPPORTED) )
+        {
+            h.good = false;
+            logerror("File '%s' uses unknown cipher %u", h.filename.c_str(), uint32(h.cipher));
+            _CloseFile();
+            return false;
+        }
+
+        if(h.checksum >= LVPACHECK_MAX_SUPPORTED)
+        {
+            h.good = false;
+            logerror("File '%s' uses unknown checksum %u", h.filename.c_str(), uint32(h.checksum));
+            _CloseFile();
+            return false;
+        }
+
+        if(!checkRestartPoints(h))
+        {
+            h.good = false;
+            logerror("Solid block '%s' has bad restart points", h.filename.c_str());
+            _CloseFile();
+            return false;
+        }
+
+        // saving again keeps the encryption as it is. Files that are raw-copied must keep it anyways, their data are not touched.
+        h.encryption = (h.flags & LVPAFLAG_ENCRYPTED) ? uint8(h.cipher) : uint8(LVPAENCR_NONE);
+
         // for stats -- do not account files inside a solid block, because the solid block is likely packed, not the individual files
         if(!(h.flags & LVPAFLAG_SOLID))
             _packedSize += h.packedSize;
-        // -- here, do not account solid blocks, because the individual files' real size matters
-        if(!(h.flags & LVPAFLAG_SOLIDBLOCK))
+        // -- here, do not account solid blocks, because the individual files' real size matters (same for dictionaries)
+        if(!(h.flags & (LVPAFLAG_SOLIDBLOCK | LVPAFLAG_DICT)))
             _realSize += h.realSize;
     }
 
@@ -710,10 +1446,140 @@ bool LVPAFile::Save(LVPAComprLevels compression, LVPAAlgos algo /* = LVPAPACK_IN
     return SaveAs(_ownName.c_str(), compression, algo, encrypt);
 }
 
+// Finds the dictionary header, or trains a new one from the small files (and adds it to hdrs).
+// useDict[i] is set for each file that should be packed with the dictionary.
+// Returns the dictionary's header index, or -1 if there is none.
+uint32 LVPAFile::_PrepareDictionary(std::vector<LVPAFileHeader>& hdrs, std::vector<bool>& useDict, ByteBuffer& storage)
+{
+    useDict.clear();
+    useDict.resize(hdrs.size(), false);
+
+    uint32 dictId = -1;
+    for(uint32 i = 0; i < hdrs.size(); ++i)
+        if(hdrs[i].good && (hdrs[i].flags & LVPAFLAG_DICT))
+        {
+            dictId = i;
+            break;
+        }
+
+    if(dictId == uint32(-1) && !_dictSize)
+        return -1;
+
+    // which files can make use of a dictionary? only those that are compressed now, and not too large
+    int8 algoOk[256];
+    memset(&algoOk[0], -1, sizeof(algoOk));
+    std::vector<uint32> candidates;
+    bool encr = false;
+    for(uint32 i = 0; i < hdrs.size(); ++i)
+    {
+        const LVPAFileHeader& h = hdrs[i];
+        if(!h.good || (h.flags & (LVPAFLAG_SOLID | LVPAFLAG_SOLIDBLOCK | LVPAFLAG_DICT))
+            || !h.data.ptr || !h.data.size || h.data.size > _dictMaxFileSize || h.level == LVPACOMP_NONE
+            || h.filter != LVPAFILTER_NONE) // the dictionary is trained on unfiltered data
+            continue;
+        if(algoOk[h.algo] < 0)
+        {
+            std::auto_ptr<ICompressor> c(_AllocCompressor(h.algo));
+            algoOk[h.algo] = c.get() && c->SupportsDictionary();
+        }
+        if(algoOk[h.algo])
+        {
+            candidates.push_back(i);
+            encr = encr || (h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED));
+        }
+    }
+
+    if(dictId != uint32(-1))
+    {
+        // keep the existing one, files that are not loaded still refer to it
+        LVPAFileHeader& dh = hdrs[dictId];
+        if(!dh.data.ptr)
+        {
+            dh.data = _PrepareFile(_headers[dictId], _verifyMode != LVPAVERIFY_TRUSTED); // note that this modifies the original headers
+            if(!dh.data.ptr)
+            {
+                logerror("Failed to load dictionary, not using it for new files");
+                return dictId; // raw-copy it for the old files
+            }
+            dh.realSize = dh.packedSize = dh.data.size;
+        }
+    }
+    else
+    {
+        // too few files make a bad dictionary, and it would not pay off anyways
+        if(candidates.size() < LVPA_DICT_MIN_FILES)
+            return -1;
+
+        // scrambled files are left out, their contents must not end up in the dictionary
+        ByteBuffer samples;
+        samples.allocator(_allocator);
+        std::vector<uint32> sampleSizes;
+        for(uint32 i = 0; i < candidates.size(); ++i)
+        {
+            const LVPAFileHeader& h = hdrs[candidates[i]];
+            if(h.flags & LVPAFLAG_SCRAMBLED)
+                continue;
+            samples.append(h.data.ptr, h.data.size);
+            sampleSizes.push_back(h.data.size);
+        }
+        if(sampleSizes.size() < LVPA_DICT_MIN_FILES)
+            return -1;
+
+        uint32 dictSize = 0;
+        storage.resize(_dictSize);
+#ifdef LVPA_SUPPORT_ZSTD
+        dictSize = ZstdCompressor::TrainDictionary(storage.contents(), _dictSize, samples.contents(), &sampleSizes[0], sampleSizes.size());
+#endif
+        if(!dictSize)
+        {
+            // can't train, so just use the beginning of each file, the most common parts tend to be there
+            uint32 part = std::max<uint32>(_dictSize / sampleSizes.size(), 16);
+            uint32 offs = 0;
+            for(uint32 i = 0; i < sampleSizes.size() && dictSize < _dictSize; offs += sampleSizes[i++])
+            {
+                uint32 n = std::min(std::min(part, sampleSizes[i]), _dictSize - dictSize);
+                memcpy(storage.contents() + dictSize, samples.contents() + offs, n);
+                dictSize += n;
+            }
+        }
+        storage.resize(dictSize);
+        if(!dictSize)
+            return -1;
+
+        LVPAFileHeader dh;
+        dh.flags = LVPAFLAG_DICT;
+        dh.filename = "*dict*";
+        dh.algo = hdrs[candidates[0]].algo; // pack it like the files that use it
+        dh.level = hdrs[candidates[0]].level;
+        dh.data.ptr = storage.contents();
+        dh.data.size = dh.realSize = dh.packedSize = dictSize;
+        dh.blockId = 0;
+        dictId = dh.id = hdrs.size();
+        hdrs.push_back(dh);
+        useDict.push_back(false);
+    }
+
+    // the dictionary contains bits of the files, so it must be protected like them
+    if(encr && !_masterKey.empty())
+        hdrs[dictId].flags |= LVPAFLAG_ENCRYPTED;
+
+    for(uint32 i = 0; i < candidates.size(); ++i)
+        useDict[candidates[i]] = true;
+
+    return dictId;
+}
+
 // note: this function must NOT modify existing headers in memory!
 bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFAULT_LEVEL */, LVPAAlgos algo /* = LVPAPACK_INHERIT */,
                       bool encrypt /* = false */)
 {
+    // files that turn out to be bad must not be written
+    WaitVerify();
+
+    // solid blocks are written as a whole
+    while(!_partial.empty())
+        _ContinueUnpack(_headers[_partial.begin()->first], 0, -1);
+
     // check before showing progress bar
     if(!_headers.size())
     {
@@ -725,7 +1591,7 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
     if(compression == LVPACOMP_INHERIT)
         compression = LVPA_DEFAULT_LEVEL;
 
-    std::auto_ptr<ICompressor> zhdr(allocCompressor(algo));
+    std::auto_ptr<ICompressor> zhdr(_AllocCompressor(algo));
     if(!zhdr.get())
     {
         logerror("Unknown compression method '%u'", (uint32)algo);
@@ -770,7 +1636,8 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
             // If sh.realSize is 0, the block does not yet exist (will be created further below)
             if(h.data.ptr && !sh.data.ptr && sh.realSize)
             {
-                memblock mbs = Get(sh.id, true); // this possibly modifies headers...
+                // not via Get(), the cache must not free anything that was copied above
+                memblock mbs = _PrepareFile(_headers[sh.id], _verifyMode != LVPAVERIFY_TRUSTED); // this possibly modifies headers...
                 if(!mbs.ptr)
                 {
                     logerror("Failed to load required solid block '%s'; can't add file '%s'", sh.filename.c_str(), h.filename.c_str());
@@ -809,14 +1676,23 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
                 // If we don't have a pointer, we keep the settings stored in the header.
                 // (**) Keep in mind that if a file inside of a solid block was loaded, the whole solid block was loaded,
                 //      and in turn if a solid block ptr is NULL, then none of the files in it was loaded.
+                // Files that are not loaded keep their dictionary reference and filter flag, because they are raw-copied.
+                // The others are compressed again and get them back if they still apply.
                 if(h.data.ptr)
+                {
                     h.realSize = h.packedSize = h.data.size;
+                    h.flags &= ~(LVPAFLAG_DICTREF | LVPAFLAG_FILTERED);
+                }
 
-                _realSize += h.realSize; // for stats
+                if(!(h.flags & LVPAFLAG_DICT))
+                    _realSize += h.realSize; // for stats
             }
 
-            h.blockId = 0;
-            DEBUG(h.blockId = -1); // to see if an error occurs - this value should never be used with these flags
+            if(!(h.flags & LVPAFLAG_DICTREF))
+            {
+                h.blockId = 0;
+                DEBUG(h.blockId = -1); // to see if an error occurs - this value should never be used with these flags
+            }
 
             if(h.level == LVPACOMP_INHERIT)
                 h.level = compression;
@@ -844,6 +1720,12 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
         }
     }
 
+    // pick up or train the shared dictionary, this may add a header
+    std::vector<bool> useDict;
+    ByteBuffer dictStorage;
+    dictStorage.allocator(_allocator);
+    uint32 dictId = _PrepareDictionary(headersCopy, useDict, dictStorage);
+
     // one buf for each file - not all have to be used.
     // it WILL be used if a file has LVPAFLAG_PACKED set, which means the data went into a compressor
     // they might not be packed if the data are incompressible, in this case, the original data in memory are used
@@ -882,10 +1764,12 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
             // inherit from global settings, or just encrypt right away if set to do so
             // in case a file inside a solid block should be encrypted, the whole solid block needs to be encrypted,
             // so adjust its settings if necessary.
-            if(h.encryption == LVPAENCR_ENABLED || (encrypt && h.encryption == LVPAENCR_INHERIT))
+            if(h.encryption == LVPAENCR_ENABLED || h.encryption == LVPAENCR_CHACHA20 || (encrypt && h.encryption == LVPAENCR_INHERIT))
             {
                 h.flags &= ~LVPAFLAG_ENCRYPTED; // remove it from this file, because the solid block gets encrypted, not this file
                 sh.flags |= LVPAFLAG_ENCRYPTED;
+                if(h.encryption == LVPAENCR_CHACHA20)
+                    sh.encryption = LVPAENCR_CHACHA20; // one file asking for it is enough for the whole block
             }
             else // not encrypting this file, but do not change the solid block's settings, as there may be other encrypted files in it.
             {
@@ -909,7 +1793,7 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
         if(h.good && !(h.flags & LVPAFLAG_SOLID) && (needbuf_solidblock || needbuf_normal) )
         {
             // each file (or solid block) can have its own compression algo, and level
-            fileBufs.v[i] = allocCompressor(h.algo);
+            fileBufs.v[i] = _AllocCompressor(h.algo);
             if(!fileBufs.v[i])
             {
                 logerror("Unknown compression algorithm %u for file '%s'", uint32(h.algo), h.filename.c_str());
@@ -919,6 +1803,7 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
     }
     uint8 solidPadding[LVPA_EXTRA_BUFSIZE];
     memset(&solidPadding[0], 0, LVPA_EXTRA_BUFSIZE);
+    std::vector<std::vector<uint32> > segmentStarts(headersCopy.size()); // for each solid block, see SetRestartInterval()
     // third iteration - append solid files to their blocks
     for(uint32 i = 0; i < headersCopy.size(); ++i)
     {
@@ -937,7 +1822,7 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
             // that all related files are present in memory when it comes to building the buffer.
             if(!h.data.ptr && sh.data.ptr)
             {
-                h.data = Get(h.id); // note that this modifies the original headers
+                h.data = _PrepareFile(_headers[h.id], _verifyMode != LVPAVERIFY_TRUSTED); // not Get(), that would pin it. note that this modifies the original headers
                 if(!h.data.ptr)
                 {
                     logerror("Failed to load file '%s' from solid block '%s' to append!", h.filename.c_str(), sh.filename.c_str());
@@ -948,17 +1833,54 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
             ICompressor *solidblock = fileBufs.v[h.blockId];
             DEBUG(ASSERT(solidblock));
             DEBUG(ASSERT(h.data.ptr));
-            solidblock->reserve(h.realSize);
+            std::vector<uint32>& starts = segmentStarts[h.blockId];
+            if(_restartInterval && solidblock->size() - (starts.empty() ? 0 : starts.back()) >= _restartInterval)
+                starts.push_back(solidblock->size());
+            if(!solidblock->size())
+                solidblock->reserve(sh.realSize); // the size of the whole block is known by now, so it is never copied
             solidblock->append(h.data.ptr, h.data.size);
             solidblock->append(&solidPadding[0], LVPA_EXTRA_BUFSIZE);
         }
     }
 
+    // Find out which files will be written from memory below, the others are raw-copied.
+    // Those get the current checksum type, raw-copied files keep theirs (their name may not even be known, if scrambled).
+    // The keys of all scrambled files that will be encrypted can be derived in one go,
+    // many short file names are hashed faster together than one after another.
+    std::vector<LVPAFileHeader*> scrambled;
+    bool checksumTypes = _checksum != LVPACHECK_CRC32; // see readFileHeader()
+    for(uint32 i = 0; i < headersCopy.size(); ++i)
+    {
+        LVPAFileHeader& h = headersCopy[i];
+        if(!h.good)
+            continue;
+        if(h.data.ptr || (fileBufs.v[i] && fileBufs.v[i]->size()))
+            h.checksum = _checksum;
+        if(h.checksum != LVPACHECK_CRC32)
+            checksumTypes = true;
+        if((h.flags & LVPAFLAG_SCRAMBLED) && !h.filename.empty()
+            && ((h.data.ptr && h.data.size) || (fileBufs.v[i] && fileBufs.v[i]->size())))
+            scrambled.push_back(&h);
+    }
+    _PrepareCipherKeys(scrambled);
+
+    // solid blocks that are packed again get new restart points, the others keep theirs
+    bool restartPoints = false;
+    for(uint32 i = 0; i < headersCopy.size(); ++i)
+    {
+        const LVPAFileHeader& h = headersCopy[i];
+        if(h.good && (h.flags & LVPAFLAG_SOLIDBLOCK) && ((fileBufs.v[i] && fileBufs.v[i]->size()) ? !segmentStarts[i].empty() : !h.restarts.empty()))
+            restartPoints = true;
+    }
+
+    const uint8 hdrChecksum = checksumTypes ? LVPACHECK_XXH64 : LVPACHECK_CRC32; // for the headers themselves
+
     bar.msg = "Compressing:  ";
 
     // fourth iteration - append each non-solid file to its buffer, and compress each file / solid block
     // also append each header to the header compressor buf
     uint32 writtenHeaders = 0;
+    uint32 minVersion = 0; // lowest version that can read all written headers, see LVPA_VERSION
     for(uint32 i = 0; i < headersCopy.size(); ++i)
     {
         LVPAFileHeader& h = headersCopy[i];
@@ -972,26 +1894,105 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
             {
                 DEBUG(ASSERT(block->size() == 0));
                 DEBUG(ASSERT(h.data.ptr));
-                block->append(h.data.ptr, h.data.size);
-            }
 
-            if(block->size())
+                // calc unpacked crc, then compress directly from the source memory (no intermediate copy)
+                h.crcReal = LVPAChecksum::Calc(h.checksum, h.data.ptr, h.data.size);
+                if(h.data.size)
+                {
+                    if(h.level != LVPACOMP_NONE)
+                    {
+                        LVPA_TRACE_SCOPE(trace, LVPATRACE_COMPRESS, h, h.data.size);
+                        if(useDict[i])
+                        {
+                            const memblock& dict = headersCopy[dictId].data;
+                            block->SetDictionary(dict.ptr, dict.size);
+                        }
+
+                        // a filter needs a copy, the original data must not be touched
+                        ByteBuffer filtered;
+                        filtered.allocator(_allocator);
+                        const uint8 *src = h.data.ptr;
+                        if(h.filter != LVPAFILTER_NONE)
+                        {
+                            filtered.resize(h.data.size);
+                            FilterEncode(h.filter, h.filterParam, filtered.contents(), h.data.ptr, h.data.size);
+                            src = filtered.contents();
+                        }
+
+                        block->CompressFrom(src, h.data.size, h.level, drawCompressProgressBar);
+                        if(block->Compressed())
+                        {
+                            if(useDict[i])
+                            {
+                                h.flags |= LVPAFLAG_DICTREF;
+                                h.blockId = dictId;
+                            }
+                            if(src != h.data.ptr)
+                                h.flags |= LVPAFLAG_FILTERED;
+                        }
+                        else if(src != h.data.ptr)
+                        {
+                            // stored as is, so it must not stay filtered
+                            block->resize(0);
+                            block->append(h.data.ptr, h.data.size);
+                        }
+                        LVPA_TRACE_OUT(trace, block->size());
+                    }
+                    else
+                        block->append(h.data.ptr, h.data.size);
+                }
+            }
+            else if(block->size())
             {
-                // calc unpacked crc before compressing
-                h.crcReal = CRC32::Calc(block->contents(), block->size());
+                // calc unpacked crc before compressing (and filtering)
+                h.crcReal = LVPAChecksum::Calc(h.checksum, block->contents(), block->size());
+                h.flags &= ~LVPAFLAG_FILTERED;
+                h.restarts.clear();
 
                 if(h.level != LVPACOMP_NONE)
-                    block->Compress(h.level, drawCompressProgressBar);
+                {
+                    LVPA_TRACE_SCOPE(trace, LVPATRACE_COMPRESS, h, block->size());
+                    if(!segmentStarts[i].empty())
+                        compressSegments(block, h, segmentStarts[i], _allocator);
+                    else
+                    {
+                        ByteBuffer unfiltered;
+                        unfiltered.allocator(_allocator);
+                        if(h.filter != LVPAFILTER_NONE)
+                        {
+                            unfiltered.resize(block->size());
+                            FilterEncode(h.filter, h.filterParam, unfiltered.contents(), block->contents(), block->size());
+                            block->swap(unfiltered); // now the other way around
+                        }
+
+                        block->Compress(h.level, drawCompressProgressBar);
+
+                        if(unfiltered.size())
+                        {
+                            if(block->Compressed())
+                                h.flags |= LVPAFLAG_FILTERED;
+                            else
+                                block->swap(unfiltered); // stored as is, use the original data
+                        }
+                    }
+                    LVPA_TRACE_OUT(trace, block->size());
+                }
+            }
+
+            if(block->size())
+            {
 
                 h.packedSize = block->size();
                 if(block->Compressed())
-                {
                     h.flags |= LVPAFLAG_PACKED; // this flag was cleared earlier
-                    h.crcPacked = CRC32::Calc(block->contents(), block->size());
-                }
 
-                // encrypt? these blocks will be thrown away, so we can just directly apply encryption
-                _CryptBlock((uint8*)block->contents(), h, true);
+                // calc packed crc, and encrypt in the same go if necessary.
+                // these blocks will be thrown away, so we can just directly apply encryption
+                {
+                    LVPA_TRACE_SCOPE_IF(trace, h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED), LVPATRACE_ENCRYPT, h, h.packedSize);
+                    if(_CryptBlock((uint8*)block->contents(), h, true, block->Compressed() ? &h.crcPacked : NULL))
+                        LVPA_TRACE_OUT(trace, h.packedSize);
+                }
 
                 bar.PartialFix();
             }
@@ -1006,16 +2007,17 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
             DEBUG(ASSERT(h.data.size == h.realSize));
             DEBUG(ASSERT(h.data.size == h.packedSize));
 
-            // we still need to calc crc
-            h.crcReal = CRC32::Calc(h.data.ptr, h.data.size);
-
-            // if the file should be encrypted, we have to make a copy anyways.
+            // if the file should be encrypted, we have to make a copy anyways, and calc the crc while encrypting.
             if(h.data.size && (h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED)))
             {
+                LVPA_TRACE_SCOPE(trace, LVPATRACE_ENCRYPT, h, h.data.size);
                 fileBufs.v[i] = new ICompressor;
                 fileBufs.v[i]->append(h.data.ptr, h.data.size);
-                _CryptBlock((uint8*)fileBufs.v[i]->contents(), h, true);
+                if(_CryptBlock((uint8*)fileBufs.v[i]->contents(), h, true, &h.crcReal))
+                    LVPA_TRACE_OUT(trace, h.data.size);
             }
+            else // we still need to calc crc
+                h.crcReal = LVPAChecksum::Calc(h.checksum, h.data.ptr, h.data.size);
         }
         else
         {
@@ -1032,7 +2034,21 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
         if(!(h.flags & LVPAFLAG_SOLID))
             _packedSize += h.packedSize;
 
-        *zhdr << h;
+        // a file written with a dictionary, filter, another cipher, checksum or restart points can't be read by older versions
+        if(restartPoints)
+            minVersion = std::max<uint32>(minVersion, 5);
+        if(checksumTypes)
+            minVersion = std::max<uint32>(minVersion, 4);
+        if((h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED)) && h.cipher != LVPAENCR_ENABLED)
+            minVersion = std::max<uint32>(minVersion, 3);
+        if(h.flags & LVPAFLAG_FILTERED)
+            minVersion = std::max<uint32>(minVersion, 2);
+        if(h.flags & (LVPAFLAG_DICT | LVPAFLAG_DICTREF))
+            minVersion = std::max<uint32>(minVersion, 1);
+
+        if(!(h.flags & LVPAFLAG_PACKED))
+            h.restarts.clear();
+        writeFileHeader(*zhdr, h, checksumTypes, restartPoints);
         ++writtenHeaders;
     }
 
@@ -1046,7 +2062,7 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
     LVPAMasterHeader masterHdr;
     ByteBuffer masterBuf;
 
-    masterHdr.version = gVersion;
+    masterHdr.version = minVersion;
     masterHdr.hdrEntries = writtenHeaders;
     masterHdr.algo = algo;
     masterHdr.realHdrSize = zhdr->size();
@@ -1055,19 +2071,23 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
 
     if(zhdr->size())
     {
-        masterHdr.hdrCrcReal = CRC32::Calc(zhdr->contents(), zhdr->size());
+        masterHdr.hdrCrcReal = uint32(LVPAChecksum::Calc(hdrChecksum, zhdr->contents(), zhdr->size()));
 
         // now we can compress the headers
         if(compression)
             zhdr->Compress(compression);
 
         if(zhdr->Compressed())
-            masterHdr.hdrCrcPacked = CRC32::Calc(zhdr->contents(), zhdr->size());
+            masterHdr.hdrCrcPacked = uint32(LVPAChecksum::Calc(hdrChecksum, zhdr->contents(), zhdr->size()));
     }
 
     masterHdr.flags = zhdr->Compressed() ? LVPAHDR_PACKED : LVPAHDR_NONE;
     if(encrypt)
         masterHdr.flags |= LVPAHDR_ENCRYPTED;
+    if(checksumTypes)
+        masterHdr.flags |= LVPAHDR_XXH64;
+    if(restartPoints)
+        masterHdr.flags |= LVPAHDR_RESTARTS;
     // its not bad if its not packed now, then packed and unpacked sizes are just equal
     masterHdr.packedHdrSize = zhdr->size();
 
@@ -1151,6 +2171,7 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
         LVPAFileHeader& h = headersCopy[i];
         if(!h.good || (h.flags & LVPAFLAG_SOLID))
             continue;
+        LVPA_TRACE_SCOPE(trace, LVPATRACE_WRITE, h, h.packedSize);
         ICompressor *block = fileBufs.v[i];
         uint32 expected;
 
@@ -1179,12 +2200,12 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
                 DEBUG(ASSERT(h.realSize));
                 memblock blob;
                 blob.size = h.packedSize;
-                blob.ptr = new uint8[blob.size + LVPA_EXTRA_BUFSIZE];
+                blob.ptr = AllocBuffer(blob.size);
 
                 if(!_LoadFile(blob, h))
                 {
                     logerror("Can't load '%s' from original file to raw-copy to outfile", h.filename.c_str());
-                    delete [] blob.ptr;
+                    FreeBuffer(blob);
                     fclose(outfile);
                     return false;
                 }
@@ -1194,9 +2215,10 @@ bool LVPAFile::SaveAs(const char *fn, LVPAComprLevels compression /* = LVPA_DEFA
                 written = 0;
                 if(blob.size)
                     written = fwrite(blob.ptr, 1, blob.size, outfile);
-                delete [] blob.ptr;
+                FreeBuffer(blob);
             }
         }
+        LVPA_TRACE_OUT(trace, written);
         if(written != expected)
         {
             logerror("Failed writing data to LVPA file - disk full?");
@@ -1234,15 +2256,20 @@ static bool _memnull(void *buf, uint32 size)
     return true;
 }
 
-memblock LVPAFile::_PrepareFile(LVPAFileHeader& h, bool checkCRC /* = true */)
+memblock LVPAFile::_PrepareFile(LVPAFileHeader& h, bool checkCRC /* = true */, uint32 from /* = 0 */, uint32 upTo /* = -1 */)
 {
     // h.good is set to false if there was a previous attempt to load the file that failed irrecoverably
     if(!h.good)
         return memblock();
+    LVPA_TRACE_SCOPE(trace, LVPATRACE_PREPARE, h, h.realSize);
 
-    // already known? -- if h.data.ptr != NULL, the data must have been fully decrypted and unpacked already.
+    // already known? -- if h.data.ptr != NULL, the data must have been fully decrypted and unpacked already,
+    // except for solid blocks, which may have to be unpacked further.
     if(h.data.ptr)
     {
+        if(!_partial.empty() && !_ContinueUnpack(h, from, upTo))
+            return memblock();
+        LVPA_TRACE_OUT(trace, h.data.size);
         return h.data;
     }
     else
@@ -1259,7 +2286,8 @@ memblock LVPAFile::_PrepareFile(LVPAFileHeader& h, bool checkCRC /* = true */)
                 return memblock();
             }
 
-            memblock solidMem = _PrepareFile(_headers[h.blockId], checkCRC);
+            // the padding after each file is part of the block
+            memblock solidMem = _PrepareFile(_headers[h.blockId], checkCRC, h.offset, h.offset + h.realSize + LVPA_EXTRA_BUFSIZE);
             if(!solidMem.ptr)
             {
                 logerror("Unable to load solid block for file '%s'", h.filename.c_str());
@@ -1268,9 +2296,16 @@ memblock LVPAFile::_PrepareFile(LVPAFileHeader& h, bool checkCRC /* = true */)
 
             if(h.offset + h.packedSize <= solidMem.size)
             {
+                LVPAFileHeader& block = _headers[h.blockId];
                 h.data.ptr = solidMem.ptr + h.offset;
                 h.data.size = h.realSize;
                 h.otherMem = true;
+                if(!h.inBlockList)
+                {
+                    h.blockLink = block.blockLink;
+                    block.blockLink = h.id;
+                    h.inBlockList = true;
+                }
             }
             else
             {
@@ -1282,7 +2317,13 @@ memblock LVPAFile::_PrepareFile(LVPAFileHeader& h, bool checkCRC /* = true */)
         else
         {
             h.otherMem = false;
-            h.data = _UnpackFile(h);
+            h.data = _UnpackFile(h, checkCRC, from, upTo);
+            if(h.data.ptr)
+            {
+                _TrackResident(h);
+                if(_cacheBudget)
+                    _CacheLink(h);
+            }
         }
 
         if(!h.data.ptr) // if its still NULL, it failed to load
@@ -1291,113 +2332,842 @@ memblock LVPAFile::_PrepareFile(LVPAFileHeader& h, bool checkCRC /* = true */)
         }
     }
 
-    // optionally check CRC32 of the unpacked data
+    // optionally check the checksum of the unpacked data
     // -- for encrypted files, this is the only chance to find out whether the decryption key was correct
     // -- solid blocks can be skipped because the individual files are checksummed on their own
+    // -- stored files were already checked while loading, most packed files while unpacking, see _UnpackFile()
+    // -- in background mode, the data are returned right away, and a failed check is noticed later
     if(checkCRC && !h.checkedCRC && !(h.flags & LVPAFLAG_SOLIDBLOCK))
     {
-        h.checkedCRC = true;
-        uint32 crc = CRC32::Calc(h.data.ptr, h.data.size);
-        if(crc != h.crcReal)
+        if(!(_verifyMode == LVPAVERIFY_BACKGROUND && _QueueVerify(h)))
         {
-            logerror("CRC mismatch for unpacked '%s', file is corrupt, or decrypt fail", h.filename.c_str());
-            if(h.flags & LVPAFLAG_ENCRYPTED)
-                h.checkedCRC = false; // encrypted but failed, maybe the key was wrong, allow re-check
-            else
-                h.good = false; // if its not encrypted, there is nothing that could fix this
-            return memblock();
+            LVPA_TRACE_SCOPE(check, LVPATRACE_CHECK, h, h.data.size);
+            if(!_CheckCRC(h, timedChecksum(_stats, h.checksum, h.data.ptr, h.data.size), false))
+                return memblock();
+            LVPA_TRACE_OUT(check, h.data.size);
         }
     }
 
     DEBUG(ASSERT(_memnull(h.data.ptr + h.data.size, LVPA_EXTRA_BUFSIZE)));
 
+    LVPA_TRACE_OUT(trace, h.data.size);
     return h.data;
 }
 
-memblock LVPAFile::_UnpackFile(LVPAFileHeader& h)
+bool LVPAFile::_ContinueUnpack(LVPAFileHeader& h, uint32 from, uint32 upTo)
 {
-    DEBUG(ASSERT(h.good && !(h.flags & LVPAFLAG_SOLID))); // if this flag is set this function should not be entered
-
-    ICompressor *buf = NULL;
-    memblock target;
-
-    if(h.flags & LVPAFLAG_PACKED)
+    std::map<uint32, LVPAPartialBlock*>::iterator it = _partial.find(h.id);
+    if(it == _partial.end())
+        return true; // complete
+    LVPAPartialBlock *pb = it->second;
+    upTo = std::min(upTo, h.realSize);
+    bool ok = true;
+    const uint32 unpackedBefore = pb->unpacked;
+    LVPA_TRACE_SCOPE(trace, LVPATRACE_UNPACK, h, h.packedSize);
+    const uint64 start = GetTimeNanos();
+
+    if(h.restarts.empty())
+    {
+        // the decoder can only go on from where it stopped
+        if(pb->unpacked >= upTo)
+            return true;
+        DEBUG(logdebug("'%s': uncompressing up to %u of %u", h.filename.c_str(), upTo, h.realSize));
+        ok = pb->comp->DecompressUntil(upTo);
+        pb->unpacked = pb->comp->DecompressedSize();
+    }
+    else
     {
-        buf = allocCompressor(h.algo);
-        target.size = h.packedSize;
-        if(target.size)
+        // only the segments that overlap the range
+        for(uint32 s = findSegment(h, from); ok && s < pb->segDone.size(); ++s)
         {
-            buf->resize(target.size);
-            target.ptr = (uint8*)buf->contents();
+            if(s && h.restarts[s - 1].unpackedOffs >= upTo)
+                break;
+            if(pb->segDone[s])
+                continue;
+            DEBUG(logdebug("'%s': uncompressing segment %u of %u", h.filename.c_str(), s, uint32(pb->segDone.size())));
+            ok = unpackSegment(pb->comp, h, s, pb->dst, pb->comp->contents());
+            pb->segDone[s] = true;
+            pb->unpacked += (s < h.restarts.size() ? h.restarts[s].unpackedOffs : h.realSize) - (s ? h.restarts[s - 1].unpackedOffs : 0);
         }
-        buf->wpos(0);
-        buf->rpos(0);
+    }
+
+    AtomicAdd(&_stats.decodeNanos, GetTimeNanos() - start);
+    AtomicAdd(&_stats.bytesDecompressed, pb->unpacked - unpackedBefore);
+    LVPA_TRACE_OUT(trace, ok ? pb->unpacked - unpackedBefore : 0);
+
+    if(ok && pb->unpacked < h.realSize)
+        return true;
+
+    _partial.erase(it);
+    delete pb;
+    if(!ok)
+    {
+        // the packed data passed their checksum already, so this is not a decryption problem.
+        // the files handed out so far stay valid, they were unpacked correctly and are checked on their own.
+        logerror("Failed to unpack '%s', file is corrupt", h.filename.c_str());
+        h.good = false;
+    }
+    return ok;
+}
+
+void LVPAFile::_DropPartial(LVPAFileHeader& h)
+{
+    std::map<uint32, LVPAPartialBlock*>::iterator it = _partial.find(h.id);
+    if(it != _partial.end())
+    {
+        delete it->second;
+        _partial.erase(it);
+    }
+}
+
+uint32 LVPAFile::GetUnpackedSize(uint32 id) const
+{
+    const LVPAFileHeader& h = _headers[id];
+    if(!h.data.ptr)
+        return 0;
+    std::map<uint32, LVPAPartialBlock*>::const_iterator it = _partial.find(id);
+    return it != _partial.end() ? it->second->unpacked : h.data.size;
+}
+
+bool LVPAFile::_CheckCRC(LVPAFileHeader& h, uint64 crc, bool packed)
+{
+    bool& checked = packed ? h.checkedCRCPacked : h.checkedCRC;
+    checked = true;
+    if(crc == (packed ? h.crcPacked : h.crcReal))
+        return true;
+
+    logerror("CRC mismatch for %s '%s', file is corrupt, or decrypt fail", packed ? "packed" : "unpacked", h.filename.c_str());
+    if(h.flags & LVPAFLAG_ENCRYPTED)
+        checked = false; // encrypted but failed, maybe the key was wrong, allow re-check
+    else
+        h.good = false; // if its not encrypted, there is nothing that could fix this
+    return false;
+}
+
+bool LVPAFile::_QueueVerify(LVPAFileHeader& h)
+{
+    if(!_verify)
+    {
+        _verify = new LVPAVerifyState;
+        _verify->owner = this;
+    }
+
+    LVPAVerifyJob job;
+    job.id = h.id;
+    job.ptr = h.data.ptr;
+    job.size = h.data.size;
+    job.expected = h.crcReal;
+    job.result = 0;
+    job.checksum = h.checksum;
+    job.filename = h.filename;
+
+    bool start = false;
+    {
+        MutexGuard g(_verify->mtx);
+        _verify->todo.push_back(job);
+        if(!_verify->running)
+            start = _verify->running = true;
+    }
+
+    if(start)
+    {
+        _verify->thread.Join(); // the previous one is done already, or about to return
+        if(!_verify->thread.Start(_VerifyThread, _verify))
+        {
+            // the queue was empty before, so this is the only job. do it right here instead.
+            MutexGuard g(_verify->mtx);
+            _verify->todo.clear();
+            _verify->running = false;
+            return false;
+        }
+    }
+
+    h.checkedCRC = true; // if it turns out to be bad, _ApplyVerifyResults() fixes this
+    return true;
+}
+
+void LVPAFile::_VerifyThread(void *p)
+{
+    LVPAVerifyState *v = (LVPAVerifyState*)p;
+    while(true)
+    {
+        LVPAVerifyJob job;
+        {
+            MutexGuard g(v->mtx);
+            if(v->todo.empty())
+            {
+                v->running = false;
+                return;
+            }
+            job = v->todo.front();
+            v->todo.pop_front();
+        }
+
+        job.result = timedChecksum(v->owner->_stats, job.checksum, job.ptr, job.size);
+        if(job.result != job.expected && v->cb)
+            v->cb(v->owner, job.id, job.filename.c_str(), v->user);
+
+        MutexGuard g(v->mtx);
+        v->done.push_back(job);
+    }
+}
+
+void LVPAFile::_ApplyVerifyResults(void)
+{
+    std::vector<LVPAVerifyJob> done;
+    {
+        MutexGuard g(_verify->mtx);
+        done.swap(_verify->done);
+    }
+    for(uint32 i = 0; i < done.size(); ++i)
+        if(done[i].result != done[i].expected)
+            _CheckCRC(_headers[done[i].id], done[i].result, false);
+}
+
+void LVPAFile::WaitVerify(void)
+{
+    if(!_verify)
+        return;
+    _verify->thread.Join(); // nothing else adds jobs meanwhile, so it returns once all are done
+    _ApplyVerifyResults();
+}
+
+bool LVPAFile::SetVerifyMode(uint8 mode, LVPAVerifyCallback cb /* = NULL */, void *user /* = NULL */)
+{
+    if(mode >= LVPAVERIFY_MAX_SUPPORTED)
+        return false;
+    WaitVerify(); // the callback may be in use
+    if(!_verify && cb)
+    {
+        _verify = new LVPAVerifyState;
+        _verify->owner = this;
+    }
+    if(_verify)
+    {
+        _verify->cb = cb;
+        _verify->user = user;
+    }
+    _verifyMode = mode;
+    return true;
+}
+
+bool LVPAFile::AllVerified(void)
+{
+    WaitVerify();
+    for(LVPAIndexMap::iterator it = _indexes.begin(); it != _indexes.end(); ++it)
+    {
+        const LVPAFileHeader& h = _headers[it->second];
+        if(!h.good)
+            return false;
+        // solid blocks and dictionaries are covered by the files that use them
+        if(!(h.flags & (LVPAFLAG_SOLIDBLOCK | LVPAFLAG_DICT)) && !h.checkedCRC)
+            return false;
+    }
+    return true;
+}
+
+// VerifyAll() reads in pieces of this size, so that the threads take turns at the disk without seeking all the time
+#define LVPA_VERIFY_CHUNK_SIZE (1024 * 1024)
+
+enum LVPAVerifyChecked
+{
+    LVPAVERIFY_CHECKED_PACKED   = 0x01, // crcs[i].first is valid
+    LVPAVERIFY_CHECKED_REAL     = 0x02, // crcs[i].second is valid
+    LVPAVERIFY_READ_FAILED      = 0x04,
+    LVPAVERIFY_UNPACK_FAILED    = 0x08,
+};
+
+struct LVPAVerifyAllJob
+{
+    LVPAFile *lvpa;
+    LVPAStats *stats; // of lvpa
+    LVPAFileReader *reader;
+    bool packedOnly;
+    uint32 innerThreads; // for decompressors
+    std::vector<uint32> ids; // files and solid blocks to read from disk
+    std::vector<std::vector<uint32> > members; // files in each solid block, by header id
+    // results by header id; each entry is written by one thread only
+    std::vector<uint8> checked; // see LVPAVerifyChecked
+    std::vector<std::pair<uint64, uint64> > crcs; // packed, real
+
+    Mutex mtx; // for the reader and the progress
+    uint32 done;
+    LVPAProgressCallback cb;
+    void *user;
+
+    // reads (and decrypts) the stored data of h, and checksums them. Into dst if not NULL.
+    bool Read(const LVPAFileHeader& h, ISymmetricCipher *ciph, uint8 *dst, uint64 *crc)
+    {
+        std::vector<uint8> scratch;
+        if(!dst && h.packedSize)
+            scratch.resize(std::min<uint32>(LVPA_VERIFY_CHUNK_SIZE, h.packedSize));
+
+        LVPAChecksum c(h.checksum);
+        uint64 crcNanos = 0;
+        for(uint32 pos = 0; pos < h.packedSize; pos += LVPA_VERIFY_CHUNK_SIZE)
+        {
+            const uint32 len = std::min<uint32>(LVPA_VERIFY_CHUNK_SIZE, h.packedSize - pos);
+            uint8 *chunk = dst ? dst + pos : &scratch[0];
+            {
+                MutexGuard g(mtx);
+                if(reader->readF(reader->opaque, chunk, h.offset + pos, len) != len)
+                    return false;
+            }
+            AtomicAdd(&stats->bytesRead, len);
+            if(ciph)
+                AtomicAdd(&stats->bytesDecrypted, len);
+            for(uint32 t = 0; t < len; t += LVPA_CRYPT_TILE_SIZE)
+            {
+                const uint32 tlen = std::min<uint32>(LVPA_CRYPT_TILE_SIZE, len - t);
+                if(ciph)
+                    ciph->Apply(chunk + t, tlen);
+                const uint64 start = GetTimeNanos();
+                c.Update(chunk + t, tlen);
+                crcNanos += GetTimeNanos() - start;
+            }
+        }
+        *crc = c.Finalize();
+        AtomicAdd(&stats->crcNanos, crcNanos);
+        return true;
+    }
+};
+
+void LVPAFile::_VerifyEntry(uint32 idx, void *p)
+{
+    LVPAVerifyAllJob *job = (LVPAVerifyAllJob*)p;
+    const uint32 id = job->ids[idx];
+    LVPAFileHeader& h = job->lvpa->_headers[id];
+    uint8& checked = job->checked[id];
+    const bool packed = (h.flags & LVPAFLAG_PACKED) != 0;
+    const bool solidBlock = (h.flags & LVPAFLAG_SOLIDBLOCK) != 0;
+    // like when loading, solid blocks are not checked as a whole, but each of their files is.
+    // so stored blocks have to be read into memory, packed ones only if they are unpacked anyway.
+    const bool load = packed ? !job->packedOnly : solidBlock;
+
+    std::auto_ptr<ISymmetricCipher> ciph;
+    if(h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED))
+        ciph.reset(job->lvpa->_InitCipher(h, false)); // the keys were prepared by VerifyAll(), nothing is changed here
+
+    std::auto_ptr<ICompressor> buf;
+    uint8 *stored = NULL;
+    uint8 *dst = NULL;
+    if(load && packed)
+    {
+        buf.reset(allocCompressor(h.algo));
+        if(buf.get())
+        {
+            buf->Threads(job->innerThreads);
+            buf->allocator(job->lvpa->_allocator);
+            buf->resize(h.packedSize);
+            dst = (uint8*)buf->contents();
+        }
+    }
+    else if(load)
+        dst = stored = job->lvpa->AllocBuffer(h.packedSize);
+
+    uint64 crc = 0;
+    if(load && packed && !buf.get())
+        checked |= LVPAVERIFY_UNPACK_FAILED;
+    else if(!job->Read(h, ciph.get(), dst, &crc))
+        checked |= LVPAVERIFY_READ_FAILED;
+    else if(packed)
+    {
+        checked |= LVPAVERIFY_CHECKED_PACKED;
+        job->crcs[id].first = crc;
+    }
+    else if(!solidBlock)
+    {
+        checked |= LVPAVERIFY_CHECKED_REAL;
+        job->crcs[id].second = crc;
+    }
+
+    // unpack only what arrived intact
+    uint8 *unpacked = NULL;
+    if(buf.get() && (checked & LVPAVERIFY_CHECKED_PACKED) && crc == h.crcPacked)
+    {
+        const LVPAFileHeader *dict = (h.flags & LVPAFLAG_DICTREF) ? &job->lvpa->_headers[h.blockId] : NULL;
+        if(dict)
+            buf->SetDictionary(dict->data.ptr, dict->data.size); // was loaded by VerifyAll()
+
+        unpacked = job->lvpa->AllocBuffer(h.realSize);
+        const uint64 start = GetTimeNanos();
+        const bool ok = dict && !dict->data.ptr ? false : unpackAll(buf.get(), h, unpacked, dst);
+        AtomicAdd(&job->stats->decodeNanos, GetTimeNanos() - start);
+        if(!ok)
+        {
+            checked |= LVPAVERIFY_UNPACK_FAILED;
+            job->lvpa->FreeBuffer(memblock(unpacked, h.realSize));
+            unpacked = NULL;
+        }
+        else
+        {
+            AtomicAdd(&job->stats->bytesDecompressed, h.realSize);
+            if(!solidBlock)
+            {
+                checked |= LVPAVERIFY_CHECKED_REAL;
+                job->crcs[id].second = timedChecksum(*job->stats, h.checksum, unpacked, h.realSize);
+            }
+        }
+    }
+    buf.reset();
+
+    const uint8 *data = unpacked ? unpacked : (checked & LVPAVERIFY_READ_FAILED) ? NULL : stored;
+    if(data && solidBlock)
+    {
+        const std::vector<uint32>& members = job->members[id];
+        for(uint32 i = 0; i < members.size(); ++i)
+        {
+            const LVPAFileHeader& mh = job->lvpa->_headers[members[i]];
+            if(mh.offset + mh.realSize > h.realSize)
+                job->checked[mh.id] |= LVPAVERIFY_UNPACK_FAILED;
+            else
+            {
+                job->checked[mh.id] |= LVPAVERIFY_CHECKED_REAL;
+                job->crcs[mh.id].second = timedChecksum(*job->stats, mh.checksum, data + mh.offset, mh.realSize);
+            }
+        }
+    }
+    if(unpacked)
+        job->lvpa->FreeBuffer(memblock(unpacked, h.realSize));
+    if(stored)
+        job->lvpa->FreeBuffer(memblock(stored, h.packedSize));
+
+    MutexGuard g(job->mtx);
+    ++job->done;
+    if(job->cb)
+        job->cb(job->done, job->ids.size(), job->user);
+}
+
+bool LVPAFile::VerifyAll(bool packedOnly /* = false */, LVPAProgressCallback cb /* = NULL */, void *user /* = NULL */)
+{
+    WaitVerify();
+    if(!_OpenFile())
+        return false;
+
+    LVPAVerifyAllJob job;
+    job.lvpa = this;
+    job.stats = &_stats;
+    job.reader = &reader;
+    job.packedOnly = packedOnly;
+    job.checked.resize(_headers.size());
+    job.crcs.resize(_headers.size());
+    job.done = 0;
+    job.cb = cb;
+    job.user = user;
+    job.members.resize(_headers.size());
+
+    bool result = true;
+    std::vector<uint32> loadedDicts;
+    for(uint32 i = 0; i < _headers.size(); ++i)
+    {
+        LVPAFileHeader& h = _headers[i];
+        if(!h.good)
+            continue; // known to be bad already
+        if(h.flags & LVPAFLAG_SOLID)
+        {
+            if(h.blockId < _headers.size())
+                job.members[h.blockId].push_back(i);
+            continue;
+        }
+
+        // the threads only read the cipher keys and cached master key states, so everything that changes them is done here
+        const uint8 cryptFlags = h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED);
+        if(cryptFlags)
+        {
+            bool prepared;
+            if(h.flags & LVPAFLAG_SCRAMBLED)
+                prepared = h.cipherKeyFlags == cryptFlags;
+            else
+                prepared = h.cipher == LVPAENCR_CHACHA20 ? _masterChaCha != NULL : _masterCipher != NULL;
+            if(h.cipher != LVPAENCR_CHACHA20 && !h.cipherWarmup)
+                prepared = false;
+            if(!prepared)
+            {
+                ISymmetricCipher *ciph = _InitCipher(h, false);
+                if(!ciph)
+                {
+                    // scrambled files whose name is not known can't be found anyway
+                    if(!(h.flags & LVPAFLAG_SCRAMBLED) || !h.filename.empty())
+                    {
+                        logerror("Unable to decrypt '%s', no key set, or wrong file name", h.filename.c_str());
+                        result = false;
+                    }
+                    continue;
+                }
+                delete ciph;
+            }
+        }
+
+        // dictionaries are needed by the threads
+        if(!packedOnly && (h.flags & LVPAFLAG_DICTREF) && h.blockId < _headers.size() && (_headers[h.blockId].flags & LVPAFLAG_DICT))
+        {
+            LVPAFileHeader& dh = _headers[h.blockId];
+            if(!dh.data.ptr && dh.good && _PrepareFile(dh).ptr)
+                loadedDicts.push_back(dh.id);
+        }
+
+        job.ids.push_back(i);
+    }
+
+    // with a single entry, the decompressor may use the threads itself
+    job.innerThreads = job.ids.size() > 1 ? 1 : _threads;
+    ParallelFor(job.ids.size(), _VerifyEntry, &job, _threads);
+
+    for(uint32 i = 0; i < loadedDicts.size(); ++i)
+        Free(loadedDicts[i]);
+
+    for(uint32 i = 0; i < _headers.size(); ++i)
+    {
+        LVPAFileHeader& h = _headers[i];
+        const uint8 checked = job.checked[i];
+        if(checked & LVPAVERIFY_READ_FAILED)
+        {
+            logerror("Unable to read enough data for file '%s'", h.filename.c_str());
+            h.good = false;
+        }
+        if(checked & LVPAVERIFY_UNPACK_FAILED)
+        {
+            logerror("Failed to unpack '%s', file is corrupt, or decrypt fail", h.filename.c_str());
+            if(!(h.flags & LVPAFLAG_ENCRYPTED))
+                h.good = false;
+            result = false;
+        }
+        if((checked & LVPAVERIFY_CHECKED_PACKED) && !_CheckCRC(h, job.crcs[i].first, true))
+            result = false;
+        if((checked & LVPAVERIFY_CHECKED_REAL) && !_CheckCRC(h, job.crcs[i].second, false))
+            result = false;
+        result = result && h.good;
+    }
+
+    return result;
+}
+
+memblock LVPAFile::_UnpackFile(LVPAFileHeader& h, bool checkCRC /* = true */, uint32 from /* = 0 */, uint32 upTo /* = -1 */)
+{
+    DEBUG(ASSERT(h.good && !(h.flags & LVPAFLAG_SOLID))); // if this flag is set this function should not be entered
+    LVPA_TRACE_SCOPE(trace, LVPATRACE_UNPACK, h, h.packedSize);
+
+    ICompressor *buf = NULL;
+    memblock target;
+
+    if(h.flags & LVPAFLAG_PACKED)
+    {
+        buf = _AllocCompressor(h.algo);
+        target.size = h.packedSize;
+        if(target.size)
+        {
+            buf->resize(target.size);
+            target.ptr = (uint8*)buf->contents();
+        }
+        buf->wpos(0);
+        buf->rpos(0);
     }
     else
     {
         target.size = h.realSize;
-        target.ptr = new uint8[target.size + LVPA_EXTRA_BUFSIZE];
+        target.ptr = AllocBuffer(target.size);
     }
 
-    if(!_DecryptFile(target, h))
+    // the checksum is calculated while loading, if it is needed:
+    // packed data are always checked, stored files (not solid blocks, see _PrepareFile()) only if requested
+    bool needCRC = buf ? !h.checkedCRCPacked : (checkCRC && !h.checkedCRC && !(h.flags & LVPAFLAG_SOLIDBLOCK));
+    uint64 crc = 0;
+
+    if(!_DecryptFile(target, h, needCRC ? &crc : NULL))
     {
         if(buf)
             delete buf;
+        else
+            FreeBuffer(target);
+        return memblock();
+    }
+
+    if(needCRC && !_CheckCRC(h, crc, buf != NULL))
+    {
+        if(buf)
+            delete buf;
+        else
+            FreeBuffer(target);
         return memblock();
     }
 
     // if the file is compressed, we allocated a decompressor buf earlier
     if(buf)
     {
-        // check CRC32 of the packed data
-        if(!h.checkedCRCPacked)
+
+        if(h.flags & LVPAFLAG_DICTREF)
         {
-            h.checkedCRCPacked = true;
-            uint32 crc = CRC32::Calc(target.ptr, target.size);
-            if(crc != h.crcPacked)
+            memblock dict;
+            if(h.blockId < _headers.size() && (_headers[h.blockId].flags & LVPAFLAG_DICT))
+                dict = _PrepareFile(_headers[h.blockId]);
+            if(!dict.ptr)
             {
-                logerror("CRC mismatch for packed '%s', file is corrupt, or decrypt fail", h.filename.c_str());
-                if(h.flags & LVPAFLAG_ENCRYPTED)
-                    h.checkedCRCPacked = false; // encrypted but failed, maybe the key was wrong, allow re-check
-                else
-                    h.good = false; // if its not encrypted, there is nothing that could fix this
+                logerror("Unable to load dictionary for file '%s'", h.filename.c_str());
+                delete buf;
                 return memblock();
             }
+            buf->SetDictionary(dict.ptr, dict.size); // stays loaded along with its header
         }
 
-        buf->Compressed(true); // tell the buf that it is compressed so it will allow decompression
-        buf->RealSize(h.realSize);
+        // decompress straight into the final buffer, the packed data stay in buf until done.
+        // a solid block is only unpacked as far as needed, if it has to be filtered afterwards it must be complete.
+        // with restart points, only the segments in the requested range are unpacked, each is filtered on its own.
         DEBUG(logdebug("'%s': uncompressing %u -> %u", h.filename.c_str(), h.packedSize, h.realSize));
-        buf->Decompress();
-        target.size = buf->size();
-        target.ptr = new uint8[target.size + LVPA_EXTRA_BUFSIZE];
+        uint8 *unpacked = AllocBuffer(h.realSize);
+        if(!h.restarts.empty())
+        {
+            LVPAPartialBlock *pb = new LVPAPartialBlock(buf, unpacked);
+            pb->segDone.resize(h.restarts.size() + 1, false);
+            _partial[h.id] = pb;
+            if(!_ContinueUnpack(h, from, upTo)) // forgets pb on failure
+            {
+                FreeBuffer(memblock(unpacked, h.realSize));
+                return memblock();
+            }
+            target.ptr = unpacked;
+            target.size = h.realSize;
+            memset(target.ptr + target.size, 0, LVPA_EXTRA_BUFSIZE);
+            LVPA_TRACE_OUT(trace, target.size);
+            return target;
+        }
 
-        if(target.size)
-            buf->read(target.ptr, target.size);
+        bool partial = upTo < h.realSize && (h.flags & LVPAFLAG_SOLIDBLOCK) && !(h.flags & (LVPAFLAG_FILTERED | LVPAFLAG_DICTREF));
+        // if the unpacked data have to be checked right away (see _PrepareFile()), unpack them in tile-sized steps
+        // and checksum each step while it is still in cache. not for filtered files, those are only final after FilterDecode(),
+        // and not for LVPAPACK_LZMAMT, stepping would decode its chunks one by one instead of in parallel.
+        const bool stepCRC = !partial && checkCRC && !h.checkedCRC && _verifyMode != LVPAVERIFY_BACKGROUND
+            && !(h.flags & (LVPAFLAG_SOLIDBLOCK | LVPAFLAG_FILTERED)) && h.algo != LVPAPACK_LZMAMT;
+        uint64 realCRC = 0, crcNanos = 0;
+        bool ok;
+        const uint64 start = GetTimeNanos();
+        if(partial)
+        {
+            ok = buf->BeginDecompress(unpacked, h.realSize, target.ptr, target.size) && buf->DecompressUntil(upTo);
+            partial = ok && buf->DecompressedSize() < h.realSize;
+        }
+        else if(stepCRC)
+        {
+            LVPAChecksum c(h.checksum);
+            ok = buf->BeginDecompress(unpacked, h.realSize, target.ptr, target.size);
+            for(uint32 done = 0; ok && done < h.realSize; )
+            {
+                ok = buf->DecompressUntil(done + std::min<uint32>(LVPA_CRYPT_TILE_SIZE, h.realSize - done))
+                    && buf->DecompressedSize() > done;
+                if(ok)
+                {
+                    const uint64 t = GetTimeNanos();
+                    c.Update(unpacked + done, buf->DecompressedSize() - done);
+                    crcNanos += GetTimeNanos() - t;
+                    done = buf->DecompressedSize();
+                }
+            }
+            buf->EndDecompress();
+            realCRC = c.Finalize();
+        }
+        else
+            ok = unpackAll(buf, h, unpacked, target.ptr);
+        AtomicAdd(&_stats.decodeNanos, GetTimeNanos() - start - crcNanos);
+        AtomicAdd(&_stats.crcNanos, crcNanos);
+        if(ok)
+            AtomicAdd(&_stats.bytesDecompressed, partial ? buf->DecompressedSize() : h.realSize);
 
+        if(partial)
+        {
+            LVPAPartialBlock *pb = new LVPAPartialBlock(buf, unpacked); // keeps the packed data and the decompressor state
+            pb->unpacked = buf->DecompressedSize();
+            _partial[h.id] = pb;
+        }
+        else
+            delete buf;
+
+        if(!ok)
+        {
+            logerror("Failed to unpack '%s', file is corrupt, or decrypt fail", h.filename.c_str());
+            FreeBuffer(memblock(unpacked, h.realSize));
+            if(!(h.flags & LVPAFLAG_ENCRYPTED))
+                h.good = false;
+            return memblock();
+        }
 
+        if(stepCRC && !_CheckCRC(h, realCRC, false)) // _PrepareFile() skips its own check now
+        {
+            FreeBuffer(memblock(unpacked, h.realSize));
+            return memblock();
+        }
 
-        delete buf;
+        target.ptr = unpacked;
+        target.size = h.realSize;
     }
 
     memset(target.ptr + target.size, 0, LVPA_EXTRA_BUFSIZE); // zero out extra space
+    LVPA_TRACE_OUT(trace, target.size);
     return target;
 }
 
-bool LVPAFile::_DecryptFile(memblock &target, LVPAFileHeader& h)
+struct CryptTilesJob
+{
+    const ISymmetricCipher *ciph;
+    uint8 *buf;
+    uint32 size;
+    bool crcFirst; // checksum before applying the cipher (when encrypting)
+    std::vector<uint32> crcs; // one per tile, empty if not needed
+    volatile uint64 *crcNanos; // time spent on crcs is added here, if not NULL
+};
+
+// CRC32 of a tile, timed if requested
+static uint32 tileChecksum(CryptTilesJob *job, const uint8 *tile, uint32 len)
+{
+    if(!job->crcNanos)
+        return CRC32::Calc(tile, len);
+    const uint64 start = GetTimeNanos();
+    const uint32 crc = CRC32::Calc(tile, len);
+    AtomicAdd(job->crcNanos, GetTimeNanos() - start);
+    return crc;
+}
+
+static void cryptTile(uint32 idx, void *user)
+{
+    CryptTilesJob *job = (CryptTilesJob*)user;
+    const uint32 pos = idx * LVPA_CRYPT_TILE_SIZE;
+    uint8 *tile = job->buf + pos;
+    const uint32 len = std::min<uint32>(LVPA_CRYPT_TILE_SIZE, job->size - pos);
+    if(job->crcs.size() && job->crcFirst)
+        job->crcs[idx] = tileChecksum(job, tile, len);
+    job->ciph->ApplyAt(tile, len, pos);
+    if(job->crcs.size() && !job->crcFirst)
+        job->crcs[idx] = tileChecksum(job, tile, len);
+}
+
+// For seekable ciphers: the tiles are independent, so spread them over several threads (0 = one per CPU).
+// Returns false (and does nothing) if that does not help. The time spent on checksums is added to crcNanos, if not NULL.
+static bool cryptTilesParallel(const ISymmetricCipher *ciph, uint8 *buf, uint32 size, bool crcFirst, uint8 checksum, uint64 *crc, uint32 threads,
+                               volatile uint64 *crcNanos = NULL)
+{
+    const uint32 tiles = (size + LVPA_CRYPT_TILE_SIZE - 1) / LVPA_CRYPT_TILE_SIZE;
+    if(!threads)
+        threads = GetCPUCount();
+    if(!ciph || !ciph->Seekable() || threads < 2 || tiles < 2)
+        return false;
+
+    // only CRC32 checksums of the tiles can be combined, others go over the whole buffer in one piece
+    if(crc && checksum != LVPACHECK_CRC32)
+    {
+        if(!crcFirst)
+            cryptTilesParallel(ciph, buf, size, crcFirst, checksum, NULL, threads);
+        const uint64 start = GetTimeNanos();
+        *crc = LVPAChecksum::Calc(checksum, buf, size);
+        if(crcNanos)
+            AtomicAdd(crcNanos, GetTimeNanos() - start);
+        if(crcFirst)
+            cryptTilesParallel(ciph, buf, size, crcFirst, checksum, NULL, threads);
+        return true;
+    }
+
+    CryptTilesJob job;
+    job.ciph = ciph;
+    job.buf = buf;
+    job.size = size;
+    job.crcFirst = crcFirst;
+    job.crcNanos = crcNanos;
+    if(crc)
+        job.crcs.resize(tiles);
+
+    ParallelFor(tiles, cryptTile, &job, threads);
+
+    if(crc)
+    {
+        // all tiles but the last one have the same size
+        const uint32 op = CRC32::CombineGen(LVPA_CRYPT_TILE_SIZE);
+        uint32 c = job.crcs[0];
+        for(uint32 i = 1; i + 1 < tiles; ++i)
+            c = CRC32::CombineOp(c, job.crcs[i], op);
+        *crc = CRC32::Combine(c, job.crcs[tiles - 1], size - (tiles - 1) * LVPA_CRYPT_TILE_SIZE);
+    }
+    return true;
+}
+
+bool LVPAFile::_DecryptFile(memblock &target, LVPAFileHeader& h, uint64 *crc /* = NULL */)
 {
     DEBUG(ASSERT(h.good && !(h.flags & LVPAFLAG_SOLID))); // if this flag is set this function should not be entered
 
-    if(!_LoadFile(target, h))
+    LVPA_TRACE_SCOPE(trace, LVPATRACE_DECRYPT, h, h.packedSize);
+    const bool crypt = (h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED)) != 0;
+    std::auto_ptr<ISymmetricCipher> ciph;
+    if(crypt)
+    {
+        ciph.reset(_InitCipher(h, false));
+        if(!ciph.get())
+        {
+            // failed to decrypt - this means the settings are not sufficient to decrypt the file,
+            // NOT that the key was wrong!
+            return false;
+        }
+    }
+
+    if(!_OpenFile())
         return false;
 
-    if(!_CryptBlock(target.ptr, h, false))
+    if(target.size != h.packedSize)
     {
-        // failed to decrypt - this means the settings are not sufficient to decrypt the file,
-        // NOT that the key was wrong!
+        logerror("Unable to read enough data for file '%s'", h.filename.c_str());
+        h.good = false;
         return false;
     }
 
+    // seek if necessary
+    reader.seek(h.offset);
+
+    // with a seekable cipher and more than one thread, read everything at once, then decrypt and checksum in parallel
+    const uint32 threads = _threads ? _threads : GetCPUCount();
+    if(crypt && ciph->Seekable() && target.size > LVPA_CRYPT_TILE_SIZE && threads > 1)
+    {
+        if(reader.read(target.ptr, target.size) != target.size)
+        {
+            logerror("Unable to read enough data for file '%s'", h.filename.c_str());
+            h.good = false;
+            return false;
+        }
+        cryptTilesParallel(ciph.get(), target.ptr, target.size, false, h.checksum, crc, threads, &_stats.crcNanos);
+        AtomicAdd(&_stats.bytesRead, target.size);
+        AtomicAdd(&_stats.bytesDecrypted, target.size);
+        LVPA_TRACE_OUT(trace, target.size);
+        return true;
+    }
+
+    // Read, decrypt and checksum one tile at a time, instead of going over the whole file three times.
+    // Each tile is still in the cache when it gets decrypted and checksummed.
+    LVPAChecksum c(h.checksum);
+    uint64 crcNanos = 0;
+    for(uint32 pos = 0; pos < target.size; pos += LVPA_CRYPT_TILE_SIZE)
+    {
+        uint8 *tile = target.ptr + pos;
+        const uint32 len = std::min<uint32>(LVPA_CRYPT_TILE_SIZE, target.size - pos);
+        if(reader.read(tile, len) != len)
+        {
+            logerror("Unable to read enough data for file '%s'", h.filename.c_str());
+            h.good = false;
+            return false;
+        }
+        if(crypt)
+            ciph->Apply(tile, len);
+        if(crc)
+        {
+            const uint64 start = GetTimeNanos();
+            c.Update(tile, len);
+            crcNanos += GetTimeNanos() - start;
+        }
+    }
+
+    AtomicAdd(&_stats.bytesRead, target.size);
+    if(crypt)
+        AtomicAdd(&_stats.bytesDecrypted, target.size);
+    if(crc)
+    {
+        *crc = c.Finalize();
+        AtomicAdd(&_stats.crcNanos, crcNanos);
+    }
+    LVPA_TRACE_OUT(trace, target.size);
+
     return true;
 }
 
@@ -1405,6 +3175,7 @@ bool LVPAFile::_LoadFile(memblock& target, LVPAFileHeader& h)
 {
     DEBUG(ASSERT(h.good && !(h.flags & LVPAFLAG_SOLID))); // if this flag is set this function should not be entered
 
+    LVPA_TRACE_SCOPE(trace, LVPATRACE_LOAD, h, h.packedSize);
     if(!_OpenFile())
         return false;
 
@@ -1412,12 +3183,14 @@ bool LVPAFile::_LoadFile(memblock& target, LVPAFileHeader& h)
     reader.seek(h.offset);
 
     uint32 bytes = reader.read(target.ptr, target.size);
+    AtomicAdd(&_stats.bytesRead, bytes);
     if(bytes != h.packedSize)
     {
         logerror("Unable to read enough data for file '%s'", h.filename.c_str());
         h.good = false;
         return false;
     }
+    LVPA_TRACE_OUT(trace, bytes);
     return true;
 }
 
@@ -1468,6 +3241,61 @@ void LVPAFile::_CalcOffsets(uint32 startOffset)
     }
 }
 
+ICompressor *LVPAFile::_AllocCompressor(uint8 algo)
+{
+    ICompressor *c = allocCompressor(algo);
+    if(c)
+    {
+        c->Threads(_threads);
+        c->allocator(_allocator);
+    }
+    return c;
+}
+
+bool LVPAFile::SetAllocator(const LVPAAllocator *alloc)
+{
+    WaitVerify();
+    for(uint32 i = 0; i < _headers.size(); ++i)
+    {
+        if(_headers[i].data.ptr)
+        {
+            logerror("SetAllocator(): can't change the allocator while '%s' is loaded", _headers[i].filename.c_str());
+            return false;
+        }
+    }
+    if(alloc)
+    {
+        DEBUG(ASSERT(alloc->allocF && alloc->freeF));
+        _allocStore = *alloc;
+        _allocator = &_allocStore;
+    }
+    else
+        _allocator = NULL;
+    return true;
+}
+
+uint8 *LVPAFile::AllocBuffer(uint32 size)
+{
+    if(!_allocator)
+        return new uint8[size + LVPA_EXTRA_BUFSIZE];
+    return (uint8*)_allocator->allocF(_allocator->opaque, size + LVPA_EXTRA_BUFSIZE);
+}
+
+void LVPAFile::FreeBuffer(memblock mb)
+{
+    if(!mb.ptr)
+        return;
+    if(!_allocator)
+        delete [] mb.ptr;
+    else
+        _allocator->freeF(_allocator->opaque, mb.ptr, mb.size + LVPA_EXTRA_BUFSIZE);
+}
+
+void LVPAFile::UseHugePages(bool use)
+{
+    SetLargeBufferHugePages(use);
+}
+
 void LVPAFile::RandomSeed(uint32 seed)
 {
     _mtrand->seed(seed);
@@ -1482,8 +3310,24 @@ bool LVPAFile::AllGood(void) const
     return true;
 }
 
+bool LVPAFile::SetChecksum(uint8 type)
+{
+    if(type >= LVPACHECK_MAX_SUPPORTED)
+        return false;
+    _checksum = type;
+    return true;
+}
+
 void LVPAFile::SetMasterKey(const void *key, uint32 size)
 {
+    // everything derived from the old key is useless now
+    delete _masterCipher;
+    delete _masterChaCha;
+    _masterCipher = NULL;
+    _masterChaCha = NULL;
+    for(uint32 i = 0; i < _headers.size(); ++i)
+        _headers[i].cipherKeyFlags = 0;
+
     _masterKey.resize(size);
     if(size)
     {
@@ -1501,20 +3345,27 @@ void LVPAFile::_CalcSaltedFilenameHash(uint8 *dst, const std::string& fn)
     sha.Finalize();
 }
 
-bool LVPAFile::_CryptBlock(uint8 *buf, LVPAFileHeader& hdr, bool writeMode)
+ISymmetricCipher *LVPAFile::_InitCipher(LVPAFileHeader& hdr, bool writeMode)
 {
-    if(!(hdr.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED)))
-        return true; // not encrypted, not scrambled, nothing to do, all fine
-
     uint8 mem[LVPAHash_Size];
-    LVPACipher ciph;
+    const uint8 cryptFlags = hdr.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED);
+    const uint8 *key = NULL; // per-file key, if the file is scrambled. NULL to use the master key.
+
+    // the cipher is chosen when encrypting, when decrypting the one stored in the header is used
+    if(writeMode)
+        hdr.cipher = (hdr.encryption == LVPAENCR_CHACHA20) ? LVPAENCR_CHACHA20 : LVPAENCR_ENABLED;
 
-    if(hdr.flags & LVPAFLAG_SCRAMBLED)
+    if((hdr.flags & LVPAFLAG_SCRAMBLED) && hdr.cipherKeyFlags == cryptFlags)
+    {
+        // the file name was already checked (or the hash calculated) when the key was derived, see below
+        key = &hdr.cipherKey[0];
+    }
+    else if(hdr.flags & LVPAFLAG_SCRAMBLED)
     {
         if(hdr.filename.empty())
         {
             DEBUG(logerror("File is scrambled, but given filename is empty, can't decrypt"));
-            return false;
+            return NULL;
         }
         _CalcSaltedFilenameHash(&mem[0], hdr.filename.c_str());
         if(writeMode)
@@ -1524,7 +3375,7 @@ bool LVPAFile::_CryptBlock(uint8 *buf, LVPAFileHeader& hdr, bool writeMode)
         else if(memcmp(&mem[0], hdr.hash, LVPAHash_Size))
         {
             DEBUG(logerror("_CryptBlock: wrong file name"));
-            return false;
+            return NULL;
         }
 
         LVPAHash::Calc(&mem[0], (uint8*)hdr.filename.c_str(), hdr.filename.length()); // this does NOT include the terminating '\0'
@@ -1538,17 +3389,66 @@ bool LVPAFile::_CryptBlock(uint8 *buf, LVPAFileHeader& hdr, bool writeMode)
             sha.Finalize();
         }
 
-        ciph.Init(&mem[0], LVPAHash_Size);
+        memcpy(&hdr.cipherKey[0], &mem[0], LVPAHash_Size);
+        hdr.cipherKeyFlags = cryptFlags;
+        key = &hdr.cipherKey[0];
     }
-    else if(hdr.flags & LVPAFLAG_ENCRYPTED)
+    else if(_masterKey.empty())
     {
-        if(_masterKey.size())
-            ciph.Init(&_masterKey[0], _masterKey.size());
+        DEBUG(logerror("_CryptBlock: encrypted, not scrambled, and no master key!"));
+        return NULL;
+    }
+
+    if(hdr.cipher == LVPAENCR_CHACHA20)
+    {
+        ChaCha20Cipher *ciph;
+        if(key)
+        {
+            ciph = new ChaCha20Cipher;
+            ciph->Init(key, LVPAHash_Size);
+        }
         else
         {
-            DEBUG(logerror("_CryptBlock: encrypted, not scrambled, and no master key!"));
-            return false;
+            // the master key can have any size, but ChaCha20 needs exactly 256 bits.
+            // not just its hash, because that is already used as salt.
+            if(!_masterChaCha)
+            {
+                LVPAHash sha(&mem[0]);
+                sha.Update(&_masterKey[0], _masterKey.size());
+                sha.Update(&_masterSalt[0], LVPAHash_Size);
+                sha.Finalize();
+                _masterChaCha = new ChaCha20Cipher;
+                _masterChaCha->Init(&mem[0], LVPAHash_Size);
+            }
+            ciph = new ChaCha20Cipher(*_masterChaCha);
         }
+
+        // never encrypt twice with the same key and nonce
+        if(writeMode)
+        {
+            for(uint32 i = 0; i < LVPA_CIPHER_NONCE_SIZE; ++i)
+                hdr.cipherNonce[i] = uint8(_mtrand->randInt(0xFF));
+            hdr.cipherWarmup = 0; // not needed, the nonce does the job
+        }
+        ciph->SetNonce(&hdr.cipherNonce[0]);
+        return ciph;
+    }
+
+    LVPACipher *ciph;
+    if(key)
+    {
+        ciph = new LVPACipher;
+        ciph->Init(key, LVPAHash_Size);
+    }
+    else
+    {
+        // the key schedule is the same for all files encrypted with the master key, so do it only once
+        if(!_masterCipher)
+        {
+            _masterCipher = new LVPACipher;
+            _masterCipher->Init(&_masterKey[0], _masterKey.size());
+        }
+        ciph = new LVPACipher(*_masterCipher);
     }
 
     if(!hdr.cipherWarmup)
@@ -1557,10 +3457,98 @@ bool LVPAFile::_CryptBlock(uint8 *buf, LVPAFileHeader& hdr, bool writeMode)
         hdr.cipherWarmup = uint16(r * sizeof(uint32)); // for speed, we always use full uint32 blocks
     }
 
-    ciph.WarmUp(hdr.cipherWarmup);
-    ciph.Apply(buf, hdr.packedSize); // packedSize because the file is encrypted AFTER compression!
+    ciph->WarmUp(hdr.cipherWarmup);
+    return ciph;
+}
+
+// does the same as _InitCipher() in write mode for all given headers, and caches the keys so that _InitCipher() can skip this part
+void LVPAFile::_PrepareCipherKeys(const std::vector<LVPAFileHeader*>& hdrs)
+{
+    const uint32 count = hdrs.size();
+    if(!count)
+        return;
+
+    std::vector<std::string> msgs(count);
+    std::vector<const uint8*> src(count);
+    std::vector<uint32> sizes(count);
+    std::vector<uint8*> dst(count);
+
+    // salted file name hashes, see _CalcSaltedFilenameHash()
+    for(uint32 i = 0; i < count; ++i)
+    {
+        LVPAFileHeader& h = *hdrs[i];
+        msgs[i].assign(h.filename.c_str(), h.filename.size() + 1); // this DOES include the terminating '\0'
+        if(_masterKey.size())
+            msgs[i].append((const char*)&_masterSalt[0], LVPAHash_Size);
+        src[i] = (const uint8*)msgs[i].data();
+        sizes[i] = msgs[i].size();
+        dst[i] = &h.hash[0];
+    }
+    LVPAHash::CalcMulti(&dst[0], &src[0], &sizes[0], count);
+
+    // the keys, from the file names only
+    for(uint32 i = 0; i < count; ++i)
+    {
+        LVPAFileHeader& h = *hdrs[i];
+        sizes[i] = h.filename.size(); // this does NOT include the terminating '\0'
+        dst[i] = &h.cipherKey[0];
+    }
+    LVPAHash::CalcMulti(&dst[0], &src[0], &sizes[0], count);
+
+    // encrypted files mix the master key in
+    uint32 n = 0;
+    for(uint32 i = 0; i < count; ++i)
+    {
+        LVPAFileHeader& h = *hdrs[i];
+        if(h.flags & LVPAFLAG_ENCRYPTED)
+        {
+            msgs[n].assign(_masterKey.begin(), _masterKey.end());
+            msgs[n].append((const char*)&h.cipherKey[0], LVPAHash_Size);
+            src[n] = (const uint8*)msgs[n].data();
+            sizes[n] = msgs[n].size();
+            dst[n] = &h.cipherKey[0];
+            ++n;
+        }
+        h.cipherKeyFlags = h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED);
+    }
+    LVPAHash::CalcMulti(&dst[0], &src[0], &sizes[0], n);
+}
 
-    // CRC is checked elsewhere
+bool LVPAFile::_CryptBlock(uint8 *buf, LVPAFileHeader& hdr, bool writeMode, uint64 *crc /* = NULL */)
+{
+    const bool crypt = (hdr.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED)) != 0;
+    if(!crypt && !crc)
+        return true; // not encrypted, not scrambled, nothing to do, all fine
+
+    std::auto_ptr<ISymmetricCipher> ciph;
+    if(crypt)
+    {
+        ciph.reset(_InitCipher(hdr, writeMode));
+        if(!ciph.get())
+            return false;
+    }
+
+    // packedSize because the file is encrypted AFTER compression!
+    if(cryptTilesParallel(ciph.get(), buf, hdr.packedSize, writeMode, hdr.checksum, crc, _threads))
+        return true;
+
+    // Go through the block tile by tile, so that the data are still in the cache when the checksum gets to them.
+    // The checksum is always over the unencrypted data: before encrypting, or after decrypting.
+    LVPAChecksum c(hdr.checksum);
+    for(uint32 pos = 0; pos < hdr.packedSize; pos += LVPA_CRYPT_TILE_SIZE)
+    {
+        uint8 *tile = buf + pos;
+        const uint32 len = std::min<uint32>(LVPA_CRYPT_TILE_SIZE, hdr.packedSize - pos);
+        if(crc && writeMode)
+            c.Update(tile, len);
+        if(crypt)
+            ciph->Apply(tile, len);
+        if(crc && !writeMode)
+            c.Update(tile, len);
+    }
+
+    if(crc)
+        *crc = c.Finalize();
 
     return true;
 }
@@ -1614,6 +3602,10 @@ bool IsSupported(LVPAAlgos algo)
     case LVPAPACK_LZF:
         return true;
 #endif
+#ifdef LVPA_SUPPORT_LZ4
+    case LVPAPACK_LZ4:
+        return true;
+#endif
 #ifdef LVPA_SUPPORT_LZO
     case LVPAPACK_LZO1X:
         return true;
@@ -1622,8 +3614,13 @@ bool IsSupported(LVPAAlgos algo)
     case LVPAPACK_DEFLATE:
         return true;
 #endif
+#ifdef LVPA_SUPPORT_ZSTD
+    case LVPAPACK_ZSTD:
+        return true;
+#endif
 #ifdef LVPA_SUPPORT_LZMA
     case LVPAPACK_LZMA:
+    case LVPAPACK_LZMAMT:
         return true;
 #endif
 #ifdef LVPA_SUPPORT_LZHAM
@@ -0,0 +1,134 @@
+#include "LVPAInternal.h"
+#include "LVPAFile.h"
+#include "LVPAFilters.h"
+
+#include <algorithm>
+
+LVPA_NAMESPACE_START
+
+// x86 relative CALL (E8) and JMP (E9) targets are converted to absolute addresses (and back),
+// so that repeated calls to the same function end up as identical byte sequences.
+// Only displacements within +-16 MB are touched (top byte 0x00 or 0xFF), and only their low 24 bits are changed.
+// The opcode and the top byte stay as they are, so the decoder picks exactly the same spots as the encoder did.
+// An opcode that is skipped looks at a byte that a conversion right after it would change,
+// so no conversion is done within the next 3 bytes, otherwise the decoder might decide differently.
+static void x86Convert(uint8 *p, uint32 size, bool encode)
+{
+    if(size < 5)
+        return;
+    const uint32 end = size - 4;
+    uint32 blockedUntil = 0;
+    for(uint32 i = 0; i < end; )
+    {
+        if((p[i] & 0xFE) != 0xE8)
+            ++i;
+        else if(i < blockedUntil || (p[i + 4] != 0x00 && p[i + 4] != 0xFF))
+        {
+            blockedUntil = i + 4;
+            ++i;
+        }
+        else
+        {
+            uint32 v = p[i + 1] | (uint32(p[i + 2]) << 8) | (uint32(p[i + 3]) << 16);
+            const uint32 pos = i + 5; // relative to the next instruction
+            v = encode ? v + pos : v - pos;
+            p[i + 1] = uint8(v);
+            p[i + 2] = uint8(v >> 8);
+            p[i + 3] = uint8(v >> 16);
+            i += 5;
+        }
+    }
+}
+
+bool IsValidFilter(uint8 filter, uint8 param)
+{
+    switch(filter)
+    {
+        case LVPAFILTER_NONE:
+        case LVPAFILTER_X86:
+            return param == 0;
+        case LVPAFILTER_DELTA:
+            return param >= 1;
+        case LVPAFILTER_SHUFFLE:
+            return param >= 2;
+    }
+    return false;
+}
+
+void FilterEncode(uint8 filter, uint8 param, uint8 *dst, const uint8 *src, uint32 size)
+{
+    DEBUG(ASSERT(IsValidFilter(filter, param)));
+
+    switch(filter)
+    {
+        case LVPAFILTER_X86:
+            memcpy(dst, src, size);
+            x86Convert(dst, size, true);
+            return;
+
+        case LVPAFILTER_DELTA:
+        {
+            const uint32 d = std::min<uint32>(param, size);
+            memcpy(dst, src, d);
+            for(uint32 i = d; i < size; ++i)
+                dst[i] = src[i] - src[i - d];
+            return;
+        }
+
+        case LVPAFILTER_SHUFFLE:
+        {
+            // byte j of every element goes into stream j; the incomplete element at the end is left alone
+            const uint32 n = size / param;
+            for(uint32 j = 0; j < param; ++j)
+            {
+                uint8 *out = dst + j * n;
+                const uint8 *in = src + j;
+                for(uint32 k = 0; k < n; ++k, in += param)
+                    out[k] = *in;
+            }
+            memcpy(dst + n * param, src + n * param, size - n * param);
+            return;
+        }
+    }
+
+    memcpy(dst, src, size);
+}
+
+bool FilterDecode(uint8 filter, uint8 param, uint8 *buf, uint32 size)
+{
+    if(!IsValidFilter(filter, param))
+        return false;
+
+    switch(filter)
+    {
+        case LVPAFILTER_X86:
+            x86Convert(buf, size, false);
+            break;
+
+        case LVPAFILTER_DELTA:
+            for(uint32 i = param; i < size; ++i)
+                buf[i] += buf[i - param];
+            break;
+
+        case LVPAFILTER_SHUFFLE:
+        {
+            const uint32 n = size / param;
+            if(n < 2)
+                break; // nothing was moved
+            uint8 *tmp = new uint8[n * param];
+            for(uint32 j = 0; j < param; ++j)
+            {
+                const uint8 *in = buf + j * n;
+                uint8 *out = tmp + j;
+                for(uint32 k = 0; k < n; ++k, out += param)
+                    *out = in[k];
+            }
+            memcpy(buf, tmp, n * param);
+            delete [] tmp;
+            break;
+        }
+    }
+    return true;
+}
+
+LVPA_NAMESPACE_END
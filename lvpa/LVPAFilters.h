@@ -0,0 +1,22 @@
+#ifndef _LVPAFILTERS_H
+#define _LVPAFILTERS_H
+
+#include "LVPACommon.h"
+
+LVPA_NAMESPACE_START
+
+// Reversible transforms applied to a file's data before compression, see LVPAFilters in LVPAFile.h.
+// None of them changes the size of the data.
+
+// true if the filter is known and param is in its valid range
+bool IsValidFilter(uint8 filter, uint8 param);
+
+// Writes size filtered bytes from src to dst. The buffers must not overlap.
+void FilterEncode(uint8 filter, uint8 param, uint8 *dst, const uint8 *src, uint32 size);
+
+// Reverts FilterEncode() in place. Returns false if the filter is unknown.
+bool FilterDecode(uint8 filter, uint8 param, uint8 *buf, uint32 size);
+
+LVPA_NAMESPACE_END
+
+#endif
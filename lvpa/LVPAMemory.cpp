@@ -0,0 +1,76 @@
+#include "LVPAInternal.h"
+#include "LVPAMemory.h"
+
+#if PLATFORM == PLATFORM_UNIX && defined(__linux__)
+#   include <sys/mman.h>
+#   define LVPA_USE_MREMAP
+#endif
+
+LVPA_NAMESPACE_START
+
+static bool s_hugePages = false;
+
+void SetLargeBufferHugePages(bool use)
+{
+    s_hugePages = use;
+}
+
+bool GetLargeBufferHugePages(void)
+{
+    return s_hugePages;
+}
+
+#ifdef LVPA_USE_MREMAP
+
+static void adviseHugePages(void *p, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+    if(s_hugePages)
+        madvise(p, size, MADV_HUGEPAGE); // just a hint, nothing happens if the kernel does not support it
+#endif
+}
+
+uint8 *LargeAlloc(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED)
+        return NULL;
+    adviseHugePages(p, size);
+    return (uint8*)p;
+}
+
+uint8 *LargeRealloc(uint8 *p, size_t oldSize, size_t newSize)
+{
+    // if the mapping can't be extended where it is, the kernel moves its pages elsewhere, the contents are never copied
+    void *n = mremap(p, oldSize, newSize, MREMAP_MAYMOVE);
+    if(n == MAP_FAILED)
+        return NULL;
+    adviseHugePages(n, newSize);
+    return (uint8*)n;
+}
+
+void LargeFree(uint8 *p, size_t size)
+{
+    munmap(p, size);
+}
+
+#else
+
+uint8 *LargeAlloc(size_t size)
+{
+    return (uint8*)malloc(size);
+}
+
+uint8 *LargeRealloc(uint8 *p, size_t oldSize, size_t newSize)
+{
+    return (uint8*)realloc(p, newSize);
+}
+
+void LargeFree(uint8 *p, size_t size)
+{
+    free(p);
+}
+
+#endif
+
+LVPA_NAMESPACE_END
@@ -0,0 +1,23 @@
+#ifndef LVPA_MEMORY_H
+#define LVPA_MEMORY_H
+
+#include "LVPACommon.h"
+
+LVPA_NAMESPACE_START
+
+// ByteBuffers of at least this many bytes take their memory from LargeAlloc()
+#define LVPA_LARGE_BUFFER_MIN (4 * 1024 * 1024)
+
+// Memory for large buffers, that can grow without copying the contents where the OS supports it:
+// on Linux, it is mapped directly (mmap), and resized with mremap. Elsewhere, this is malloc/realloc/free.
+uint8 *LargeAlloc(size_t size); // NULL on failure
+uint8 *LargeRealloc(uint8 *p, size_t oldSize, size_t newSize); // keeps the contents; NULL on failure, p is still valid then
+void LargeFree(uint8 *p, size_t size);
+
+// Back large buffers with transparent huge pages (Linux only), see LVPAFile::UseHugePages()
+void SetLargeBufferHugePages(bool use);
+bool GetLargeBufferHugePages(void);
+
+LVPA_NAMESPACE_END
+
+#endif
@@ -2,6 +2,11 @@
 #include "ByteConverter.h"
 #include "LVPAStreamCipher.h"
 #include "MersenneTwister.h"
+#include "CPUFeatures.h"
+
+#ifdef LVPA_X86_SIMD
+#  include <emmintrin.h>
+#endif
 
 LVPA_NAMESPACE_START
 
@@ -207,4 +212,250 @@ void HPRC4LikeCipher::_DoRemainingBytes(uint8 *buf, uint8 bytes)
     }
 }
 
+
+static inline uint32 readLE32(const uint8 *p)
+{
+    return p[0] | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+}
+
+static inline uint32 rotl32(uint32 v, uint32 n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+#define CHACHA_QR(a, b, c, d) \
+    a += b; d ^= a; d = rotl32(d, 16); \
+    c += d; b ^= c; b = rotl32(b, 12); \
+    a += b; d ^= a; d = rotl32(d, 8); \
+    c += d; b ^= c; b = rotl32(b, 7);
+
+// one 64 byte keystream block for the given counter
+static void chachaBlock(const uint32 *state, uint32 counter, uint8 *out)
+{
+    uint32 x[16];
+    memcpy(x, state, sizeof(x));
+    x[12] = counter;
+    for(uint32 i = 0; i < 10; ++i)
+    {
+        CHACHA_QR(x[0], x[4], x[8],  x[12]);
+        CHACHA_QR(x[1], x[5], x[9],  x[13]);
+        CHACHA_QR(x[2], x[6], x[10], x[14]);
+        CHACHA_QR(x[3], x[7], x[11], x[15]);
+        CHACHA_QR(x[0], x[5], x[10], x[15]);
+        CHACHA_QR(x[1], x[6], x[11], x[12]);
+        CHACHA_QR(x[2], x[7], x[8],  x[13]);
+        CHACHA_QR(x[3], x[4], x[9],  x[14]);
+    }
+    for(uint32 i = 0; i < 16; ++i)
+    {
+        uint32 v = x[i] + (i == 12 ? counter : state[i]);
+        out[i * 4 + 0] = uint8(v);
+        out[i * 4 + 1] = uint8(v >> 8);
+        out[i * 4 + 2] = uint8(v >> 16);
+        out[i * 4 + 3] = uint8(v >> 24);
+    }
+}
+
+#undef CHACHA_QR
+
+// full blocks only, starting at block counter; returns the number of blocks done
+typedef uint32 (*ChaChaBlocksFunc)(const uint32 *state, uint32 counter, uint8 *buf, uint32 blocks);
+
+static uint32 chachaBlocksGeneric(const uint32 *state, uint32 counter, uint8 *buf, uint32 blocks)
+{
+    uint8 ks[ChaCha20Cipher::BLOCK_SIZE];
+    for(uint32 b = 0; b < blocks; ++b, buf += ChaCha20Cipher::BLOCK_SIZE)
+    {
+        chachaBlock(state, counter + b, ks);
+        for(uint32 i = 0; i < ChaCha20Cipher::BLOCK_SIZE; ++i)
+            buf[i] ^= ks[i];
+    }
+    return blocks;
+}
+
+#ifdef LVPA_X86_SIMD
+
+#define ROTL_SSE2(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define CHACHA_QR_SSE2(a, b, c, d) \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTL_SSE2(d, 16); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTL_SSE2(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTL_SSE2(d, 8); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTL_SSE2(b, 7);
+
+// 4 blocks at once, each 32 bit lane of a register belongs to one block
+LVPA_TARGET("sse2") static uint32 chachaBlocksSSE2(const uint32 *state, uint32 counter, uint8 *buf, uint32 blocks)
+{
+    const uint32 todo = blocks & ~3u;
+    for(uint32 b = 0; b < todo; b += 4, buf += 4 * ChaCha20Cipher::BLOCK_SIZE)
+    {
+        __m128i s[16], x[16];
+        for(uint32 i = 0; i < 16; ++i)
+            s[i] = _mm_set1_epi32(int(state[i]));
+        s[12] = _mm_add_epi32(_mm_set1_epi32(int(counter + b)), _mm_set_epi32(3, 2, 1, 0));
+        for(uint32 i = 0; i < 16; ++i)
+            x[i] = s[i];
+
+        for(uint32 i = 0; i < 10; ++i)
+        {
+            CHACHA_QR_SSE2(x[0], x[4], x[8],  x[12]);
+            CHACHA_QR_SSE2(x[1], x[5], x[9],  x[13]);
+            CHACHA_QR_SSE2(x[2], x[6], x[10], x[14]);
+            CHACHA_QR_SSE2(x[3], x[7], x[11], x[15]);
+            CHACHA_QR_SSE2(x[0], x[5], x[10], x[15]);
+            CHACHA_QR_SSE2(x[1], x[6], x[11], x[12]);
+            CHACHA_QR_SSE2(x[2], x[7], x[8],  x[13]);
+            CHACHA_QR_SSE2(x[3], x[4], x[9],  x[14]);
+        }
+
+        // transpose each group of 4 words, so that every register holds 16 consecutive bytes of one block
+        for(uint32 i = 0; i < 16; i += 4)
+        {
+            __m128i a = _mm_add_epi32(x[i + 0], s[i + 0]);
+            __m128i c = _mm_add_epi32(x[i + 1], s[i + 1]);
+            __m128i e = _mm_add_epi32(x[i + 2], s[i + 2]);
+            __m128i g = _mm_add_epi32(x[i + 3], s[i + 3]);
+            __m128i t0 = _mm_unpacklo_epi32(a, c);
+            __m128i t1 = _mm_unpacklo_epi32(e, g);
+            __m128i t2 = _mm_unpackhi_epi32(a, c);
+            __m128i t3 = _mm_unpackhi_epi32(e, g);
+            __m128i out[4];
+            out[0] = _mm_unpacklo_epi64(t0, t1);
+            out[1] = _mm_unpackhi_epi64(t0, t1);
+            out[2] = _mm_unpacklo_epi64(t2, t3);
+            out[3] = _mm_unpackhi_epi64(t2, t3);
+            for(uint32 k = 0; k < 4; ++k)
+            {
+                __m128i *p = (__m128i*)(buf + k * ChaCha20Cipher::BLOCK_SIZE + i * 4);
+                _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), out[k]));
+            }
+        }
+    }
+    return todo;
+}
+
+#undef CHACHA_QR_SSE2
+#undef ROTL_SSE2
+
+#endif
+
+static ChaChaBlocksFunc getChaChaBlocksFunc(ChaCha20Cipher::Impl impl)
+{
+#ifdef LVPA_X86_SIMD
+    if(impl != ChaCha20Cipher::IMPL_GENERIC && ChaCha20Cipher::IsSupported(ChaCha20Cipher::IMPL_SSE2))
+        return chachaBlocksSSE2;
+#endif
+    return chachaBlocksGeneric;
+}
+
+static ChaCha20Cipher::Impl s_chachaImpl = ChaCha20Cipher::IMPL_AUTO;
+static ChaChaBlocksFunc s_chachaBlocks = getChaChaBlocksFunc(ChaCha20Cipher::IMPL_AUTO);
+
+ChaCha20Cipher::ChaCha20Cipher()
+: _pos(0)
+{
+    // "expand 32-byte k"
+    _state[0] = 0x61707865;
+    _state[1] = 0x3320646e;
+    _state[2] = 0x79622d32;
+    _state[3] = 0x6b206574;
+    memset(&_state[4], 0, 12 * sizeof(uint32));
+}
+
+void ChaCha20Cipher::Init(const uint8 *key, uint32 size)
+{
+    DEBUG(ASSERT(size == KEY_SIZE));
+    for(uint32 i = 0; i < 8; ++i)
+        _state[4 + i] = readLE32(key + i * 4);
+}
+
+void ChaCha20Cipher::SetNonce(const uint8 *nonce, uint32 counter /* = 0 */)
+{
+    _state[12] = counter;
+    for(uint32 i = 0; i < 3; ++i)
+        _state[13 + i] = readLE32(nonce + i * 4);
+    _pos = 0;
+}
+
+void ChaCha20Cipher::Apply(uint8 *buf, uint32 size)
+{
+    ApplyAt(buf, size, _pos);
+    _pos += size;
+}
+
+void ChaCha20Cipher::ApplyAt(uint8 *buf, uint32 size, uint64 pos) const
+{
+    uint32 counter = _state[12] + uint32(pos / BLOCK_SIZE);
+    uint32 skip = uint32(pos % BLOCK_SIZE);
+    uint8 ks[BLOCK_SIZE];
+
+    // incomplete block at the start
+    if(skip)
+    {
+        chachaBlock(_state, counter++, ks);
+        uint32 n = std::min<uint32>(size, BLOCK_SIZE - skip);
+        for(uint32 i = 0; i < n; ++i)
+            buf[i] ^= ks[skip + i];
+        buf += n;
+        size -= n;
+    }
+
+    uint32 blocks = size / BLOCK_SIZE;
+    uint32 done = s_chachaBlocks(_state, counter, buf, blocks);
+    chachaBlocksGeneric(_state, counter + done, buf + done * BLOCK_SIZE, blocks - done);
+    counter += blocks;
+    buf += blocks * BLOCK_SIZE;
+    size -= blocks * BLOCK_SIZE;
+
+    // and at the end
+    if(size)
+    {
+        chachaBlock(_state, counter, ks);
+        for(uint32 i = 0; i < size; ++i)
+            buf[i] ^= ks[i];
+    }
+}
+
+bool ChaCha20Cipher::IsSupported(Impl impl)
+{
+    switch(impl)
+    {
+        case IMPL_AUTO:
+        case IMPL_GENERIC:
+            return true;
+        case IMPL_SSE2:
+#ifdef LVPA_X86_SIMD
+            return GetCPUFeatures().sse2;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool ChaCha20Cipher::SetImpl(Impl impl)
+{
+    if(!IsSupported(impl))
+        return false;
+    s_chachaImpl = impl;
+    s_chachaBlocks = getChaChaBlocksFunc(impl);
+    return true;
+}
+
+ChaCha20Cipher::Impl ChaCha20Cipher::GetImpl(void)
+{
+    return s_chachaImpl;
+}
+
+const char *ChaCha20Cipher::GetImplName(Impl impl)
+{
+    switch(impl)
+    {
+        case IMPL_AUTO:    return "auto";
+        case IMPL_GENERIC: return "generic";
+        case IMPL_SSE2:    return "sse2";
+        default:           return "unknown";
+    }
+}
+
 LVPA_NAMESPACE_END
@@ -11,6 +11,12 @@ public:
     virtual void Init(const uint8 *key, uint32 size) {}
     virtual void Apply(uint8 *buf, uint32 size) = 0;
     virtual void WarmUp(uint32 size);
+
+    // Counter mode ciphers can start anywhere in the keystream, so a buffer can be split into pieces
+    // that are processed independently (and in parallel). ApplyAt() is only supported if Seekable() returns true.
+    virtual bool Seekable(void) const { return false; }
+    // applies the keystream starting at byte pos, without changing the cipher's state. Safe to call from several threads at once.
+    virtual void ApplyAt(uint8 *buf, uint32 size, uint64 pos) const {}
 };
 
 // the original (A)RC4 algorithm - for reference
@@ -44,6 +50,44 @@ private:
     uint8 _x, _y, _rb;
 };
 
+// ChaCha20 as in RFC 8439: 256 bit key, 96 bit nonce, 32 bit block counter.
+// The keystream is generated from a counter, so it is seekable; with SSE2, 4 blocks are generated at once.
+class ChaCha20Cipher : public ISymmetricCipher
+{
+public:
+    enum { KEY_SIZE = 32, NONCE_SIZE = 12, BLOCK_SIZE = 64 };
+
+    // ways to generate the keystream, all give the same result
+    enum Impl
+    {
+        IMPL_AUTO,      // fastest one supported by the CPU (default)
+        IMPL_GENERIC,   // portable C, one block at a time
+        IMPL_SSE2,      // 4 blocks at once
+
+        IMPL_MAX
+    };
+
+    ChaCha20Cipher();
+    virtual ~ChaCha20Cipher() {}
+    virtual void Init(const uint8 *key, uint32 size); // size must be KEY_SIZE
+    void SetNonce(const uint8 *nonce, uint32 counter = 0); // NONCE_SIZE bytes. Also rewinds the keystream to the start.
+    virtual void Apply(uint8 *buf, uint32 size);
+    virtual void WarmUp(uint32 size) { _pos += size; }
+    virtual bool Seekable(void) const { return true; }
+    virtual void ApplyAt(uint8 *buf, uint32 size, uint64 pos) const;
+
+    // Selects the implementation used from now on, for testing and benchmarking.
+    // Returns false (and changes nothing) if it is not supported on this machine.
+    static bool SetImpl(Impl impl);
+    static Impl GetImpl(void);
+    static bool IsSupported(Impl impl);
+    static const char *GetImplName(Impl impl);
+
+private:
+    uint32 _state[16]; // constants, key, counter, nonce
+    uint64 _pos; // position in the keystream, in bytes
+};
+
 LVPA_NAMESPACE_END
 
 #endif
@@ -0,0 +1,292 @@
+#include "LVPAInternal.h"
+#include "LVPAThreading.h"
+
+#if PLATFORM == PLATFORM_WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#   include <unistd.h>
+#   include <time.h>
+#endif
+
+LVPA_NAMESPACE_START
+
+
+uint32 GetCPUCount(void)
+{
+#if PLATFORM == PLATFORM_WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long n = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    long n = 1;
+#endif
+    return n > 0 ? uint32(n) : 1;
+}
+
+Mutex::Mutex()
+{
+#if PLATFORM == PLATFORM_WIN32
+    CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+    InitializeCriticalSection(cs);
+    _mtx = cs;
+#else
+    pthread_mutex_t *m = new pthread_mutex_t;
+    pthread_mutex_init(m, NULL);
+    _mtx = m;
+#endif
+}
+
+Mutex::~Mutex()
+{
+#if PLATFORM == PLATFORM_WIN32
+    DeleteCriticalSection((CRITICAL_SECTION*)_mtx);
+    delete (CRITICAL_SECTION*)_mtx;
+#else
+    pthread_mutex_destroy((pthread_mutex_t*)_mtx);
+    delete (pthread_mutex_t*)_mtx;
+#endif
+}
+
+void Mutex::Lock(void)
+{
+#if PLATFORM == PLATFORM_WIN32
+    EnterCriticalSection((CRITICAL_SECTION*)_mtx);
+#else
+    pthread_mutex_lock((pthread_mutex_t*)_mtx);
+#endif
+}
+
+void Mutex::Unlock(void)
+{
+#if PLATFORM == PLATFORM_WIN32
+    LeaveCriticalSection((CRITICAL_SECTION*)_mtx);
+#else
+    pthread_mutex_unlock((pthread_mutex_t*)_mtx);
+#endif
+}
+
+
+// calls the private Thread::_Run()
+struct ThreadEntry
+{
+#if PLATFORM == PLATFORM_WIN32
+    static DWORD WINAPI Run(LPVOID p) { Thread::_Run((Thread*)p); return 0; }
+#else
+    static void *Run(void *p) { Thread::_Run((Thread*)p); return NULL; }
+#endif
+};
+
+Thread::Thread()
+: _th(NULL), _started(false), _func(NULL), _user(NULL)
+{
+}
+
+Thread::~Thread()
+{
+    Join();
+}
+
+bool Thread::Start(ThreadFunc func, void *user)
+{
+    if(_started)
+        return false;
+    _func = func;
+    _user = user;
+#if PLATFORM == PLATFORM_WIN32
+    HANDLE h = CreateThread(NULL, 0, ThreadEntry::Run, this, 0, NULL);
+    if(!h)
+        return false;
+    _th = h;
+#else
+    pthread_t *t = new pthread_t;
+    if(pthread_create(t, NULL, ThreadEntry::Run, this))
+    {
+        delete t;
+        return false;
+    }
+    _th = t;
+#endif
+    _started = true;
+    return true;
+}
+
+void Thread::Join(void)
+{
+    if(!_started)
+        return;
+#if PLATFORM == PLATFORM_WIN32
+    WaitForSingleObject((HANDLE)_th, INFINITE);
+    CloseHandle((HANDLE)_th);
+#else
+    pthread_join(*(pthread_t*)_th, NULL);
+    delete (pthread_t*)_th;
+#endif
+    _th = NULL;
+    _started = false;
+}
+
+
+struct ParallelJob
+{
+    ParallelFunc func;
+    void *user;
+    uint32 count;
+    uint32 next; // protected by mtx
+    Mutex mtx;
+};
+
+static void runParallelJob(ParallelJob *job)
+{
+    while(true)
+    {
+        uint32 idx;
+        {
+            MutexGuard g(job->mtx);
+            if(job->next >= job->count)
+                return;
+            idx = job->next++;
+        }
+        job->func(idx, job->user);
+    }
+}
+
+#if PLATFORM == PLATFORM_WIN32
+static DWORD WINAPI parallelThreadEntry(LPVOID p)
+{
+    runParallelJob((ParallelJob*)p);
+    return 0;
+}
+#else
+static void *parallelThreadEntry(void *p)
+{
+    runParallelJob((ParallelJob*)p);
+    return NULL;
+}
+#endif
+
+void ParallelFor(uint32 count, ParallelFunc func, void *user, uint32 threads /* = 0 */)
+{
+    if(!threads)
+        threads = GetCPUCount();
+    if(threads > count)
+        threads = count;
+
+    // nothing to gain from extra threads
+    if(threads <= 1)
+    {
+        for(uint32 i = 0; i < count; ++i)
+            func(i, user);
+        return;
+    }
+
+    ParallelJob job;
+    job.func = func;
+    job.user = user;
+    job.count = count;
+    job.next = 0;
+
+    // the calling thread is one of the workers, so start one less
+    uint32 started = 0;
+#if PLATFORM == PLATFORM_WIN32
+    std::vector<HANDLE> th(threads - 1);
+    for(uint32 i = 0; i < threads - 1; ++i)
+        if((th[started] = CreateThread(NULL, 0, parallelThreadEntry, &job, 0, NULL)))
+            ++started;
+#else
+    std::vector<pthread_t> th(threads - 1);
+    for(uint32 i = 0; i < threads - 1; ++i)
+        if(!pthread_create(&th[started], NULL, parallelThreadEntry, &job))
+            ++started;
+#endif
+
+    // if a thread could not be created, the remaining ones (or this one alone) just pick up more work
+    runParallelJob(&job);
+
+    for(uint32 i = 0; i < started; ++i)
+    {
+#if PLATFORM == PLATFORM_WIN32
+        WaitForSingleObject(th[i], INFINITE);
+        CloseHandle(th[i]);
+#else
+        pthread_join(th[i], NULL);
+#endif
+    }
+}
+
+
+uint64 AtomicAdd(volatile uint64 *p, uint64 v)
+{
+#if PLATFORM == PLATFORM_WIN32
+    return uint64(InterlockedExchangeAdd64((volatile LONGLONG*)p, LONGLONG(v))) + v;
+#else
+    return __sync_add_and_fetch(p, v);
+#endif
+}
+
+uint64 AtomicSub(volatile uint64 *p, uint64 v)
+{
+    return AtomicAdd(p, uint64(0) - v);
+}
+
+void AtomicMax(volatile uint64 *p, uint64 v)
+{
+    uint64 cur = AtomicGet(p);
+    while(cur < v)
+    {
+#if PLATFORM == PLATFORM_WIN32
+        uint64 seen = uint64(InterlockedCompareExchange64((volatile LONGLONG*)p, LONGLONG(v), LONGLONG(cur)));
+#else
+        uint64 seen = __sync_val_compare_and_swap(p, cur, v);
+#endif
+        if(seen == cur)
+            return;
+        cur = seen; // changed meanwhile, try again if still lower
+    }
+}
+
+uint64 AtomicGet(const volatile uint64 *p)
+{
+    // a plain read may tear on 32-bit systems
+#if PLATFORM == PLATFORM_WIN32
+    return uint64(InterlockedCompareExchange64((volatile LONGLONG*)p, 0, 0));
+#else
+    return __sync_add_and_fetch((volatile uint64*)p, 0);
+#endif
+}
+
+void AtomicSet(volatile uint64 *p, uint64 v)
+{
+#if PLATFORM == PLATFORM_WIN32
+    InterlockedExchange64((volatile LONGLONG*)p, LONGLONG(v));
+#else
+    uint64 cur = AtomicGet(p);
+    uint64 seen;
+    while((seen = __sync_val_compare_and_swap(p, cur, v)) != cur)
+        cur = seen;
+#endif
+}
+
+uint64 GetTimeNanos(void)
+{
+#if PLATFORM == PLATFORM_WIN32
+    static LARGE_INTEGER freq; // constant while the system is running
+    if(!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    // split up, so that the multiplication does not overflow
+    const uint64 secs = uint64(t.QuadPart) / uint64(freq.QuadPart);
+    const uint64 rest = uint64(t.QuadPart) % uint64(freq.QuadPart);
+    return secs * 1000000000ULL + rest * 1000000000ULL / uint64(freq.QuadPart);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64(ts.tv_sec) * 1000000000ULL + uint64(ts.tv_nsec);
+#endif
+}
+
+LVPA_NAMESPACE_END
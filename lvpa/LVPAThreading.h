@@ -0,0 +1,78 @@
+#ifndef LVPA_THREADING_H
+#define LVPA_THREADING_H
+
+#include "LVPACommon.h"
+
+LVPA_NAMESPACE_START
+
+// number of logical CPUs, at least 1
+uint32 GetCPUCount(void);
+
+class Mutex
+{
+public:
+    Mutex();
+    ~Mutex();
+    void Lock(void);
+    void Unlock(void);
+
+private:
+    Mutex(const Mutex&); // non-copyable
+    Mutex& operator=(const Mutex&);
+    void *_mtx;
+};
+
+class MutexGuard
+{
+public:
+    MutexGuard(Mutex& m) : _m(m) { _m.Lock(); }
+    ~MutexGuard() { _m.Unlock(); }
+
+private:
+    MutexGuard& operator=(const MutexGuard&);
+    Mutex& _m;
+};
+
+typedef void (*ThreadFunc)(void *user);
+
+// Runs func(user) in a thread of its own. Only one at a time; Join() before starting the next one.
+class Thread
+{
+public:
+    Thread();
+    ~Thread(); // joins
+    bool Start(ThreadFunc func, void *user); // returns false if no thread could be created, or one was started and not yet joined
+    void Join(void); // waits until func has returned; does nothing if not started
+
+private:
+    Thread(const Thread&); // non-copyable
+    Thread& operator=(const Thread&);
+    static void _Run(Thread *t) { t->_func(t->_user); }
+    friend struct ThreadEntry;
+
+    void *_th;
+    bool _started;
+    ThreadFunc _func;
+    void *_user;
+};
+
+typedef void (*ParallelFunc)(uint32 idx, void *user);
+
+// Calls func(i, user) for each i in [0, count), spread over up to <threads> threads (0 = one per CPU).
+// The calling thread does its share of the work, and the function returns when all calls are done.
+// Indices are handed out in ascending order, but may complete in any order.
+void ParallelFor(uint32 count, ParallelFunc func, void *user, uint32 threads = 0);
+
+// Lock-free operations on 64-bit counters that are shared between threads. Each one is a full memory barrier.
+uint64 AtomicAdd(volatile uint64 *p, uint64 v); // returns the new value
+uint64 AtomicSub(volatile uint64 *p, uint64 v); // returns the new value
+void AtomicMax(volatile uint64 *p, uint64 v); // raises *p to v, if it is lower
+uint64 AtomicGet(const volatile uint64 *p);
+void AtomicSet(volatile uint64 *p, uint64 v);
+
+// monotonic clock for measuring durations, in nanoseconds since some unspecified point
+uint64 GetTimeNanos(void);
+
+LVPA_NAMESPACE_END
+
+#endif
@@ -0,0 +1,63 @@
+#include "LVPACompileConfig.h"
+
+#ifdef LVPA_SUPPORT_LZ4
+
+#ifdef LVPA_SYSTEM_LZ4
+#  include <lz4.h>
+#  include <lz4hc.h>
+#else
+#  include <lz4/lz4.h>
+#  include <lz4/lz4hc.h>
+#endif
+#include "LVPAInternal.h"
+#include "LZ4Compressor.h"
+
+LVPA_NAMESPACE_START
+
+// level 1: the fast compressor, at full strength (anything faster packs worse than LZF); 2..9: LZ4HC level (level 0 means store)
+static const int s_lz4hcLevels[10] = { 0, 0, 3, 4, 5, 6, 7, 8, 9, 12 };
+
+
+uint32 LZ4Compressor::CompressBound(uint32 srcLen) const
+{
+    return srcLen > 1 ? srcLen - 1 : 0; // LZ4 fails if the output does not fit, so anything larger is pointless
+}
+
+uint32 LZ4Compressor::CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb /* = NULL */)
+{
+    if(!level || srcLen > LZ4_MAX_INPUT_SIZE)
+        return 0;
+    if(level > 9)
+        level = 9;
+    if(dstCap > LZ4_MAX_INPUT_SIZE)
+        dstCap = LZ4_MAX_INPUT_SIZE;
+
+    int newsize;
+    if(level < 2)
+        newsize = LZ4_compress_default((const char*)src, (char*)dst, srcLen, dstCap);
+    else
+        newsize = LZ4_compress_HC((const char*)src, (char*)dst, srcLen, dstCap, s_lz4hcLevels[level]);
+
+    if(newsize <= 0)
+        return 0;
+
+    if(pcb)
+        pcb(NULL, srcLen, newsize);
+
+    return newsize;
+}
+
+bool LZ4Compressor::DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    if(srcLen > LZ4_MAX_INPUT_SIZE || dstLen > LZ4_MAX_INPUT_SIZE
+        || LZ4_decompress_safe((const char*)src, (char*)dst, srcLen, dstLen) != int(dstLen))
+    {
+        logerror("LZ4Compressor: decompression failed");
+        return false;
+    }
+    return true;
+}
+
+LVPA_NAMESPACE_END
+
+#endif // LVPA_SUPPORT_LZ4
@@ -0,0 +1,20 @@
+#ifndef _LZ4COMPRESSOR_H
+#define _LZ4COMPRESSOR_H
+
+#include "ICompressor.h"
+
+LVPA_NAMESPACE_START
+
+// Plain LZ4 block format (no frame). Level 1 uses the fast compressor, 2-9 the HC compressor.
+// Decompression is equally fast for all levels.
+class LZ4Compressor : public ICompressor
+{
+public:
+    virtual uint32 CompressBound(uint32 srcLen) const;
+    virtual uint32 CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb = NULL);
+    virtual bool DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+};
+
+LVPA_NAMESPACE_END
+
+#endif
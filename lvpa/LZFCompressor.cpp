@@ -8,61 +8,36 @@
 LVPA_NAMESPACE_START
 
 
-void LZFCompressor::Compress(uint8 /*level*/, ProgressCallback pcb /* = NULL */) // both not used
+uint32 LZFCompressor::CompressBound(uint32 srcLen) const
 {
-    if(_iscompressed || (!size()))
-        return;
-
-    unsigned int oldsize = (unsigned int)size();
-    unsigned int newsize = oldsize - 1;
-
-    uint8 *buf = new uint8[newsize];
+    return srcLen > 1 ? srcLen - 1 : 0; // lzf fails if the output does not fit, so anything larger is pointless
+}
 
-    newsize = lzf_compress(contents(), oldsize, buf, newsize);
+uint32 LZFCompressor::CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 /*level*/, ProgressCallback pcb /* = NULL */) // level not used
+{
+    unsigned int newsize = lzf_compress(src, srcLen, dst, dstCap);
 
     if(!newsize)
     {
         //DEBUG(logdebug("LZFCompressor: This block contains incompressible data."));
-        delete [] buf;
-        return;
+        return 0;
     }
 
-    resize((size_t)newsize);
-    rpos(0);
-    wpos(0);
-    append(buf,(size_t)newsize);
-    delete [] buf;
-
-    _iscompressed = true;
-    _real_size = (uint64)oldsize;
-
     if(pcb)
-        pcb(NULL, oldsize, newsize);
+        pcb(NULL, srcLen, newsize);
+
+    return newsize;
 }
 
-void LZFCompressor::Decompress(void)
+bool LZFCompressor::DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
 {
-    if( (!_iscompressed) || (!_real_size) || (!size()))
-        return;
-
-    unsigned int currentSize = size();
-    unsigned int targetSize = _real_size;
-    uint8 *target = new uint8[targetSize];
-
-    targetSize = lzf_decompress(contents(), currentSize, target, targetSize);
-    if(!targetSize)
+    unsigned int targetSize = lzf_decompress(src, srcLen, dst, dstLen);
+    if(targetSize != dstLen)
     {
         logerror("LZFCompressor: decompression failed");
-        return;
+        return false;
     }
-
-    resize((size_t)targetSize);
-    wpos(0);
-    rpos(0);
-    append(target, (size_t)targetSize);
-    delete [] target;
-    _real_size = 0;
-    _iscompressed = false;
+    return true;
 }
 
 LVPA_NAMESPACE_END
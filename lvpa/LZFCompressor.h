@@ -9,8 +9,9 @@ LVPA_NAMESPACE_START
 class LZFCompressor : public ICompressor
 {
 public:
-    virtual void Compress(uint8 level = 0, ProgressCallback pcb = NULL); // both args unused
-    virtual void Decompress(void);
+    virtual uint32 CompressBound(uint32 srcLen) const;
+    virtual uint32 CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb = NULL); // level unused
+    virtual bool DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
 
 private:
     static bool s_lzoNeedsInit;
@@ -6,14 +6,23 @@
 #include "LVPAInternal.h"
 #include "LVPATools.h"
 #include "LZHAMCompressor.h"
+#include "LVPAThreading.h"
 
 LVPA_NAMESPACE_START
 
+// below this size, starting the helper threads costs more than they save
+static const uint32 LZHAM_MT_MIN_SIZE = 256 * 1024;
 
-void LZHAMCompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
+
+uint32 LZHAMCompressor::CompressBound(uint32 srcLen) const
+{
+    return srcLen; // 1 byte dict size + (srcLen - 1) bytes max., anything larger is pointless
+}
+
+uint32 LZHAMCompressor::CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb /* = NULL */)
 {
-    if(_iscompressed || (!size()))
-        return;
+    if(dstCap < 2)
+        return 0;
 
     // to be honest, i am not exactly sure if the params auto-selected here are okay...
     // just guessing, for now
@@ -21,7 +30,13 @@ void LZHAMCompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
     lzham_compress_params comp_params;
     memset(&comp_params, 0, sizeof(comp_params));
     comp_params.m_struct_size = sizeof(comp_params);
-    comp_params.m_max_helper_threads = 1; // FIXME: really?
+
+    // the calling thread does work as well, so one less helper is needed
+    if(srcLen >= LZHAM_MT_MIN_SIZE)
+    {
+        uint32 threads = _threads ? _threads : GetCPUCount();
+        comp_params.m_max_helper_threads = std::min<uint32>(threads - 1, LZHAM_MAX_HELPER_THREADS);
+    }
 
 
     switch(level)
@@ -51,7 +66,7 @@ void LZHAMCompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
     // (26 is max. recommended on x86/32bit)
     comp_params.m_dict_size_log2 = lzham_compress_level(level + 17);
 
-    size_t oldsize = size();
+    size_t oldsize = srcLen;
 
     // limit dict size to sane values (at least try to)
     // e.g. do not allocate more memory for the dict than half the file size
@@ -66,48 +81,36 @@ void LZHAMCompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
         comp_params.m_compress_flags |= LZHAM_COMP_FLAG_FORCE_POLAR_CODING;
 
     
-    size_t newsize = oldsize - 1;
+    size_t newsize = dstCap - 1;
     lzham_uint32 adler; // unused
 
-
-    uint8 *buf = new uint8[newsize];
-
-    lzham_compress_status_t status = lzham_compress_memory(&comp_params, buf, &newsize, contents(), oldsize, &adler);
+    // first byte in stream is the dict size, the compressed data follow directly
+    lzham_compress_status_t status = lzham_compress_memory(&comp_params, dst + 1, &newsize, src, oldsize, &adler);
 
     if(status != LZHAM_COMP_STATUS_SUCCESS || !newsize)
-    {
-        delete [] buf;
-        return;
-    }
+        return 0;
 
-    resize((size_t)newsize);
-    rpos(0);
-    wpos(0);
-    (*this) << uint8(comp_params.m_dict_size_log2);
-    append(buf,(size_t)newsize);
-    delete [] buf;
-
-    _iscompressed = true;
-    _real_size = (uint64)oldsize;
+    dst[0] = uint8(comp_params.m_dict_size_log2);
 
     if(pcb)
         pcb(NULL, oldsize, newsize);
+
+    return uint32(newsize + 1);
 }
 
-void LZHAMCompressor::Decompress(void)
+bool LZHAMCompressor::DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
 {
-    if( (!_iscompressed) || (!_real_size) || (!size()))
-        return;
+    if(srcLen < 2)
+        return false;
 
-    const uint8 *readbuf = contents();
+    const uint8 *readbuf = src;
     uint8 dictsize = *readbuf++; // first byte in stream
 
     if(dictsize < LZHAM_MIN_DICT_SIZE_LOG2 || dictsize > LZHAM_MAX_DICT_SIZE_LOG2_X64)
-        return;
+        return false;
 
-    size_t currentSize = size() - 1; // skipped first byte
-    size_t targetSize = _real_size;
-    uint8 *target = new uint8[targetSize];
+    size_t currentSize = srcLen - 1; // skipped first byte
+    size_t targetSize = dstLen;
     lzham_uint32 adler; // unused
     
     lzham_decompress_params decomp_params;
@@ -117,21 +120,14 @@ void LZHAMCompressor::Decompress(void)
     decomp_params.m_compute_adler32 = false; // not needed, doing own crc32 checking after decompressing
     decomp_params.m_output_unbuffered = true; // FIXME: not sure if this is really okay for big files
 
-    lzham_decompress_status_t status = lzham_decompress_memory(&decomp_params, target, &targetSize, readbuf, currentSize, &adler);
+    lzham_decompress_status_t status = lzham_decompress_memory(&decomp_params, dst, &targetSize, readbuf, currentSize, &adler);
 
-    if(status != LZHAM_DECOMP_STATUS_SUCCESS || !targetSize)
+    if(status != LZHAM_DECOMP_STATUS_SUCCESS || targetSize != dstLen)
     {
         logerror("LZHAMCompressor: decompression failed");
-        return;
+        return false;
     }
-
-    resize(targetSize);
-    wpos(0);
-    rpos(0);
-    append(target, targetSize);
-    delete [] target;
-    _real_size = 0;
-    _iscompressed = false;
+    return true;
 }
 
 LVPA_NAMESPACE_END
@@ -25,21 +25,45 @@ static void myLzmaFree(void *, void *ptr)
         free(ptr);
 }
 
+struct LZMADecodeState
+{
+    CLzmaDec dec;
+    ISzAlloc alloc;
+    uint32 inPos; // next input byte
+};
+
+LZMACompressor::~LZMACompressor()
+{
+    LZMACompressor::EndDecompress();
+}
+
+
+uint32 LZMACompressor::CompressBound(uint32 srcLen) const
+{
+    return LZMA_PROPS_SIZE + srcLen / 20 * 21 + (1 << 16); // we allocate 105% of original size for output buffer
+}
 
-void LZMACompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
+uint32 LZMACompressor::CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb /* = NULL */)
 {
-    if( _iscompressed || (!size()))
-        return;
+    return _Encode(dst, dstCap, src, srcLen, level, 0, pcb);
+}
+
+bool LZMACompressor::DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    return _Decode(dst, dstLen, src, srcLen);
+}
+
+uint32 LZMACompressor::_Encode(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, uint32 dictSize, ProgressCallback pcb)
+{
+    if(dstCap <= LZMA_PROPS_SIZE)
+        return 0;
 
     CLzmaEncProps props;
     LzmaEncProps_Init(&props);
     props.level = level;
+    props.dictSize = dictSize;
 
-    SizeT oldsize = size();
-    SizeT newsize = oldsize / 20 * 21 + (1 << 16); // we allocate 105% of original size for output buffer
-
-    Byte *buf = new Byte[newsize];
-    
+    SizeT newsize = dstCap - LZMA_PROPS_SIZE;
 
     ISzAlloc alloc;
     alloc.Alloc = myLzmaAlloc;
@@ -49,64 +73,90 @@ void LZMACompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
     progress.Progress = pcb ? pcb : myLzmaProgressDummy;
 
     SizeT propsSize = LZMA_PROPS_SIZE;
-    Byte propsEnc[LZMA_PROPS_SIZE];
-
-    uint32 result = LzmaEncode(buf, &newsize, this->contents(), oldsize, &props, &propsEnc[0], &propsSize, 0, &progress, &alloc, &alloc);
-    if(result != SZ_OK || !newsize || newsize > oldsize)
-    {
-        delete [] buf;
-        return;
-    }
-    ASSERT(propsSize == LZMA_PROPS_SIZE); // this should not be changed by the library
 
-    resize(newsize);
-    rpos(0);
-    wpos(0);
-    append(&propsEnc[0], LZMA_PROPS_SIZE);
-    append(buf,newsize);
-    delete [] buf;
+    // first 5 bytes are encoded props, the compressed data follow directly
+    uint32 result = LzmaEncode(dst + LZMA_PROPS_SIZE, &newsize, src, srcLen, &props, dst, &propsSize, 0, &progress, &alloc, &alloc);
+    if(result != SZ_OK || !newsize)
+        return 0;
 
-    _iscompressed = true;
+    ASSERT(propsSize == LZMA_PROPS_SIZE); // this should not be changed by the library
 
-    _real_size = oldsize;
+    return uint32(newsize + LZMA_PROPS_SIZE);
 }
 
-void LZMACompressor::Decompress(void)
+bool LZMACompressor::_Decode(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
 {
-    if( (!_iscompressed) || (!_real_size) || (!size()))
-        return;
-
-    uint32 origsize = _real_size;
-    SRes result = SZ_OK;
-    uint8 *target = new uint8[_real_size];
-    wpos(0);
-    rpos(0);
-    SizeT srcLen = this->size() - LZMA_PROPS_SIZE;
+    if(srcLen <= LZMA_PROPS_SIZE)
+        return false;
 
     ISzAlloc alloc;
     alloc.Alloc = myLzmaAlloc;
     alloc.Free = myLzmaFree;
 
     ELzmaStatus status;
-    Byte *dataPtr = (Byte*)this->contents() + LZMA_PROPS_SIZE; // first 5 bytes are encoded props
+    SizeT packedLen = srcLen - LZMA_PROPS_SIZE;
+    SizeT rs = dstLen;
+
+    SRes result = LzmaDecode(dst, &rs, src + LZMA_PROPS_SIZE, &packedLen, src, LZMA_PROPS_SIZE, LZMA_FINISH_END, &status, &alloc);
+    if(result != SZ_OK || rs != dstLen)
+    {
+        //DEBUG(logerror("LZMACompressor: Decompress error! result=%d cursize=%u origsize=%u realsize=%u\n",result,srcLen,rs,dstLen));
+        return false;
+    }
+    return true;
+}
+
+bool LZMACompressor::BeginDecompress(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    EndDecompress();
+    if(srcLen <= LZMA_PROPS_SIZE)
+        return false;
+
+    LZMADecodeState *st = new LZMADecodeState;
+    st->alloc.Alloc = myLzmaAlloc;
+    st->alloc.Free = myLzmaFree;
+    LzmaDec_Construct(&st->dec);
+    if(LzmaDec_AllocateProbs(&st->dec, src, LZMA_PROPS_SIZE, &st->alloc) != SZ_OK)
+    {
+        delete st;
+        return false;
+    }
+    // decode straight into dst, like LzmaDecode() does
+    st->dec.dic = dst;
+    st->dec.dicBufSize = dstLen;
+    LzmaDec_Init(&st->dec);
+    st->inPos = LZMA_PROPS_SIZE;
+    _dec = st;
+
+    return ICompressor::BeginDecompress(dst, dstLen, src, srcLen);
+}
 
-    SizeT rs = _real_size;
+bool LZMACompressor::DecompressUntil(uint32 upTo)
+{
+    if(!_dec)
+        return false;
+    if(upTo > _streamDstLen)
+        upTo = _streamDstLen;
+    if(_streamDone >= upTo)
+        return true;
 
-    result = LzmaDecode(target, &rs, dataPtr, &srcLen, (const Byte*)this->contents(), LZMA_PROPS_SIZE, LZMA_FINISH_END, &status, &alloc);
-    if( result != SZ_OK || origsize != _real_size)
+    ELzmaStatus status;
+    SizeT inLen = _streamSrcLen - _dec->inPos;
+    SRes result = LzmaDec_DecodeToDic(&_dec->dec, upTo, _streamSrc + _dec->inPos, &inLen, LZMA_FINISH_ANY, &status);
+    _dec->inPos += uint32(inLen);
+    _streamDone = uint32(_dec->dec.dicPos);
+    return result == SZ_OK && _streamDone >= upTo;
+}
+
+void LZMACompressor::EndDecompress(void)
+{
+    if(_dec)
     {
-        //DEBUG(logerror("LZMACompressor: Decompress error! result=%d cursize=%u origsize=%u realsize=%u\n",result,size(),origsize,_real_size));
-        delete [] target;
-        return;
+        LzmaDec_FreeProbs(&_dec->dec, &_dec->alloc);
+        delete _dec;
+        _dec = NULL;
     }
-    _real_size = (uint32)rs;
-    resize(origsize);
-    wpos(0);
-    rpos(0);
-    append(target, origsize);
-    delete [] target;
-    _real_size = 0;
-    _iscompressed = false;
+    ICompressor::EndDecompress();
 }
 
 LVPA_NAMESPACE_END
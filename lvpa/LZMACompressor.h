@@ -6,11 +6,27 @@
 
 LVPA_NAMESPACE_START
 
+struct LZMADecodeState;
+
 class LZMACompressor : public ICompressor
 {
 public:
-    virtual void Compress(uint8 level = 1, ProgressCallback pcb = NULL);
-    virtual void Decompress(void);
+    LZMACompressor() : _dec(NULL) {}
+    virtual ~LZMACompressor();
+    virtual uint32 CompressBound(uint32 srcLen) const;
+    virtual uint32 CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb = NULL);
+    virtual bool DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+    virtual bool BeginDecompress(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+    virtual bool DecompressUntil(uint32 upTo);
+    virtual void EndDecompress(void);
+
+protected:
+    // dictSize == 0 selects the default for the level
+    static uint32 _Encode(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, uint32 dictSize, ProgressCallback pcb);
+    static bool _Decode(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+
+private:
+    LZMADecodeState *_dec; // while unpacking incrementally
 };
 
 LVPA_NAMESPACE_END
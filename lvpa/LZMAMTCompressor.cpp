@@ -0,0 +1,285 @@
+#include "LVPACompileConfig.h"
+
+#ifdef LVPA_SUPPORT_LZMA
+
+#include <algorithm>
+#include <lzma/LzmaEnc.h>
+#include "LVPAInternal.h"
+#include "LZMAMTCompressor.h"
+#include "LVPAThreading.h"
+
+LVPA_NAMESPACE_START
+
+// chunk size is 1 << (MIN_CHUNK_LOG2 + level / 3), so 2 MB on level 0..2, up to 16 MB on level 9
+// (the encoder needs roughly 11 times the dict size per thread at high levels, so this must not get too large)
+static const uint32 MIN_CHUNK_LOG2 = 21;
+static const uint32 MAX_CHUNK_LOG2 = 30;
+static const uint32 CHUNK_RAW = 0x80000000;
+
+static inline uint32 chunkCount(uint32 len, uint32 chunkLog)
+{
+    return uint32((uint64(len) + (uint64(1) << chunkLog) - 1) >> chunkLog);
+}
+
+static inline uint32 chunkLen(uint32 idx, uint32 total, uint32 chunkLog)
+{
+    uint32 offs = idx << chunkLog;
+    uint32 rem = total - offs;
+    return rem < (uint32(1) << chunkLog) ? rem : (uint32(1) << chunkLog);
+}
+
+static inline void putLE32(uint8 *p, uint32 v)
+{
+    p[0] = uint8(v);
+    p[1] = uint8(v >> 8);
+    p[2] = uint8(v >> 16);
+    p[3] = uint8(v >> 24);
+}
+
+static inline uint32 getLE32(const uint8 *p)
+{
+    return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+}
+
+struct LZMAMTJob
+{
+    const uint8 *src;
+    uint8 *dst;
+    uint32 total; // unpacked size
+    uint32 chunkLog;
+    uint32 dictSize;
+    uint32 first; // index of the first chunk in a ParallelFor() run
+    uint8 level;
+    std::vector<uint32> offs; // where each chunk is (or, while compressing, its slot)
+    std::vector<uint32> sizes; // packed size of each chunk, incl. CHUNK_RAW flag
+    std::vector<uint8> ok;
+
+    ICompressor::ProgressCallback pcb;
+    uint64 done; // protected by mtx
+    Mutex mtx;
+};
+
+class LZMAMTWorker : public LZMACompressor
+{
+public:
+    static void EncodeChunk(uint32 idx, void *user)
+    {
+        LZMAMTJob *job = (LZMAMTJob*)user;
+        const uint8 *in = job->src + (idx << job->chunkLog);
+        uint8 *out = job->dst + job->offs[idx];
+        uint32 len = chunkLen(idx, job->total, job->chunkLog);
+
+        uint32 packed = _Encode(out, job->sizes[idx], in, len, job->level, job->dictSize, NULL);
+        if(!packed || packed >= len)
+        {
+            memcpy(out, in, len); // the slot is always large enough for this
+            packed = len | CHUNK_RAW;
+        }
+        job->sizes[idx] = packed;
+
+        if(job->pcb)
+        {
+            MutexGuard g(job->mtx); // the callback is not expected to be thread safe
+            job->done += len;
+            job->pcb(NULL, job->done, 0);
+        }
+    }
+
+    static void DecodeChunk(uint32 idx, void *user)
+    {
+        LZMAMTJob *job = (LZMAMTJob*)user;
+        idx += job->first;
+        const uint8 *in = job->src + job->offs[idx];
+        uint8 *out = job->dst + (idx << job->chunkLog);
+        uint32 len = chunkLen(idx, job->total, job->chunkLog);
+        uint32 packed = job->sizes[idx];
+
+        if(packed & CHUNK_RAW)
+        {
+            if((packed & ~CHUNK_RAW) != len)
+                return;
+            memcpy(out, in, len);
+            job->ok[idx] = 1;
+        }
+        else if(_Decode(out, len, in, packed))
+            job->ok[idx] = 1;
+    }
+};
+
+
+// reads the chunk table; returns false if it does not fit the sizes
+static bool readHeader(LZMAMTJob& job, uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    if(!dstLen || !srcLen)
+        return false;
+
+    job.src = src;
+    job.dst = dst;
+    job.total = dstLen;
+    job.chunkLog = src[0];
+    job.first = 0;
+    job.pcb = NULL;
+
+    if(job.chunkLog < MIN_CHUNK_LOG2 || job.chunkLog > MAX_CHUNK_LOG2)
+    {
+        logerror("LZMAMTCompressor: invalid chunk size");
+        return false;
+    }
+
+    uint32 n = chunkCount(dstLen, job.chunkLog);
+    uint64 pos = 1 + uint64(n) * 4;
+    if(pos > srcLen)
+    {
+        logerror("LZMAMTCompressor: truncated header");
+        return false;
+    }
+
+    job.offs.resize(n);
+    job.sizes.resize(n);
+    job.ok.resize(n, 0);
+    for(uint32 i = 0; i < n; ++i)
+    {
+        job.offs[i] = uint32(pos);
+        job.sizes[i] = getLE32(src + 1 + i * 4);
+        pos += job.sizes[i] & ~CHUNK_RAW;
+    }
+    if(pos != srcLen)
+    {
+        logerror("LZMAMTCompressor: chunk sizes do not match packed size");
+        return false;
+    }
+    return true;
+}
+
+// unpacks the chunks [first, end) in parallel
+static bool decodeChunks(LZMAMTJob& job, uint32 first, uint32 end, uint32 threads)
+{
+    job.first = first;
+    ParallelFor(end - first, LZMAMTWorker::DecodeChunk, &job, threads);
+
+    for(uint32 i = first; i < end; ++i)
+        if(!job.ok[i])
+        {
+            logerror("LZMAMTCompressor: failed to decompress chunk %u", i);
+            return false;
+        }
+    return true;
+}
+
+LZMAMTCompressor::~LZMAMTCompressor()
+{
+    LZMAMTCompressor::EndDecompress();
+}
+
+uint32 LZMAMTCompressor::CompressBound(uint32 srcLen) const
+{
+    // the smallest chunk size has the most per-chunk overhead, this covers all levels
+    uint32 n = chunkCount(srcLen, MIN_CHUNK_LOG2);
+    uint64 bound = 1 + uint64(n) * 4;
+    for(uint32 i = 0; i < n; ++i)
+        bound += LZMACompressor::CompressBound(chunkLen(i, srcLen, MIN_CHUNK_LOG2));
+    return bound > 0xFFFFFFFF ? 0 : uint32(bound);
+}
+
+uint32 LZMAMTCompressor::CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb /* = NULL */)
+{
+    if(!srcLen)
+        return 0;
+
+    LZMAMTJob job;
+    job.src = src;
+    job.dst = dst;
+    job.total = srcLen;
+    job.chunkLog = MIN_CHUNK_LOG2 + std::min<uint32>(level, 9) / 3;
+    job.level = level;
+    job.first = 0;
+    job.pcb = pcb;
+    job.done = 0;
+
+    // the whole chunk fits into the dictionary, more is useless
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    props.level = level;
+    LzmaEncProps_Normalize(&props);
+    job.dictSize = std::min<uint32>(props.dictSize, uint32(1) << job.chunkLog);
+
+    uint32 n = chunkCount(srcLen, job.chunkLog);
+    uint32 hdrSize = 1 + n * 4;
+    job.offs.resize(n);
+    job.sizes.resize(n);
+
+    // each chunk gets its own slot, large enough to hold the worst case
+    uint64 pos = hdrSize;
+    for(uint32 i = 0; i < n; ++i)
+    {
+        job.offs[i] = uint32(pos);
+        job.sizes[i] = LZMACompressor::CompressBound(chunkLen(i, srcLen, job.chunkLog));
+        pos += job.sizes[i];
+    }
+    if(pos > dstCap)
+        return 0;
+
+    ParallelFor(n, LZMAMTWorker::EncodeChunk, &job, _threads);
+
+    // close the gaps between the slots, and write the header
+    dst[0] = uint8(job.chunkLog);
+    uint32 wpos = hdrSize;
+    for(uint32 i = 0; i < n; ++i)
+    {
+        uint32 sz = job.sizes[i] & ~CHUNK_RAW;
+        if(wpos != job.offs[i])
+            memmove(dst + wpos, dst + job.offs[i], sz);
+        wpos += sz;
+        putLE32(dst + 1 + i * 4, job.sizes[i]);
+    }
+
+    return wpos;
+}
+
+bool LZMAMTCompressor::DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    LZMAMTJob job;
+    return readHeader(job, dst, dstLen, src, srcLen)
+        && decodeChunks(job, 0, job.offs.size(), _threads);
+}
+
+bool LZMAMTCompressor::BeginDecompress(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    EndDecompress();
+    LZMAMTJob *job = new LZMAMTJob;
+    if(!readHeader(*job, dst, dstLen, src, srcLen))
+    {
+        delete job;
+        return false;
+    }
+    _job = job;
+    return ICompressor::BeginDecompress(dst, dstLen, src, srcLen);
+}
+
+bool LZMAMTCompressor::DecompressUntil(uint32 upTo)
+{
+    if(!_job)
+        return false;
+    if(upTo > _streamDstLen)
+        upTo = _streamDstLen;
+    if(_streamDone >= upTo)
+        return true;
+
+    // everything before _streamDone is made of whole chunks
+    uint32 end = chunkCount(upTo, _job->chunkLog);
+    if(!decodeChunks(*_job, _streamDone >> _job->chunkLog, end, _threads))
+        return false;
+    _streamDone = uint32(std::min<uint64>(uint64(end) << _job->chunkLog, _streamDstLen));
+    return true;
+}
+
+void LZMAMTCompressor::EndDecompress(void)
+{
+    delete _job;
+    _job = NULL;
+    LZMACompressor::EndDecompress();
+}
+
+LVPA_NAMESPACE_END
+
+#endif // LVPA_SUPPORT_LZMA
@@ -0,0 +1,34 @@
+#ifndef _LZMAMTCOMPRESSOR_H
+#define _LZMAMTCOMPRESSOR_H
+
+#include "LZMACompressor.h"
+
+LVPA_NAMESPACE_START
+
+struct LZMAMTJob;
+
+// Splits the input into independent LZMA chunks, which are compressed and decompressed in parallel.
+// Similar in spirit to LZMA2/xz blocks, but the container is LVPA-specific:
+//   uint8 log2(chunk size), uint32 packed size per chunk (high bit set: chunk is stored uncompressed),
+//   followed by the chunks, each being a regular LZMACompressor stream (or raw data).
+// The number of chunks is derived from the unpacked size, which is always known.
+// Incremental decompression works chunk by chunk, with all chunks up to the requested position unpacked in parallel.
+class LZMAMTCompressor : public LZMACompressor
+{
+public:
+    LZMAMTCompressor() : _job(NULL) {}
+    virtual ~LZMAMTCompressor();
+    virtual uint32 CompressBound(uint32 srcLen) const;
+    virtual uint32 CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb = NULL);
+    virtual bool DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+    virtual bool BeginDecompress(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+    virtual bool DecompressUntil(uint32 upTo);
+    virtual void EndDecompress(void);
+
+private:
+    LZMAMTJob *_job; // while unpacking incrementally
+};
+
+LVPA_NAMESPACE_END
+
+#endif
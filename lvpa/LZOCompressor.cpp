@@ -23,10 +23,15 @@ static void lzo_progress_wrapper(lzo_callback_p lzo_cb, lzo_uint cur, lzo_uint t
         my_cb(NULL, cur, total);
 }
 
-void LZOCompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
+uint32 LZOCompressor::CompressBound(uint32 srcLen) const
 {
-    if(!level || _iscompressed || (!size()))
-        return;
+    return LZO_OUT_LEN(srcLen);
+}
+
+uint32 LZOCompressor::CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb /* = NULL */)
+{
+    if(!level || dstCap < LZO_OUT_LEN(srcLen)) // lzo does not check the output size
+        return 0;
 
     if(s_lzoNeedsInit)
     {
@@ -35,58 +40,74 @@ void LZOCompressor::Compress(uint8 level, ProgressCallback pcb /* = NULL */)
         ASSERT(res == LZO_E_OK);
     }
 
-    lzo_uint oldsize = size();
-    lzo_uint newsize = LZO_OUT_LEN(oldsize);
-
-    uint8 *wrkmem = new uint8[LZO1X_999_MEM_COMPRESS];
+    lzo_uint newsize = dstCap;
+    int r;
 
-    // to make valgrind happy
-    memset(wrkmem, 0, LZO1X_999_MEM_COMPRESS);
+    if(level < 3)
+    {
+        // the fast compressors, roughly 10x faster than lzo1x_999 at the lowest level, and decode with the same decompressor
+        lzo_uint32 memsize = level == 1 ? LZO1X_1_15_MEM_COMPRESS : LZO1X_1_MEM_COMPRESS;
+        uint8 *wrkmem = new uint8[memsize];
+        if(level == 1)
+            r = lzo1x_1_15_compress(src, srcLen, dst, &newsize, wrkmem);
+        else
+            r = lzo1x_1_compress(src, srcLen, dst, &newsize, wrkmem);
+        delete [] wrkmem;
+
+        if(r == LZO_E_OK && pcb)
+            pcb(NULL, srcLen, newsize);
+    }
+    else
+    {
+        uint8 *wrkmem = new uint8[LZO1X_999_MEM_COMPRESS];
 
-    uint8 *buf = new uint8[newsize];
+        // to make valgrind happy
+        memset(wrkmem, 0, LZO1X_999_MEM_COMPRESS);
 
-    lzo_callback_t cb;
-    cb.nalloc = NULL;
-    cb.nfree = NULL;
-    cb.nprogress = lzo_progress_wrapper;
-    cb.user1 = (void*)pcb;
+        lzo_callback_t cb;
+        cb.nalloc = NULL;
+        cb.nfree = NULL;
+        cb.nprogress = lzo_progress_wrapper;
+        cb.user1 = (void*)pcb;
 
-    int r = lzo1x_999_compress_level(contents(), oldsize, buf, &newsize, wrkmem, NULL, 0, &cb, level);
+        r = lzo1x_999_compress_level(src, srcLen, dst, &newsize, wrkmem, NULL, 0, &cb, level);
 
-    delete [] wrkmem;
+        delete [] wrkmem;
+    }
 
     if(r != LZO_E_OK)
     {
         /* this should NEVER happen */
         logerror("LZOCompressor: internal error - compression failed: %d", r);
-        delete [] buf;
-        return;
+        return 0;
     }
     /* check for an incompressible block */
-    if (newsize >= oldsize)
+    if (newsize >= srcLen)
     {
         //DEBUG(logdebug("LZOCompressor: This block contains incompressible data."));
-        delete [] buf;
-        return;
+        return 0;
     }
 
-    // TODO: add lzo1x_optimize() step and use this instead of append() ?
-
-    resize((size_t)newsize);
-    rpos(0);
-    wpos(0);
-    append(buf,(size_t)newsize);
-    delete [] buf;
+    // lzo1x_999 output can be rearranged to decompress faster (the size stays the same).
+    // This needs to decompress the data again, but that is cheap compared to compressing with 999.
+    if(level >= 3)
+    {
+        uint8 *tmp = new uint8[srcLen];
+        lzo_uint origsize = srcLen;
+        r = lzo1x_optimize(dst, newsize, tmp, &origsize, NULL);
+        delete [] tmp;
+        if(r != LZO_E_OK || origsize != srcLen)
+        {
+            logerror("LZOCompressor: internal error - optimize failed: %d", r);
+            return 0;
+        }
+    }
 
-    _iscompressed = true;
-    _real_size = (uint64)oldsize;
+    return uint32(newsize);
 }
 
-void LZOCompressor::Decompress(void)
+bool LZOCompressor::DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
 {
-    if( (!_iscompressed) || (!_real_size) || (!size()))
-        return;
-
     if(s_lzoNeedsInit)
     {
         s_lzoNeedsInit = false;
@@ -94,25 +115,16 @@ void LZOCompressor::Decompress(void)
         ASSERT(res == LZO_E_OK);
     }
 
-    lzo_uint currentSize = size();
-    lzo_uint targetSize = _real_size;
-    uint8 *target = new uint8[targetSize];
+    lzo_uint targetSize = dstLen;
 
-    int r = lzo1x_decompress(contents(), currentSize, target, &targetSize, NULL);
-    if (!(r == LZO_E_OK && (uint64)targetSize == _real_size))
+    int r = lzo1x_decompress_safe(src, srcLen, dst, &targetSize, NULL);
+    if (!(r == LZO_E_OK && targetSize == dstLen))
     {
         /* this should NEVER happen */
         logerror("LZOCompressor: internal error - decompression failed: %d", r);
-        return;
+        return false;
     }
-
-    resize((size_t)_real_size);
-    wpos(0);
-    rpos(0);
-    append(target, (size_t)_real_size);
-    delete [] target;
-    _real_size = 0;
-    _iscompressed = false;
+    return true;
 }
 
 LVPA_NAMESPACE_END
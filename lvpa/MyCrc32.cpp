@@ -1,10 +1,190 @@
-#include "LVPACommon.h"
+#include "LVPAInternal.h"
 #include "MyCrc32.h"
+#include "CPUFeatures.h"
+
+#ifdef LVPA_X86_SIMD
+#  include <emmintrin.h>
+#  include <smmintrin.h>
+#  include <wmmintrin.h>
+#endif
 
 LVPA_NAMESPACE_START
 
-static uint32 _tab[256];
+// _tab[0] is the classic table, _tab[k] advances the CRC over k more zero bytes (for slicing)
+static uint32 _tab[16][256];
+static uint32 _x2n[32]; // x^(2^n) modulo the polynomial, for Combine()
 static bool _notab = true;
+static CRC32::Impl _impl = CRC32::IMPL_AUTO;
+
+// little endian read, regardless of platform and alignment; compiles to a single load on x86
+static inline uint32 read32(const uint8 *p)
+{
+    return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+}
+
+// multiplies a and b modulo the polynomial (bit-reflected, so x^0 is the top bit). a must not be 0.
+static uint32 multModP(uint32 a, uint32 b)
+{
+    uint32 m = uint32(1) << 31;
+    uint32 p = 0;
+    for(;;)
+    {
+        if(a & m)
+        {
+            p ^= b;
+            if(!(a & (m - 1)))
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ 0xEDB88320 : b >> 1;
+    }
+    return p;
+}
+
+// x^(n * 2^k) modulo the polynomial
+static uint32 x2nModP(uint64 n, uint32 k)
+{
+    uint32 p = uint32(1) << 31; // x^0 == 1
+    for( ; n; n >>= 1, ++k)
+        if(n & 1)
+            p = multModP(_x2n[k & 31], p);
+    return p;
+}
+
+static uint32 updateBytewise(uint32 crc, const uint8 *b, uint32 size)
+{
+    for (uint32 i = 0; i < size; i++)
+        crc = ((crc >> 8) & 0x00FFFFFF) ^ _tab[0][(crc ^ *b++) & 0xFF];
+    return crc;
+}
+
+static uint32 updateSlice8(uint32 crc, const uint8 *b, uint32 size)
+{
+    for( ; size >= 8; size -= 8, b += 8)
+    {
+        uint32 lo = crc ^ read32(b);
+        uint32 hi = read32(b + 4);
+        crc = _tab[7][lo & 0xFF] ^ _tab[6][(lo >> 8) & 0xFF] ^ _tab[5][(lo >> 16) & 0xFF] ^ _tab[4][lo >> 24]
+            ^ _tab[3][hi & 0xFF] ^ _tab[2][(hi >> 8) & 0xFF] ^ _tab[1][(hi >> 16) & 0xFF] ^ _tab[0][hi >> 24];
+    }
+    return updateBytewise(crc, b, size);
+}
+
+static uint32 updateSlice16(uint32 crc, const uint8 *b, uint32 size)
+{
+    for( ; size >= 16; size -= 16, b += 16)
+    {
+        uint32 w0 = crc ^ read32(b);
+        uint32 w1 = read32(b + 4);
+        uint32 w2 = read32(b + 8);
+        uint32 w3 = read32(b + 12);
+        crc = _tab[15][w0 & 0xFF] ^ _tab[14][(w0 >> 8) & 0xFF] ^ _tab[13][(w0 >> 16) & 0xFF] ^ _tab[12][w0 >> 24]
+            ^ _tab[11][w1 & 0xFF] ^ _tab[10][(w1 >> 8) & 0xFF] ^ _tab[ 9][(w1 >> 16) & 0xFF] ^ _tab[ 8][w1 >> 24]
+            ^ _tab[ 7][w2 & 0xFF] ^ _tab[ 6][(w2 >> 8) & 0xFF] ^ _tab[ 5][(w2 >> 16) & 0xFF] ^ _tab[ 4][w2 >> 24]
+            ^ _tab[ 3][w3 & 0xFF] ^ _tab[ 2][(w3 >> 8) & 0xFF] ^ _tab[ 1][(w3 >> 16) & 0xFF] ^ _tab[ 0][w3 >> 24];
+    }
+    return updateBytewise(crc, b, size);
+}
+
+#ifdef LVPA_X86_SIMD
+
+// Folding with carry-less multiplication, as described in Intel's paper
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Gopal et al., 2009),
+// with the bit-reflected constants for the IEEE polynomial given there.
+// size must be >= 64 and a multiple of 16.
+LVPA_TARGET("pclmul,sse4.1")
+static uint32 foldPclmul(uint32 crc, const uint8 *buf, uint32 size)
+{
+    const __m128i k1k2 = _mm_set_epi32(0x00000001, 0xC6E41596, 0x00000001, 0x54442BD4);
+    const __m128i k3k4 = _mm_set_epi32(0x00000000, 0xCCAA009E, 0x00000001, 0x751997D0);
+    const __m128i k5k0 = _mm_set_epi32(0x00000000, 0x00000000, 0x00000001, 0x63CD6124);
+    const __m128i poly = _mm_set_epi32(0x00000001, 0xF7011641, 0x00000001, 0xDB710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(int(crc)));
+    buf += 64;
+    size -= 64;
+
+    // fold 4 x 128 bits in parallel
+    x0 = k1k2;
+    for( ; size >= 64; size -= 64, buf += 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+    }
+
+    // fold the 4 lanes into one
+    x0 = k3k4;
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // remaining 16 byte blocks
+    for( ; size >= 16; size -= 16, buf += 16)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)buf)), x5);
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return uint32(_mm_extract_epi32(x1, 1));
+}
+
+static uint32 updatePclmul(uint32 crc, const uint8 *b, uint32 size)
+{
+    if(size >= 64)
+    {
+        uint32 n = size & ~15u;
+        crc = foldPclmul(crc, b, n);
+        b += n;
+        size -= n;
+    }
+    return updateSlice16(crc, b, size);
+}
+
+#endif
+
+typedef uint32 (*UpdateFn)(uint32 crc, const uint8 *buf, uint32 size); // same as CRC32::UpdateFunc
+static UpdateFn getUpdateFunc(CRC32::Impl impl);
+
+CRC32::UpdateFunc CRC32::_update = NULL;
 
 CRC32::CRC32()
 : _crc(0xFFFFFFFF)
@@ -12,6 +192,7 @@ CRC32::CRC32()
     if(_notab)
     {
         GenTab();
+        _update = getUpdateFunc(_impl);
         _notab = false;
     }
 }
@@ -29,8 +210,16 @@ void CRC32::GenTab(void)
             else
                 crc >>= 1;
         }
-        _tab[i] = crc;
+        _tab[0][i] = crc;
     }
+    for (uint16 i = 0; i < 256; i++)
+        for (uint8 k = 1; k < 16; k++)
+            _tab[k][i] = (_tab[k - 1][i] >> 8) ^ _tab[0][_tab[k - 1][i] & 0xFF];
+
+    uint32 p = uint32(1) << 30; // x^1
+    _x2n[0] = p;
+    for (uint8 n = 1; n < 32; n++)
+        _x2n[n] = p = multModP(p, p);
 }
 
 void CRC32::Finalize(void)
@@ -38,11 +227,88 @@ void CRC32::Finalize(void)
     _crc ^= 0xFFFFFFFF;
 }
 
-void CRC32::Update(const void *buf, uint32 size)
+uint32 CRC32::CombineGen(uint64 len2)
 {
-    const uint8* b = (const uint8*)buf;
-    for (uint32 i = 0; i < size; i++)
-        _crc = ((_crc >> 8) & 0x00FFFFFF) ^ _tab[(_crc ^ *b++) & 0xFF];
+    CRC32 init; // make sure the tables exist
+    return x2nModP(len2, 3); // x^(8 * len2)
+}
+
+uint32 CRC32::CombineOp(uint32 crc1, uint32 crc2, uint32 op)
+{
+    // appending len2 bytes shifts crc1 by that many bits, the xor-ed in pre/post conditioning cancels out
+    return multModP(op, crc1) ^ crc2;
+}
+
+uint32 CRC32::Combine(uint32 crc1, uint32 crc2, uint64 len2)
+{
+    return CombineOp(crc1, crc2, CombineGen(len2));
+}
+
+bool CRC32::IsSupported(Impl impl)
+{
+    switch(impl)
+    {
+        case IMPL_AUTO:
+        case IMPL_BYTEWISE:
+        case IMPL_SLICE8:
+        case IMPL_SLICE16:
+            return true;
+        case IMPL_PCLMUL:
+#ifdef LVPA_X86_SIMD
+            return GetCPUFeatures().pclmul && GetCPUFeatures().sse41;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+static UpdateFn getUpdateFunc(CRC32::Impl impl)
+{
+    switch(impl)
+    {
+        case CRC32::IMPL_BYTEWISE: return &updateBytewise;
+        case CRC32::IMPL_SLICE8:   return &updateSlice8;
+        case CRC32::IMPL_SLICE16:  return &updateSlice16;
+#ifdef LVPA_X86_SIMD
+        case CRC32::IMPL_PCLMUL:   return &updatePclmul;
+#endif
+        default: ; // auto
+    }
+#ifdef LVPA_X86_SIMD
+    if(CRC32::IsSupported(CRC32::IMPL_PCLMUL))
+        return &updatePclmul;
+#endif
+    return &updateSlice16;
+}
+
+bool CRC32::SetImpl(Impl impl)
+{
+    if(!IsSupported(impl))
+        return false;
+    CRC32 init; // make sure the tables exist
+    _impl = impl;
+    _update = getUpdateFunc(impl);
+    return true;
+}
+
+CRC32::Impl CRC32::GetImpl(void)
+{
+    return _impl;
+}
+
+const char *CRC32::GetImplName(Impl impl)
+{
+    switch(impl)
+    {
+        case IMPL_AUTO:     return "auto";
+        case IMPL_BYTEWISE: return "bytewise";
+        case IMPL_SLICE8:   return "slice-by-8";
+        case IMPL_SLICE16:  return "slice-by-16";
+        case IMPL_PCLMUL:   return "pclmul";
+        default:            return "unknown";
+    }
 }
 
 LVPA_NAMESPACE_END
@@ -6,8 +6,20 @@ LVPA_NAMESPACE_START
 class CRC32
 {
 public:
+    // ways to calculate the checksum, all give the same result
+    enum Impl
+    {
+        IMPL_AUTO,      // fastest one supported by the CPU (default)
+        IMPL_BYTEWISE,  // classic table lookup, one byte per step
+        IMPL_SLICE8,    // 8 tables, 8 bytes per step
+        IMPL_SLICE16,   // 16 tables, 16 bytes per step; fastest portable one
+        IMPL_PCLMUL,    // x86 carry-less multiplication (PCLMULQDQ + SSE4.1), folds 64 bytes per step
+
+        IMPL_MAX
+    };
+
     CRC32();
-    void Update(const void *buf, uint32 size);
+    void Update(const void *buf, uint32 size) { _crc = _update(_crc, (const uint8*)buf, size); }
     void Finalize(void);
     uint32 Result(void) { return _crc; }
 
@@ -19,8 +31,26 @@ public:
         return crc.Result();
     }
 
+    // Given the (finalized) checksums of two consecutive blocks of data, and the length of the second one,
+    // returns the checksum of both blocks together, without looking at the data again (like zlib's crc32_combine()).
+    // Allows checksumming pieces of a buffer in parallel, or rolling up checksums of parts into one for the whole.
+    static uint32 Combine(uint32 crc1, uint32 crc2, uint64 len2);
+    // The same in two steps, for combining many blocks of the same length: CombineGen() is the slow part, do it once.
+    static uint32 CombineGen(uint64 len2);
+    static uint32 CombineOp(uint32 crc1, uint32 crc2, uint32 op);
+
+    // Selects the implementation used from now on, for testing and benchmarking.
+    // Returns false (and changes nothing) if it is not supported on this machine.
+    static bool SetImpl(Impl impl);
+    static Impl GetImpl(void);
+    static bool IsSupported(Impl impl);
+    static const char *GetImplName(Impl impl);
+
 private:
+    typedef uint32 (*UpdateFunc)(uint32 crc, const uint8 *buf, uint32 size);
+
     static void GenTab(void);
+    static UpdateFunc _update;
     uint32 _crc;
 };
 
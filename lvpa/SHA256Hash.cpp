@@ -4,9 +4,20 @@
 LVPA_NAMESPACE_START
 
 
+static SHA256Hash::Impl s_impl = SHA256Hash::IMPL_AUTO;
+static bool s_implReady = false;
+
+// picks the implementation the first time a hash is calculated, unless SetImpl() was called already
+static inline void initImpl(void)
+{
+    if(!s_implReady)
+        SHA256Hash::SetImpl(s_impl);
+}
+
 SHA256Hash::SHA256Hash(uint8 *target /* = NULL */)
 : _digestPtr(target ? target : &_digest[0])
 {
+    initImpl();
     sha256_init(&_ctx);
 }
 
@@ -23,6 +34,7 @@ void SHA256Hash::Finalize(void)
 
 void SHA256Hash::Calc(uint8 *dst, const uint8 *src, uint32 size)
 {
+    initImpl();
     sha256_ctx ctx;
     sha256_init(&ctx);
     sha256_chunk(&ctx, src, size);
@@ -30,4 +42,138 @@ void SHA256Hash::Calc(uint8 *dst, const uint8 *src, uint32 size)
     sha256_hash(&ctx, dst);
 }
 
+#ifdef LVPA_X86_SIMD
+
+// messages up to this many blocks (after padding) go through the 4-lane code, longer ones are hashed one by one
+#define SHA256_MULTI_MAX_BLOCKS 4
+
+// appends padding and length, like sha256_final() does; returns the number of blocks
+static uint32 padMessage(uint8 *buf, const uint8 *src, uint32 size)
+{
+    const uint32 blocks = (size + 8) / 64 + 1;
+    memcpy(buf, src, size);
+    buf[size] = 0x80;
+    memset(buf + size + 1, 0, blocks * 64 - size - 1);
+    const uint64 bits = uint64(size) << 3;
+    for(uint32 i = 0; i < 8; ++i)
+        buf[blocks * 64 - 1 - i] = uint8(bits >> (i * 8));
+    return blocks;
+}
+
+static void calcMultiX4(uint8 *const *dst, const uint8 *const *src, const uint32 *sizes, uint32 count)
+{
+    uint8 bufs[4][SHA256_MULTI_MAX_BLOCKS * 64];
+    uint32 states[4][8];
+    uint32 *hs[4];
+    const uint8 *data[4];
+    uint32 blocks[4];
+    uint8 *outs[4];
+    uint32 used = 0;
+
+    for(uint32 l = 0; l < 4; ++l)
+    {
+        hs[l] = &states[l][0];
+        data[l] = &bufs[l][0];
+    }
+
+    for(uint32 i = 0; i < count || used; ++i)
+    {
+        if(i < count)
+        {
+            if(sizes[i] + 9 > SHA256_MULTI_MAX_BLOCKS * 64)
+            {
+                SHA256Hash::Calc(dst[i], src[i], sizes[i]);
+                continue;
+            }
+            outs[used] = dst[i];
+            blocks[used] = padMessage(bufs[used], src[i], sizes[i]);
+            if(++used < 4)
+                continue;
+        }
+
+        for(uint32 l = 0; l < 4; ++l)
+        {
+            sha256_ctx ctx;
+            sha256_init(&ctx);
+            memcpy(hs[l], ctx.h, sizeof(ctx.h));
+            if(l >= used)
+                blocks[l] = 0; // unused lane
+        }
+        sha256_blocks_x4(hs, data, blocks);
+
+        for(uint32 l = 0; l < used; ++l)
+        {
+            sha256_ctx ctx;
+            memcpy(ctx.h, hs[l], sizeof(ctx.h));
+            sha256_hash(&ctx, outs[l]);
+        }
+        used = 0;
+    }
+}
+
+#endif
+
+void SHA256Hash::CalcMulti(uint8 *const *dst, const uint8 *const *src, const uint32 *sizes, uint32 count)
+{
+    initImpl();
+#ifdef LVPA_X86_SIMD
+    // a single message with the SHA extensions is still faster than 4 at once without
+    if(sha256_blocks != sha256_blocks_shani && GetCPUFeatures().sse2)
+    {
+        calcMultiX4(dst, src, sizes, count);
+        return;
+    }
+#endif
+    for(uint32 i = 0; i < count; ++i)
+        Calc(dst[i], src[i], sizes[i]);
+}
+
+bool SHA256Hash::IsSupported(Impl impl)
+{
+    switch(impl)
+    {
+        case IMPL_AUTO:
+        case IMPL_GENERIC:
+            return true;
+        case IMPL_SHANI:
+#ifdef LVPA_X86_SIMD
+            return GetCPUFeatures().sha && GetCPUFeatures().ssse3 && GetCPUFeatures().sse41;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool SHA256Hash::SetImpl(Impl impl)
+{
+    if(!IsSupported(impl))
+        return false;
+    s_impl = impl;
+    s_implReady = true;
+    sha256_blocks = sha256_blocks_generic;
+#ifdef LVPA_X86_SIMD
+    if(impl == IMPL_SHANI || (impl == IMPL_AUTO && IsSupported(IMPL_SHANI)))
+        sha256_blocks = sha256_blocks_shani;
+#endif
+    return true;
+}
+
+SHA256Hash::Impl SHA256Hash::GetImpl(void)
+{
+    return s_impl;
+}
+
+const char *SHA256Hash::GetImplName(Impl impl)
+{
+    switch(impl)
+    {
+        case IMPL_AUTO:    return "auto";
+        case IMPL_GENERIC: return "generic";
+        case IMPL_SHANI:   return "sha-ni";
+        default:           return "unknown";
+    }
+}
+
 LVPA_NAMESPACE_END
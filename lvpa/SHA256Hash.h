@@ -10,6 +10,16 @@ LVPA_NAMESPACE_START
 class SHA256Hash
 {
 public:
+    // ways to calculate the hash, all give the same result
+    enum Impl
+    {
+        IMPL_AUTO,      // fastest one supported by the CPU (default)
+        IMPL_GENERIC,   // portable C; CalcMulti() hashes 4 messages at once with SSE2, if available
+        IMPL_SHANI,     // x86 SHA extensions
+
+        IMPL_MAX
+    };
+
     SHA256Hash(uint8 *target = NULL);
     void Update(const uint8 *ptr, uint32 size);
     void Finalize(void);
@@ -17,6 +27,16 @@ public:
 
     static inline uint32 Size(void) { return SHA256_DIGEST_LENGTH; }
     static void Calc(uint8 *dst, const uint8 *src, uint32 size);
+    // Hashes count independent messages, dst[i] = hash of sizes[i] bytes at src[i].
+    // Faster than one Calc() after another for many short messages (like file names), if the CPU has no SHA extensions.
+    static void CalcMulti(uint8 *const *dst, const uint8 *const *src, const uint32 *sizes, uint32 count);
+
+    // Selects the implementation used from now on, for testing and benchmarking.
+    // Returns false (and changes nothing) if it is not supported on this machine.
+    static bool SetImpl(Impl impl);
+    static Impl GetImpl(void);
+    static bool IsSupported(Impl impl);
+    static const char *GetImplName(Impl impl);
 
 private:
     sha256_ctx _ctx;
@@ -0,0 +1,127 @@
+#include "LVPAInternal.h"
+#include "XXHash64.h"
+
+#include <algorithm>
+
+LVPA_NAMESPACE_START
+
+static const uint64 PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64 PRIME3 = 0x165667B19E3779F9ULL;
+static const uint64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+// little endian reads, regardless of platform and alignment; compile to a single load on x86
+static inline uint32 read32(const uint8 *p)
+{
+    return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+}
+
+static inline uint64 read64(const uint8 *p)
+{
+    return uint64(read32(p)) | (uint64(read32(p + 4)) << 32);
+}
+
+static inline uint64 rotl(uint64 x, uint32 r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64 xxRound(uint64 acc, uint64 input)
+{
+    acc += input * PRIME2;
+    return rotl(acc, 31) * PRIME1;
+}
+
+static inline uint64 mergeRound(uint64 acc, uint64 v)
+{
+    acc ^= xxRound(0, v);
+    return acc * PRIME1 + PRIME4;
+}
+
+// processes all complete 32 byte stripes, returns the number of bytes used
+static uint32 stripes(uint64 *v, const uint8 *p, uint32 size)
+{
+    const uint8 *start = p;
+    const uint8 *end = p + (size & ~31u);
+    uint64 v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+    for( ; p < end; p += 32)
+    {
+        v1 = xxRound(v1, read64(p));
+        v2 = xxRound(v2, read64(p + 8));
+        v3 = xxRound(v3, read64(p + 16));
+        v4 = xxRound(v4, read64(p + 24));
+    }
+    v[0] = v1; v[1] = v2; v[2] = v3; v[3] = v4;
+    return uint32(p - start);
+}
+
+XXHash64::XXHash64(uint64 seed /* = 0 */)
+: _seed(seed), _total(0), _result(0), _memsize(0)
+{
+    _v[0] = seed + PRIME1 + PRIME2;
+    _v[1] = seed + PRIME2;
+    _v[2] = seed;
+    _v[3] = seed - PRIME1;
+}
+
+void XXHash64::Update(const void *buf, uint32 size)
+{
+    const uint8 *p = (const uint8*)buf;
+    _total += size;
+
+    // complete a stripe left over from last time
+    if(_memsize)
+    {
+        const uint32 n = std::min<uint32>(32 - _memsize, size);
+        memcpy(_mem + _memsize, p, n);
+        _memsize += n;
+        p += n;
+        size -= n;
+        if(_memsize < 32)
+            return;
+        stripes(_v, _mem, 32);
+        _memsize = 0;
+    }
+
+    const uint32 done = stripes(_v, p, size);
+    _memsize = size - done;
+    memcpy(_mem, p + done, _memsize);
+}
+
+void XXHash64::Finalize(void)
+{
+    uint64 h;
+    if(_total >= 32)
+    {
+        h = rotl(_v[0], 1) + rotl(_v[1], 7) + rotl(_v[2], 12) + rotl(_v[3], 18);
+        for(uint32 i = 0; i < 4; ++i)
+            h = mergeRound(h, _v[i]);
+    }
+    else
+        h = _seed + PRIME5;
+
+    h += _total;
+
+    const uint8 *p = _mem;
+    const uint8 *end = _mem + _memsize;
+    for( ; p + 8 <= end; p += 8)
+        h = rotl(h ^ xxRound(0, read64(p)), 27) * PRIME1 + PRIME4;
+    if(p + 4 <= end)
+    {
+        h = rotl(h ^ (uint64(read32(p)) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for( ; p < end; ++p)
+        h = rotl(h ^ (*p * PRIME5), 11) * PRIME1;
+
+    // avalanche
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    _result = h;
+}
+
+LVPA_NAMESPACE_END
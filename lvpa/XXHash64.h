@@ -0,0 +1,35 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+LVPA_NAMESPACE_START
+
+// xxHash64 by Yann Collet (https://github.com/Cyan4973/xxHash), a fast non-cryptographic 64 bit hash.
+// Same results as the reference XXH64().
+class XXHash64
+{
+public:
+    XXHash64(uint64 seed = 0);
+    void Update(const void *buf, uint32 size);
+    void Finalize(void);
+    uint64 Result(void) { return _result; }
+
+    inline static uint64 Calc(const void *buf, uint32 size, uint64 seed = 0)
+    {
+        XXHash64 h(seed);
+        h.Update(buf, size);
+        h.Finalize();
+        return h.Result();
+    }
+
+private:
+    uint64 _v[4]; // the 4 lanes, each eats 8 bytes of every 32 byte stripe
+    uint64 _seed;
+    uint64 _total;
+    uint64 _result;
+    uint8 _mem[32]; // incomplete stripe left over from Update()
+    uint32 _memsize;
+};
+
+LVPA_NAMESPACE_END
+
+#endif
@@ -0,0 +1,129 @@
+#include "LVPACompileConfig.h"
+
+#ifdef LVPA_SUPPORT_ZSTD
+
+#include <zstd/zstd.h>
+#include <zstd/zstd_errors.h>
+#include <zstd/zdict.h>
+#include "LVPAInternal.h"
+#include "ZstdCompressor.h"
+#include "LVPAThreading.h"
+
+LVPA_NAMESPACE_START
+
+// maps LVPA levels 1..9 onto zstd's 1..22 (level 0 means store)
+static const int s_zstdLevels[10] = { 0, 1, 2, 3, 5, 7, 10, 15, 19, 22 };
+
+// inputs at least this large use long-distance matching (from LVPA level 4 up) and a window covering the whole input
+static const uint32 ZSTD_LONG_MIN_SIZE = 16 * 1024 * 1024;
+
+// inputs at least this large are split into jobs for worker threads
+static const uint32 ZSTD_MT_MIN_SIZE = 4 * 1024 * 1024;
+
+
+uint32 ZstdCompressor::CompressBound(uint32 srcLen) const
+{
+    size_t bound = ZSTD_compressBound(srcLen);
+    return bound > 0xFFFFFFFF ? 0 : uint32(bound);
+}
+
+uint32 ZstdCompressor::CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb /* = NULL */)
+{
+    if(!level)
+        return 0;
+
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    if(!cctx)
+        return 0;
+
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, s_zstdLevels[level > 9 ? 9 : level]);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 0); // we have our own crc32
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 0); // the real size is stored in the file header anyway
+
+    if(_dict)
+    {
+        ZSTD_CCtx_loadDictionary(cctx, _dict, _dictSize);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_dictIDFlag, 0); // the archive knows which dictionary belongs to which file
+    }
+
+    if(srcLen >= ZSTD_LONG_MIN_SIZE && level >= 4)
+    {
+        // let the window span the whole input, so that matches can be found everywhere in big solid blocks
+        int wlog = 0;
+        while(wlog < 32 && (uint64(1) << wlog) < srcLen)
+            ++wlog;
+        ZSTD_bounds wb = ZSTD_cParam_getBounds(ZSTD_c_windowLog);
+        if(wlog > wb.upperBound)
+            wlog = wb.upperBound;
+
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, wlog);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1);
+    }
+
+    if(srcLen >= ZSTD_MT_MIN_SIZE)
+    {
+        uint32 threads = _threads ? _threads : GetCPUCount();
+        if(threads > 1) // 1 worker would run beside the calling thread, which only waits
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, int(threads));
+    }
+
+    size_t newsize = ZSTD_compress2(cctx, dst, dstCap, src, srcLen);
+    ZSTD_freeCCtx(cctx);
+
+    if(ZSTD_isError(newsize))
+    {
+        // dst too small is expected for incompressible data, anything else is not
+        if(ZSTD_getErrorCode(newsize) != ZSTD_error_dstSize_tooSmall)
+            logerror("ZstdCompressor: compression failed: %s", ZSTD_getErrorName(newsize));
+        return 0;
+    }
+
+    if(pcb)
+        pcb(NULL, srcLen, newsize);
+
+    return uint32(newsize);
+}
+
+bool ZstdCompressor::DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen)
+{
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    if(!dctx)
+        return false;
+
+    // compression may have used a window larger than the default decoder limit, see above.
+    // the output buffer is allocated in full anyway, so this does not cost extra memory.
+    ZSTD_bounds wb = ZSTD_dParam_getBounds(ZSTD_d_windowLogMax);
+    ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, wb.upperBound);
+
+    if(_dict)
+        ZSTD_DCtx_loadDictionary(dctx, _dict, _dictSize);
+
+    size_t rs = ZSTD_decompressDCtx(dctx, dst, dstLen, src, srcLen);
+    ZSTD_freeDCtx(dctx);
+
+    if(ZSTD_isError(rs) || rs != dstLen)
+    {
+        logerror("ZstdCompressor: decompression failed: %s", ZSTD_isError(rs) ? ZSTD_getErrorName(rs) : "size mismatch");
+        return false;
+    }
+    return true;
+}
+
+uint32 ZstdCompressor::TrainDictionary(uint8 *dst, uint32 dstCap, const uint8 *samples, const uint32 *sampleSizes, uint32 count)
+{
+    if(!count)
+        return 0;
+
+    std::vector<size_t> sizes(sampleSizes, sampleSizes + count);
+    size_t dictSize = ZDICT_trainFromBuffer(dst, dstCap, samples, &sizes[0], count);
+    if(ZDICT_isError(dictSize))
+    {
+        DEBUG(logdebug("ZstdCompressor: dictionary training failed: %s", ZDICT_getErrorName(dictSize)));
+        return 0;
+    }
+    return uint32(dictSize);
+}
+
+LVPA_NAMESPACE_END
+
+#endif // LVPA_SUPPORT_ZSTD
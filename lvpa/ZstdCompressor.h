@@ -0,0 +1,23 @@
+#ifndef _ZSTDCOMPRESSOR_H
+#define _ZSTDCOMPRESSOR_H
+
+#include "ICompressor.h"
+
+LVPA_NAMESPACE_START
+
+class ZstdCompressor : public ICompressor
+{
+public:
+    virtual uint32 CompressBound(uint32 srcLen) const;
+    virtual uint32 CompressTo(uint8 *dst, uint32 dstCap, const uint8 *src, uint32 srcLen, uint8 level, ProgressCallback pcb = NULL);
+    virtual bool DecompressTo(uint8 *dst, uint32 dstLen, const uint8 *src, uint32 srcLen);
+    virtual bool SupportsDictionary(void) const { return true; }
+
+    // Trains a dictionary from samples (stored back to back, with their sizes in sampleSizes) and writes it to dst.
+    // Returns the dictionary size, or 0 if there were not enough / unsuitable samples.
+    static uint32 TrainDictionary(uint8 *dst, uint32 dstCap, const uint8 *samples, const uint32 *sampleSizes, uint32 count);
+};
+
+LVPA_NAMESPACE_END
+
+#endif
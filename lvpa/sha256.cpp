@@ -3,6 +3,12 @@
 #include "LVPAInternal.h"
 #include "sha256.h"
 
+#include <algorithm>
+
+#ifdef LVPA_X86_SIMD
+#  include <immintrin.h>
+#endif
+
 LVPA_NAMESPACE_START
 
 #define PTR(t, a) ((t*)(a))
@@ -55,64 +61,194 @@ void sha256_init(sha256_ctx *p)
     memcpy(p->h, T_H, sizeof(T_H));
 }
 
-static void sha256_block(sha256_ctx *p)
+void sha256_blocks_generic(uint32 *hs, const uint8 *data, uint32 blocks)
 {
     uint32 i;
     uint32 s0, s1;
     uint32 a, b, c, d, e, f, g, h;
     uint32 t1, t2, maj, ch;
+    uint32 w[64];
 
-    for(i = 0; i < 16; i++)
-        p->w[i] = LD32BE(p->in + i * 4);
-
-    for(i = 16; i < 64; i++)
+    for( ; blocks; --blocks, data += 64)
     {
-        s0 = ROR32(p->w[i - 15],  7) ^ ROR32(p->w[i - 15], 18) ^ LSR32(p->w[i - 15],  3);
-        s1 = ROR32(p->w[i -  2], 17) ^ ROR32(p->w[i -  2], 19) ^ LSR32(p->w[i -  2], 10);
-        p->w[i] = p->w[i - 16] + s0 + p->w[i - 7] + s1;
+        for(i = 0; i < 16; i++)
+            w[i] = LD32BE(data + i * 4);
+
+        for(i = 16; i < 64; i++)
+        {
+            s0 = ROR32(w[i - 15],  7) ^ ROR32(w[i - 15], 18) ^ LSR32(w[i - 15],  3);
+            s1 = ROR32(w[i -  2], 17) ^ ROR32(w[i -  2], 19) ^ LSR32(w[i -  2], 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        a = hs[0]; b = hs[1]; c = hs[2]; d = hs[3];
+        e = hs[4]; f = hs[5]; g = hs[6]; h = hs[7];
+
+        for(i = 0; i < 64; i++)
+        {
+            s0 = ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22);
+            maj = (a & b) ^ (a & c) ^ (b & c);
+            t2 = s0 + maj;
+            s1 = ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25);
+            ch = (e & f) ^ (~e & g);
+            t1 = h + s1 + ch + T_K[i] + w[i];
+
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        hs[0] += a; hs[1] += b; hs[2] += c; hs[3] += d;
+        hs[4] += e; hs[5] += f; hs[6] += g; hs[7] += h;
     }
+}
 
-    a = p->h[0]; b = p->h[1]; c = p->h[2]; d = p->h[3];
-    e = p->h[4]; f = p->h[5]; g = p->h[6]; h = p->h[7];
+#ifdef LVPA_X86_SIMD
 
-    for(i = 0; i < 64; i++)
+// x86 SHA extensions: two rounds per instruction. The state is kept as ABEF/CDGH, like the instructions want it.
+LVPA_TARGET("sha,ssse3,sse4.1") void sha256_blocks_shani(uint32 *h, const uint8 *data, uint32 blocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[0]), 0xB1); // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&h[4]), 0x1B); // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+
+    for( ; blocks; --blocks, data += 64)
     {
-        s0 = ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22);
-        maj = (a & b) ^ (a & c) ^ (b & c);
-        t2 = s0 + maj;
-        s1 = ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25);
-        ch = (e & f) ^ (~e & g);
-        t1 = h + s1 + ch + T_K[i] + p->w[i];
-
-        h = g; g = f; f = e; e = d + t1;
-        d = c; c = b; b = a; a = t1 + t2;
+        const __m128i save0 = state0, save1 = state1;
+        __m128i m[4]; // the last 16 words of the message schedule
+        for(uint32 i = 0; i < 4; ++i)
+            m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), bswap);
+
+        for(uint32 i = 0; i < 16; ++i) // 4 rounds each
+        {
+            __m128i msg = _mm_add_epi32(m[i & 3], _mm_loadu_si128((const __m128i*)&T_K[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+            // words i*4+16 .. i*4+19 replace the ones just used
+            if(i < 12)
+            {
+                __m128i t = _mm_sha256msg1_epu32(m[i & 3], m[(i + 1) & 3]);
+                t = _mm_add_epi32(t, _mm_alignr_epi8(m[(i + 3) & 3], m[(i + 2) & 3], 4));
+                m[i & 3] = _mm_sha256msg2_epu32(t, m[(i + 3) & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, save0);
+        state1 = _mm_add_epi32(state1, save1);
     }
 
-    p->h[0] += a; p->h[1] += b; p->h[2] += c; p->h[3] += d;
-    p->h[4] += e; p->h[5] += f; p->h[6] += g; p->h[7] += h;
+    tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+    _mm_storeu_si128((__m128i*)&h[0], _mm_blend_epi16(tmp, state1, 0xF0)); // DCBA
+    _mm_storeu_si128((__m128i*)&h[4], _mm_alignr_epi8(state1, tmp, 8)); // HGFE
+}
 
-    //next block
-    p->inlen = 0;
+#define ROR_X4(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+
+// Each 32 bit lane belongs to another message. Lanes that are done early keep their state,
+// so messages of different lengths can be mixed (but similar lengths waste the least).
+LVPA_TARGET("sse2") void sha256_blocks_x4(uint32 *const *hs, const uint8 *const *data, const uint32 *blocks)
+{
+    uint32 maxBlocks = 0;
+    for(uint32 l = 0; l < 4; ++l)
+        maxBlocks = std::max(maxBlocks, blocks[l]);
+
+    __m128i st[8];
+    for(uint32 i = 0; i < 8; ++i)
+        st[i] = _mm_set_epi32(int(hs[3][i]), int(hs[2][i]), int(hs[1][i]), int(hs[0][i]));
+
+    for(uint32 blk = 0; blk < maxBlocks; ++blk)
+    {
+        // lanes without data for this block compress zeros, but keep their old state
+        static const uint8 zeros[64] = { 0 };
+        const uint8 *p[4];
+        uint32 active[4];
+        for(uint32 l = 0; l < 4; ++l)
+        {
+            active[l] = blk < blocks[l] ? 0xFFFFFFFF : 0;
+            p[l] = active[l] ? data[l] + blk * 64 : &zeros[0];
+        }
+        const __m128i mask = _mm_set_epi32(int(active[3]), int(active[2]), int(active[1]), int(active[0]));
+
+        __m128i w[64];
+        for(uint32 i = 0; i < 16; ++i)
+            w[i] = _mm_set_epi32(int(LD32BE(p[3] + i * 4)), int(LD32BE(p[2] + i * 4)),
+                                 int(LD32BE(p[1] + i * 4)), int(LD32BE(p[0] + i * 4)));
+        for(uint32 i = 16; i < 64; ++i)
+        {
+            __m128i s0 = _mm_xor_si128(_mm_xor_si128(ROR_X4(w[i - 15], 7), ROR_X4(w[i - 15], 18)), _mm_srli_epi32(w[i - 15], 3));
+            __m128i s1 = _mm_xor_si128(_mm_xor_si128(ROR_X4(w[i - 2], 17), ROR_X4(w[i - 2], 19)), _mm_srli_epi32(w[i - 2], 10));
+            w[i] = _mm_add_epi32(_mm_add_epi32(w[i - 16], s0), _mm_add_epi32(w[i - 7], s1));
+        }
+
+        __m128i a = st[0], b = st[1], c = st[2], d = st[3];
+        __m128i e = st[4], f = st[5], g = st[6], h = st[7];
+        for(uint32 i = 0; i < 64; ++i)
+        {
+            __m128i s0 = _mm_xor_si128(_mm_xor_si128(ROR_X4(a, 2), ROR_X4(a, 13)), ROR_X4(a, 22));
+            __m128i maj = _mm_xor_si128(_mm_xor_si128(_mm_and_si128(a, b), _mm_and_si128(a, c)), _mm_and_si128(b, c));
+            __m128i t2 = _mm_add_epi32(s0, maj);
+            __m128i s1 = _mm_xor_si128(_mm_xor_si128(ROR_X4(e, 6), ROR_X4(e, 11)), ROR_X4(e, 25));
+            __m128i ch = _mm_xor_si128(_mm_and_si128(e, f), _mm_andnot_si128(e, g));
+            __m128i t1 = _mm_add_epi32(_mm_add_epi32(h, s1), _mm_add_epi32(ch, _mm_add_epi32(_mm_set1_epi32(int(T_K[i])), w[i])));
+            h = g; g = f; f = e; e = _mm_add_epi32(d, t1);
+            d = c; c = b; b = a; a = _mm_add_epi32(t1, t2);
+        }
+
+        const __m128i v[8] = { a, b, c, d, e, f, g, h };
+        for(uint32 i = 0; i < 8; ++i)
+            st[i] = _mm_add_epi32(st[i], _mm_and_si128(v[i], mask));
+    }
+
+    for(uint32 i = 0; i < 8; ++i)
+    {
+        uint32 lanes[4];
+        _mm_storeu_si128((__m128i*)&lanes[0], st[i]);
+        for(uint32 l = 0; l < 4; ++l)
+            hs[l][i] = lanes[l];
+    }
 }
 
+#undef ROR_X4
+
+#endif
+
+sha256_blocks_func sha256_blocks = sha256_blocks_generic;
+
 void sha256_chunk(sha256_ctx *p, const uint8 *s, uint32 len)
 {
     uint32 l;
     p->len += len;
 
-    while(len)
+    // fill up what is left from last time
+    if(p->inlen)
     {
         l = 64 - p->inlen;
         l = (len < l) ? len : l;
-
         memcpy(p->in + p->inlen, s, l);
         s += l;
         p->inlen += l;
         len -= l;
+        if(p->inlen < 64)
+            return;
+        sha256_blocks(p->h, p->in, 1);
+        p->inlen = 0;
+    }
 
-        if(p->inlen == 64)
-            sha256_block(p);
+    // whole blocks straight from the source
+    if(len >= 64)
+    {
+        sha256_blocks(p->h, s, len / 64);
+        s += len & ~63u;
+        len &= 63;
     }
+
+    memcpy(p->in, s, len);
+    p->inlen = len;
 }
 
 void sha256_final(sha256_ctx *p)
@@ -123,7 +259,8 @@ void sha256_final(sha256_ctx *p)
     if(p->inlen > 56)
     {
         memset(p->in + p->inlen, 0, 64 - p->inlen);
-        sha256_block(p);
+        sha256_blocks(p->h, p->in, 1);
+        p->inlen = 0;
     }
 
     memset(p->in + p->inlen, 0, 56 - p->inlen);
@@ -131,7 +268,8 @@ void sha256_final(sha256_ctx *p)
     len = p->len << 3;
     ST32BE(p->in + 56, len >> 32);
     ST32BE(p->in + 60, len);
-    sha256_block(p);
+    sha256_blocks(p->h, p->in, 1);
+    p->inlen = 0;
 }
 
 void sha256_hash(sha256_ctx *p, uint8 *s)
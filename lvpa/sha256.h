@@ -3,6 +3,8 @@
 #ifndef SHA256_H
 #define SHA256_H
 
+#include "CPUFeatures.h"
+
 LVPA_NAMESPACE_START
 
 //author: vladitx
@@ -12,7 +14,6 @@ struct sha256_ctx
     uint8 in[64];
     unsigned inlen;
 
-    uint32 w[64];
     uint32 h[8];
     uint64 len;
 };
@@ -22,6 +23,16 @@ void sha256_chunk(sha256_ctx *p, const uint8 *s, uint32 len);
 void sha256_final(sha256_ctx *p);
 void sha256_hash(sha256_ctx *p, uint8 *s);
 
+// compresses whole 64 byte blocks into the state h
+typedef void (*sha256_blocks_func)(uint32 *h, const uint8 *data, uint32 blocks);
+void sha256_blocks_generic(uint32 *h, const uint8 *data, uint32 blocks);
+#ifdef LVPA_X86_SIMD
+void sha256_blocks_shani(uint32 *h, const uint8 *data, uint32 blocks); // needs SHA-NI, SSSE3 and SSE4.1
+// 4 independent states at once (SSE2), lane i compresses blocks[i] blocks from data[i] into h[i]
+void sha256_blocks_x4(uint32 *const *h, const uint8 *const *data, const uint32 *blocks);
+#endif
+extern sha256_blocks_func sha256_blocks; // used by sha256_chunk() and sha256_final()
+
 LVPA_NAMESPACE_END
 
 #endif
@@ -21,6 +21,12 @@ VFSDirLVPA::VFSDirLVPA(VFSFile *vf, LVPAFile *lvpa)
 
 VFSDirLVPA::~VFSDirLVPA()
 {
+    // the files may outlive the archive, but they must not give their pins back to a deleted one
+    for(size_t i = 0; i < _lvpaFiles.size(); ++i)
+    {
+        _lvpaFiles[i]->detachLVPA();
+        _lvpaFiles[i]->ref--;
+    }
     delete _lvpa; // TODO: possibility to keep the archive alive anyway?
 
     // Must be done *after* deleting the LVPA file!
@@ -44,7 +50,7 @@ unsigned int VFSDirLVPA::load(bool /*ignored*/)
             continue;
         }
         // solid blocks are no real files, and scrambled files without filename can't be read anyways, at this point
-        if(hdr.flags & LVPAFLAG_SOLIDBLOCK || (hdr.flags & LVPAFLAG_SCRAMBLED && hdr.filename.empty()))
+        if(hdr.flags & (LVPAFLAG_SOLIDBLOCK | LVPAFLAG_DICT) || (hdr.flags & LVPAFLAG_SCRAMBLED && hdr.filename.empty()))
         {
             ++ctr;
             continue;
@@ -52,7 +58,7 @@ unsigned int VFSDirLVPA::load(bool /*ignored*/)
 
         VFSFileLVPA *file = new VFSFileLVPA(_lvpa, i);
         addRecursive(file, true, VFSDir::NONE);
-        file->ref--; // file was added and refcount increased, decref here
+        _lvpaFiles.push_back(file); // keeps the reference from creating it, see ~VFSDirLVPA()
         ++ctr;
     }
     return ctr;
@@ -1,6 +1,7 @@
 #ifndef VFSDIR_LVPA_H
 #define VFSDIR_LVPA_H
 
+#include <vector>
 #include "VFSDir.h"
 #include "LVPACompileConfig.h"
 
@@ -10,6 +11,8 @@ LVPA_NAMESPACE_END
 
 VFS_NAMESPACE_START
 
+class VFSFileLVPA;
+
 class VFSDirLVPA : public VFSDir
 {
 public:
@@ -26,6 +29,7 @@ public:
 protected:
     LVPA_NAMESPACE_IMPL LVPAFile *_lvpa;
     VFSFile *_vlvpa;
+    std::vector<VFSFileLVPA*> _lvpaFiles; // created by load(), referenced until the LVPAFile is deleted
 };
 
 VFS_NAMESPACE_END
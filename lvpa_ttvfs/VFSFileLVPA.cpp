@@ -15,6 +15,7 @@ VFSFileLVPA::VFSFileLVPA(LVPAFile *src, unsigned int headerId)
     _mode = "b"; // binary mode by default
     _lvpa = src;
     _pos = 0;
+    _pinned = false;
     _size = src->GetFileInfo(headerId).realSize;
     _headerId = headerId;
 }
@@ -23,6 +24,15 @@ VFSFileLVPA::~VFSFileLVPA()
 {
     if(_fixedStr)
         delete [] _fixedStr;
+    if(_pinned && _lvpa)
+        _lvpa->Release(_headerId); // or its solid block stays pinned for good
+}
+
+void VFSFileLVPA::detachLVPA(void)
+{
+    VFS_GUARD_OPT(this);
+    _lvpa = NULL;
+    _pinned = false; // the pins go away with the LVPAFile
 }
 
 bool VFSFileLVPA::open(const char *mode /* = NULL */)
@@ -83,7 +93,7 @@ vfspos VFSFileLVPA::getpos(void) const
 unsigned int VFSFileLVPA::read(void *dst, unsigned int bytes)
 {
     VFS_GUARD_OPT(this);
-    memblock data = _lvpa->Get(_headerId);
+    memblock data = _getData();
     uint8 *startptr = data.ptr + _pos;
     uint8 *endptr = data.ptr + data.size;
     bytes = std::min((unsigned int)(endptr - startptr), bytes); // limit in case reading over buffer size
@@ -101,7 +111,7 @@ unsigned int VFSFileLVPA::write(const void *src, unsigned int bytes)
     if(getpos() + bytes >= size())
         _setsize(getpos() + bytes); // enlarge if necessary
 
-    memblock data = _lvpa->Get(_headerId);
+    memblock data = _getData();
     memcpy(data.ptr + getpos(), src, bytes);
 
     return bytes;
@@ -119,7 +129,7 @@ void VFSFileLVPA::_setsize(vfspos newsize)
     if(newsize == size())
         return;
 
-    memblock data = _lvpa->Get(_headerId);
+    memblock data = _getData();
     const LVPAFileHeader& hdr = _lvpa->GetFileInfo(_headerId);
     uint32 n = uint32(newsize);
 
@@ -161,7 +171,7 @@ const void *VFSFileLVPA::getBuf(allocator_func alloc /* = NULL */, delete_func d
         return buf;
     }
 
-    memblock mb = _lvpa->Get(_headerId);
+    memblock mb = _getData();
     const uint8 *buf = mb.ptr;
     if(buf && _mode.find("b") == std::string::npos) // text mode?
     {
@@ -182,13 +192,27 @@ void VFSFileLVPA::dropBuf(bool del)
             delBuf(_fixedStr);
             _fixedStr = NULL;
         }
-        _lvpa->Free(_headerId);
+        _lvpa->Free(_headerId); // gives the pin back, too
+        _pinned = false;
     }
     else
     {
         _fixedStr = NULL;
-        _lvpa->Drop(_headerId);
+        _lvpa->Drop(_headerId); // stays pinned, the memory is in use elsewhere
+    }
+}
+
+memblock VFSFileLVPA::_getData(void)
+{
+    // the file is pinned once while it is in use, so that neither the cache nor clearGarbage() take its solid block away
+    memblock data = _lvpa->Get(_headerId);
+    if(data.ptr)
+    {
+        if(_pinned)
+            _lvpa->Release(_headerId);
+        _pinned = true;
     }
+    return data;
 }
 
 VFS_NAMESPACE_END
@@ -6,6 +6,7 @@
 
 LVPA_NAMESPACE_START
 class LVPAFile;
+struct memblock;
 LVPA_NAMESPACE_END
 
 VFS_NAMESPACE_START
@@ -30,9 +31,11 @@ public:
     virtual const char *getType(void) const { return "LVPA"; }
 
     inline LVPA_NAMESPACE_IMPL LVPAFile *getLVPA(void) const { return _lvpa; }
+    void detachLVPA(void); // called before the LVPAFile is deleted; the file must not be read afterwards
 
 protected:
     void _setsize(vfspos newsize);
+    LVPA_NAMESPACE_IMPL memblock _getData(void); // Get()s the file, and keeps it pinned until dropBuf()
 
     unsigned int _pos;
     unsigned int _size;
@@ -40,6 +43,7 @@ protected:
     std::string _mode;
     LVPA_NAMESPACE_IMPL LVPAFile *_lvpa;
     char *_fixedStr; // for \n fixed string in text mode. cleared when mode is changed
+    bool _pinned;
 };
 
 VFS_NAMESPACE_END
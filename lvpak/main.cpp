@@ -45,7 +45,8 @@ enum PackCmd
     PC_SET_PATH,        // * -p <PATH>
     PC_SET_ENCRYPT,     // * -e
     PC_SET_SCRAMBLE,    // * -x
-    PC_SET_SOLID_COMPR, //   -S<name>=<A><#>
+    PC_SET_FILTER,      // * -r<F>
+    PC_SET_SOLID_COMPR, //   -S<name>=<A><#>[,<F>]
     PC_SET_HDR_COMPR,   //   -H<A><#>
     PC_SET_HDR_ENCRYPT, //   -E
     PC_SET_KEY,         //   -K[b/h] <text>
@@ -53,6 +54,7 @@ enum PackCmd
     // things marked with * are reset on listfile line end
     // <A> means algorithm
     // <#> is a number
+    // <F> means filter
 };
 
 struct PackDef;
@@ -70,19 +72,20 @@ static void PackCmd_SetHdrCompr(LVPAFile *lvpa, PackDef *d, PackDef *glob);
 static void PackCmd_SetHdrEncrypt(LVPAFile *lvpa, PackDef *d, PackDef *glob);
 static void PackCmd_SetEncrypt(LVPAFile *lvpa, PackDef *d, PackDef *glob);
 static void PackCmd_SetScramble(LVPAFile *lvpa, PackDef *d, PackDef *glob);
+static void PackCmd_SetFilter(LVPAFile *lvpa, PackDef *d, PackDef *glob);
 static void PackCmd_SetKey(LVPAFile *lvpa, PackDef *d, PackDef *glob);
 
 
 struct PackDef
 {
     PackDef()
-        : level(LVPACOMP_INHERIT), algo(LVPAPACK_INHERIT), encrypt(LVPAENCR_INHERIT),
-        solid(false), scramble(false), exec(NULL)
+        : exec(NULL), level(LVPACOMP_INHERIT), algo(LVPAPACK_INHERIT), encrypt(LVPAENCR_INHERIT),
+        solid(false), scramble(false), filter(LVPAFILTER_NONE), filterParam(0)
     {}
 
     PackDef(PackCmd cmd)
-        : level(LVPACOMP_INHERIT), algo(LVPAPACK_INHERIT), encrypt(LVPAENCR_INHERIT),
-        solid(false), scramble(false), exec(NULL)
+        : exec(NULL), level(LVPACOMP_INHERIT), algo(LVPAPACK_INHERIT), encrypt(LVPAENCR_INHERIT),
+        solid(false), scramble(false), filter(LVPAFILTER_NONE), filterParam(0)
     {
         init(cmd);
     }
@@ -104,6 +107,7 @@ struct PackDef
             case PC_SET_HDR_ENCRYPT:    exec = &PackCmd_SetHdrEncrypt; break;
             case PC_SET_ENCRYPT:        exec = &PackCmd_SetEncrypt; break;
             case PC_SET_SCRAMBLE:       exec = &PackCmd_SetScramble; break;
+            case PC_SET_FILTER:         exec = &PackCmd_SetFilter; break;
             case PC_SET_KEY:            exec = &PackCmd_SetKey; break;
             default:
                 logerror("PackDef init switch ERROR");
@@ -121,6 +125,8 @@ struct PackDef
     bool solid;     // this is needed because "" is also a valid solid block name
     
     bool scramble;
+    uint8 filter; // LVPAFILTER_NONE by default
+    uint8 filterParam;
     bool useHash; // for SetKey
     bool useBinary; // for SetKey
     bool fromCmdLine;
@@ -132,10 +138,12 @@ static LVPAAlgos g_hdrAlgo = LVPAPACK_INHERIT;
 static bool g_hdrEncr = false;
 static bool g_usingKey = false;
 static bool g_checkCRC = true; // during extraction
+static bool g_xxh64 = false; // checksum for written files, applied after loading the archive
 static uint8 g_mode = 0;
 static uint32 g_filesDone = 0;
 static std::string g_relPath;
 static LVPAFile *g_lvpa = NULL;
+static std::string g_traceFile; // see -P
 
 static std::string g_currentDir; // this is constantly updated whenever directories are changed
 
@@ -302,6 +310,10 @@ static bool _AddFileToArchive(LVPAFile *lvpa, PackDef *glob, const std::string&
     lvpa->Add(archiveFileName.c_str(), memblock(buf, s), glob->solid ? glob->solidBlockName.c_str() : NULL,
         glob->algo, glob->level, glob->encrypt, glob->scramble);
 
+    // files in a solid block use the block's filter, see -S
+    if(!glob->solid && glob->filter != LVPAFILTER_NONE)
+        lvpa->SetFilter(archiveFileName.c_str(), glob->filter, glob->filterParam);
+
     return true;
 }
 
@@ -475,8 +487,9 @@ static void PackCmd_SetSolidCompr(LVPAFile *lvpa, PackDef *d, PackDef *glob)
 {
     if(!_IsAddMode())
         return;
-    logdebug("-> Block '%s' compression algo=%u, level=%u", d->solidBlockName.c_str(), uint32(d->algo), uint32(d->level));
-    lvpa->SetSolidBlock(d->solidBlockName.c_str(), d->level, d->algo);
+    logdebug("-> Block '%s' compression algo=%u, level=%u, filter=%u/%u", d->solidBlockName.c_str(), uint32(d->algo), uint32(d->level),
+        uint32(d->filter), uint32(d->filterParam));
+    lvpa->SetSolidBlock(d->solidBlockName.c_str(), d->level, d->algo, d->filter, d->filterParam);
 }
 
 static void PackCmd_SetHdrCompr(LVPAFile *lvpa, PackDef *d, PackDef *glob)
@@ -508,6 +521,8 @@ static void PackCmd_ListfileNewline(LVPAFile *lvpa, PackDef *d, PackDef *glob)
     glob->solidBlockName = "";
     glob->encrypt = false;
     glob->scramble = false;
+    glob->filter = LVPAFILTER_NONE;
+    glob->filterParam = 0;
 }
 
 static void PackCmd_SetEncrypt(LVPAFile *lvpa, PackDef *d, PackDef *glob)
@@ -526,6 +541,15 @@ static void PackCmd_SetScramble(LVPAFile *lvpa, PackDef *d, PackDef *glob)
     glob->scramble = d->scramble;
 }
 
+static void PackCmd_SetFilter(LVPAFile *lvpa, PackDef *d, PackDef *glob)
+{
+    if(!_IsAddMode())
+        return;
+    logdebug("-> Set filter: %u, param %u", uint32(d->filter), uint32(d->filterParam));
+    glob->filter = d->filter;
+    glob->filterParam = d->filterParam;
+}
+
 static void PackCmd_SetKey(LVPAFile *lvpa, PackDef *d, PackDef *glob)
 {
     // all modes
@@ -558,6 +582,96 @@ static void PackCmd_SetKey(LVPAFile *lvpa, PackDef *d, PackDef *glob)
     g_usingKey = true;
 }
 
+// one call of the trace callback; the file name is only kept for the beginning of a stage
+struct TraceRecord
+{
+    LVPATraceEvent ev;
+    std::string filename;
+};
+static std::vector<TraceRecord> g_trace;
+
+static void collectTrace(LVPAFile *lvpa, const LVPATraceEvent& ev, void *user)
+{
+    g_trace.push_back(TraceRecord());
+    TraceRecord& r = g_trace.back();
+    r.ev = ev;
+    r.ev.filename = NULL; // not valid after the call
+    if(ev.begin)
+        r.filename = ev.filename;
+}
+
+static const char *algoName(uint8 algo)
+{
+    switch(algo)
+    {
+        case LVPAPACK_NONE:    return "none";
+        case LVPAPACK_LZMA:    return "lzma";
+        case LVPAPACK_LZO1X:   return "lzo";
+        case LVPAPACK_DEFLATE: return "zip";
+        case LVPAPACK_LZF:     return "lzf";
+        case LVPAPACK_LZHAM:   return "lzham";
+        case LVPAPACK_LZMAMT:  return "lzmt";
+        case LVPAPACK_ZSTD:    return "zstd";
+        case LVPAPACK_LZ4:     return "lz4";
+        case LVPAPACK_INHERIT: return "default";
+    }
+    return "unknown";
+}
+
+static const char *cipherName(uint8 cipher)
+{
+    switch(cipher)
+    {
+        case LVPAENCR_NONE:     return "none";
+        case LVPAENCR_ENABLED:  return "lvpa";
+        case LVPAENCR_CHACHA20: return "chacha20";
+    }
+    return "unknown";
+}
+
+static void writeJsonString(FILE *f, const std::string& str)
+{
+    fputc('"', f);
+    for(uint32 i = 0; i < str.length(); ++i)
+    {
+        const unsigned char c = str[i];
+        if(c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if(c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+// writes what collectTrace() got in the Chrome trace event format (chrome://tracing, Perfetto)
+static bool writeTrace(const char *fn)
+{
+    FILE *f = fopen(fn, "w");
+    if(!f)
+        return false;
+    fputs("{\"traceEvents\":[\n", f);
+    const uint64 start = g_trace.empty() ? 0 : g_trace[0].ev.time;
+    for(uint32 i = 0; i < g_trace.size(); ++i)
+    {
+        const LVPATraceEvent& ev = g_trace[i].ev;
+        fprintf(f, "%s{\"ph\":\"%c\",\"pid\":1,\"tid\":1,\"ts\":%.3f,", i ? ",\n" : "", ev.begin ? 'B' : 'E',
+            double(ev.time - start) / 1000.0); // in microseconds
+        if(ev.begin)
+        {
+            fprintf(f, "\"name\":\"%s\",\"cat\":\"lvpa\",\"args\":{\"id\":%u,\"file\":", LVPAFile::GetTraceStageName(ev.stage), ev.id);
+            writeJsonString(f, g_trace[i].filename);
+            fprintf(f, ",\"bytesIn\":%llu}}", (unsigned long long)ev.bytesIn);
+        }
+        else // the codecs are known for sure only at the end, when saving
+            fprintf(f, "\"args\":{\"algo\":\"%s\",\"cipher\":\"%s\",\"bytesOut\":%llu}}",
+                algoName(ev.algo), cipherName(ev.cipher), (unsigned long long)ev.bytesOut);
+    }
+    fputs("\n]}\n", f);
+    return !fclose(f);
+}
+
 static void dep_authors(void)
 {
     puts("** lvpak uses:"
@@ -575,6 +689,12 @@ static void dep_authors(void)
 #endif
 #ifdef LVPA_SUPPORT_LZHAM
          " - LZHAM by Richard Geldreich"
+#endif
+#ifdef LVPA_SUPPORT_ZSTD
+         " - Zstandard by Yann Collet, Meta Platforms"
+#endif
+#ifdef LVPA_SUPPORT_LZ4
+         " - LZ4 format by Yann Collet"
 #endif
          " **");
 }
@@ -597,7 +717,7 @@ static void usage(void)
            "  -c<A><#> - default compression level and algorithm\n"                              // PC_SET_COMPR
            "     A - can be none"
 #ifdef LVPA_SUPPORT_LZMA
-           ", lzma"
+           ", lzma, lzmt"
 #endif
 #ifdef LVPA_SUPPORT_LZO
            ", lzo"
@@ -610,6 +730,12 @@ static void usage(void)
 #endif
 #ifdef LVPA_SUPPORT_LZHAM
            ", lzham"
+#endif
+#ifdef LVPA_SUPPORT_ZSTD
+           ", zstd"
+#endif
+#ifdef LVPA_SUPPORT_LZ4
+           ", lz4"
 #endif
            ", or i (inherit)\n"
            "     # - a number in 0..9 or i (inherit)\n"
@@ -617,17 +743,30 @@ static void usage(void)
            "  -s<NAME> - put the following files into a solid block with name NAME.\n"           // PC_MAKE_SOLID
            "             (NAME can be empty)\n"
            "  -n - not solid block. This disables -s.\n"                                         // PC_NOT_SOLID
-           "  -e[0] - encrypt the following files. -e0 turns off encryption.\n"                  // PC_SET_ENCRYPT
+           "  -e[0|c] - encrypt the following files. -e0 turns off encryption.\n"                // PC_SET_ENCRYPT
+           "            -ec uses ChaCha20, which can be decrypted using multiple threads.\n"
            "  -x[0] - scramble the following files. -x0 turns off scrambling.\n"                 // PC_SET_SCRAMBLE
+           "  -r<F> - filter the following files before compressing them:\n"                    // PC_SET_FILTER
+           "     F - x86 (executables), delta# (# bytes per record/sample, 1..255),\n"
+           "         shuf# (arrays of #-byte numbers, 2..255), or 0 (off)\n"
            "  -v - be verbose\n"                                                                 // processed inline
-           "  -S<NAME>=<A><#> - choose compression params for solid block (see -c, -s).\n"       // PC_SET_SOLID_COMPR
+           "  -S<NAME>=<A><#>[,<F>] - choose compression params and filter for solid block\n"   // PC_SET_SOLID_COMPR
+           "                          (see -c, -s, -r).\n"
            "  -H<A><#> - choose compression params for headers (see -c).\n"                      // PC_SET_HDR_COMPR
            "  -E - turn on header encryption\n"                                                  // PC_SET_HDR_ENCRYPT
            "  -K[bh] <key> - set key required for de/encryption. Req. if -e/-E is used!\n"       // PC_SET_KEY & processed inline if seen on cmdline
            "     b  - if -Kb is used, treat the key as hexadecimal binary string.\n"
            "      h - use not the string, but the SHA256 hash of it.\n"
            "     bh - treat as hex string and hash it.\n"
-           "  -F - fast (skip CRC check of uncompressed data when extracting)\n"
+           "  -F - fast (skip CRC check of uncompressed data when extracting or testing)\n"
+           "  -T<#> - use at most # threads per file/solid block (lzmt, lzham),\n"
+           "          or for testing. Default: all CPUs\n"
+           "  -D[#] - train a shared dictionary of # KB (default 64) for small files (zip, zstd)\n"
+           "  -X - use XXH64 instead of CRC32 to checksum the files written (much faster)\n"
+           "  -R[#] - pack solid blocks in segments of # MB (default 4) that can be unpacked\n"
+           "          on their own, for faster access to single files\n"
+           "  -P[FILE] - write the time taken by each stage of loading and saving every file\n"
+           "             to FILE (default lvpak-trace.json), as Chrome trace events\n"
            "\n"
            "<archive> is the archive file to create/modify/read\n"
            "<files> is a list of files to add; directories are added recursively.\n"
@@ -636,6 +775,8 @@ static void usage(void)
            "If files have no explicit compression/encryption settings,\n"
            "they will be inherited from the headers.\n"
            "Note that LZMA level >= 7 takes large amounts of memory and time!\n"
+           "lzmt is LZMA split into chunks of 2-16 MB (depending on level), which are\n"
+           "compressed and decompressed using all CPU cores. Use it for large files.\n"
            "\n"
            "Examples: lvpak c arch.lvpa -Hlzo9 -E -Kh secret file01.txt file02...\n"
            "          lvpak x arch.lvpa -p extractdir\n"
@@ -713,6 +854,14 @@ static bool parseCompressString(const char *str, LVPAAlgos *algo, LVPAComprLevel
                     *level = LVPACOMP_INHERIT;
                     return parseCompressString(str + 3, NULL, level);
                 }
+#endif
+#ifdef LVPA_SUPPORT_LZ4
+                if(!strnicmp(str, "lz4", 3))
+                {
+                    *algo = LVPAPACK_LZ4;
+                    *level = LVPACOMP_INHERIT;
+                    return parseCompressString(str + 3, NULL, level);
+                }
 #endif
                 // ...
 
@@ -725,6 +874,20 @@ static bool parseCompressString(const char *str, LVPAAlgos *algo, LVPAComprLevel
                         *level = LVPACOMP_INHERIT;
                         return parseCompressString(str + 4, NULL, level);
                     }
+                    if(!strnicmp(str, "lzmt", 4))
+                    {
+                        *algo = LVPAPACK_LZMAMT;
+                        *level = LVPACOMP_INHERIT;
+                        return parseCompressString(str + 4, NULL, level);
+                    }
+#endif
+#ifdef LVPA_SUPPORT_ZSTD
+                    if(!strnicmp(str, "zstd", 4))
+                    {
+                        *algo = LVPAPACK_ZSTD;
+                        *level = LVPACOMP_INHERIT;
+                        return parseCompressString(str + 4, NULL, level);
+                    }
 #endif
                     if(!strnicmp(str, "none", 4))
                     {
@@ -755,6 +918,44 @@ static bool parseCompressString(const char *str, LVPAAlgos *algo, LVPAComprLevel
     return false;
 }
 
+static bool parseFilterString(const char *str, uint8 *filter, uint8 *param)
+{
+    uint32 n = 0;
+    *filter = LVPAFILTER_NONE;
+    *param = 0;
+
+    if(!str[0] || !strcmp(str, "0") || !stricmp(str, "none"))
+        return true;
+    if(!stricmp(str, "x86"))
+    {
+        *filter = LVPAFILTER_X86;
+        return true;
+    }
+    if(!strnicmp(str, "delta", 5))
+    {
+        n = str[5] ? atoi(str + 5) : 1;
+        if(n >= 1 && n <= 255)
+        {
+            *filter = LVPAFILTER_DELTA;
+            *param = uint8(n);
+            return true;
+        }
+    }
+    else if(!strnicmp(str, "shuf", 4))
+    {
+        n = str[4] ? atoi(str + 4) : 4;
+        if(n >= 2 && n <= 255)
+        {
+            *filter = LVPAFILTER_SHUFFLE;
+            *param = uint8(n);
+            return true;
+        }
+    }
+
+    logerror("malformed/invalid filter: '%s'", str);
+    return false;
+}
+
 static bool parseSingleCmd(char **argv, uint32 available, PackDef &pd, uint32& skip)
 {
     const char *str = argv[0];
@@ -824,6 +1025,13 @@ static bool parseSingleCmd(char **argv, uint32 available, PackDef &pd, uint32& s
             }
             *eqpos = 0;
             pd.solidBlockName = str;
+            char *commapos = strchr(eqpos + 1, ',');
+            if(commapos)
+            {
+                *commapos = 0;
+                if(!parseFilterString(commapos + 1, &pd.filter, &pd.filterParam))
+                    return false;
+            }
             if(!parseCompressString(eqpos + 1, &pd.algo, &pd.level))
                 return false;
 
@@ -834,7 +1042,10 @@ static bool parseSingleCmd(char **argv, uint32 available, PackDef &pd, uint32& s
         case 'e':
         {
             ++str; // skip "-e"
-            pd.encrypt = (str[0] != '0'); // if its just -e, this is \0
+            if(str[0] == 'c')
+                pd.encrypt = LVPAENCR_CHACHA20;
+            else
+                pd.encrypt = (str[0] != '0'); // if its just -e, this is \0
             pd.init(PC_SET_ENCRYPT);
             return true;
         }
@@ -847,6 +1058,15 @@ static bool parseSingleCmd(char **argv, uint32 available, PackDef &pd, uint32& s
             return true;
         }
 
+        case 'r':
+        {
+            if(!parseFilterString(str + 1, &pd.filter, &pd.filterParam)) // skip "-r"
+                return false;
+
+            pd.init(PC_SET_FILTER);
+            return true;
+        }
+
         case 'K':
         {
             char c;
@@ -880,6 +1100,37 @@ static bool parseSingleCmd(char **argv, uint32 available, PackDef &pd, uint32& s
             g_checkCRC = false;
             return false;
 
+        case 'T':
+            g_lvpa->SetThreads(atoi(str + 1)); // "-T" alone gives 0, which is auto
+            return false;
+
+        case 'D':
+        {
+            uint32 kb = str[1] ? atoi(str + 1) : 64;
+            g_lvpa->UseDictionary(kb * 1024);
+            return false;
+        }
+
+        case 'X':
+            g_xxh64 = true;
+            return false;
+
+        case 'R':
+        {
+            uint32 mb = str[1] ? atoi(str + 1) : 4;
+            g_lvpa->SetRestartInterval(mb * 1024 * 1024);
+            return false;
+        }
+
+        case 'P':
+            if(!g_lvpa->SetTraceCallback(collectTrace))
+            {
+                logwarn("Built without tracing support, -P is ignored");
+                return false;
+            }
+            g_traceFile = str[1] ? str + 1 : "lvpak-trace.json";
+            return false;
+
         default:
             unknown(argv[0]);
     }
@@ -1029,6 +1280,14 @@ static void processPackDefList(LVPAFile& lvpa, std::list<PackDef>& cmds, PackDef
     }
 }
 
+static void drawTestProgressBar(uint32 done, uint32 total, void *user)
+{
+    ProgressBar *bar = (ProgressBar*)user;
+    bar->total = total;
+    bar->done = done;
+    bar->Update();
+}
+
 static bool _LoadLVPA(LVPAFile& lvpa, const std::string& archive)
 {
     if(g_mode != 'c') // in every other mode an existing file must be opened
@@ -1081,6 +1340,8 @@ int main(int argc, char *argv[])
 
     if(!_LoadLVPA(lvpa, archive))
         return 1;
+    if(g_xxh64)
+        lvpa.SetChecksum(LVPACHECK_XXH64);
 
     PackDef glob; // holds current global settings
 
@@ -1107,12 +1368,16 @@ int main(int argc, char *argv[])
                     case LVPAPACK_DEFLATE: algoStr = "Zip  "; break;
                     case LVPAPACK_LZF:     algoStr = "Lzf  "; break;
                     case LVPAPACK_LZHAM:   algoStr = "Lzham"; break;
+                    case LVPAPACK_LZMAMT:  algoStr = "LzmaT"; break;
+                    case LVPAPACK_ZSTD:    algoStr = "Zstd "; break;
+                    case LVPAPACK_LZ4:     algoStr = "Lz4  "; break;
                 }
-                printf("[%c%c%c%c,%s%c%s%s] '%s' (%u KB, %.2f%%)%s\n",
+                printf("[%c%c%c%c%c,%s%c%s%s] '%s' (%u KB, %.2f%%)%s\n",
                     h.flags & LVPAFLAG_PACKED ? 'P' : '-',
-                    h.flags & LVPAFLAG_SOLID ? 'S' : (h.flags & LVPAFLAG_SOLIDBLOCK ? '#' : '-'),
-                    h.flags & LVPAFLAG_ENCRYPTED ? 'E' : '-',
+                    h.flags & LVPAFLAG_SOLID ? 'S' : (h.flags & LVPAFLAG_SOLIDBLOCK ? '#' : (h.flags & LVPAFLAG_DICT ? 'D' : '-')),
+                    h.flags & LVPAFLAG_ENCRYPTED ? (h.cipher == LVPAENCR_CHACHA20 ? 'C' : 'E') : '-',
                     h.flags & LVPAFLAG_SCRAMBLED ? 'X' : '-',
+                    h.flags & LVPAFLAG_FILTERED ? 'F' : '-',
                     algoStr,
                     lvlc,
                     h.flags & LVPAFLAG_SOLID ? "," : "",
@@ -1182,25 +1447,23 @@ int main(int argc, char *argv[])
         case 't':
         {
             processPackDefList(lvpa, cmds, glob);
-            result = true;
+            uint32 untested = 0;
+            for(uint32 i = 0; i < lvpa.HeaderCount(); ++i)
+            {
+                const LVPAFileHeader &h = lvpa.GetFileInfo(i);
+                if((h.flags & LVPAFLAG_SCRAMBLED) && h.filename.empty())
+                    ++untested;
+            }
             {
-                ProgressBar bar(lvpa.HeaderCount());
-                bar.msg = "Testing ...";
+                ProgressBar bar;
+                bar.msg = g_checkCRC ? "Testing ..." : "Testing (packed data only) ...";
                 bar.Reset();
                 bar.Update(true);
-                for(uint32 i = 0; i < lvpa.HeaderCount(); ++i)
-                {
-                    const LVPAFileHeader &h = lvpa.GetFileInfo(i);
-                    if(h.flags & (LVPAFLAG_SOLIDBLOCK | LVPAFLAG_SCRAMBLED))
-                        continue;
-
-                    memblock mb = lvpa.Get(i);
-                    result = mb.ptr && result;
-                    lvpa.Free(i);
-                    bar.Step();
-                }
+                result = lvpa.VerifyAll(!g_checkCRC, drawTestProgressBar, &bar);
                 bar.Finalize();
             }
+            if(untested)
+                printf("%u scrambled files not tested, their names are unknown\n", untested);
 
             result = result && lvpa.AllGood();
             printf("%s", result ? "File is OK\n" : "File is damaged, use 'lvpak l' to list\n");
@@ -1222,7 +1485,7 @@ int main(int argc, char *argv[])
                 for(uint32 i = 0; i < lvpa.HeaderCount(); ++i)
                 {
                     const LVPAFileHeader &h = lvpa.GetFileInfo(i);
-                    if(h.flags & LVPAFLAG_SOLIDBLOCK)
+                    if(h.flags & (LVPAFLAG_SOLIDBLOCK | LVPAFLAG_DICT))
                         continue;
                     if(!h.filename.length())
                     {
@@ -1258,6 +1521,14 @@ int main(int argc, char *argv[])
             result = false;
     }
 
+    if(!g_traceFile.empty())
+    {
+        if(writeTrace(g_traceFile.c_str()))
+            printf("Trace with %u events written to '%s'\n", uint32(g_trace.size()), g_traceFile.c_str());
+        else
+            logerror("Failed to write trace to '%s'", g_traceFile.c_str());
+    }
+
     lvpa.Clear();
     return result ? 0 : 1;
 }
@@ -0,0 +1,243 @@
+/*
+ * LZ4 block format compressor/decompressor for LVPA, see lz4.h.
+ *
+ * Written for LVPA, same license (zlib license, or GPL v2+).
+ */
+
+#include "lz4.h"
+#include "lz4_internal.h"
+
+#define LZ4_HASHLOG 12 /* 16 KB hash table, fits into L1 cache */
+#define LZ4_SKIP_TRIGGER 6 /* after 2^6 failed attempts, search with increasing step size */
+
+/* hashes the 4 bytes at p, or 5 where 64 bit multiplications are cheap: fewer collisions, so more matches are found */
+LZ4_INLINE lz4_u32 lz4_hash(const lz4_byte *p)
+{
+    if(sizeof(size_t) == 8)
+        return (lz4_u32)(((lz4_read64(p) << 24) * 889523592379ULL) >> (64 - LZ4_HASHLOG));
+    return (lz4_read32(p) * 2654435761U) >> (32 - LZ4_HASHLOG);
+}
+
+int LZ4_compressBound(int inputSize)
+{
+    return LZ4_COMPRESSBOUND(inputSize);
+}
+
+int LZ4_compress_default(const char *src, char *dst, int srcSize, int dstCapacity)
+{
+    return LZ4_compress_fast(src, dst, srcSize, dstCapacity, 1);
+}
+
+int LZ4_compress_fast(const char *source, char *dest, int srcSize, int dstCapacity, int acceleration)
+{
+    lz4_u32 table[1 << LZ4_HASHLOG]; /* positions relative to src */
+    const lz4_byte *src = (const lz4_byte*)source;
+    const lz4_byte *ip = src;
+    const lz4_byte *anchor = src;
+    const lz4_byte *iend = src + srcSize;
+    const lz4_byte *mflimit = iend - LZ4_MFLIMIT;
+    const lz4_byte *matchlimit = iend - LZ4_LASTLITERALS;
+    lz4_byte *op = (lz4_byte*)dest;
+    lz4_byte *oend = op + dstCapacity;
+
+    if(srcSize < 0 || (unsigned)srcSize > LZ4_MAX_INPUT_SIZE || dstCapacity <= 0)
+        return 0;
+    if(acceleration < 1)
+        acceleration = 1;
+
+    if(srcSize >= LZ4_MIN_INPUT)
+    {
+        memset(table, 0, sizeof(table)); /* everything points to position 0, which is a valid match candidate */
+        ++ip;
+
+        for(;;)
+        {
+            const lz4_byte *match;
+            size_t len;
+            unsigned step = 1;
+            unsigned searches = (unsigned)acceleration << LZ4_SKIP_TRIGGER;
+
+            /* find a match, skipping faster through data that don't compress */
+            for(;;)
+            {
+                lz4_u32 h;
+                if(ip > mflimit)
+                    goto last_literals;
+                h = lz4_hash(ip);
+                match = src + table[h];
+                table[h] = (lz4_u32)(ip - src);
+                if(ip - match <= LZ4_MAX_DISTANCE && lz4_read32(match) == lz4_read32(ip))
+                    break;
+                ip += step;
+                step = searches++ >> LZ4_SKIP_TRIGGER;
+            }
+
+            /* the match may start earlier */
+            while(ip > anchor && match > src && ip[-1] == match[-1])
+            {
+                --ip;
+                --match;
+            }
+
+            len = LZ4_MINMATCH + lz4_count(ip + LZ4_MINMATCH, match + LZ4_MINMATCH, matchlimit);
+            op = lz4_put_sequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - match), len);
+            if(!op)
+                return 0;
+
+            ip += len;
+            anchor = ip;
+            if(ip > mflimit)
+                break;
+
+            /* a position from inside the match helps finding the next one */
+            table[lz4_hash(ip - 2)] = (lz4_u32)(ip - 2 - src);
+        }
+    }
+
+last_literals:
+    op = lz4_put_last_literals(op, oend, anchor, (size_t)(iend - anchor));
+    if(!op)
+        return 0;
+    return (int)(op - (lz4_byte*)dest);
+}
+
+/* reads a length extension; returns 0 if the input ends early */
+LZ4_INLINE int lz4_get_length(const lz4_byte **ipp, const lz4_byte *iend, size_t *len)
+{
+    const lz4_byte *ip = *ipp;
+    unsigned s;
+    do
+    {
+        if(ip >= iend)
+            return 0;
+        s = *ip++;
+        *len += s;
+    }
+    while(s == 255);
+    *ipp = ip;
+    return 1;
+}
+
+/* copies at least len bytes in 8 byte steps, may write up to 7 bytes more. src must be >= 8 bytes behind dst, or not overlap at all */
+LZ4_INLINE void lz4_wild_copy(lz4_byte *dst, const lz4_byte *src, size_t len)
+{
+    lz4_byte *end = dst + len;
+    do
+    {
+        memcpy(dst, src, 8);
+        dst += 8;
+        src += 8;
+    }
+    while(dst < end);
+}
+
+int LZ4_decompress_safe(const char *source, char *dest, int compressedSize, int dstCapacity)
+{
+    /* to continue a match that is less than 8 bytes back, see below */
+    static const unsigned inc32[8] = { 0, 1, 2, 1, 0, 4, 4, 4 };
+    static const int dec64[8] = { 0, 0, 0, -1, -4, 1, 2, 3 };
+    const lz4_byte *ip = (const lz4_byte*)source;
+    const lz4_byte *iend = ip + compressedSize;
+    lz4_byte *op = (lz4_byte*)dest;
+    lz4_byte *oend = op + dstCapacity;
+
+    if(compressedSize <= 0 || dstCapacity < 0)
+        return -1;
+
+    for(;;)
+    {
+        const lz4_byte *match;
+        size_t offset;
+        unsigned token = *ip++;
+        size_t len = token >> 4;
+
+        /* the common case, short literals and a short match far from both ends: fixed size copies, hardly any checks */
+        if(len != LZ4_RUN_MASK && (size_t)(iend - ip) >= 16 + 2 && (size_t)(oend - op) >= 16 + 18)
+        {
+            memcpy(op, ip, 16);
+            op += len;
+            ip += len;
+            offset = ip[0] | ((size_t)ip[1] << 8);
+            ip += 2;
+            match = op - offset;
+            len = token & LZ4_ML_MASK;
+            if(len != LZ4_ML_MASK && offset >= 8 && offset <= (size_t)(op - (lz4_byte*)dest))
+            {
+                memcpy(op, match, 8);
+                memcpy(op + 8, match + 8, 8);
+                memcpy(op + 16, match + 16, 2);
+                op += len + LZ4_MINMATCH;
+                continue;
+            }
+            goto check_match; /* the literals are done, and the match is in range of the checks below */
+        }
+
+        /* literals */
+        if(len == LZ4_RUN_MASK && !lz4_get_length(&ip, iend, &len))
+            return -1;
+        if(len > (size_t)(iend - ip) || len > (size_t)(oend - op))
+            return -1;
+        if((size_t)(iend - ip) >= len + 8 && (size_t)(oend - op) >= len + 8)
+            lz4_wild_copy(op, ip, len); /* enough room on both sides to overshoot a little */
+        else
+            memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        if(ip == iend)
+            break; /* the last sequence has no match */
+
+        /* match */
+        if(iend - ip < 2)
+            return -1;
+        offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        len = token & LZ4_ML_MASK;
+
+check_match:
+        if(!offset || offset > (size_t)(op - (lz4_byte*)dest))
+            return -1;
+        match = op - offset;
+        if(len == LZ4_ML_MASK && !lz4_get_length(&ip, iend, &len))
+            return -1;
+        len += LZ4_MINMATCH;
+        if(len > (size_t)(oend - op))
+            return -1;
+
+        if((size_t)(oend - op) >= len + 16)
+        {
+            lz4_byte *cpy = op + len;
+            if(offset < 8)
+            {
+                /* copy the first 8 bytes one by one or from where the pattern repeats, then the source is far enough behind */
+                op[0] = match[0];
+                op[1] = match[1];
+                op[2] = match[2];
+                op[3] = match[3];
+                match += inc32[offset];
+                memcpy(op + 4, match, 4);
+                match -= dec64[offset];
+            }
+            else
+            {
+                memcpy(op, match, 8);
+                match += 8;
+            }
+            op += 8;
+            if(op < cpy)
+                lz4_wild_copy(op, match, (size_t)(cpy - op));
+            op = cpy;
+        }
+        else
+        {
+            lz4_byte *cpy = op + len;
+            while(op < cpy)
+                *op++ = *match++;
+        }
+
+        if(ip >= iend)
+            return -1; /* must end with literals */
+    }
+
+    return (int)(op - (lz4_byte*)dest);
+}
@@ -0,0 +1,47 @@
+/*
+ * LZ4 block format compressor/decompressor for LVPA.
+ *
+ * This is a small, independent implementation of the LZ4 block format
+ * (see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md).
+ * Its output can be decoded by the reference LZ4 library and vice versa.
+ * Only the subset of the reference API that LVPA uses is provided, with the same
+ * names and semantics, so that the reference library can be used instead
+ * (CMake does so if it finds it, see LVPA_USE_INTERNAL_LZ4). The files of upstream's lib/
+ * directory can replace lz4.c, lz4.h, lz4hc.c and lz4hc.h as they are, see CMakeLists.txt.
+ *
+ * Written for LVPA, same license (zlib license, or GPL v2+).
+ */
+
+#ifndef LZ4_H_LVPA
+#define LZ4_H_LVPA
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LZ4_MAX_INPUT_SIZE 0x7E000000 /* 2 113 929 216 bytes */
+#define LZ4_COMPRESSBOUND(isize) ((unsigned)(isize) > (unsigned)LZ4_MAX_INPUT_SIZE ? 0 : (isize) + ((isize) / 255) + 16)
+
+/* Max. size of the compressed data for an input of inputSize bytes, 0 if the input is too large. */
+int LZ4_compressBound(int inputSize);
+
+/*
+ * Compresses srcSize bytes from src into dst, which can hold dstCapacity bytes.
+ * Returns the number of bytes written, or 0 if the output did not fit.
+ * acceleration >= 1: larger values are faster, but compress worse. 1 is the default.
+ */
+int LZ4_compress_fast(const char *src, char *dst, int srcSize, int dstCapacity, int acceleration);
+int LZ4_compress_default(const char *src, char *dst, int srcSize, int dstCapacity);
+
+/*
+ * Decompresses compressedSize bytes from src into dst, writing at most dstCapacity bytes.
+ * Returns the number of bytes written, or a negative value if the input is malformed.
+ * Never reads or writes outside of the given buffers.
+ */
+int LZ4_decompress_safe(const char *src, char *dst, int compressedSize, int dstCapacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Shared helpers of the LZ4 compressors, see lz4.h.
+ *
+ * Written for LVPA, same license (zlib license, or GPL v2+).
+ */
+
+#ifndef LZ4_INTERNAL_H_LVPA
+#define LZ4_INTERNAL_H_LVPA
+
+#include <string.h>
+#include <stddef.h>
+
+#ifdef _MSC_VER
+#  define LZ4_INLINE static __inline
+#else
+#  define LZ4_INLINE static inline
+#endif
+
+typedef unsigned char lz4_byte;
+typedef unsigned int lz4_u32;
+typedef unsigned long long lz4_u64;
+
+/* format constants, see lz4_Block_format.md */
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5 /* the last 5 bytes are always literals */
+#define LZ4_MFLIMIT 12 /* the last match must start at least 12 bytes before the end */
+#define LZ4_MIN_INPUT (LZ4_MFLIMIT + 1) /* anything shorter is stored as literals */
+#define LZ4_MAX_DISTANCE 65535
+#define LZ4_ML_MASK 15
+#define LZ4_RUN_MASK 15
+
+LZ4_INLINE lz4_u32 lz4_read32(const void *p)
+{
+    lz4_u32 v;
+    memcpy(&v, p, 4); /* compiles to a single load where unaligned access is allowed */
+    return v;
+}
+
+LZ4_INLINE lz4_u64 lz4_read64(const void *p)
+{
+    lz4_u64 v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+/* number of equal bytes at a and b, not reading beyond limit (which is relative to a) */
+LZ4_INLINE size_t lz4_count(const lz4_byte *a, const lz4_byte *b, const lz4_byte *limit)
+{
+    const lz4_byte *start = a;
+    while(a + 4 <= limit && lz4_read32(a) == lz4_read32(b))
+    {
+        a += 4;
+        b += 4;
+    }
+    while(a < limit && *a == *b)
+    {
+        ++a;
+        ++b;
+    }
+    return (size_t)(a - start);
+}
+
+LZ4_INLINE lz4_byte *lz4_put_length(lz4_byte *op, size_t len)
+{
+    while(len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (lz4_byte)len;
+    return op;
+}
+
+/*
+ * Writes one sequence: litLen literals from lit, then a match of matchLen (>= LZ4_MINMATCH) bytes at distance offset.
+ * Returns the new output position, or NULL if it does not fit into [op, oend).
+ */
+LZ4_INLINE lz4_byte *lz4_put_sequence(lz4_byte *op, lz4_byte *oend, const lz4_byte *lit, size_t litLen, size_t offset, size_t matchLen)
+{
+    lz4_byte *token;
+    size_t ml = matchLen - LZ4_MINMATCH;
+
+    if(1 + (litLen / 255 + 1) + litLen + 2 + (ml / 255 + 1) > (size_t)(oend - op))
+        return NULL;
+
+    token = op++;
+    if(litLen >= LZ4_RUN_MASK)
+    {
+        *token = LZ4_RUN_MASK << 4;
+        op = lz4_put_length(op, litLen - LZ4_RUN_MASK);
+    }
+    else
+        *token = (lz4_byte)(litLen << 4);
+
+    memcpy(op, lit, litLen);
+    op += litLen;
+
+    op[0] = (lz4_byte)offset;
+    op[1] = (lz4_byte)(offset >> 8);
+    op += 2;
+
+    if(ml >= LZ4_ML_MASK)
+    {
+        *token |= LZ4_ML_MASK;
+        op = lz4_put_length(op, ml - LZ4_ML_MASK);
+    }
+    else
+        *token |= (lz4_byte)ml;
+
+    return op;
+}
+
+/* The final sequence, literals only. Returns the new output position, or NULL if it does not fit. */
+LZ4_INLINE lz4_byte *lz4_put_last_literals(lz4_byte *op, lz4_byte *oend, const lz4_byte *lit, size_t litLen)
+{
+    if(1 + (litLen / 255 + 1) + litLen > (size_t)(oend - op))
+        return NULL;
+
+    if(litLen >= LZ4_RUN_MASK)
+    {
+        *op++ = LZ4_RUN_MASK << 4;
+        op = lz4_put_length(op, litLen - LZ4_RUN_MASK);
+    }
+    else
+        *op++ = (lz4_byte)(litLen << 4);
+
+    memcpy(op, lit, litLen);
+    return op + litLen;
+}
+
+#endif
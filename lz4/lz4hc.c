@@ -0,0 +1,159 @@
+/*
+ * LZ4 high compression mode for LVPA, see lz4hc.h.
+ * Finds matches via hash chains over the whole 64 KB window, and uses lazy matching
+ * (a match is postponed by one byte if a longer one starts there).
+ *
+ * Written for LVPA, same license (zlib license, or GPL v2+).
+ */
+
+#include <stdlib.h>
+#include "lz4hc.h"
+#include "lz4_internal.h"
+
+#define LZ4HC_HASHLOG 15
+#define LZ4HC_CHAIN_SIZE 65536 /* one entry per window position, so the chain never has to be cleaned up */
+#define LZ4HC_BASE 65536 /* index of the first input byte, so that index 0 (= empty) is always out of the window */
+
+typedef struct
+{
+    lz4_u32 head[1 << LZ4HC_HASHLOG]; /* most recent index for each hash */
+    unsigned short chain[LZ4HC_CHAIN_SIZE]; /* distance to the previous index with the same hash */
+    const lz4_byte *src;
+    lz4_u32 nextToUpdate; /* first index not yet inserted */
+    unsigned maxAttempts;
+} lz4hc_state;
+
+LZ4_INLINE lz4_u32 lz4hc_hash(lz4_u32 seq)
+{
+    return (seq * 2654435761U) >> (32 - LZ4HC_HASHLOG);
+}
+
+/* inserts all positions before ip */
+static void lz4hc_insert(lz4hc_state *st, const lz4_byte *ip)
+{
+    lz4_u32 target = (lz4_u32)(ip - st->src) + LZ4HC_BASE;
+    lz4_u32 idx;
+    for(idx = st->nextToUpdate; idx < target; ++idx)
+    {
+        lz4_u32 h = lz4hc_hash(lz4_read32(st->src + (idx - LZ4HC_BASE)));
+        lz4_u32 delta = idx - st->head[h];
+        if(delta > LZ4_MAX_DISTANCE)
+            delta = LZ4_MAX_DISTANCE; /* anything that far back is out of the window anyways */
+        st->chain[idx & (LZ4HC_CHAIN_SIZE - 1)] = (unsigned short)delta;
+        st->head[h] = idx;
+    }
+    st->nextToUpdate = target;
+}
+
+/* returns the length of the longest match for ip (0 if none), and its position in *matchOut */
+static size_t lz4hc_find(lz4hc_state *st, const lz4_byte *ip, const lz4_byte *matchlimit, const lz4_byte **matchOut)
+{
+    lz4_u32 idx = (lz4_u32)(ip - st->src) + LZ4HC_BASE;
+    lz4_u32 low = idx > LZ4HC_BASE + LZ4_MAX_DISTANCE ? idx - LZ4_MAX_DISTANCE : LZ4HC_BASE;
+    lz4_u32 ref;
+    unsigned attempts = st->maxAttempts;
+    size_t best = 0;
+    lz4_u32 seq = lz4_read32(ip);
+
+    lz4hc_insert(st, ip);
+    ref = st->head[lz4hc_hash(seq)];
+
+    while(ref >= low && attempts--)
+    {
+        const lz4_byte *m = st->src + (ref - LZ4HC_BASE);
+        /* ip + best never exceeds matchlimit, so checking the byte that would make the match longer is safe */
+        if(m[best] == ip[best] && lz4_read32(m) == seq)
+        {
+            size_t len = LZ4_MINMATCH + lz4_count(ip + LZ4_MINMATCH, m + LZ4_MINMATCH, matchlimit);
+            if(len > best)
+            {
+                best = len;
+                *matchOut = m;
+                if(ip + len >= matchlimit)
+                    break; /* can't get any longer */
+            }
+        }
+        ref -= st->chain[ref & (LZ4HC_CHAIN_SIZE - 1)];
+    }
+
+    return best;
+}
+
+int LZ4_compress_HC(const char *source, char *dest, int srcSize, int dstCapacity, int compressionLevel)
+{
+    const lz4_byte *src = (const lz4_byte*)source;
+    const lz4_byte *ip = src;
+    const lz4_byte *anchor = src;
+    const lz4_byte *iend = src + srcSize;
+    const lz4_byte *mflimit = iend - LZ4_MFLIMIT;
+    const lz4_byte *matchlimit = iend - LZ4_LASTLITERALS;
+    lz4_byte *op = (lz4_byte*)dest;
+    lz4_byte *oend = op + dstCapacity;
+
+    if(srcSize < 0 || (unsigned)srcSize > LZ4_MAX_INPUT_SIZE || dstCapacity <= 0)
+        return 0;
+
+    if(compressionLevel <= 0)
+        compressionLevel = LZ4HC_CLEVEL_DEFAULT;
+    else if(compressionLevel < LZ4HC_CLEVEL_MIN)
+        compressionLevel = LZ4HC_CLEVEL_MIN;
+    else if(compressionLevel > LZ4HC_CLEVEL_MAX)
+        compressionLevel = LZ4HC_CLEVEL_MAX;
+
+    if(srcSize >= LZ4_MIN_INPUT)
+    {
+        lz4hc_state *st = (lz4hc_state*)malloc(sizeof(lz4hc_state));
+        if(!st)
+            return 0;
+        memset(st->head, 0, sizeof(st->head));
+        st->src = src;
+        st->nextToUpdate = LZ4HC_BASE;
+        st->maxAttempts = 1u << (compressionLevel - 1);
+
+        while(ip <= mflimit)
+        {
+            const lz4_byte *match = NULL;
+            size_t len = lz4hc_find(st, ip, matchlimit, &match);
+            if(len < LZ4_MINMATCH)
+            {
+                ++ip;
+                continue;
+            }
+
+            /* lazy matching: emitting one more literal pays off if a longer match starts at the next byte */
+            while(ip + 1 <= mflimit)
+            {
+                const lz4_byte *match2 = NULL;
+                size_t len2 = lz4hc_find(st, ip + 1, matchlimit, &match2);
+                if(len2 <= len)
+                    break;
+                ++ip;
+                len = len2;
+                match = match2;
+            }
+
+            while(ip > anchor && match > src && ip[-1] == match[-1])
+            {
+                --ip;
+                --match;
+                ++len;
+            }
+
+            op = lz4_put_sequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - match), len);
+            if(!op)
+            {
+                free(st);
+                return 0;
+            }
+            ip += len;
+            anchor = ip;
+        }
+
+        free(st);
+    }
+
+    op = lz4_put_last_literals(op, oend, anchor, (size_t)(iend - anchor));
+    if(!op)
+        return 0;
+    return (int)(op - (lz4_byte*)dest);
+}
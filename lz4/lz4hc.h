@@ -0,0 +1,31 @@
+/*
+ * LZ4 high compression mode for LVPA, see lz4.h.
+ *
+ * Written for LVPA, same license (zlib license, or GPL v2+).
+ */
+
+#ifndef LZ4HC_H_LVPA
+#define LZ4HC_H_LVPA
+
+#include "lz4.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LZ4HC_CLEVEL_MIN 3
+#define LZ4HC_CLEVEL_DEFAULT 9
+#define LZ4HC_CLEVEL_MAX 12
+
+/*
+ * Like LZ4_compress_fast(), but searches much harder for matches. The output is regular LZ4 data
+ * and decompresses just as fast. compressionLevel is clamped to [LZ4HC_CLEVEL_MIN, LZ4HC_CLEVEL_MAX],
+ * each level doubles the search depth. 0 selects the default level.
+ */
+int LZ4_compress_HC(const char *src, char *dst, int srcSize, int dstCapacity, int compressionLevel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
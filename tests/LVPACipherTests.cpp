@@ -192,3 +192,140 @@ int TestHPRC4LikeMassive()
 {
     return TestCipherMassive<HPRC4LikeCipher>();
 }
+
+// RFC 8439, section 2.4.2
+int TestChaCha20()
+{
+    static const char *text = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    static const uint8 nonce[] = { 0,0,0,0, 0,0,0,0x4a, 0,0,0,0 };
+    static const uint8 expected[] =
+    {
+        0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+        0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+        0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+        0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab, 0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+        0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+        0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+        0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+        0x87, 0x4d
+    };
+    uint8 key[ChaCha20Cipher::KEY_SIZE];
+    for(uint32 i = 0; i < sizeof(key); ++i)
+        key[i] = uint8(i);
+
+    uint32 len = strlen(text);
+    if(len != sizeof(expected))
+        return 1;
+    std::vector<uint8> buf(text, text + len);
+    ChaCha20Cipher c;
+    c.Init(key, sizeof(key));
+
+    int ret = 0;
+    for(uint32 impl = ChaCha20Cipher::IMPL_AUTO; impl < ChaCha20Cipher::IMPL_MAX && !ret; ++impl)
+    {
+        if(!ChaCha20Cipher::SetImpl(ChaCha20Cipher::Impl(impl)))
+        {
+            printf("ChaCha20 %s: not supported here\n", ChaCha20Cipher::GetImplName(ChaCha20Cipher::Impl(impl)));
+            continue;
+        }
+        memcpy(&buf[0], text, len);
+        c.SetNonce(nonce, 1);
+        c.Apply(&buf[0], len);
+        if(memcmp(&buf[0], expected, len))
+        {
+            logerror("Expected memory:");
+            printchex((char*)expected, len, true);
+            logerror("Actual memory:");
+            printchex((char*)&buf[0], len, true);
+            ret = 2;
+        }
+
+        // bytewise must give the same
+        memcpy(&buf[0], text, len);
+        c.SetNonce(nonce, 1);
+        for(uint32 i = 0; i < len; ++i)
+            c.Apply(&buf[i], 1);
+        if(!ret && memcmp(&buf[0], expected, len))
+            ret = 3;
+
+        // the text starts at block 1, so with block 0 in front, 4 blocks can go through the SIMD code at once
+        std::vector<uint8> four(4 * ChaCha20Cipher::BLOCK_SIZE, 0);
+        memcpy(&four[ChaCha20Cipher::BLOCK_SIZE], text, len);
+        c.SetNonce(nonce, 0);
+        c.Apply(&four[0], four.size());
+        if(!ret && memcmp(&four[ChaCha20Cipher::BLOCK_SIZE], expected, len))
+            ret = 4;
+    }
+    ChaCha20Cipher::SetImpl(ChaCha20Cipher::IMPL_AUTO);
+    return ret;
+}
+
+// the keystream must not depend on how a buffer is split up, or where the pieces start
+int TestChaCha20Seek()
+{
+    uint8 key[ChaCha20Cipher::KEY_SIZE], nonce[ChaCha20Cipher::NONCE_SIZE];
+    for(uint32 i = 0; i < sizeof(key); ++i)
+        key[i] = uint8(i * 7 + 3);
+    for(uint32 i = 0; i < sizeof(nonce); ++i)
+        nonce[i] = uint8(0xA0 + i);
+
+    const uint32 size = 5000; // many blocks, so that the SIMD code is used, and a partial one at the end
+    std::vector<uint8> whole(size), pieces(size);
+    for(uint32 i = 0; i < size; ++i)
+        whole[i] = pieces[i] = uint8(i);
+
+    ChaCha20Cipher c;
+    c.Init(key, sizeof(key));
+    c.SetNonce(nonce);
+    c.Apply(&whole[0], size);
+
+    // odd-sized pieces from the back to the front, each one at its own position
+    uint32 end = size;
+    for(uint32 len = 1; end; len = len * 3 + 1)
+    {
+        uint32 n = std::min(len, end);
+        end -= n;
+        c.ApplyAt(&pieces[end], n, end);
+    }
+    if(pieces != whole)
+        return 1;
+
+    // WarmUp() skips ahead
+    std::vector<uint8> tail(size - 777);
+    for(uint32 i = 0; i < tail.size(); ++i)
+        tail[i] = uint8(i + 777);
+    ChaCha20Cipher d;
+    d.Init(key, sizeof(key));
+    d.SetNonce(nonce);
+    d.WarmUp(777);
+    d.Apply(&tail[0], tail.size());
+    if(memcmp(&tail[0], &whole[777], tail.size()))
+        return 2;
+
+    // and back
+    c.ApplyAt(&whole[0], size, 0);
+    for(uint32 i = 0; i < size; ++i)
+        if(whole[i] != uint8(i))
+            return 3;
+
+    // every implementation gives the keystream of the generic one, also for pieces that start in the middle of a block
+    std::vector<uint8> ref(size, 0);
+    ChaCha20Cipher::SetImpl(ChaCha20Cipher::IMPL_GENERIC);
+    c.ApplyAt(&ref[0], size, 0);
+    int ret = 0;
+    for(uint32 impl = ChaCha20Cipher::IMPL_AUTO; impl < ChaCha20Cipher::IMPL_MAX && !ret; ++impl)
+    {
+        if(!ChaCha20Cipher::SetImpl(ChaCha20Cipher::Impl(impl)))
+            continue;
+        for(uint32 pos = 1; pos < size && !ret; pos += 333)
+        {
+            uint32 n = std::min<uint32>(size - pos, 9 * ChaCha20Cipher::BLOCK_SIZE + 5);
+            std::vector<uint8> ks(n, 0);
+            c.ApplyAt(&ks[0], n, pos);
+            if(memcmp(&ks[0], &ref[pos], n))
+                ret = 4;
+        }
+    }
+    ChaCha20Cipher::SetImpl(ChaCha20Cipher::IMPL_AUTO);
+    return ret;
+}
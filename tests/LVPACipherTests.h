@@ -8,5 +8,7 @@ int TestRC4Warm();
 int TestHPRC4LikeWarm();
 int TestRC4Massive();
 int TestHPRC4LikeMassive();
+int TestChaCha20();
+int TestChaCha20Seek();
 
 #endif
@@ -1,12 +1,21 @@
 #include "LVPAInternal.h"
 #include <cstdio>
+#include <ctime>
+#include <algorithm>
 
 #include "LVPACommon.h"
 #include "LVPAFile.h"
 #include "SHA256Hash.h"
+#include "LVPAFilters.h"
+#include "MyCrc32.h"
+#include "XXHash64.h"
+#include "LVPAStreamCipher.h"
+#include "LVPAThreading.h"
+#include "ByteBuffer.h"
 
 #ifdef LVPA_SUPPORT_LZMA
 #  include "LZMACompressor.h"
+#  include "LZMAMTCompressor.h"
 #endif
 #ifdef LVPA_SUPPORT_LZO
 #  include "LZOCompressor.h"
@@ -20,12 +29,24 @@
 #ifdef LVPA_SUPPORT_LZHAM
 #  include "LZHAMCompressor.h"
 #endif
+#ifdef LVPA_SUPPORT_ZSTD
+#  include "ZstdCompressor.h"
+#endif
+#ifdef LVPA_SUPPORT_LZ4
+#  include "LZ4Compressor.h"
+#endif
 
 
 #ifdef LVPA_NAMESPACE
   using namespace LVPA_NAMESPACE;
 #endif
 
+#ifdef LVPA_SUPPORT_ZSTD
+#  define LVPA_TEST_DICT_ALGO LVPAPACK_ZSTD
+#else
+#  define LVPA_TEST_DICT_ALGO LVPAPACK_DEFLATE
+#endif
+
 const char v0[] = "";
 const char v1[] = "a";
 const char v2[] = "aaaaaaaaaa";
@@ -71,7 +92,15 @@ const uint32 i2[] =
     _c.Compress(lv); \
     if(prn) printf("C %s [%s]: %u -> %u\n", #mem, #compr, _c.RealSize(), _c.size()); \
     _c.Decompress(); \
-    if(memcmp((const char*)&mem[0], _c.contents(), _c.size())) return 1; \
+    if(_c.size() != _size || memcmp((const char*)&mem[0], _c.contents(), _c.size())) return 1; \
+    compr _s; _s.CompressFrom((const uint8*)&mem[0], _size, lv); \
+    if(_s.Compressed()) \
+    { \
+        std::vector<uint8> _out(_size); \
+        if(!_s.DecompressTo(&_out[0], _size, _s.contents(), _s.size())) return 1; \
+        if(memcmp((const char*)&mem[0], &_out[0], _size)) return 1; \
+    } \
+    else if(_s.size() != _size || memcmp((const char*)&mem[0], _s.contents(), _size)) return 1; \
 }
 
 #define DO_PACK_UNPACK(mem, compr) \
@@ -170,12 +199,74 @@ int LVPATestsInit()
     return 0;
 }
 
+// small, similar files, like config or script files - each one alone does not compress well
+static std::string makeRecordFile(uint32 n)
+{
+    static const char *types[] = { "monster", "item", "door", "lamp" };
+    char buf[256];
+    std::string s;
+    for(uint32 i = 0; i < 4 + n % 5; ++i)
+    {
+        uint32 id = n * 7 + i * 13;
+        sprintf(buf, "{ \"id\": %u, \"name\": \"entity_%u\", \"type\": \"%s\", \"health\": %u, \"speed\": %u.5, "
+            "\"script\": \"scripts/entities/entity_%u.lua\", \"flags\": [\"solid\", \"visible\"] }\n",
+            id, id, types[id % 4], (id * 31) % 500, id % 9, id);
+        s += buf;
+    }
+    return s;
+}
+
+// compresses data with and without dictionary; returns 0 if the dictionary helped and everything unpacks correctly
+static int checkDictionary(ICompressor& comp, ICompressor& decomp, const std::string& dict, const std::string& data)
+{
+    uint32 bound = comp.CompressBound(data.size());
+    std::vector<uint8> packed(bound), unpacked(data.size());
+
+    uint32 sizeNoDict = comp.CompressTo(&packed[0], bound, (const uint8*)data.c_str(), data.size(), LVPACOMP_NORMAL);
+    comp.SetDictionary((const uint8*)dict.c_str(), dict.size());
+    uint32 sizeDict = comp.CompressTo(&packed[0], bound, (const uint8*)data.c_str(), data.size(), LVPACOMP_NORMAL);
+    if(!sizeNoDict || !sizeDict || sizeDict >= sizeNoDict)
+        return 1;
+
+    decomp.SetDictionary((const uint8*)dict.c_str(), dict.size());
+    if(!decomp.DecompressTo(&unpacked[0], data.size(), &packed[0], sizeDict))
+        return 2;
+    if(memcmp(&unpacked[0], data.c_str(), data.size()))
+        return 3;
+    return 0;
+}
+
 #ifdef LVPA_SUPPORT_LZMA
 int TestLZMA()
 {
     DO_COMPRESS_RUN(LZMACompressor);
     return 0;
 }
+
+int TestLZMAMT()
+{
+    DO_COMPRESS_RUN(LZMAMTCompressor);
+
+    // large enough for multiple chunks: compressible, incompressible (stored raw), and a short one at the end
+    std::vector<uint8> big((5 << 20) + 123);
+    uint32 r = 42;
+    for(uint32 i = 0; i < big.size(); ++i)
+    {
+        r = r * 1103515245 + 12345;
+        big[i] = (i >= (2 << 20) && i < (4 << 20)) ? uint8(r >> 24) : uint8(i / 1000);
+    }
+
+    LZMAMTCompressor c;
+    c.Threads(4); // also exercise the threaded path on single-core machines
+    c.append(&big[0], big.size());
+    c.Compress(1);
+    if(!c.Compressed() || c.size() >= big.size())
+        return 1;
+    c.Decompress();
+    if(c.size() != big.size() || memcmp(&big[0], c.contents(), big.size()))
+        return 2;
+    return 0;
+}
 #endif
 
 #ifdef LVPA_SUPPORT_LZO
@@ -202,6 +293,24 @@ int TestGzip()
     DO_COMPRESS_RUN(GzipCompressor);
     return 0;
 }
+int TestDeflateDict()
+{
+    std::string dict;
+    for(uint32 i = 0; i < 20; ++i)
+        dict += makeRecordFile(i);
+    std::string data = makeRecordFile(1000);
+
+    DeflateCompressor dc, dd;
+    ZlibCompressor zc, zd;
+    GzipCompressor gz;
+    if(gz.SupportsDictionary()) // gzip streams have no way to signal a dictionary
+        return 1;
+    if(int r = checkDictionary(dc, dd, dict, data))
+        return 10 + r;
+    if(int r = checkDictionary(zc, zd, dict, data))
+        return 20 + r;
+    return 0;
+}
 #endif
 
 #ifdef LVPA_SUPPORT_LZF
@@ -212,6 +321,57 @@ int TestLZF()
 }
 #endif
 
+#ifdef LVPA_SUPPORT_LZ4
+int TestLZ4()
+{
+    DO_COMPRESS_RUN(LZ4Compressor);
+
+    // long enough to exercise long literal runs, long matches, and overlapping copies in both compressors
+    std::vector<uint8> big(300000);
+    uint32 r = 42;
+    for(uint32 i = 0; i < big.size(); ++i)
+    {
+        r = r * 1103515245 + 12345;
+        if(i < 1000 || (i >= 100000 && i < 101000))
+            big[i] = uint8(r >> 24);
+        else if(i < 100000)
+            big[i] = uint8(i % 3);
+        else
+            big[i] = big[i - 65535 + (r >> 28)];
+    }
+    for(uint8 level = 1; level <= 9; ++level)
+    {
+        LZ4Compressor c;
+        c.append(&big[0], big.size());
+        c.Compress(level);
+        if(!c.Compressed() || c.size() >= big.size())
+            return 1;
+        c.Decompress();
+        if(c.size() != big.size() || memcmp(&big[0], c.contents(), big.size()))
+            return 2;
+    }
+
+#ifdef LVPA_SUPPORT_LZF
+    // LZ4 is meant to replace LZF, so no level may pack worse than it
+    std::string text;
+    for(uint32 i = 0; text.size() < 200000; ++i)
+        text += makeRecordFile(i);
+    LZFCompressor lzf;
+    lzf.CompressFrom((const uint8*)text.c_str(), text.size());
+    if(!lzf.Compressed())
+        return 3;
+    for(uint8 level = 1; level <= 9; ++level)
+    {
+        LZ4Compressor c;
+        c.CompressFrom((const uint8*)text.c_str(), text.size(), level);
+        if(!c.Compressed() || c.size() > lzf.size())
+            return 10 + level;
+    }
+#endif
+    return 0;
+}
+#endif
+
 #ifdef LVPA_SUPPORT_LZHAM
 int TestLZHAM()
 {
@@ -220,6 +380,409 @@ int TestLZHAM()
 }
 #endif
 
+#ifdef LVPA_SUPPORT_ZSTD
+int TestZstd()
+{
+    DO_COMPRESS_RUN(ZstdCompressor);
+    return 0;
+}
+
+int TestZstdLong()
+{
+    // 2 identical halves of noise, 9 MB apart: too far for the default window, but not with long mode
+    const uint32 half = 9 << 20;
+    std::vector<uint8> big(half * 2);
+    uint32 r = 42;
+    for(uint32 i = 0; i < half; ++i)
+    {
+        r = r * 1103515245 + 12345;
+        big[i] = big[i + half] = uint8(r >> 24);
+    }
+
+    ZstdCompressor c;
+    c.append(&big[0], big.size());
+    c.Compress(LVPACOMP_GOOD);
+    if(!c.Compressed() || c.size() > half + half / 8)
+        return 1;
+    c.Decompress();
+    if(c.size() != big.size() || memcmp(&big[0], c.contents(), big.size()))
+        return 2;
+    return 0;
+}
+
+int TestZstdDict()
+{
+    std::string samples;
+    std::vector<uint32> sizes;
+    for(uint32 i = 0; i < 200; ++i)
+    {
+        std::string f = makeRecordFile(i);
+        samples += f;
+        sizes.push_back(f.size());
+    }
+
+    std::string dict(8 * 1024, 0);
+    uint32 dictSize = ZstdCompressor::TrainDictionary((uint8*)&dict[0], dict.size(), (const uint8*)samples.c_str(), &sizes[0], sizes.size());
+    if(!dictSize || dictSize > dict.size())
+        return 1;
+    dict.resize(dictSize);
+
+    ZstdCompressor c, d;
+    if(int r = checkDictionary(c, d, dict, makeRecordFile(1000)))
+        return 10 + r;
+
+    // a raw-content dictionary works too
+    ZstdCompressor c2, d2;
+    if(int r = checkDictionary(c2, d2, samples.substr(0, 4096), makeRecordFile(1001)))
+        return 20 + r;
+    return 0;
+}
+#endif
+
+// deterministic pseudo-random bytes
+static void fillRandom(std::vector<uint8>& v, uint32 seed)
+{
+    for(uint32 i = 0; i < v.size(); ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        v[i] = uint8(seed >> 16);
+    }
+}
+
+// fake machine code: lots of calls to a few functions, from all over the place
+static std::vector<uint8> makeCallCode(uint32 size)
+{
+    std::vector<uint8> v(size);
+    fillRandom(v, 42);
+    for(uint32 pos = 16; pos + 5 <= size; pos += 23)
+    {
+        int32 rel = int32((pos * 7) % 5 * 1000) - int32(pos + 5); // one of 5 targets
+        v[pos] = 0xE8;
+        memcpy(&v[pos + 1], &rel, 4); // little endian
+    }
+    return v;
+}
+
+int TestFilters()
+{
+    static const uint8 filters[][2] =
+    {
+        { LVPAFILTER_NONE, 0 },
+        { LVPAFILTER_X86, 0 },
+        { LVPAFILTER_DELTA, 1 },
+        { LVPAFILTER_DELTA, 3 },
+        { LVPAFILTER_DELTA, 255 },
+        { LVPAFILTER_SHUFFLE, 2 },
+        { LVPAFILTER_SHUFFLE, 4 },
+        { LVPAFILTER_SHUFFLE, 255 },
+    };
+    static const uint32 sizes[] = { 0, 1, 4, 5, 6, 7, 9, 100, 1001, 65536 };
+
+    std::vector<uint8> code = makeCallCode(65536);
+    for(uint32 f = 0; f < sizeof(filters) / sizeof(filters[0]); ++f)
+    {
+        if(!IsValidFilter(filters[f][0], filters[f][1]))
+            return 1;
+        for(uint32 s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+        {
+            for(uint32 k = 0; k < 2; ++k)
+            {
+                std::vector<uint8> in(sizes[s] + 1), out(sizes[s] + 1);
+                if(k)
+                    memcpy(&in[0], &code[0], sizes[s]);
+                else
+                    fillRandom(in, sizes[s]);
+                FilterEncode(filters[f][0], filters[f][1], &out[0], &in[0], sizes[s]);
+                if(!FilterDecode(filters[f][0], filters[f][1], &out[0], sizes[s]))
+                    return 2;
+                if(memcmp(&in[0], &out[0], sizes[s]))
+                    return 3;
+            }
+        }
+    }
+
+    // calls to the same function must look the same afterwards
+    // (a few are missed, because random bytes nearby look like calls too)
+    std::vector<uint8> conv(code.size());
+    FilterEncode(LVPAFILTER_X86, 0, &conv[0], &code[0], code.size());
+    uint32 same = 0, total = 0;
+    for(uint32 pos = 16 + 23 * 5; pos + 5 <= code.size(); pos += 23, ++total)
+        same += !memcmp(&conv[pos], &conv[pos - 23 * 5], 5);
+    if(same < total * 9 / 10)
+        return 4;
+
+    if(IsValidFilter(LVPAFILTER_X86, 1) || IsValidFilter(LVPAFILTER_DELTA, 0) || IsValidFilter(LVPAFILTER_SHUFFLE, 1)
+        || IsValidFilter(LVPAFILTER_MAX_SUPPORTED, 0))
+        return 5;
+    return 0;
+}
+
+// one bit at a time, straight from the definition
+static uint32 crc32Reference(const uint8 *buf, uint32 size)
+{
+    uint32 crc = 0xFFFFFFFF;
+    for(uint32 i = 0; i < size; ++i)
+    {
+        crc ^= buf[i];
+        for(uint32 j = 0; j < 8; ++j)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+int TestCRC32()
+{
+    std::vector<uint8> data(100000 + 16);
+    fillRandom(data, 7);
+
+    int ret = 0;
+    for(uint32 impl = CRC32::IMPL_AUTO; impl < CRC32::IMPL_MAX && !ret; ++impl)
+    {
+        if(!CRC32::SetImpl(CRC32::Impl(impl)))
+        {
+            printf("CRC32 %s: not supported here\n", CRC32::GetImplName(CRC32::Impl(impl)));
+            continue;
+        }
+        if(CRC32::Calc("123456789", 9) != 0xCBF43926)
+            ret = 1;
+        // all sizes around the block lengths, at all alignments
+        for(uint32 offs = 0; offs < 16 && !ret; ++offs)
+            for(uint32 size = 0; size < 300 && !ret; ++size)
+                if(CRC32::Calc(&data[offs], size) != crc32Reference(&data[offs], size))
+                    ret = 2;
+        if(!ret && CRC32::Calc(&data[3], 100000) != crc32Reference(&data[3], 100000))
+            ret = 3;
+        // split into pieces
+        CRC32 crc;
+        for(uint32 pos = 0; pos < 100000; pos += 777)
+            crc.Update(&data[pos], std::min<uint32>(777, 100000 - pos));
+        crc.Finalize();
+        if(!ret && crc.Result() != crc32Reference(&data[0], 100000))
+            ret = 4;
+    }
+    CRC32::SetImpl(CRC32::IMPL_AUTO);
+    return ret;
+}
+
+int TestCRC32Combine()
+{
+    std::vector<uint8> data(50000);
+    fillRandom(data, 11);
+    const uint32 whole = CRC32::Calc(&data[0], data.size());
+
+    // two parts, split anywhere (including empty parts)
+    static const uint32 splits[] = { 0, 1, 3, 16, 17, 1000, 49999, 50000 };
+    for(uint32 i = 0; i < sizeof(splits) / sizeof(splits[0]); ++i)
+    {
+        uint32 a = splits[i], b = data.size() - a;
+        uint32 crc1 = CRC32::Calc(&data[0], a);
+        uint32 crc2 = CRC32::Calc(&data[0] + a, b);
+        if(CRC32::Combine(crc1, crc2, b) != whole)
+            return 1;
+    }
+
+    // many equally sized pieces, as if checksummed in parallel
+    const uint32 piece = 5000;
+    const uint32 op = CRC32::CombineGen(piece);
+    uint32 crc = CRC32::Calc(&data[0], piece);
+    for(uint32 pos = piece; pos < data.size(); pos += piece)
+        crc = CRC32::CombineOp(crc, CRC32::Calc(&data[pos], piece), op);
+    if(crc != whole)
+        return 2;
+
+    // appending nothing changes nothing
+    if(CRC32::Combine(whole, CRC32::Calc(&data[0], 0), 0) != whole)
+        return 3;
+    return 0;
+}
+
+int TestCRC32Speed()
+{
+    std::vector<uint8> data(4 * 1024 * 1024);
+    fillRandom(data, 3);
+    const uint32 rounds = 8;
+
+    for(uint32 impl = CRC32::IMPL_AUTO; impl < CRC32::IMPL_MAX; ++impl)
+    {
+        if(!CRC32::SetImpl(CRC32::Impl(impl)))
+            continue;
+        uint32 x = 0;
+        clock_t t = clock();
+        for(uint32 i = 0; i < rounds; ++i)
+            x = CRC32::Calc(&data[0], data.size());
+        double secs = double(clock() - t) / CLOCKS_PER_SEC;
+        double mbs = secs > 0 ? (double(data.size()) * rounds / (1024 * 1024)) / secs : 0;
+        printf("CRC32 %-12s %8.0f MB/s (%08X)\n", CRC32::GetImplName(CRC32::Impl(impl)), mbs, x);
+    }
+    CRC32::SetImpl(CRC32::IMPL_AUTO);
+    return 0;
+}
+
+static bool sha256Equals(const uint8 *digest, const char *hex)
+{
+    char buf[LVPAHash_Size * 2 + 1];
+    for(uint32 i = 0; i < LVPAHash_Size; ++i)
+        sprintf(&buf[i * 2], "%02x", digest[i]);
+    return !strcmp(buf, hex);
+}
+
+int TestSHA256()
+{
+    std::vector<uint8> data(1000 + 16);
+    fillRandom(data, 5);
+
+    // reference results for all lengths, from the plain C code
+    SHA256Hash::SetImpl(SHA256Hash::IMPL_GENERIC);
+    std::vector<uint8> ref(1000 * LVPAHash_Size);
+    for(uint32 size = 0; size < 1000; ++size)
+        SHA256Hash::Calc(&ref[size * LVPAHash_Size], &data[size & 15], size);
+
+    int ret = 0;
+    for(uint32 impl = SHA256Hash::IMPL_AUTO; impl < SHA256Hash::IMPL_MAX && !ret; ++impl)
+    {
+        if(!SHA256Hash::SetImpl(SHA256Hash::Impl(impl)))
+        {
+            printf("SHA256 %s: not supported here\n", SHA256Hash::GetImplName(SHA256Hash::Impl(impl)));
+            continue;
+        }
+        uint8 digest[LVPAHash_Size];
+        SHA256Hash::Calc(digest, (const uint8*)"abc", 3);
+        if(!sha256Equals(digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"))
+            ret = 1;
+        SHA256Hash::Calc(digest, (const uint8*)"", 0);
+        if(!ret && !sha256Equals(digest, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"))
+            ret = 2;
+        const char *two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+        SHA256Hash::Calc(digest, (const uint8*)two, strlen(two));
+        if(!ret && !sha256Equals(digest, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"))
+            ret = 3;
+        for(uint32 size = 0; size < 1000 && !ret; ++size)
+        {
+            SHA256Hash::Calc(digest, &data[size & 15], size);
+            if(memcmp(digest, &ref[size * LVPAHash_Size], LVPAHash_Size))
+                ret = 4;
+        }
+        // split into pieces that don't line up with the blocks
+        SHA256Hash h;
+        for(uint32 pos = 0; pos < 999; pos += 37)
+            h.Update(&data[(999 & 15) + pos], std::min<uint32>(37, 999 - pos));
+        h.Finalize();
+        if(!ret && memcmp(h.GetDigest(), &ref[999 * LVPAHash_Size], LVPAHash_Size))
+            ret = 5;
+    }
+    SHA256Hash::SetImpl(SHA256Hash::IMPL_AUTO);
+    return ret;
+}
+
+int TestSHA256Multi()
+{
+    std::vector<uint8> data(1000);
+    fillRandom(data, 6);
+
+    // mixed lengths, including some that are too long for the multi-buffer code
+    const uint32 count = 23;
+    uint32 sizes[count];
+    const uint8 *src[count];
+    uint8 *dst[count];
+    std::vector<uint8> multi(count * LVPAHash_Size), single(count * LVPAHash_Size);
+    for(uint32 i = 0; i < count; ++i)
+    {
+        sizes[i] = (i * 97 + i * i * 13) % 400;
+        src[i] = &data[i * 17];
+        dst[i] = &multi[i * LVPAHash_Size];
+        SHA256Hash::Calc(&single[i * LVPAHash_Size], src[i], sizes[i]);
+    }
+
+    for(uint32 impl = SHA256Hash::IMPL_AUTO; impl < SHA256Hash::IMPL_MAX; ++impl)
+    {
+        if(!SHA256Hash::SetImpl(SHA256Hash::Impl(impl)))
+            continue;
+        // every count, so that all numbers of leftover lanes are used
+        for(uint32 n = 0; n <= count; ++n)
+        {
+            memset(&multi[0], 0, multi.size());
+            SHA256Hash::CalcMulti(dst, src, sizes, n);
+            if(memcmp(&multi[0], &single[0], n * LVPAHash_Size))
+            {
+                SHA256Hash::SetImpl(SHA256Hash::IMPL_AUTO);
+                return 1;
+            }
+        }
+    }
+    SHA256Hash::SetImpl(SHA256Hash::IMPL_AUTO);
+    return 0;
+}
+
+int TestSHA256Speed()
+{
+    std::vector<uint8> data(4 * 1024 * 1024);
+    fillRandom(data, 3);
+    const uint32 rounds = 2;
+
+    for(uint32 impl = SHA256Hash::IMPL_AUTO; impl < SHA256Hash::IMPL_MAX; ++impl)
+    {
+        if(!SHA256Hash::SetImpl(SHA256Hash::Impl(impl)))
+            continue;
+        uint8 digest[LVPAHash_Size];
+        clock_t t = clock();
+        for(uint32 i = 0; i < rounds; ++i)
+            SHA256Hash::Calc(digest, &data[0], data.size());
+        double secs = double(clock() - t) / CLOCKS_PER_SEC;
+        double mbs = secs > 0 ? (double(data.size()) * rounds / (1024 * 1024)) / secs : 0;
+        printf("SHA256 %-12s %8.0f MB/s\n", SHA256Hash::GetImplName(SHA256Hash::Impl(impl)), mbs);
+    }
+    SHA256Hash::SetImpl(SHA256Hash::IMPL_AUTO);
+    return 0;
+}
+
+int TestXXHash64()
+{
+    if(XXHash64::Calc("", 0) != 0xEF46DB3751D8E999ULL || XXHash64::Calc("abc", 3) != 0x44BC2CF5AD770999ULL)
+        return 1;
+
+    std::vector<uint8> data(1000);
+    fillRandom(data, 9);
+    // pieces of all sizes around the 32 byte stripes give the same as all at once
+    for(uint32 piece = 1; piece < 70; ++piece)
+    {
+        XXHash64 h(piece);
+        for(uint32 pos = 0; pos < data.size(); pos += piece)
+            h.Update(&data[pos], std::min<uint32>(piece, data.size() - pos));
+        h.Finalize();
+        if(h.Result() != XXHash64::Calc(&data[0], data.size(), piece))
+            return 2;
+    }
+    return 0;
+}
+
+int TestByteBufferGrowth()
+{
+    // grows past LVPA_LARGE_BUFFER_MIN in small steps, the contents must survive each move
+    std::vector<uint8> data(3 * LVPA_LARGE_BUFFER_MIN);
+    fillRandom(data, 21);
+    for(uint32 huge = 0; huge < 2; ++huge)
+    {
+        LVPAFile::UseHugePages(huge != 0);
+        ByteBuffer bb;
+        for(uint32 pos = 0; pos < data.size(); pos += 100000)
+            bb.append(&data[pos], std::min<uint32>(100000, data.size() - pos));
+        if(bb.size() != data.size() || memcmp(bb.contents(), &data[0], data.size()))
+            return 1 + huge * 10;
+
+        // swapped and copied like any other buffer
+        ByteBuffer other(bb);
+        ByteBuffer empty;
+        empty.swap(bb);
+        if(bb.size() || empty.size() != data.size() || other.size() != data.size() || memcmp(other.contents(), empty.contents(), data.size()))
+            return 2 + huge * 10;
+        empty.reserve(empty.capacity() + 1);
+        if(memcmp(empty.contents(), &data[0], data.size()))
+            return 3 + huge * 10;
+    }
+    LVPAFile::UseHugePages(false);
+    return 0;
+}
+
 int TestLVPAUncompressed()
 {
     INIT_TEST();
@@ -246,6 +809,180 @@ int TestLVPA_LZMA()
     return 0;
 }
 
+int TestLVPA_Zstd()
+{
+    INIT_TEST();
+    {
+        LVPAFile lvpa;
+        DO_ADD_CHECK_ALL();
+        lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_NORMAL, LVPAPACK_ZSTD);
+        lvpa.Clear(false); // otherwise we would attempt to delete const memory
+    }
+    DO_LOAD_AND_CHECK_ALL();
+    return 0;
+}
+
+int TestLVPA_LZ4()
+{
+    INIT_TEST();
+    {
+        LVPAFile lvpa;
+        DO_ADD_CHECK_ALL();
+        lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_GOOD, LVPAPACK_LZ4);
+        lvpa.Clear(false); // otherwise we would attempt to delete const memory
+    }
+    DO_LOAD_AND_CHECK_ALL();
+    return 0;
+}
+
+int TestLVPA_Dictionary()
+{
+    std::vector<std::string> files(300);
+    for(uint32 i = 0; i < files.size(); ++i)
+        files[i] = makeRecordFile(i);
+
+    // once without and once with dictionary
+    uint32 packedSize[2];
+    for(uint32 pass = 0; pass < 2; ++pass)
+    {
+        LVPAFile lvpa;
+        if(pass)
+            lvpa.UseDictionary(8 * 1024);
+        for(uint32 i = 0; i < files.size(); ++i)
+        {
+            char name[32];
+            sprintf(name, "rec/%u.json", i);
+            lvpa.Add(name, memblock((uint8*)files[i].c_str(), files[i].size()));
+        }
+        if(!lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_NORMAL, LVPA_TEST_DICT_ALGO))
+            return 1;
+        packedSize[pass] = lvpa.GetPackedSize();
+        lvpa.Clear(false); // otherwise we would attempt to delete const memory
+    }
+    if(packedSize[1] >= packedSize[0])
+        return 2;
+
+    // append a file, the others are not loaded and raw-copied, still referring to the dictionary
+    std::string extra = makeRecordFile(5000);
+    {
+        LVPAFile lvpa;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 3;
+        if(lvpa.GetId("*dict*") == uint32(-1))
+            return 4;
+        memblock mb = lvpa.Get("rec/7.json");
+        if(!mb.ptr || mb.size != files[7].size() || memcmp(mb.ptr, files[7].c_str(), mb.size))
+            return 5;
+        lvpa.Add("rec/extra.json", memblock((uint8*)extra.c_str(), extra.size()));
+        if(!lvpa.Save(LVPACOMP_NORMAL, LVPA_TEST_DICT_ALGO))
+            return 6;
+        lvpa.Drop("rec/extra.json");
+    }
+    {
+        LVPAFile lvpa;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 7;
+        for(uint32 i = 0; i < files.size(); ++i)
+        {
+            char name[32];
+            sprintf(name, "rec/%u.json", i);
+            memblock mb = lvpa.Get(name);
+            if(!mb.ptr || mb.size != files[i].size() || memcmp(mb.ptr, files[i].c_str(), mb.size))
+                return 8;
+            if(!(lvpa.GetFileInfo(lvpa.GetId(name)).flags & LVPAFLAG_DICTREF))
+                return 9;
+        }
+        memblock mb = lvpa.Get("rec/extra.json");
+        if(!mb.ptr || mb.size != extra.size() || memcmp(mb.ptr, extra.c_str(), mb.size))
+            return 10;
+    }
+    return 0;
+}
+
+int TestLVPA_Filters()
+{
+    // 16 bit audio: a slowly rising signal, which delta coding turns into mostly equal bytes
+    std::vector<uint8> wave(128 * 1024);
+    for(uint32 i = 0; i < wave.size() / 2; ++i)
+    {
+        uint16 v = uint16(i * 5 + (i / 1000) % 3);
+        wave[i * 2] = uint8(v);
+        wave[i * 2 + 1] = uint8(v >> 8);
+    }
+    // vertices: the high bytes of the floats change slowly, the low ones look like noise
+    std::vector<uint8> verts(64 * 1024);
+    for(uint32 i = 0; i < verts.size() / 4; ++i)
+    {
+        float f = 100.0f + float(i) * 0.37f;
+        memcpy(&verts[i * 4], &f, 4);
+    }
+    std::vector<uint8> code = makeCallCode(64 * 1024);
+    std::vector<uint8> noise(10000);
+    fillRandom(noise, 1);
+
+    // without and with filters; the filtered archive must be smaller
+    uint32 packedSize[2];
+    for(uint32 pass = 0; pass < 2; ++pass)
+    {
+        LVPAFile lvpa;
+        lvpa.Add("wave.raw", memblock(&wave[0], wave.size()));
+        lvpa.Add("code.exe", memblock(&code[0], code.size()));
+        lvpa.Add("noise.bin", memblock(&noise[0], noise.size()));
+        lvpa.Add("verts.bin", memblock(&verts[0], verts.size()), "mesh");
+        if(pass)
+        {
+            if(!lvpa.SetFilter("wave.raw", LVPAFILTER_DELTA, 2)
+                || !lvpa.SetFilter("code.exe", LVPAFILTER_X86)
+                || !lvpa.SetFilter("noise.bin", LVPAFILTER_DELTA, 1) // does not help, stays unfiltered
+                || lvpa.SetFilter("verts.bin", LVPAFILTER_SHUFFLE, 4) // solid files can't have their own filter
+                || lvpa.SetFilter("wave.raw", LVPAFILTER_SHUFFLE, 1))
+                return 1;
+            lvpa.SetSolidBlock("mesh", LVPACOMP_INHERIT, LVPAPACK_INHERIT, LVPAFILTER_SHUFFLE, 4);
+        }
+        if(!lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_NORMAL))
+            return 2;
+        packedSize[pass] = lvpa.GetPackedSize();
+        lvpa.Clear(false); // otherwise we would attempt to delete const memory
+    }
+    if(packedSize[1] >= packedSize[0])
+        return 3;
+
+    // load one file so it's packed again, the others are raw-copied
+    std::vector<uint8> extra(wave.begin(), wave.begin() + 5000);
+    {
+        LVPAFile lvpa;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 4;
+        memblock mb = lvpa.Get("wave.raw");
+        if(!mb.ptr || mb.size != wave.size() || memcmp(mb.ptr, &wave[0], mb.size))
+            return 5;
+        lvpa.Add("extra.raw", memblock(&extra[0], extra.size()));
+        lvpa.SetFilter("extra.raw", LVPAFILTER_DELTA, 2);
+        if(!lvpa.Save(LVPACOMP_NORMAL))
+            return 6;
+        lvpa.Drop("extra.raw");
+    }
+    {
+        LVPAFile lvpa;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 7;
+        const char *names[] = { "wave.raw", "code.exe", "noise.bin", "verts.bin", "extra.raw" };
+        const std::vector<uint8> *data[] = { &wave, &code, &noise, &verts, &extra };
+        const bool filtered[] = { true, true, false, false, true };
+        for(uint32 i = 0; i < 5; ++i)
+        {
+            memblock mb = lvpa.Get(names[i]);
+            if(!mb.ptr || mb.size != data[i]->size() || memcmp(mb.ptr, &(*data[i])[0], mb.size))
+                return 8;
+            if(!!(lvpa.GetFileInfo(lvpa.GetId(names[i])).flags & LVPAFLAG_FILTERED) != filtered[i])
+                return 9;
+        }
+        if(!(lvpa.GetFileInfo(lvpa.GetId("mesh*")).flags & LVPAFLAG_FILTERED))
+            return 10;
+    }
+    return 0;
+}
+
 int TestLVPA_LZO()
 {
     INIT_TEST();
@@ -376,6 +1113,1343 @@ int TestLVPA_Compr_EncrScram()
     return 0;
 }
 
+// files spanning several read/decrypt tiles, with sizes that are not a multiple of the tile size
+int TestLVPA_LargeEncrypted()
+{
+    std::vector<uint8> noise(100003), text(250001);
+    fillRandom(noise, 1);
+    for(uint32 i = 0; i < text.size(); ++i)
+        text[i] = "All your base are belong to us. "[i % 32] + (i / 4096) % 3;
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        lvpa.Add("noise", memblock(&noise[0], noise.size()), NULL, LVPAPACK_INHERIT, LVPACOMP_NONE, LVPAENCR_ENABLED, false);
+        lvpa.Add("text", memblock(&text[0], text.size()), NULL, LVPAPACK_INHERIT, LVPACOMP_INHERIT, LVPAENCR_ENABLED, true);
+        lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST);
+        lvpa.Clear(false);
+    }
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 1;
+        memblock m = lvpa.Get("noise");
+        if(m.size != noise.size() || memcmp(m.ptr, &noise[0], m.size))
+            return 2;
+        m = lvpa.Get("text");
+        if(m.size != text.size() || memcmp(m.ptr, &text[0], m.size))
+            return 3;
+        if(!(lvpa.GetFileInfo(1).flags & LVPAFLAG_PACKED))
+            return 4;
+    }
+    {
+        // with the wrong key, the checksums must not match
+        LVPAFile lvpa;
+        lvpa.SetMasterKey("wrong", 5);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 5;
+        if(lvpa.Get("noise").ptr || lvpa.Get("text").ptr)
+            return 6;
+    }
+    return 0;
+}
+
+// the cipher state for the master key and the per-file keys are cached, they must follow the master key
+int TestLVPA_CipherKeyCache()
+{
+    std::vector<std::string> files(64);
+    for(uint32 i = 0; i < files.size(); ++i)
+        files[i] = makeRecordFile(i);
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        for(uint32 i = 0; i < files.size(); ++i)
+        {
+            char fn[32];
+            sprintf(fn, "rec%u", i);
+            lvpa.Add(fn, memblock((uint8*)files[i].c_str(), files[i].size()), NULL,
+                LVPAPACK_INHERIT, LVPACOMP_INHERIT, LVPAENCR_ENABLED, i % 2 != 0);
+        }
+        lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_NONE);
+        lvpa.Clear(false);
+    }
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey("wrong", 5);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 1;
+        if(lvpa.Get("rec0").ptr || lvpa.Get("rec1").ptr)
+            return 2;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        for(uint32 pass = 0; pass < 2; ++pass) // the second time, all keys are known already
+        {
+            for(uint32 i = 0; i < files.size(); ++i)
+            {
+                char fn[32];
+                sprintf(fn, "rec%u", i);
+                memblock m = lvpa.Get(fn);
+                if(m.size != files[i].size() || memcmp(m.ptr, files[i].c_str(), m.size))
+                    return 3;
+            }
+            // saving again must encrypt the same way
+            if(!lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_NONE))
+                return 4;
+        }
+    }
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 5;
+        for(uint32 i = 0; i < files.size(); ++i)
+        {
+            char fn[32];
+            sprintf(fn, "rec%u", i);
+            memblock m = lvpa.Get(fn);
+            if(m.size != files[i].size() || memcmp(m.ptr, files[i].c_str(), m.size))
+                return 6;
+        }
+    }
+    return 0;
+}
+
+static int checkChaChaArchive(uint32 threads, const std::vector<uint8>& noise, const std::vector<uint8>& text)
+{
+    LVPAFile lvpa;
+    lvpa.SetThreads(threads);
+    lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 1;
+    DO_CHECK_SAME(v5);
+    DO_CHECK_SAME(b1);
+    DO_CHECK_SAME(i1);
+    memblock m = lvpa.Get("noise");
+    if(m.size != noise.size() || memcmp(m.ptr, &noise[0], m.size))
+        return 3;
+    m = lvpa.Get("text");
+    if(m.size != text.size() || memcmp(m.ptr, &text[0], m.size))
+        return 4;
+
+    uint32 chacha = 0, other = 0;
+    for(uint32 i = 0; i < lvpa.HeaderCount(); ++i)
+    {
+        const LVPAFileHeader& h = lvpa.GetFileInfo(i);
+        if(h.flags & (LVPAFLAG_ENCRYPTED | LVPAFLAG_SCRAMBLED))
+            ++(h.cipher == LVPAENCR_CHACHA20 ? chacha : other);
+    }
+    if(chacha != 4 || other != 1) // noise, text, the solid block, the scrambled file; and i1 with the old cipher
+        return 5;
+    return 0;
+}
+
+int TestLVPA_ChaCha20()
+{
+    INIT_TEST();
+    std::vector<uint8> noise(200003), text(150001);
+    fillRandom(noise, 7);
+    for(uint32 i = 0; i < text.size(); ++i)
+        text[i] = "All your base are belong to us. "[i % 32] + (i / 4096) % 3;
+    {
+        LVPAFile lvpa;
+        lvpa.SetThreads(4); // even with one CPU, to go through the parallel code
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        lvpa.Add("noise", memblock(&noise[0], noise.size()), NULL, LVPAPACK_INHERIT, LVPACOMP_NONE, LVPAENCR_CHACHA20);
+        lvpa.Add("text", memblock(&text[0], text.size()), NULL, LVPAPACK_INHERIT, LVPACOMP_INHERIT, LVPAENCR_CHACHA20);
+        g_encrypt = LVPAENCR_CHACHA20;
+        g_blockName = "solid";
+        ADD_MEMBLOCK(v5);
+        g_blockName = NULL;
+        g_scramble = true;
+        ADD_MEMBLOCK(b1);
+        g_scramble = false;
+        g_encrypt = LVPAENCR_ENABLED;
+        ADD_MEMBLOCK(i1);
+        lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST);
+        lvpa.Clear(false);
+    }
+    int r = checkChaChaArchive(4, noise, text);
+    if(r)
+        return r;
+    r = checkChaChaArchive(1, noise, text);
+    if(r)
+        return 10 + r;
+    // written with the fastest implementation, the plain one must read it all the same
+    ChaCha20Cipher::SetImpl(ChaCha20Cipher::IMPL_GENERIC);
+    r = checkChaChaArchive(4, noise, text);
+    ChaCha20Cipher::SetImpl(ChaCha20Cipher::IMPL_AUTO);
+    if(r)
+        return 30 + r;
+    {
+        LVPAFile lvpa;
+        lvpa.SetThreads(4);
+        lvpa.SetMasterKey("wrong", 5);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 20;
+        if(lvpa.Get("noise").ptr || lvpa.Get("text").ptr)
+            return 21;
+    }
+    return 0;
+}
+
+static int checkChecksumArchive(uint8 type, uint8 noiseType, const std::vector<uint8>& noise)
+{
+    LVPAFile lvpa;
+    lvpa.SetThreads(4);
+    lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 1;
+    if(lvpa.GetChecksum() != type)
+        return 3;
+    DO_CHECK_ALL();
+    memblock m = lvpa.Get("noise");
+    if(m.size != noise.size() || memcmp(m.ptr, &noise[0], m.size))
+        return 4;
+    const LVPAFileHeader& h = lvpa.GetFileInfo(lvpa.GetId("noise"));
+    if(h.checksum != noiseType || h.crcReal != (noiseType == LVPACHECK_XXH64 ? XXHash64::Calc(m.ptr, m.size) : CRC32::Calc(m.ptr, m.size)))
+        return 5;
+    return 0;
+}
+
+int TestLVPA_XXH64()
+{
+    INIT_TEST();
+    std::vector<uint8> noise(200003);
+    fillRandom(noise, 8);
+    {
+        LVPAFile lvpa;
+        lvpa.SetThreads(4); // large ChaCha20 files are checksummed apart from decrypting
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        if(!lvpa.SetChecksum(LVPACHECK_XXH64) || lvpa.SetChecksum(LVPACHECK_MAX_SUPPORTED))
+            return 10;
+        lvpa.Add("noise", memblock(&noise[0], noise.size()), NULL, LVPAPACK_INHERIT, LVPACOMP_NONE, LVPAENCR_CHACHA20);
+        g_encrypt = LVPAENCR_ENABLED;
+        ADD_MEMBLOCK(v0);
+        ADD_MEMBLOCK(v1);
+        g_scramble = true;
+        ADD_MEMBLOCK(v2);
+        g_scramble = false;
+        g_encrypt = LVPAENCR_NONE;
+        g_blockName = "txt";
+        ADD_MEMBLOCK(v3);
+        ADD_MEMBLOCK(v4);
+        ADD_MEMBLOCK(v5);
+        ADD_MEMBLOCK(v6);
+        g_blockName = NULL;
+        ADD_MEMBLOCK(b1);
+        ADD_MEMBLOCK(i1);
+        ADD_MEMBLOCK(i2);
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST, LVPAPACK_INHERIT, true);
+        lvpa.Clear(false);
+        if(!saved)
+            return 11;
+    }
+    int r = checkChecksumArchive(LVPACHECK_XXH64, LVPACHECK_XXH64, noise);
+    if(r)
+        return r;
+
+    // back to CRC32: files that are not loaded are copied with their checksums, so the archive has both now
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 20;
+        lvpa.SetChecksum(LVPACHECK_CRC32);
+        if(!lvpa.Get("FILE_v0").ptr || !lvpa.Get("FILE_v5").ptr)
+            return 21;
+        if(!lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST, LVPAPACK_INHERIT, true))
+            return 22;
+    }
+    r = checkChecksumArchive(LVPACHECK_XXH64, LVPACHECK_XXH64, noise);
+    if(r)
+        return 30 + r;
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        lvpa.LoadFrom("~test.lvpa.tmp");
+        if(lvpa.GetFileInfo(lvpa.GetId("FILE_v0")).checksum != LVPACHECK_CRC32
+            || lvpa.GetFileInfo(lvpa.GetId("FILE_v5")).checksum != LVPACHECK_CRC32
+            || lvpa.GetFileInfo(lvpa.GetId("FILE_b1")).checksum != LVPACHECK_XXH64)
+            return 40;
+
+        // once every file was written again, it's a plain CRC32 archive, readable by older versions
+        lvpa.SetChecksum(LVPACHECK_CRC32);
+        DO_CHECK_ALL();
+        if(!lvpa.Get("noise").ptr)
+            return 41;
+        if(!lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST, LVPAPACK_INHERIT, true))
+            return 42;
+    }
+    r = checkChecksumArchive(LVPACHECK_CRC32, LVPACHECK_CRC32, noise);
+    if(r)
+        return 50 + r;
+    return 0;
+}
+
+static uint32 s_verifyFailed;
+
+static void countVerifyFail(LVPAFile *lvpa, uint32 id, const char *fn, void *user)
+{
+    ++s_verifyFailed;
+    *(uint32*)user = id;
+}
+
+int TestLVPA_BackgroundVerify()
+{
+    INIT_TEST();
+    uint32 badId = -1;
+    s_verifyFailed = 0;
+    {
+        LVPAFile lvpa;
+        DO_ADD_ALL();
+        g_blockName = "txt";
+        ADD_MEMBLOCK(v3);
+        ADD_MEMBLOCK(v6);
+        g_blockName = NULL;
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST);
+        lvpa.Clear(false);
+        if(!saved)
+            return 10;
+    }
+    uint64 fingerprint;
+    {
+        LVPAFile lvpa;
+        if(!lvpa.SetVerifyMode(LVPAVERIFY_BACKGROUND, countVerifyFail, &badId) || lvpa.SetVerifyMode(LVPAVERIFY_MAX_SUPPORTED))
+            return 11;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 12;
+        DO_CHECK_ALL();
+        if(!lvpa.AllVerified() || s_verifyFailed)
+            return 13;
+        fingerprint = lvpa.GetFingerprint();
+    }
+
+    // the solid block is stored, so a damaged file in it is only noticed by its own checksum
+    {
+        LVPAFile lvpa;
+        g_blockName = "sb";
+        DO_ADD_ALL();
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_NONE);
+        lvpa.Clear(false);
+        if(!saved)
+            return 20;
+    }
+    {
+        FILE *fh = fopen("~test.lvpa.tmp", "r+b");
+        if(!fh)
+            return 21;
+        std::vector<uint8> buf(64 * 1024);
+        buf.resize(fread(&buf[0], 1, buf.size(), fh));
+        std::vector<uint8>::iterator it = std::search(buf.begin(), buf.end(), &v6[0], &v6[sizeof(v6) - 1]);
+        if(it == buf.end())
+        {
+            fclose(fh);
+            return 22;
+        }
+        fseek(fh, long(it - buf.begin()) + 10, SEEK_SET);
+        fputc(it[10] ^ 0x20, fh);
+        fclose(fh);
+    }
+    {
+        LVPAFile lvpa;
+        lvpa.SetVerifyMode(LVPAVERIFY_BACKGROUND, countVerifyFail, &badId);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 23;
+        if(lvpa.GetFingerprint() == fingerprint)
+            return 24;
+        if(!lvpa.Get("FILE_v6").ptr) // returned before it was checked
+            return 25;
+        DO_CHECK_SAME(v5);
+        lvpa.WaitVerify();
+        if(s_verifyFailed != 1 || badId != lvpa.GetId("FILE_v6") || lvpa.GetFileInfo(badId).good)
+            return 26;
+        if(lvpa.Get("FILE_v6").ptr || lvpa.AllVerified())
+            return 27;
+        fingerprint = lvpa.GetFingerprint();
+    }
+    {
+        LVPAFile lvpa;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 30;
+        if(lvpa.Get("FILE_v6").ptr) // the default checks right away
+            return 31;
+    }
+    {
+        LVPAFile lvpa;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 40;
+        if(lvpa.GetFingerprint() != fingerprint)
+            return 41;
+        lvpa.SetVerifyMode(LVPAVERIFY_TRUSTED);
+        if(!lvpa.Get("FILE_v6").ptr)
+            return 42;
+        DO_CHECK_SAME(i2);
+        if(lvpa.AllVerified() || s_verifyFailed != 1)
+            return 43;
+    }
+    return 0;
+}
+
+static void countVerifyProgress(uint32 done, uint32 total, void *user)
+{
+    uint32 *p = (uint32*)user;
+    if(done == p[0] + 1 && total >= done)
+        p[0] = done;
+    p[1] = total;
+}
+
+// flips one byte of the file's stored data on disk
+static bool damageFile(const LVPAFileHeader& h, uint32 pos)
+{
+    FILE *fh = fopen("~test.lvpa.tmp", "r+b");
+    if(!fh)
+        return false;
+    fseek(fh, h.offset + pos, SEEK_SET);
+    int c = fgetc(fh);
+    fseek(fh, h.offset + pos, SEEK_SET);
+    fputc(c ^ 0x20, fh);
+    fclose(fh);
+    return true;
+}
+
+int TestLVPA_VerifyAll()
+{
+    INIT_TEST();
+    std::vector<uint8> noise(300007);
+    fillRandom(noise, 11);
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        lvpa.UseDictionary(1024);
+        lvpa.Add("noise", memblock(&noise[0], noise.size()), NULL, LVPAPACK_INHERIT, LVPACOMP_NONE, LVPAENCR_CHACHA20);
+        DO_ADD_ALL();
+        g_blockName = "txt";
+        ADD_MEMBLOCK(v3);
+        ADD_MEMBLOCK(v6);
+        g_blockName = NULL;
+        g_encrypt = LVPAENCR_ENABLED;
+        g_scramble = true;
+        ADD_MEMBLOCK(b1);
+        g_scramble = false;
+        g_blockName = "enc";
+        ADD_MEMBLOCK(v5);
+        g_blockName = NULL;
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST, LVPA_TEST_DICT_ALGO);
+        lvpa.Clear(false);
+        if(!saved)
+            return 10;
+    }
+    for(uint32 threads = 1; threads <= 4; threads += 3)
+    {
+        for(uint32 packedOnly = 0; packedOnly < 2; ++packedOnly)
+        {
+            LVPAFile lvpa;
+            lvpa.SetThreads(threads);
+            lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+            if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+                return 11;
+            uint32 progress[2] = { 0, 0 };
+            if(!lvpa.VerifyAll(!!packedOnly, countVerifyProgress, progress))
+                return 12;
+            if(!progress[1] || progress[0] != progress[1])
+                return 13;
+            if(lvpa.AllVerified() == !!packedOnly) // only a full check covers the unpacked data
+                return 14;
+            if(lvpa.GetFileInfo(lvpa.GetId("FILE_v0")).data.ptr) // nothing stays loaded
+                return 15;
+            DO_CHECK_ALL();
+        }
+    }
+
+    // damaged packed data are found either way
+    uint32 damagedId;
+    {
+        LVPAFile lvpa;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 20;
+        damagedId = lvpa.GetId("FILE_v6");
+        const LVPAFileHeader& h = lvpa.GetFileInfo(lvpa.GetFileInfo(damagedId).blockId);
+        if(!(h.flags & LVPAFLAG_PACKED) || !damageFile(h, h.packedSize / 2))
+            return 21;
+    }
+    for(uint32 packedOnly = 0; packedOnly < 2; ++packedOnly)
+    {
+        LVPAFile lvpa;
+        lvpa.SetThreads(4);
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 22;
+        if(lvpa.VerifyAll(!!packedOnly))
+            return 23;
+        if(lvpa.GetFileInfo(lvpa.GetFileInfo(damagedId).blockId).good)
+            return 24;
+        DO_CHECK_SAME(v0);
+        DO_CHECK_SAME(b1);
+    }
+
+    // a damaged file in a stored solid block is only noticed when the block is loaded
+    g_encrypt = LVPAENCR_NONE;
+    g_blockName = "sb";
+    {
+        LVPAFile lvpa;
+        DO_ADD_ALL();
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_NONE);
+        lvpa.Clear(false);
+        if(!saved)
+            return 30;
+    }
+    {
+        LVPAFile lvpa;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 31;
+        damagedId = lvpa.GetId("FILE_v4");
+        const LVPAFileHeader& h = lvpa.GetFileInfo(damagedId);
+        if(!damageFile(lvpa.GetFileInfo(h.blockId), h.offset + 3))
+            return 32;
+    }
+    for(uint32 packedOnly = 0; packedOnly < 2; ++packedOnly)
+    {
+        LVPAFile lvpa;
+        lvpa.SetThreads(4);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 33;
+        if(lvpa.VerifyAll(!!packedOnly))
+            return 34;
+        // only the damaged file is bad, the others in the block are still fine
+        if(!lvpa.GetFileInfo(lvpa.GetFileInfo(damagedId).blockId).good || lvpa.GetFileInfo(damagedId).good)
+            return 35;
+        if(lvpa.Get("FILE_v4").ptr)
+            return 36;
+        DO_CHECK_SAME(v5);
+    }
+    return 0;
+}
+
+struct CountingAllocator
+{
+    Mutex mtx;
+    uint32 allocs;
+    uint32 live;
+    uint64 liveBytes;
+};
+
+static void *countingAlloc(void *opaque, size_t size)
+{
+    CountingAllocator *ca = (CountingAllocator*)opaque;
+    MutexGuard g(ca->mtx);
+    ++ca->allocs;
+    ++ca->live;
+    ca->liveBytes += size;
+    return malloc(size);
+}
+
+static void countingFree(void *opaque, void *ptr, size_t size)
+{
+    CountingAllocator *ca = (CountingAllocator*)opaque;
+    MutexGuard g(ca->mtx);
+    --ca->live;
+    ca->liveBytes -= size;
+    free(ptr);
+}
+
+int TestLVPA_Allocator()
+{
+    INIT_TEST();
+    CountingAllocator ca;
+    ca.allocs = ca.live = 0;
+    ca.liveBytes = 0;
+    LVPAAllocator alloc = { countingAlloc, countingFree, &ca };
+    {
+        LVPAFile lvpa;
+        lvpa.SetAllocator(&alloc);
+        lvpa.SetThreads(4);
+        lvpa.UseDictionary(1024);
+        DO_ADD_ALL();
+        g_blockName = "txt";
+        ADD_MEMBLOCK(v3);
+        ADD_MEMBLOCK(v6);
+        g_blockName = NULL;
+        lvpa.SetFilter("FILE_b1", LVPAFILTER_DELTA, 1);
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_NORMAL, LVPA_TEST_DICT_ALGO);
+        lvpa.Clear(false);
+        if(!saved)
+            return 10;
+        if(!ca.allocs || ca.live || ca.liveBytes)
+            return 11;
+    }
+    for(uint32 threads = 1; threads <= 4; threads += 3)
+    {
+        LVPAFile lvpa;
+        lvpa.SetThreads(threads);
+        if(!lvpa.SetAllocator(&alloc) || !lvpa.LoadFrom("~test.lvpa.tmp"))
+            return 20;
+        ca.allocs = 0;
+        DO_CHECK_ALL();
+        if(!ca.allocs || !ca.live || lvpa.SetAllocator(NULL)) // can't change while data are loaded
+            return 21;
+        lvpa.Clear();
+        if(ca.live || ca.liveBytes || !lvpa.SetAllocator(&alloc))
+            return 22;
+        if(!lvpa.LoadFrom("~test.lvpa.tmp") || !lvpa.VerifyAll())
+            return 23;
+        DO_CHECK_SAME(v6);
+    }
+    if(ca.live || ca.liveBytes) // the destructor frees everything
+        return 24;
+    {
+        // memory handed over to the LVPAFile must come from the allocator
+        LVPAFile lvpa;
+        lvpa.SetAllocator(&alloc);
+        uint8 *p = lvpa.AllocBuffer(sizeof(v5));
+        memcpy(p, &v5[0], sizeof(v5));
+        lvpa.Add("FILE_v5", memblock(p, sizeof(v5)));
+        p = lvpa.AllocBuffer(sizeof(v4));
+        memcpy(p, &v4[0], sizeof(v4));
+        lvpa.Add("FILE_v4", memblock(p, sizeof(v4)));
+        if(ca.live != 2)
+            return 30;
+        memblock mb = lvpa.Remove("FILE_v4");
+        if(mb.ptr != p)
+            return 31;
+        lvpa.FreeBuffer(mb);
+        DO_CHECK_SAME(v5);
+    }
+    if(ca.live || ca.liveBytes)
+        return 32;
+    return 0;
+}
+
+static bool isLoaded(LVPAFile& lvpa, const char *fn)
+{
+    return lvpa.GetFileInfo(lvpa.GetId(fn)).data.ptr != NULL;
+}
+
+static bool getAndCheck(LVPAFile& lvpa, const char *fn, const std::vector<uint8>& v)
+{
+    memblock mb = lvpa.Get(fn);
+    return mb.ptr && mb.size == v.size() && !memcmp(mb.ptr, &v[0], v.size());
+}
+
+int TestLVPA_Cache()
+{
+    INIT_TEST();
+    const uint32 size = 100000;
+    std::vector<uint8> a(size), b(size), c(size), s1(size / 2), s2(size / 2);
+    fillRandom(a, 1);
+    fillRandom(b, 2);
+    fillRandom(c, 3);
+    fillRandom(s1, 4);
+    fillRandom(s2, 5);
+    {
+        LVPAFile lvpa;
+        lvpa.Add("a", memblock(&a[0], size));
+        lvpa.Add("b", memblock(&b[0], size));
+        lvpa.Add("c", memblock(&c[0], size));
+        lvpa.Add("s1", memblock(&s1[0], size / 2), "sb");
+        lvpa.Add("s2", memblock(&s2[0], size / 2), "sb");
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FASTEST);
+        lvpa.Clear(false);
+        if(!saved)
+            return 10;
+    }
+    LVPAFile lvpa;
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 11;
+    lvpa.SetCacheBudget(size * 5 / 2);
+
+    // the least recently used file goes first
+    if(!getAndCheck(lvpa, "a", a) || !getAndCheck(lvpa, "b", b))
+        return 20;
+    lvpa.Release("a");
+    lvpa.Release("b");
+    if(lvpa.GetCacheUsed() != 2 * size)
+        return 21;
+    if(!getAndCheck(lvpa, "c", c))
+        return 22;
+    lvpa.Release("c");
+    if(isLoaded(lvpa, "a") || !isLoaded(lvpa, "b") || !isLoaded(lvpa, "c") || lvpa.GetCacheUsed() != 2 * size)
+        return 23;
+    if(!getAndCheck(lvpa, "b", b)) // now c is the oldest
+        return 24;
+    lvpa.Release("b");
+    if(!getAndCheck(lvpa, "a", a))
+        return 25;
+    if(isLoaded(lvpa, "c") || !isLoaded(lvpa, "b"))
+        return 26;
+
+    // pinned files stay, even over budget
+    if(!getAndCheck(lvpa, "b", b) || !getAndCheck(lvpa, "c", c))
+        return 30;
+    if(!isLoaded(lvpa, "a") || !isLoaded(lvpa, "b") || lvpa.GetCacheUsed() != 3 * size)
+        return 31;
+    lvpa.Release("a");
+    lvpa.Release("b");
+    lvpa.Release("c");
+    if(lvpa.GetCacheUsed() > lvpa.GetCacheBudget() || isLoaded(lvpa, "a"))
+        return 32;
+
+    // solid blocks are kept as a whole, and stay while any of their files is in use
+    if(!getAndCheck(lvpa, "s1", s1))
+        return 40;
+    lvpa.SetCacheBudget(size / 4);
+    const LVPAFileHeader& sb = lvpa.GetFileInfo(lvpa.GetFileInfo(lvpa.GetId("s1")).blockId);
+    if(!isLoaded(lvpa, "s1") || lvpa.GetCacheUsed() != sb.data.size || sb.data.size < size)
+        return 41;
+    lvpa.Release("s1");
+    if(isLoaded(lvpa, "s1") || isLoaded(lvpa, "b") || lvpa.GetCacheUsed())
+        return 42;
+    if(!getAndCheck(lvpa, "s2", s2) || !getAndCheck(lvpa, "s1", s1))
+        return 43;
+    lvpa.Release("s2");
+    lvpa.Release("s1");
+    if(isLoaded(lvpa, "s2"))
+        return 44;
+
+    // without a budget, everything stays loaded until it is freed by hand
+    lvpa.SetCacheBudget(0);
+    if(!getAndCheck(lvpa, "a", a) || !getAndCheck(lvpa, "s2", s2))
+        return 50;
+    lvpa.Release("a");
+    lvpa.Release("s2");
+    if(!isLoaded(lvpa, "a") || !isLoaded(lvpa, "s2") || lvpa.GetCacheUsed())
+        return 51;
+    if(lvpa.FreeUnused() != 1 || isLoaded(lvpa, "s2"))
+        return 52;
+    return 0;
+}
+
+int TestLVPA_Handles()
+{
+    INIT_TEST();
+    const uint32 size = 50000;
+    std::vector<uint8> a(size), s1(size), s2(size);
+    fillRandom(a, 6);
+    fillRandom(s1, 7);
+    fillRandom(s2, 8);
+    {
+        LVPAFile lvpa;
+        lvpa.Add("a", memblock(&a[0], size));
+        lvpa.Add("s1", memblock(&s1[0], size), "sb");
+        lvpa.Add("s2", memblock(&s2[0], size), "sb");
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FASTEST);
+        lvpa.Clear(false);
+        if(!saved)
+            return 10;
+    }
+    LVPAFile lvpa;
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 11;
+    const uint32 blockId = lvpa.GetFileInfo(lvpa.GetId("s1")).blockId;
+
+    // the solid block goes away together with the last handle into it
+    LVPAHandle h1 = lvpa.GetHandle("s1");
+    if(!h1.Valid() || h1.Size() != size || memcmp(h1.Ptr(), &s1[0], size))
+        return 20;
+    {
+        LVPAHandle h2 = h1;
+        LVPAHandle h3 = lvpa.GetHandle("s2");
+        if(!h3.Valid() || memcmp(h3.Ptr(), &s2[0], size))
+            return 21;
+        h3 = h2;
+        if(h3.Ptr() != h1.Ptr() || lvpa.GetFileInfo(blockId).pins != 3)
+            return 22;
+    }
+    if(!lvpa.GetFileInfo(blockId).data.ptr || lvpa.FreeUnused())
+        return 23;
+    h1.Reset();
+    if(h1.Valid() || lvpa.GetFileInfo(blockId).data.ptr || isLoaded(lvpa, "s1") || isLoaded(lvpa, "s2"))
+        return 24;
+
+    // other files stay loaded
+    {
+        LVPAHandle h = lvpa.GetHandle("a");
+        if(!h.Valid() || memcmp(h.Ptr(), &a[0], size))
+            return 30;
+    }
+    if(!isLoaded(lvpa, "a") || lvpa.GetHandle("nonexistent").Valid())
+        return 31;
+
+    // Free() gives back the pins of plain Get() calls, but leaves the block to FreeUnused()
+    if(!getAndCheck(lvpa, "s1", s1) || !getAndCheck(lvpa, "s2", s2))
+        return 40;
+    lvpa.Free("s1");
+    if(!lvpa.GetFileInfo(blockId).data.ptr || !isLoaded(lvpa, "s2"))
+        return 41;
+    lvpa.Free("s2");
+    if(!lvpa.GetFileInfo(blockId).data.ptr || lvpa.GetFileInfo(blockId).pins || lvpa.FreeUnused() != 1)
+        return 42;
+
+    // blocks only kept by the cache are left to FreeUnused()
+    lvpa.SetCacheBudget(size * 10);
+    h1 = lvpa.GetHandle("s2");
+    h1.Reset();
+    lvpa.SetCacheBudget(0);
+    if(!lvpa.GetFileInfo(blockId).data.ptr || lvpa.FreeUnused() != 1 || isLoaded(lvpa, "s2"))
+        return 50;
+    if(!getAndCheck(lvpa, "s1", s1)) // and loaded again when needed
+        return 51;
+    lvpa.Release("s1");
+    lvpa.FreeUnused();
+
+    // Free() takes the pins of handles along; when they go away later, they must leave newer pins alone
+    h1 = lvpa.GetHandle("s1");
+    lvpa.Free(blockId);
+    if(lvpa.GetFileInfo(lvpa.GetId("s1")).pins)
+        return 60;
+    memblock mb = lvpa.Get("s2");
+    {
+        LVPAHandle stale = h1; // copying a stale handle pins nothing
+        h1.Reset();
+    }
+    if(!mb.ptr || lvpa.GetFileInfo(blockId).pins != 1 || !lvpa.GetFileInfo(blockId).data.ptr || memcmp(mb.ptr, &s2[0], size))
+        return 61;
+    lvpa.Release("s2");
+
+    // the same for a file inside the block
+    h1 = lvpa.GetHandle("s1");
+    lvpa.Free("s1");
+    mb = lvpa.Get("s1");
+    h1.Reset();
+    if(!mb.ptr || lvpa.GetFileInfo(lvpa.GetId("s1")).pins != 1 || lvpa.GetFileInfo(blockId).pins != 1 || memcmp(mb.ptr, &s1[0], size))
+        return 62;
+    lvpa.Release("s1");
+    if(lvpa.GetFileInfo(blockId).pins || lvpa.FreeUnused() != 1)
+        return 63;
+    return 0;
+}
+
+int TestLVPA_SolidLifetime()
+{
+    INIT_TEST();
+    const uint32 count = 32, size = 20000;
+    std::vector<std::vector<uint8> > files(count);
+    std::vector<uint8> extra(size);
+    char fn[32];
+    {
+        LVPAFile lvpa;
+        for(uint32 i = 0; i < count; ++i)
+        {
+            files[i].resize(size);
+            fillRandom(files[i], 100 + i);
+            for(uint32 k = 0; k < size; ++k)
+                files[i][k] &= 7; // compressible, so that the block is packed
+            sprintf(fn, "s%u", i);
+            lvpa.Add(fn, memblock(&files[i][0], size), "sb");
+        }
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FASTEST);
+        lvpa.Clear(false);
+        if(!saved)
+            return 10;
+    }
+    LVPAFile lvpa;
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 11;
+    const uint32 blockId = lvpa.GetFileInfo(lvpa.GetId("s0")).blockId;
+    const uint32 blockSize = lvpa.GetFileInfo(blockId).realSize;
+
+    // freeing each file after use must not throw away the block the next one needs
+    for(uint32 i = 0; i < count; ++i)
+    {
+        sprintf(fn, "s%u", i);
+        if(!getAndCheck(lvpa, fn, files[i]))
+            return 20;
+        lvpa.Free(fn);
+    }
+    if(lvpa.GetStats().bytesDecompressed != blockSize || lvpa.FreeUnused() != 1)
+        return 21;
+
+    // the same with Release()
+    lvpa.ResetStats();
+    for(uint32 i = 0; i < count; ++i)
+    {
+        sprintf(fn, "s%u", i);
+        if(!getAndCheck(lvpa, fn, files[i]))
+            return 30;
+        lvpa.Release(fn);
+    }
+    if(lvpa.GetStats().bytesDecompressed != blockSize || lvpa.FreeUnused() != 1)
+        return 31;
+
+    // files loaded only to be saved again are not left pinned
+    fillRandom(extra, 99);
+    lvpa.Add("extra", memblock(&extra[0], size), "sb");
+    bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FASTEST);
+    lvpa.Drop("extra");
+    if(!saved)
+        return 40;
+    if(lvpa.GetFileInfo(blockId).pins || lvpa.GetFileInfo(lvpa.GetId("s0")).pins)
+        return 41;
+    lvpa.FreeUnused();
+    if(lvpa.GetFileInfo(blockId).data.ptr || lvpa.GetStats().residentBlocks)
+        return 42;
+    lvpa.Clear();
+    LVPAFile saved2;
+    if(!saved2.LoadFrom("~test.lvpa.tmp") || !getAndCheck(saved2, "s5", files[5]) || !getAndCheck(saved2, "extra", extra))
+        return 43;
+    return 0;
+}
+
+static uint32 partialSolidRun(uint8 algo)
+{
+    // compressible data, large enough to span more than one LZMAMT chunk per file
+    const uint32 size = 2500000;
+    std::vector<uint8> s1(size), s2(size), s3(size);
+    fillRandom(s1, 9);
+    fillRandom(s2, 10);
+    fillRandom(s3, 11);
+    for(uint32 i = 0; i < size; ++i)
+    {
+        s1[i] &= 3;
+        s2[i] &= 3;
+        s3[i] &= 3;
+    }
+    {
+        LVPAFile lvpa;
+        lvpa.SetSolidBlock("sb", LVPACOMP_FASTEST, algo);
+        lvpa.Add("s1", memblock(&s1[0], size), "sb");
+        lvpa.Add("s2", memblock(&s2[0], size), "sb");
+        lvpa.Add("s3", memblock(&s3[0], size), "sb");
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FASTEST);
+        lvpa.Clear(false);
+        if(!saved)
+            return 10;
+    }
+    LVPAFile lvpa;
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 11;
+    const uint32 blockId = lvpa.GetFileInfo(lvpa.GetId("s1")).blockId;
+    const uint32 blockSize = lvpa.GetFileInfo(blockId).realSize;
+
+    // the first file does not need the rest of the block
+    if(!getAndCheck(lvpa, "s1", s1))
+        return 20;
+    uint32 done = lvpa.GetUnpackedSize(blockId);
+    if(done < size || done >= blockSize)
+        return 21;
+    if(!getAndCheck(lvpa, "s2", s2) || lvpa.GetUnpackedSize(blockId) < done)
+        return 22;
+    if(!getAndCheck(lvpa, "s3", s3) || lvpa.GetUnpackedSize(blockId) != blockSize)
+        return 23;
+    if(!getAndCheck(lvpa, "s1", s1) || !getAndCheck(lvpa, "s2", s2))
+        return 24;
+    lvpa.Free("s1");
+    lvpa.Free("s2");
+    lvpa.Free("s3");
+    lvpa.FreeUnused();
+    if(lvpa.GetUnpackedSize(blockId))
+        return 25;
+
+    // freeing a partially unpacked block starts over next time
+    if(!getAndCheck(lvpa, "s1", s1) || lvpa.GetUnpackedSize(blockId) >= blockSize)
+        return 30;
+    lvpa.Free("s1");
+    lvpa.FreeUnused();
+    if(lvpa.GetUnpackedSize(blockId))
+        return 31;
+    if(!getAndCheck(lvpa, "s2", s2) || !getAndCheck(lvpa, "s1", s1))
+        return 32;
+
+    // saving needs the whole block
+    if(!lvpa.SaveAs("~test.lvpa.tmp") || lvpa.GetUnpackedSize(blockId) != blockSize)
+        return 40;
+    if(!getAndCheck(lvpa, "s3", s3))
+        return 41;
+    return 0;
+}
+
+int TestLVPA_PartialSolid()
+{
+    INIT_TEST();
+    static const uint8 algos[] = { LVPAPACK_LZMA, LVPAPACK_LZMAMT, LVPAPACK_DEFLATE };
+    for(uint32 i = 0; i < sizeof(algos) / sizeof(algos[0]); ++i)
+    {
+        uint32 r = partialSolidRun(algos[i]);
+        if(r)
+            return r + 100 * (i + 1);
+    }
+    return 0;
+}
+
+static uint32 restartPointsRun(uint8 algo, uint8 filter, uint8 filterParam)
+{
+    // s3 is incompressible, its segment is stored as it is
+    const uint32 size = 1000000;
+    std::vector<uint8> s[4];
+    for(uint32 i = 0; i < 4; ++i)
+    {
+        s[i].resize(size);
+        fillRandom(s[i], 12 + i);
+        if(i != 2)
+            for(uint32 k = 0; k < size; ++k)
+                s[i][k] = uint8(k / 8 + (s[i][k] & 1));
+    }
+    const char *names[4] = { "s1", "s2", "s3", "s4" };
+    {
+        LVPAFile lvpa;
+        lvpa.SetRestartInterval(size);
+        lvpa.SetSolidBlock("sb", LVPACOMP_FASTEST, algo, filter, filterParam);
+        for(uint32 i = 0; i < 4; ++i)
+            lvpa.Add(names[i], memblock(&s[i][0], size), "sb");
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FASTEST);
+        lvpa.Clear(false);
+        if(!saved)
+            return 10;
+    }
+    LVPAFile lvpa;
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 11;
+    const uint32 blockId = lvpa.GetFileInfo(lvpa.GetId("s1")).blockId;
+    const LVPAFileHeader& block = lvpa.GetFileInfo(blockId);
+    if(block.restarts.size() != 3 || block.restarts[2].unpackedOffs != lvpa.GetFileInfo(lvpa.GetId("s4")).offset)
+        return 12;
+
+    // each file only needs its own segment
+    const uint32 segment = size + LVPA_EXTRA_BUFSIZE;
+    if(!getAndCheck(lvpa, "s4", s[3]) || lvpa.GetUnpackedSize(blockId) != segment)
+        return 20;
+    if(!getAndCheck(lvpa, "s3", s[2]) || lvpa.GetUnpackedSize(blockId) != 2 * segment)
+        return 21;
+    if(!getAndCheck(lvpa, "s4", s[3]) || lvpa.GetUnpackedSize(blockId) != 2 * segment)
+        return 22;
+    if(!getAndCheck(lvpa, "s1", s[0]) || !getAndCheck(lvpa, "s2", s[1]) || lvpa.GetUnpackedSize(blockId) != block.realSize)
+        return 23;
+    if(!lvpa.VerifyAll())
+        return 24;
+
+    // copied as it is, the block keeps its restart points
+    std::vector<uint8> a(100);
+    fillRandom(a, 20);
+    {
+        LVPAFile lvpa2;
+        if(!lvpa2.LoadFrom("~test.lvpa.tmp"))
+            return 30;
+        lvpa2.Add("a", memblock(&a[0], a.size()));
+        if(!lvpa2.Save(LVPACOMP_FASTEST))
+            return 31;
+        lvpa2.Clear(false);
+    }
+    {
+        LVPAFile lvpa2;
+        if(!lvpa2.LoadFrom("~test.lvpa.tmp") || lvpa2.GetFileInfo(blockId).restarts.size() != 3)
+            return 32;
+        if(!getAndCheck(lvpa2, "s2", s[1]) || lvpa2.GetUnpackedSize(blockId) != segment || !getAndCheck(lvpa2, "a", a))
+            return 33;
+
+        // packed again without
+        if(!lvpa2.Save(LVPACOMP_FASTEST))
+            return 34;
+    }
+    {
+        LVPAFile lvpa2;
+        if(!lvpa2.LoadFrom("~test.lvpa.tmp") || !lvpa2.GetFileInfo(blockId).restarts.empty())
+            return 40;
+        for(uint32 i = 0; i < 4; ++i)
+            if(!getAndCheck(lvpa2, names[i], s[i]))
+                return 41 + i;
+    }
+    return 0;
+}
+
+int TestLVPA_RestartPoints()
+{
+    INIT_TEST();
+    static const uint8 algos[] = { LVPAPACK_LZMA, LVPAPACK_DEFLATE, LVPAPACK_LZMAMT, LVPAPACK_LZ4 };
+    for(uint32 i = 0; i < sizeof(algos) / sizeof(algos[0]); ++i)
+    {
+        uint32 r = restartPointsRun(algos[i], LVPAFILTER_NONE, 0);
+        if(r)
+            return r + 100 * (i + 1);
+    }
+    uint32 r = restartPointsRun(LVPAPACK_DEFLATE, LVPAFILTER_DELTA, 1);
+    return r ? r + 1000 : 0;
+}
+
+int TestLVPA_Stats()
+{
+    INIT_TEST();
+    const uint32 size = 100000;
+    std::vector<uint8> a(size), s1(size), s2(size);
+    fillRandom(a, 12);
+    fillRandom(s1, 13);
+    fillRandom(s2, 14);
+    for(uint32 i = 0; i < size; ++i)
+    {
+        a[i] &= 7;
+        s1[i] &= 7;
+        s2[i] &= 7;
+    }
+    {
+        LVPAFile lvpa;
+        lvpa.Add("a", memblock(&a[0], size));
+        lvpa.SetSolidBlock("sb", LVPACOMP_FASTEST);
+        lvpa.Add("s1", memblock(&s1[0], size), "sb");
+        lvpa.Add("s2", memblock(&s2[0], size), "sb");
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FASTEST);
+        if(lvpa.GetStats().residentBytes) // added memory is not counted
+            return 1;
+        lvpa.Clear(false);
+        if(!saved)
+            return 2;
+    }
+    LVPAFile lvpa;
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 3;
+    const uint32 blockSize = lvpa.GetFileInfo(lvpa.GetFileInfo(lvpa.GetId("s1")).blockId).realSize;
+
+    if(!getAndCheck(lvpa, "a", a))
+        return 10;
+    LVPAStats st = lvpa.GetStats();
+    if(st.cacheMisses != 1 || st.cacheHits || st.residentFiles != 1 || st.residentFileBytes != size || st.residentBlocks)
+        return 11;
+    if(!st.bytesRead || st.bytesDecompressed != size || st.bytesDecrypted)
+        return 12;
+    if(!getAndCheck(lvpa, "a", a) || lvpa.GetStats().cacheHits != 1)
+        return 13;
+
+    // files in a solid block count as part of the block
+    if(!getAndCheck(lvpa, "s1", s1) || !getAndCheck(lvpa, "s2", s2))
+        return 20;
+    st = lvpa.GetStats();
+    if(st.cacheMisses != 2 || st.cacheHits != 2 || st.residentBlocks != 1 || st.residentBlockBytes != blockSize)
+        return 21;
+    if(st.residentBytes != size + blockSize || st.peakResidentBytes != st.residentBytes || st.bytesDecompressed != size + blockSize)
+        return 22;
+
+    lvpa.Free("a");
+    st = lvpa.GetStats();
+    if(st.residentFiles || st.residentFileBytes || st.residentBytes != blockSize || st.peakResidentBytes != size + blockSize)
+        return 30;
+    lvpa.ResetStats();
+    st = lvpa.GetStats();
+    if(st.cacheHits || st.cacheMisses || st.bytesRead || st.bytesDecompressed || st.peakResidentBytes != blockSize || st.residentBlocks != 1)
+        return 31;
+
+    // VerifyAll() reads everything again, but keeps nothing
+    if(!lvpa.VerifyAll())
+        return 40;
+    st = lvpa.GetStats();
+    if(!st.bytesRead || st.bytesDecompressed != size + blockSize || st.residentBytes != blockSize)
+        return 41;
+
+    lvpa.Free("s1");
+    lvpa.Free("s2");
+    lvpa.FreeUnused();
+    if(lvpa.GetStats().residentBytes || lvpa.GetStats().residentBlocks)
+        return 50;
+    if(!getAndCheck(lvpa, "s2", s2) || lvpa.GetStats().residentBlockBytes != blockSize)
+        return 51;
+    lvpa.Clear();
+    if(lvpa.GetStats().residentBytes || lvpa.GetStats().peakResidentBytes != blockSize) // since ResetStats()
+        return 52;
+    return 0;
+}
+
+static void collectTrace(LVPAFile *lvpa, const LVPATraceEvent& ev, void *user)
+{
+    std::vector<LVPATraceEvent> *events = (std::vector<LVPATraceEvent>*)user;
+    events->push_back(ev);
+    events->back().filename = NULL; // not valid afterwards
+}
+
+// true if the events nest properly, and every stage ended with output. counts the stages by type in counts.
+static bool checkTrace(const std::vector<LVPATraceEvent>& events, uint32 *counts)
+{
+    std::vector<LVPATraceEvent> open;
+    memset(counts, 0, LVPATRACE_MAX * sizeof(uint32));
+    for(uint32 i = 0; i < events.size(); ++i)
+    {
+        const LVPATraceEvent& ev = events[i];
+        if(ev.begin)
+        {
+            open.push_back(ev);
+            continue;
+        }
+        if(open.empty() || open.back().stage != ev.stage || open.back().id != ev.id || open.back().time > ev.time)
+            return false;
+        if(!ev.bytesOut || ev.bytesIn != open.back().bytesIn)
+            return false;
+        open.pop_back();
+        ++counts[ev.stage];
+    }
+    return open.empty();
+}
+
+int TestLVPA_Trace()
+{
+    INIT_TEST();
+    const uint32 size = 100000;
+    std::vector<uint8> a(size), s1(size), s2(size);
+    fillRandom(a, 15);
+    fillRandom(s1, 16);
+    fillRandom(s2, 17);
+    for(uint32 i = 0; i < size; ++i)
+    {
+        a[i] &= 7;
+        s1[i] &= 7;
+        s2[i] &= 7;
+    }
+    std::vector<LVPATraceEvent> events;
+    uint32 counts[LVPATRACE_MAX];
+    {
+        LVPAFile lvpa;
+        if(!lvpa.SetTraceCallback(collectTrace, &events))
+            return 0; // built without tracing
+        lvpa.Add("a", memblock(&a[0], size), NULL, LVPAPACK_DEFLATE);
+        lvpa.SetSolidBlock("sb", LVPACOMP_FASTEST, LVPAPACK_LZMA);
+        lvpa.Add("s1", memblock(&s1[0], size), "sb");
+        lvpa.Add("s2", memblock(&s2[0], size), "sb");
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FASTEST);
+        lvpa.Clear(false);
+        if(!saved)
+            return 1;
+    }
+    // a and the block are compressed and written, nothing is encrypted
+    if(!checkTrace(events, counts) || counts[LVPATRACE_COMPRESS] != 2 || counts[LVPATRACE_WRITE] != 2 || counts[LVPATRACE_ENCRYPT])
+        return 2;
+    if(events[0].stage != LVPATRACE_COMPRESS || events[0].algo != LVPAPACK_DEFLATE || events[0].bytesIn != size)
+        return 3;
+
+    events.clear();
+    LVPAFile lvpa;
+    lvpa.SetTraceCallback(collectTrace, &events);
+    if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+        return 10;
+    if(!events.empty()) // only the headers were loaded
+        return 11;
+    const uint32 blockId = lvpa.GetFileInfo(lvpa.GetId("s1")).blockId;
+    if(!getAndCheck(lvpa, "s1", s1))
+        return 12;
+
+    // s1 is prepared, which needs the solid block to be prepared, unpacked and read
+    if(!checkTrace(events, counts) || counts[LVPATRACE_PREPARE] != 2 || counts[LVPATRACE_UNPACK] != 1 || counts[LVPATRACE_DECRYPT] != 1)
+        return 13;
+    if(counts[LVPATRACE_CHECK] != 1 || events.size() != 10)
+        return 14;
+    static const uint8 order[] = { LVPATRACE_PREPARE, LVPATRACE_PREPARE, LVPATRACE_UNPACK, LVPATRACE_DECRYPT };
+    for(uint32 i = 0; i < sizeof(order); ++i)
+        if(!events[i].begin || events[i].stage != order[i])
+            return 20 + i;
+    if(events[1].id != blockId || events[2].algo != LVPAPACK_LZMA || events[2].cipher != LVPAENCR_NONE)
+        return 25;
+
+    // already in memory, nothing more to do
+    events.clear();
+    if(!getAndCheck(lvpa, "s1", s1))
+        return 30;
+    if(!checkTrace(events, counts) || events.size() != 2 || counts[LVPATRACE_PREPARE] != 1)
+        return 31;
+
+    lvpa.SetTraceCallback(NULL);
+    events.clear();
+    if(!getAndCheck(lvpa, "a", a) || !events.empty())
+        return 40;
+    return 0;
+}
+
+// packed files are checksummed in steps while they are unpacked, sizes are not a multiple of the step size.
+// only LVPAPACK_LZMAMT unpacks all at once and is checked afterwards.
+int TestLVPA_UnpackCRC()
+{
+    std::vector<uint8> text(250001);
+    for(uint32 i = 0; i < text.size(); ++i)
+        text[i] = "All your base are belong to us. "[i % 32] + (i / 4096) % 3;
+    std::vector<uint8> algos;
+#ifdef LVPA_SUPPORT_LZMA
+    algos.push_back(LVPAPACK_LZMA);
+    algos.push_back(LVPAPACK_LZMAMT);
+#endif
+#ifdef LVPA_SUPPORT_ZLIB
+    algos.push_back(LVPAPACK_DEFLATE);
+#endif
+#ifdef LVPA_SUPPORT_ZSTD
+    algos.push_back(LVPAPACK_ZSTD);
+#endif
+#ifdef LVPA_SUPPORT_LZ4
+    algos.push_back(LVPAPACK_LZ4);
+#endif
+
+    for(uint32 a = 0; a < algos.size(); ++a)
+        for(uint8 check = LVPACHECK_CRC32; check <= LVPACHECK_XXH64; ++check)
+        {
+            const int err = 100 * a + 10 * check;
+            {
+                LVPAFile lvpa;
+                lvpa.SetChecksum(check);
+                lvpa.Add("text", memblock(&text[0], text.size()), NULL, algos[a], LVPACOMP_INHERIT, LVPAENCR_NONE, false);
+                bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST);
+                lvpa.Clear(false);
+                if(!saved)
+                    return err + 1;
+            }
+            std::vector<LVPATraceEvent> events;
+            uint32 counts[LVPATRACE_MAX];
+            LVPAFile lvpa;
+            if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+                return err + 2;
+            const bool traced = lvpa.SetTraceCallback(collectTrace, &events);
+            memblock m = lvpa.Get("text");
+            if(m.size != text.size() || memcmp(m.ptr, &text[0], m.size))
+                return err + 3;
+            const LVPAFileHeader& h = lvpa.GetFileInfo(lvpa.GetId("text"));
+            if(!(h.flags & LVPAFLAG_PACKED) || h.algo != algos[a] || !h.checkedCRC || !h.checkedCRCPacked)
+                return err + 4;
+            if(traced && (!checkTrace(events, counts) || counts[LVPATRACE_CHECK] != (algos[a] == LVPAPACK_LZMAMT ? 1u : 0u)))
+                return err + 5;
+        }
+    return 0;
+}
+
+// saving a loaded archive again keeps the encryption of each file, whether it was loaded or only copied over
+int TestLVPA_ResaveEncrypted()
+{
+    const uint32 size = 50000;
+    std::vector<uint8> a(size), c(size), p(size);
+    fillRandom(a, 18);
+    fillRandom(c, 19);
+    fillRandom(p, 20);
+    for(uint32 i = 0; i < size; ++i)
+        a[i] &= 7;
+    {
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        lvpa.Add("a", memblock(&a[0], size), NULL, LVPAPACK_INHERIT, LVPACOMP_INHERIT, LVPAENCR_ENABLED);
+        lvpa.Add("c", memblock(&c[0], size), NULL, LVPAPACK_INHERIT, LVPACOMP_NONE, LVPAENCR_CHACHA20);
+        lvpa.Add("p", memblock(&p[0], size), NULL, LVPAPACK_INHERIT, LVPACOMP_NONE, LVPAENCR_NONE);
+        bool saved = lvpa.SaveAs("~test.lvpa.tmp", LVPACOMP_FAST);
+        lvpa.Clear(false);
+        if(!saved)
+            return 1;
+    }
+    for(uint32 loaded = 0; loaded < 2; ++loaded) // first the files are copied as they are, then they are loaded and written anew
+    {
+        const int err = 10 + 10 * loaded;
+        {
+            LVPAFile lvpa;
+            lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+            if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+                return err;
+            if(loaded && !(getAndCheck(lvpa, "a", a) && getAndCheck(lvpa, "c", c) && getAndCheck(lvpa, "p", p)))
+                return err + 1;
+            if(!lvpa.Save())
+                return err + 2;
+        }
+        LVPAFile lvpa;
+        lvpa.SetMasterKey(&g_masterKey[0], LVPAHash_Size);
+        if(!lvpa.LoadFrom("~test.lvpa.tmp"))
+            return err + 3;
+        if(!getAndCheck(lvpa, "a", a) || !getAndCheck(lvpa, "c", c) || !getAndCheck(lvpa, "p", p))
+            return err + 4;
+        const LVPAFileHeader& ha = lvpa.GetFileInfo(lvpa.GetId("a"));
+        const LVPAFileHeader& hc = lvpa.GetFileInfo(lvpa.GetId("c"));
+        if(!(ha.flags & LVPAFLAG_ENCRYPTED) || ha.cipher != LVPAENCR_ENABLED || !(ha.flags & LVPAFLAG_PACKED))
+            return err + 5;
+        if(!(hc.flags & LVPAFLAG_ENCRYPTED) || hc.cipher != LVPAENCR_CHACHA20)
+            return err + 6;
+        if(lvpa.GetFileInfo(lvpa.GetId("p")).flags & LVPAFLAG_ENCRYPTED)
+            return err + 7;
+    }
+    return 0;
+}
+
 int TestLVPA_Everything()
 {
     INIT_TEST();
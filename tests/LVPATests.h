@@ -4,23 +4,58 @@
 int LVPATestsInit();
 
 int TestLZMA();
+int TestLZMAMT();
 int TestLZO();
 int TestDeflate();
 int TestZlib();
 int TestGzip();
+int TestDeflateDict();
 int TestLZF();
 int TestLZHAM();
+int TestLZ4();
+int TestZstd();
+int TestZstdLong();
+int TestZstdDict();
+int TestFilters();
+int TestCRC32();
+int TestCRC32Combine();
+int TestCRC32Speed();
+int TestSHA256();
+int TestSHA256Multi();
+int TestSHA256Speed();
+int TestXXHash64();
+int TestByteBufferGrowth();
 int TestLVPAUncompressed();
 int TestLVPAUncompressedSolid();
 int TestLVPA_LZMA();
 int TestLVPA_LZO();
+int TestLVPA_Zstd();
+int TestLVPA_LZ4();
 int TestLVPA_Deflate();
 int TestLVPA_Gzip();
+int TestLVPA_Dictionary();
+int TestLVPA_Filters();
 int TestLVPA_MixedSolid();
 int TestLVPAUncompressedEncrypted();
 int TestLVPAUncompressedScrambled();
 int TestLVPAUncompressedEncrScram();
 int TestLVPA_Compr_EncrScram();
+int TestLVPA_LargeEncrypted();
+int TestLVPA_CipherKeyCache();
+int TestLVPA_ChaCha20();
+int TestLVPA_XXH64();
+int TestLVPA_BackgroundVerify();
+int TestLVPA_VerifyAll();
+int TestLVPA_Allocator();
+int TestLVPA_Cache();
+int TestLVPA_Handles();
+int TestLVPA_SolidLifetime();
+int TestLVPA_PartialSolid();
+int TestLVPA_RestartPoints();
+int TestLVPA_Stats();
+int TestLVPA_Trace();
+int TestLVPA_UnpackCRC();
+int TestLVPA_ResaveEncrypted();
 int TestLVPA_Everything();
 
 int TestLVPA_CreateAndAppend1();
@@ -15,11 +15,13 @@ int main(int argc, char *argv[])
 #endif
 #ifdef LVPA_SUPPORT_LZMA
     DO_TESTRUN(TestLZMA());
+    DO_TESTRUN(TestLZMAMT());
 #endif
 #ifdef LVPA_SUPPORT_ZLIB
     DO_TESTRUN(TestDeflate());
     DO_TESTRUN(TestZlib());
     DO_TESTRUN(TestGzip());
+    DO_TESTRUN(TestDeflateDict());
 #endif
 #ifdef LVPA_SUPPORT_LZF
     DO_TESTRUN(TestLZF());
@@ -27,6 +29,23 @@ int main(int argc, char *argv[])
 #ifdef LVPA_SUPPORT_LZHAM
     DO_TESTRUN(TestLZHAM());
 #endif
+#ifdef LVPA_SUPPORT_LZ4
+    DO_TESTRUN(TestLZ4());
+#endif
+#ifdef LVPA_SUPPORT_ZSTD
+    DO_TESTRUN(TestZstd());
+    DO_TESTRUN(TestZstdLong());
+    DO_TESTRUN(TestZstdDict());
+#endif
+    DO_TESTRUN(TestFilters());
+    DO_TESTRUN(TestCRC32());
+    DO_TESTRUN(TestCRC32Combine());
+    DO_TESTRUN(TestCRC32Speed());
+    DO_TESTRUN(TestSHA256());
+    DO_TESTRUN(TestSHA256Multi());
+    DO_TESTRUN(TestSHA256Speed());
+    DO_TESTRUN(TestXXHash64());
+    DO_TESTRUN(TestByteBufferGrowth());
 
     DO_TESTRUN(TestRC4());
     DO_TESTRUN(TestHPRC4Like());
@@ -35,6 +54,8 @@ int main(int argc, char *argv[])
     DO_TESTRUN(TestHPRC4LikeWarm());
     //DO_TESTRUN(TestRC4Massive()); // RC4 not used and just kept for reference (is rather slow too)
     DO_TESTRUN(TestHPRC4LikeMassive());
+    DO_TESTRUN(TestChaCha20());
+    DO_TESTRUN(TestChaCha20Seek());
 
     DO_TESTRUN(TestLVPAUncompressed());
 #ifdef LVPA_SUPPORT_LZO
@@ -46,12 +67,38 @@ int main(int argc, char *argv[])
 #ifdef LVPA_SUPPORT_ZLIB
     DO_TESTRUN(TestLVPA_Deflate());
 #endif
+#ifdef LVPA_SUPPORT_ZSTD
+    DO_TESTRUN(TestLVPA_Zstd());
+#endif
+#ifdef LVPA_SUPPORT_LZ4
+    DO_TESTRUN(TestLVPA_LZ4());
+#endif
+#if defined(LVPA_SUPPORT_ZSTD) || defined(LVPA_SUPPORT_ZLIB)
+    DO_TESTRUN(TestLVPA_Dictionary());
+#endif
+    DO_TESTRUN(TestLVPA_Filters());
     DO_TESTRUN(TestLVPAUncompressedSolid());
     DO_TESTRUN(TestLVPA_MixedSolid());
     DO_TESTRUN(TestLVPAUncompressedEncrypted());
     DO_TESTRUN(TestLVPAUncompressedScrambled());
     DO_TESTRUN(TestLVPAUncompressedEncrScram());
     DO_TESTRUN(TestLVPA_Compr_EncrScram());
+    DO_TESTRUN(TestLVPA_LargeEncrypted());
+    DO_TESTRUN(TestLVPA_CipherKeyCache());
+    DO_TESTRUN(TestLVPA_ChaCha20());
+    DO_TESTRUN(TestLVPA_XXH64());
+    DO_TESTRUN(TestLVPA_BackgroundVerify());
+    DO_TESTRUN(TestLVPA_VerifyAll());
+    DO_TESTRUN(TestLVPA_Allocator());
+    DO_TESTRUN(TestLVPA_Cache());
+    DO_TESTRUN(TestLVPA_Handles());
+    DO_TESTRUN(TestLVPA_SolidLifetime());
+    DO_TESTRUN(TestLVPA_PartialSolid());
+    DO_TESTRUN(TestLVPA_RestartPoints());
+    DO_TESTRUN(TestLVPA_Stats());
+    DO_TESTRUN(TestLVPA_Trace());
+    DO_TESTRUN(TestLVPA_UnpackCRC());
+    DO_TESTRUN(TestLVPA_ResaveEncrypted());
     DO_TESTRUN(TestLVPA_Everything());
 
     DO_TESTRUN(TestLVPA_CreateAndAppend1());